@@ -40,8 +40,29 @@ typedef struct {
     uint64_t    rx_errors;
     uint64_t    tx_errors;
     uint64_t    rx_dropped;
+    uint64_t    rx_kicks;       /* Doorbells rung for RX refills */
+    uint64_t    tx_kicks;       /* Doorbells rung for TX */
+    uint32_t    queue_pairs;    /* RX/TX pairs in use (VIRTIO_NET_F_MQ) */
+    bool        ring_packed;    /* Packed virtqueues (VIRTIO_F_RING_PACKED) */
 } eth_stats_t;
 
+/*
+ * RX Polling Statistics
+ *
+ * Histogram bucket i counts passes with a value in [2^(i-1), 2^i),
+ * bucket 0 those with 0; the last bucket is open-ended.
+ */
+#define ETH_POLL_HIST_BUCKETS   10
+
+typedef struct {
+    uint64_t    passes;
+    uint64_t    irq_wakeups;
+    uint64_t    budget_exhausted;   /* Passes that hit the budget */
+    uint64_t    poll_mode_entries;  /* Switches to tick-driven polling */
+    uint32_t    pkt_hist[ETH_POLL_HIST_BUCKETS];    /* Packets per pass */
+    uint32_t    time_hist[ETH_POLL_HIST_BUCKETS];   /* Microseconds per pass */
+} eth_poll_stats_t;
+
 /*
  * API Functions
  */
@@ -55,6 +76,9 @@ netif_t *eth_get_netif(void);
 /* Get statistics */
 void eth_get_stats(eth_stats_t *stats);
 
+/* Get RX polling statistics */
+void eth_get_poll_stats(eth_poll_stats_t *stats);
+
 /* Poll for packets (non-interrupt mode) */
 void eth_poll(void);
 
@@ -48,6 +48,11 @@
 #define PNIO_FRAME_ID_DCP_GET       0xFEFE
 #define PNIO_FRAME_ID_DCP_SET       0xFEFF
 
+/* 802.1p priorities; RT and alarm frames are sent priority-tagged */
+#define PNIO_PCP_RT                 6
+#define PNIO_PCP_ALARM_HIGH         6
+#define PNIO_PCP_ALARM_LOW          5
+
 /* PROFINET Service IDs */
 #define PNIO_SERVICE_CONNECT        0x01
 #define PNIO_SERVICE_RELEASE        0x02
@@ -196,6 +201,7 @@ typedef struct {
     uint32_t        cycle_time_us;
     uint64_t        cycle_count;
     uint64_t        last_cycle_time;
+    uint64_t        next_launch;    /* Launch time of the next cyclic frame, ns */
 
     /* Cyclic data buffers (zero-copy) */
     zbuf_t          *tx_buffer;
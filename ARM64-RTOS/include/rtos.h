@@ -81,6 +81,13 @@ extern status_t msgq_recv(msgqueue_t *mq, void *msg, tick_t timeout);
 extern void timer_init(timer_t *timer, timer_callback_t callback, void *arg);
 extern status_t timer_start(timer_t *timer, tick_t delay, bool periodic);
 extern void timer_stop(timer_t *timer);
+extern uint64_t timer_get_ns(void);
+
+/* High-Resolution Timer (callbacks run in IRQ context) */
+extern void hrtimer_driver_init(void);
+extern void hrtimer_init(hrtimer_t *timer, timer_callback_t callback, void *arg);
+extern status_t hrtimer_start(hrtimer_t *timer, uint64_t expires);
+extern void hrtimer_cancel(hrtimer_t *timer);
 
 /* Memory */
 extern void heap_init(void);
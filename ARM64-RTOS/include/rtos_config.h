@@ -79,6 +79,9 @@
 #ifndef CONFIG_ZBUF_HEADROOM
 #define CONFIG_ZBUF_HEADROOM         128           /* Space for protocol headers */
 #endif
+#ifndef CONFIG_ZBUF_DEBUG
+#define CONFIG_ZBUF_DEBUG            0             /* Owner tagging / leak report */
+#endif
 
 /* Kernel Configuration */
 #ifndef CONFIG_KERNEL_PREEMPTION
@@ -107,11 +110,86 @@
 #ifndef CONFIG_NET_MAX_SOCKETS
 #define CONFIG_NET_MAX_SOCKETS       64
 #endif
+#ifndef CONFIG_NET_SOCK_HASH_SIZE
+#define CONFIG_NET_SOCK_HASH_SIZE    256           /* Power of two */
+#endif
+#ifndef CONFIG_NET_ARP_ENTRIES
+#define CONFIG_NET_ARP_ENTRIES       256
+#endif
+#ifndef CONFIG_NET_ARP_TIMEOUT
+#define CONFIG_NET_ARP_TIMEOUT       300           /* seconds */
+#endif
+#ifndef CONFIG_NET_ARP_QUEUE_LEN
+#define CONFIG_NET_ARP_QUEUE_LEN     4
+#endif
+#ifndef CONFIG_NET_ROUTE_ENTRIES
+#define CONFIG_NET_ROUTE_ENTRIES     16
+#endif
+#ifndef CONFIG_NET_TX_BANDS
+#define CONFIG_NET_TX_BANDS          4
+#endif
+#ifndef CONFIG_NET_TX_QUEUE_LEN
+#define CONFIG_NET_TX_QUEUE_LEN      64            /* Frames per band */
+#endif
+#ifndef CONFIG_NET_TX_INFLIGHT
+#define CONFIG_NET_TX_INFLIGHT       16384         /* Bytes on the driver ring */
+#endif
+#ifndef CONFIG_NET_TAS_QUEUE_LEN
+#define CONFIG_NET_TAS_QUEUE_LEN     16            /* Frames awaiting launch */
+#endif
+#ifndef CONFIG_NET_TAS_GUARD_NS
+#define CONFIG_NET_TAS_GUARD_NS      150000        /* Protected window */
+#endif
+#ifndef CONFIG_NET_TAS_LEAD_NS
+#define CONFIG_NET_TAS_LEAD_NS       5000          /* Launch timer lead */
+#endif
+#ifndef CONFIG_NET_CLS_RULES
+#define CONFIG_NET_CLS_RULES         16            /* At most 32 */
+#endif
+#ifndef CONFIG_NET_PROTO_HANDLERS
+#define CONFIG_NET_PROTO_HANDLERS    4
+#endif
 #ifndef CONFIG_TCP_MSS
 #define CONFIG_TCP_MSS               1460
 #endif
 #ifndef CONFIG_TCP_WINDOW_SIZE
-#define CONFIG_TCP_WINDOW_SIZE       65535
+#define CONFIG_TCP_WINDOW_SIZE       65535         /* Initial receive buffer */
+#endif
+#ifndef CONFIG_TCP_RCVBUF_MAX
+#define CONFIG_TCP_RCVBUF_MAX        262144        /* Autosizing limit */
+#endif
+#ifndef CONFIG_TCP_SNDBUF
+#define CONFIG_TCP_SNDBUF            32768
+#endif
+#ifndef CONFIG_TCP_OOO_SEGS
+#define CONFIG_TCP_OOO_SEGS          32
+#endif
+#ifndef CONFIG_TCP_SACK
+#define CONFIG_TCP_SACK              1             /* Selective ACK (RFC 2018) */
+#endif
+#ifndef CONFIG_TCP_WSCALE
+#define CONFIG_TCP_WSCALE            1             /* Window scaling (RFC 7323) */
+#endif
+#ifndef CONFIG_TCP_TIMESTAMPS
+#define CONFIG_TCP_TIMESTAMPS        1             /* Timestamps and PAWS (RFC 7323) */
+#endif
+#ifndef CONFIG_TCP_DELACK_MS
+#define CONFIG_TCP_DELACK_MS         40
+#endif
+#ifndef CONFIG_TCP_RETRIES
+#define CONFIG_TCP_RETRIES           5
+#endif
+#ifndef CONFIG_TCP_KEEPALIVE_IDLE
+#define CONFIG_TCP_KEEPALIVE_IDLE    7200          /* Seconds */
+#endif
+#ifndef CONFIG_TCP_KEEPALIVE_INTVL
+#define CONFIG_TCP_KEEPALIVE_INTVL   75            /* Seconds */
+#endif
+#ifndef CONFIG_TCP_KEEPALIVE_PROBES
+#define CONFIG_TCP_KEEPALIVE_PROBES  9
+#endif
+#ifndef CONFIG_TCP_TIMER_PRIORITY
+#define CONFIG_TCP_TIMER_PRIORITY    11            /* With the Ethernet poll task */
 #endif
 
 /* Modbus Configuration */
@@ -179,6 +257,9 @@
 #ifndef CONFIG_PROFINET_RT_CLASS
 #define CONFIG_PROFINET_RT_CLASS     1             /* RT Class 1 */
 #endif
+#ifndef CONFIG_PROFINET_LAUNCH_TIME
+#define CONFIG_PROFINET_LAUNCH_TIME  1             /* Cyclic frames on the cycle */
+#endif
 
 /* ARM64 GIC Configuration */
 #ifndef CONFIG_GICD_BASE
@@ -190,11 +271,17 @@
 #ifndef CONFIG_GIC_SPI_START
 #define CONFIG_GIC_SPI_START         32
 #endif
+#ifndef CONFIG_ARM64_NEON_CSUM
+#define CONFIG_ARM64_NEON_CSUM       1             /* NEON checksum */
+#endif
 
 /* Timer Configuration */
 #ifndef CONFIG_TIMER_IRQ
 #define CONFIG_TIMER_IRQ             27            /* Generic Timer PPI */
 #endif
+#ifndef CONFIG_HRTIMER_IRQ
+#define CONFIG_HRTIMER_IRQ           30            /* EL1 physical timer PPI */
+#endif
 
 /* UART Configuration */
 #ifndef CONFIG_UART_ENABLED
@@ -221,7 +308,25 @@
 #define CONFIG_ETH_BASE              0x0A000000
 #endif
 #ifndef CONFIG_ETH_IRQ
-#define CONFIG_ETH_IRQ               47
+#define CONFIG_ETH_IRQ               48
+#endif
+#ifndef CONFIG_ETH_RX_BUDGET
+#define CONFIG_ETH_RX_BUDGET         64            /* Packets per poll pass */
+#endif
+#ifndef CONFIG_ETH_POLL_PRIORITY
+#define CONFIG_ETH_POLL_PRIORITY     11            /* Below PROFINET (12) */
+#endif
+#ifndef CONFIG_ETH_POLL_SPIN_PASSES
+#define CONFIG_ETH_POLL_SPIN_PASSES  4
+#endif
+#ifndef CONFIG_ETH_OFFLOAD
+#define CONFIG_ETH_OFFLOAD           1             /* virtio CSUM/TSO */
+#endif
+#ifndef CONFIG_ETH_RING_PACKED
+#define CONFIG_ETH_RING_PACKED       1             /* virtio 1.1 packed ring */
+#endif
+#ifndef CONFIG_ETH_QUEUE_PAIRS
+#define CONFIG_ETH_QUEUE_PAIRS       1             /* One per network core */
 #endif
 
 /* Debug Configuration */
@@ -157,6 +157,15 @@ typedef struct timer {
     struct timer    *next;
 } timer_t;
 
+/* High-resolution one-shot timer, nanoseconds on the timer_get_ns() clock */
+typedef struct hrtimer {
+    uint64_t        expires;
+    timer_callback_t callback;
+    void            *arg;
+    bool            active;
+    struct hrtimer  *next;
+} hrtimer_t;
+
 /* Memory Pool */
 typedef struct {
     void            *base;
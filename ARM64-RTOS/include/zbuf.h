@@ -69,6 +69,12 @@ typedef struct zbuf {
     /* Networking */
     void            *netif;         /* Network interface */
     uint32_t        hash;           /* Flow hash */
+    uint32_t        csum;           /* Partial payload sum (ZBUF_F_CSUM_PARTIAL) */
+    uint32_t        seq;            /* TCP sequence of data[0] (reassembly queue) */
+    uint32_t        peer_addr;      /* UDP: sender on RX, destination on TX, host order */
+    uint16_t        peer_port;      /* UDP: port of peer_addr */
+    uint16_t        vlan_tci;       /* 802.1Q tag, host order (ZBUF_F_VLAN) */
+    uint8_t         priority;       /* 802.1p PCP 0-7, selects the TX band */
 
     /* DMA info */
     addr_t          dma_addr;       /* Physical address for DMA */
@@ -77,9 +83,26 @@ typedef struct zbuf {
     struct zbuf     *next;
     struct zbuf     *prev;
 
-    /* Timestamp for PROFINET RT */
+    /* Offload (virtio_net_hdr semantics) */
+    struct zbuf     *frag;          /* Next buffer of a multi-buffer packet */
+    uint16_t        csum_start;     /* L4 header, offset from head (ZBUF_F_CHECKSUM) */
+    uint16_t        csum_offset;    /* Checksum field, offset from csum_start */
+    uint16_t        gso_size;       /* TSO segment payload size, 0 = none */
+
+    /* Timestamp for PROFINET RT; launch time, then release time, on TX;
+     * arrival of a received UDP datagram (timer_get_ns() unless the
+     * driver stamped it, ZBUF_F_TIMESTAMP) */
     uint64_t        timestamp;
 
+#if CONFIG_ZBUF_DEBUG
+    /* Leak tracking (owner tag and call site of the last allocation) */
+    const char      *alloc_site;    /* Allocating function */
+    tick_t          alloc_tick;     /* Allocation time */
+    uint16_t        alloc_line;     /* Allocating source line */
+    uint8_t         owner;          /* zbuf_owner_t */
+    uint8_t         _dbg_pad;
+#endif
+
     /* Padding to align data */
     uint8_t         _pad[8];
 
@@ -92,8 +115,17 @@ typedef struct zbuf {
 #define ZBUF_F_DMA          (1 << 2)    /* DMA capable */
 #define ZBUF_F_SHARED       (1 << 3)    /* Shared buffer (don't free) */
 #define ZBUF_F_CLONED       (1 << 4)    /* Cloned buffer */
-#define ZBUF_F_CHECKSUM     (1 << 5)    /* Checksum offload */
+#define ZBUF_F_CHECKSUM     (1 << 5)    /* L4 checksum left to the device */
 #define ZBUF_F_TIMESTAMP    (1 << 6)    /* Has hardware timestamp */
+#define ZBUF_F_CSUM_PARTIAL (1 << 7)    /* csum covers the payload */
+#define ZBUF_F_CSUM_VALID   (1 << 8)    /* RX L4 checksum verified by the device */
+#define ZBUF_F_HASH_VALID   (1 << 9)    /* hash holds the RSS flow hash */
+#define ZBUF_F_VLAN         (1 << 10)   /* RX: tag stripped; TX: send tagged */
+#define ZBUF_F_TXTIME       (1 << 11)   /* TX: send at timestamp (ns) */
+#define ZBUF_F_SACKED       (1 << 12)   /* TCP: queued segment SACKed by the peer */
+
+/* Largest payload of a single buffer */
+#define ZBUF_DATA_MAX       (CONFIG_ZBUF_SIZE - CONFIG_ZBUF_HEADROOM)
 
 /* Protocol IDs */
 #define ZBUF_PROTO_ETH      0x0001
@@ -103,6 +135,32 @@ typedef struct zbuf {
 #define ZBUF_PROTO_VLAN     0x8100
 #define ZBUF_PROTO_PROFINET 0x8892
 
+/*
+ * Buffer Owners
+ *
+ * With CONFIG_ZBUF_DEBUG each buffer carries the subsystem that holds it
+ * and the call site that allocated it. A source file selects its default
+ * owner by defining ZBUF_OWNER before including this header; buffers that
+ * change hands (e.g. queued to a socket) are re-tagged with zbuf_set_owner().
+ */
+typedef enum {
+    ZBUF_OWNER_NONE = 0,
+    ZBUF_OWNER_ETH,             /* Driver rings */
+    ZBUF_OWNER_NET,             /* IP/ARP/ICMP */
+    ZBUF_OWNER_UDP,
+    ZBUF_OWNER_TCP,
+    ZBUF_OWNER_SOCK,            /* Socket queues */
+    ZBUF_OWNER_MODBUS,
+    ZBUF_OWNER_OPCUA,
+    ZBUF_OWNER_PROFINET,
+    ZBUF_OWNER_APP,
+    ZBUF_OWNER_COUNT
+} zbuf_owner_t;
+
+#ifndef ZBUF_OWNER
+#define ZBUF_OWNER          ZBUF_OWNER_NONE
+#endif
+
 /*
  * Buffer Pool
  */
@@ -112,10 +170,35 @@ typedef struct {
     uint32_t        total_count;
     uint32_t        free_count;
     uint32_t        alloc_failures;
+    uint32_t        peak_used;      /* High-water mark of buffers in use */
     void            *pool_memory;
     size_t          buf_size;
+    size_t          buf_stride;     /* Header + data, 64-byte aligned */
 } zbuf_pool_t;
 
+/*
+ * Pool Census
+ */
+typedef struct {
+    uint32_t        total;
+    uint32_t        free;
+    uint32_t        live;           /* Buffers with refcount > 0 */
+    uint32_t        peak_used;
+    uint32_t        alloc_failures;
+    uint32_t        by_owner[ZBUF_OWNER_COUNT];
+} zbuf_census_t;
+
+/*
+ * Leak Report Entry
+ */
+typedef struct {
+    zbuf_t          *zb;
+    const char      *site;
+    uint16_t        line;
+    uint8_t         owner;
+    tick_t          age;            /* Ticks since allocation */
+} zbuf_leak_t;
+
 /* Global buffer pool */
 extern zbuf_pool_t zbuf_pool;
 
@@ -126,6 +209,13 @@ extern zbuf_pool_t zbuf_pool;
 /* Pool Management */
 status_t zbuf_pool_init(void);
 void zbuf_pool_stats(uint32_t *total, uint32_t *free, uint32_t *failures);
+uint32_t zbuf_pool_peak(void);
+void zbuf_pool_reset_peak(void);
+
+/* Leak Detection */
+void zbuf_census(zbuf_census_t *census);
+uint32_t zbuf_leak_report(tick_t min_age, zbuf_leak_t *out, uint32_t max);
+const char *zbuf_owner_name(uint8_t owner);
 
 /* Buffer Allocation */
 zbuf_t *zbuf_alloc(uint16_t size);
@@ -138,6 +228,40 @@ zbuf_t *zbuf_ref(zbuf_t *zb);
 void zbuf_unref(zbuf_t *zb);
 zbuf_t *zbuf_clone(zbuf_t *zb);
 
+/* Ownership Tagging */
+#if CONFIG_ZBUF_DEBUG
+static inline zbuf_t *zbuf_tag(zbuf_t *zb, uint8_t owner, const char *site, uint16_t line)
+{
+    if (zb != NULL) {
+        zb->owner = owner;
+        zb->alloc_site = site;
+        zb->alloc_line = line;
+    }
+    return zb;
+}
+
+static inline void zbuf_set_owner(zbuf_t *zb, uint8_t owner)
+{
+    if (zb != NULL) {
+        zb->owner = owner;
+    }
+}
+
+/* Record caller of every allocation (zbuf.c sees the plain functions) */
+#ifndef ZBUF_INTERNAL
+#define zbuf_alloc(size)    zbuf_tag(zbuf_alloc(size), ZBUF_OWNER, __func__, __LINE__)
+#define zbuf_alloc_tx(size) zbuf_tag(zbuf_alloc_tx(size), ZBUF_OWNER, __func__, __LINE__)
+#define zbuf_alloc_rx(size) zbuf_tag(zbuf_alloc_rx(size), ZBUF_OWNER, __func__, __LINE__)
+#define zbuf_clone(zb)      zbuf_tag(zbuf_clone(zb), ZBUF_OWNER, __func__, __LINE__)
+#endif
+#else
+static inline void zbuf_set_owner(zbuf_t *zb, uint8_t owner)
+{
+    (void)zb;
+    (void)owner;
+}
+#endif
+
 /* Data Manipulation */
 uint8_t *zbuf_push(zbuf_t *zb, uint16_t len);
 uint8_t *zbuf_pull(zbuf_t *zb, uint16_t len);
@@ -152,6 +276,16 @@ static inline uint16_t zbuf_len(zbuf_t *zb) { return zb->len; }
 static inline uint16_t zbuf_headroom(zbuf_t *zb) { return zb->data - zb->head; }
 static inline uint16_t zbuf_tailroom(zbuf_t *zb) { return zb->end - zb->tail; }
 
+/* Total length of a multi-buffer packet (zb->frag chain) */
+static inline uint32_t zbuf_pkt_len(const zbuf_t *zb)
+{
+    uint32_t len = 0;
+    for (; zb != NULL; zb = zb->frag) {
+        len += zb->len;
+    }
+    return len;
+}
+
 /* Protocol Headers */
 static inline void *zbuf_l2_hdr(zbuf_t *zb) { return zb->data + zb->l2_offset; }
 static inline void *zbuf_l3_hdr(zbuf_t *zb) { return zb->data + zb->l3_offset; }
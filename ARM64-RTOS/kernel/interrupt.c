@@ -342,3 +342,159 @@ void timer_tick_handler(void)
 
     spin_unlock(&timer_lock);
 }
+
+/*
+ * High-Resolution Timers
+ *
+ * One-shot timers on the nanosecond clock, driven by the EL1 physical
+ * timer so they do not disturb the tick on the virtual timer. The list
+ * is sorted by expiry and the compare register tracks its head; an
+ * interrupt that finds nothing due re-arms for the new head.
+ */
+#define CNT_CTL_ENABLE      (1 << 0)
+#define CNT_CTL_IMASK       (1 << 1)
+
+static hrtimer_t *hrtimer_list = NULL;
+static spinlock_t hrtimer_lock = SPINLOCK_INIT;
+static uint64_t cnt_freq = 0;
+
+static inline uint64_t read_cntpct(void)
+{
+    uint64_t cnt;
+    __asm__ volatile("isb\n mrs %0, cntpct_el0" : "=r"(cnt) : : "memory");
+    return cnt;
+}
+
+static uint64_t counter_freq(void)
+{
+    if (unlikely(cnt_freq == 0)) {
+        uint64_t freq;
+        __asm__ volatile("mrs %0, cntfrq_el0" : "=r"(freq));
+        cnt_freq = freq ? freq : CONFIG_CPU_FREQ_HZ;
+    }
+    return cnt_freq;
+}
+
+uint64_t timer_get_ns(void)
+{
+    uint64_t freq = counter_freq();
+    uint64_t cnt = read_cntpct();
+
+    /* Split so cnt * 1e9 cannot overflow */
+    return (cnt / freq) * 1000000000ULL + (cnt % freq) * 1000000000ULL / freq;
+}
+
+/* Point the compare register at expires (hrtimer_lock held) */
+static void hrtimer_program(uint64_t expires)
+{
+    uint64_t freq = counter_freq();
+    uint64_t cval = (expires / 1000000000ULL) * freq +
+                    (expires % 1000000000ULL) * freq / 1000000000ULL;
+
+    __asm__ volatile("msr cntp_cval_el0, %0" : : "r"(cval));
+    __asm__ volatile("msr cntp_ctl_el0, %0" : : "r"((uint64_t)CNT_CTL_ENABLE));
+}
+
+/* Take timer off the list if it is on it (hrtimer_lock held) */
+static void hrtimer_unlink(hrtimer_t *timer)
+{
+    hrtimer_t **pp = &hrtimer_list;
+
+    while (*pp != NULL) {
+        if (*pp == timer) {
+            *pp = timer->next;
+            break;
+        }
+        pp = &(*pp)->next;
+    }
+    timer->next = NULL;
+    timer->active = false;
+}
+
+static void hrtimer_irq_handler(uint32_t irq __attribute__((unused)), void *arg __attribute__((unused)))
+{
+    /* Level-triggered: quiet the line until the next head is programmed */
+    __asm__ volatile("msr cntp_ctl_el0, %0" : : "r"((uint64_t)CNT_CTL_IMASK));
+
+    spin_lock(&hrtimer_lock);
+
+    while (hrtimer_list != NULL) {
+        hrtimer_t *timer = hrtimer_list;
+
+        if (timer->expires > timer_get_ns()) {
+            hrtimer_program(timer->expires);
+            break;
+        }
+
+        hrtimer_list = timer->next;
+        timer->next = NULL;
+        timer->active = false;
+
+        /* Call callback outside lock; it may re-arm */
+        spin_unlock(&hrtimer_lock);
+        timer->callback(timer->arg);
+        spin_lock(&hrtimer_lock);
+    }
+
+    spin_unlock(&hrtimer_lock);
+}
+
+void hrtimer_driver_init(void)
+{
+    counter_freq();
+    __asm__ volatile("msr cntp_ctl_el0, %0" : : "r"((uint64_t)CNT_CTL_IMASK));
+
+    /* Ahead of the tick when both are pending */
+    irq_register(CONFIG_HRTIMER_IRQ, hrtimer_irq_handler, NULL);
+    irq_set_priority(CONFIG_HRTIMER_IRQ, 0x80);
+    irq_enable(CONFIG_HRTIMER_IRQ);
+}
+
+void hrtimer_init(hrtimer_t *timer, timer_callback_t callback, void *arg)
+{
+    timer->expires = 0;
+    timer->callback = callback;
+    timer->arg = arg;
+    timer->active = false;
+    timer->next = NULL;
+}
+
+/*
+ * Arm timer for the absolute time expires (timer_get_ns() clock),
+ * moving it if already armed. A time in the past fires at once.
+ */
+status_t hrtimer_start(hrtimer_t *timer, uint64_t expires)
+{
+    if (timer == NULL || timer->callback == NULL) {
+        return STATUS_INVALID;
+    }
+
+    spin_lock_irq(&hrtimer_lock);
+
+    hrtimer_unlink(timer);
+    timer->expires = expires;
+    timer->active = true;
+
+    hrtimer_t **pp = &hrtimer_list;
+    while (*pp != NULL && (*pp)->expires <= expires) {
+        pp = &(*pp)->next;
+    }
+    timer->next = *pp;
+    *pp = timer;
+
+    if (hrtimer_list == timer) {
+        hrtimer_program(expires);
+    }
+
+    spin_unlock_irq(&hrtimer_lock);
+    return STATUS_OK;
+}
+
+void hrtimer_cancel(hrtimer_t *timer)
+{
+    if (timer == NULL) return;
+
+    spin_lock_irq(&hrtimer_lock);
+    hrtimer_unlink(timer);
+    spin_unlock_irq(&hrtimer_lock);
+}
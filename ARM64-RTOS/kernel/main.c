@@ -87,6 +87,8 @@ static void timer_irq_handler(uint32_t irq __attribute__((unused)), void *arg __
 
 static void timer_init(void)
 {
+    extern void hrtimer_driver_init(void);
+
     /* Set timer compare value */
     uint64_t cnt;
     __asm__ volatile("mrs %0, cntvct_el0" : "=r"(cnt));
@@ -99,6 +101,9 @@ static void timer_init(void)
     /* Register and enable IRQ */
     irq_register(CONFIG_TIMER_IRQ, timer_irq_handler, NULL);
     irq_enable(CONFIG_TIMER_IRQ);
+
+    /* One-shot timers for launch-time transmit */
+    hrtimer_driver_init();
 }
 
 /* Network Interface (简化以太网驱动) */
@@ -329,7 +334,24 @@ static void main_task(void *arg __attribute__((unused)))
             print_hex(free);
             uart_puts("/");
             print_hex(total);
+            uart_puts("  Peak: ");
+            print_hex(zbuf_pool_peak());
             uart_puts("\n");
+
+#if CONFIG_ZBUF_DEBUG
+            /* Buffers held for more than a minute are leak suspects */
+            zbuf_leak_t leaks[4];
+            uint32_t n = zbuf_leak_report(60 * CONFIG_TICK_RATE_HZ, leaks, 4);
+            for (uint32_t i = 0; i < n && i < 4; i++) {
+                uart_puts("  ZBuf leak? owner=");
+                uart_puts(zbuf_owner_name(leaks[i].owner));
+                uart_puts(" site=");
+                uart_puts(leaks[i].site ? leaks[i].site : "?");
+                uart_puts(":");
+                print_hex(leaks[i].line);
+                uart_puts("\n");
+            }
+#endif
         }
     }
 }
@@ -23,6 +23,7 @@
  * Zero-Copy Network Buffer Implementation
  */
 
+#define ZBUF_INTERNAL
 #include "zbuf.h"
 
 /* Global buffer pool */
@@ -36,21 +37,29 @@ static uint8_t zbuf_memory[CONFIG_ZBUF_POOL_SIZE] ALIGNED(64) SECTION(".zbuf");
  */
 status_t zbuf_pool_init(void)
 {
+    /* Calculate actual buffer size including header */
+    size_t buf_total = sizeof(zbuf_t) + CONFIG_ZBUF_SIZE;
+    buf_total = (buf_total + 63) & ~63;  /* 64-byte align */
+
+    /* Never carve more buffers than the pool memory holds */
+    uint32_t count = CONFIG_ZBUF_COUNT;
+    if (count > CONFIG_ZBUF_POOL_SIZE / buf_total) {
+        count = CONFIG_ZBUF_POOL_SIZE / buf_total;
+    }
+
     zbuf_pool.lock = (spinlock_t)SPINLOCK_INIT;
     zbuf_pool.free_list = NULL;
-    zbuf_pool.total_count = CONFIG_ZBUF_COUNT;
-    zbuf_pool.free_count = CONFIG_ZBUF_COUNT;
+    zbuf_pool.total_count = count;
+    zbuf_pool.free_count = count;
     zbuf_pool.alloc_failures = 0;
+    zbuf_pool.peak_used = 0;
     zbuf_pool.pool_memory = zbuf_memory;
     zbuf_pool.buf_size = CONFIG_ZBUF_SIZE;
-
-    /* Calculate actual buffer size including header */
-    size_t buf_total = sizeof(zbuf_t) + CONFIG_ZBUF_SIZE;
-    buf_total = (buf_total + 63) & ~63;  /* 64-byte align */
+    zbuf_pool.buf_stride = buf_total;
 
     /* Initialize free list */
     uint8_t *ptr = zbuf_memory;
-    for (uint32_t i = 0; i < CONFIG_ZBUF_COUNT; i++) {
+    for (uint32_t i = 0; i < count; i++) {
         zbuf_t *zb = (zbuf_t *)ptr;
 
         /* Initialize buffer */
@@ -66,6 +75,13 @@ status_t zbuf_pool_init(void)
         zb->netif = NULL;
         zb->dma_addr = (addr_t)zb->head;  /* Identity mapping */
         zb->timestamp = 0;
+        zb->frag = NULL;
+#if CONFIG_ZBUF_DEBUG
+        zb->alloc_site = NULL;
+        zb->alloc_tick = 0;
+        zb->alloc_line = 0;
+        zb->owner = ZBUF_OWNER_NONE;
+#endif
 
         /* Add to free list */
         zb->next = zbuf_pool.free_list;
@@ -93,6 +109,21 @@ void zbuf_pool_stats(uint32_t *total, uint32_t *free, uint32_t *failures)
     spin_unlock_irq(&zbuf_pool.lock);
 }
 
+/*
+ * Peak Usage Watermark
+ */
+uint32_t zbuf_pool_peak(void)
+{
+    return zbuf_pool.peak_used;
+}
+
+void zbuf_pool_reset_peak(void)
+{
+    spin_lock_irq(&zbuf_pool.lock);
+    zbuf_pool.peak_used = zbuf_pool.total_count - zbuf_pool.free_count;
+    spin_unlock_irq(&zbuf_pool.lock);
+}
+
 /*
  * Buffer Allocation
  */
@@ -118,6 +149,11 @@ zbuf_t *zbuf_alloc(uint16_t size)
     }
     zbuf_pool.free_count--;
 
+    uint32_t used = zbuf_pool.total_count - zbuf_pool.free_count;
+    if (used > zbuf_pool.peak_used) {
+        zbuf_pool.peak_used = used;
+    }
+
     spin_unlock_irq(&zbuf_pool.lock);
 
     /* Reset buffer state */
@@ -132,9 +168,24 @@ zbuf_t *zbuf_alloc(uint16_t size)
     zb->l4_offset = 0;
     zb->netif = NULL;
     zb->hash = 0;
+    zb->csum = 0;
+    zb->peer_addr = 0;
+    zb->peer_port = 0;
+    zb->vlan_tci = 0;
+    zb->priority = 0;
     zb->timestamp = 0;
     zb->next = NULL;
     zb->prev = NULL;
+    zb->frag = NULL;
+    zb->csum_start = 0;
+    zb->csum_offset = 0;
+    zb->gso_size = 0;
+#if CONFIG_ZBUF_DEBUG
+    zb->alloc_site = NULL;
+    zb->alloc_tick = get_system_ticks();
+    zb->alloc_line = 0;
+    zb->owner = ZBUF_OWNER_NONE;
+#endif
 
     return zb;
 }
@@ -162,26 +213,29 @@ zbuf_t *zbuf_alloc_rx(uint16_t size)
 
 /*
  * Buffer Free
+ *
+ * Drops one reference; the last one returns the buffer and any
+ * fragments chained on zb->frag to the pool.
  */
-void zbuf_free(zbuf_t *zb)
+static bool zbuf_release(zbuf_t *zb)
 {
-    if (zb == NULL) {
-        return;
-    }
-
     /* Check if shared */
     if (zb->flags & ZBUF_F_SHARED) {
-        return;
+        return false;
     }
 
-    /* Decrement refcount */
-    if (atomic_sub((volatile uint32_t *)&zb->refcount, 1) > 1) {
-        return;
+    /*
+     * Decrement refcount. The atomic operates on the 32-bit word shared
+     * with flags, so only the low half (refcount) decides the outcome.
+     */
+    if ((atomic_sub((volatile uint32_t *)&zb->refcount, 1) & 0xFFFF) != 0) {
+        return false;
     }
 
     /* Return to pool */
     spin_lock_irq(&zbuf_pool.lock);
 
+    zb->frag = NULL;
     zb->next = zbuf_pool.free_list;
     zb->prev = NULL;
     if (zbuf_pool.free_list != NULL) {
@@ -191,6 +245,20 @@ void zbuf_free(zbuf_t *zb)
     zbuf_pool.free_count++;
 
     spin_unlock_irq(&zbuf_pool.lock);
+    return true;
+}
+
+void zbuf_free(zbuf_t *zb)
+{
+    while (zb != NULL) {
+        zbuf_t *frag = zb->frag;
+
+        /* Fragments stay attached while the head is still referenced */
+        if (!zbuf_release(zb)) {
+            return;
+        }
+        zb = frag;
+    }
 }
 
 /*
@@ -235,11 +303,129 @@ zbuf_t *zbuf_clone(zbuf_t *zb)
     clone->l4_offset = zb->l4_offset;
     clone->netif = zb->netif;
     clone->hash = zb->hash;
+    clone->csum = zb->csum;
+    clone->peer_addr = zb->peer_addr;
+    clone->peer_port = zb->peer_port;
+    clone->vlan_tci = zb->vlan_tci;
+    clone->priority = zb->priority;
+    clone->csum_start = zb->csum_start - zbuf_headroom(zb) + zbuf_headroom(clone);
+    clone->csum_offset = zb->csum_offset;
+    clone->gso_size = zb->gso_size;
     clone->timestamp = zb->timestamp;
 
     return clone;
 }
 
+/*
+ * Leak Detection
+ *
+ * Walks the pool memory directly, so buffers are found no matter which
+ * queue (or stray pointer) holds them. A buffer is live while its
+ * refcount is non-zero.
+ */
+static inline zbuf_t *zbuf_pool_entry(uint32_t index)
+{
+    return (zbuf_t *)((uint8_t *)zbuf_pool.pool_memory + index * zbuf_pool.buf_stride);
+}
+
+void zbuf_census(zbuf_census_t *census)
+{
+    if (census == NULL) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < ZBUF_OWNER_COUNT; i++) {
+        census->by_owner[i] = 0;
+    }
+    census->live = 0;
+
+    spin_lock_irq(&zbuf_pool.lock);
+
+    census->total = zbuf_pool.total_count;
+    census->free = zbuf_pool.free_count;
+    census->peak_used = zbuf_pool.peak_used;
+    census->alloc_failures = zbuf_pool.alloc_failures;
+
+    for (uint32_t i = 0; i < zbuf_pool.total_count; i++) {
+        zbuf_t *zb = zbuf_pool_entry(i);
+        if (zb->refcount == 0) {
+            continue;
+        }
+        census->live++;
+#if CONFIG_ZBUF_DEBUG
+        census->by_owner[zb->owner < ZBUF_OWNER_COUNT ? zb->owner : ZBUF_OWNER_NONE]++;
+#else
+        census->by_owner[ZBUF_OWNER_NONE]++;
+#endif
+    }
+
+    spin_unlock_irq(&zbuf_pool.lock);
+}
+
+/*
+ * Report live buffers allocated at least min_age ticks ago.
+ * Fills up to max entries and returns the total number found.
+ */
+uint32_t zbuf_leak_report(tick_t min_age, zbuf_leak_t *out, uint32_t max)
+{
+#if CONFIG_ZBUF_DEBUG
+    tick_t now = get_system_ticks();
+    uint32_t found = 0;
+
+    spin_lock_irq(&zbuf_pool.lock);
+
+    for (uint32_t i = 0; i < zbuf_pool.total_count; i++) {
+        zbuf_t *zb = zbuf_pool_entry(i);
+        if (zb->refcount == 0) {
+            continue;
+        }
+
+        tick_t age = now - zb->alloc_tick;
+        if (age < min_age) {
+            continue;
+        }
+
+        if (out != NULL && found < max) {
+            out[found].zb = zb;
+            out[found].site = zb->alloc_site;
+            out[found].line = zb->alloc_line;
+            out[found].owner = zb->owner;
+            out[found].age = age;
+        }
+        found++;
+    }
+
+    spin_unlock_irq(&zbuf_pool.lock);
+    return found;
+#else
+    (void)min_age;
+    (void)out;
+    (void)max;
+    return 0;
+#endif
+}
+
+const char *zbuf_owner_name(uint8_t owner)
+{
+    static const char *const names[ZBUF_OWNER_COUNT] = {
+        [ZBUF_OWNER_NONE]     = "none",
+        [ZBUF_OWNER_ETH]      = "eth",
+        [ZBUF_OWNER_NET]      = "net",
+        [ZBUF_OWNER_UDP]      = "udp",
+        [ZBUF_OWNER_TCP]      = "tcp",
+        [ZBUF_OWNER_SOCK]     = "sock",
+        [ZBUF_OWNER_MODBUS]   = "modbus",
+        [ZBUF_OWNER_OPCUA]    = "opcua",
+        [ZBUF_OWNER_PROFINET] = "profinet",
+        [ZBUF_OWNER_APP]      = "app",
+    };
+
+    if (owner >= ZBUF_OWNER_COUNT) {
+        return "?";
+    }
+    return names[owner];
+}
+
 /*
  * Data Manipulation - Push header at front
  */
@@ -0,0 +1,507 @@
+/*
+ * Gracemont Industrial Control Framework - ARM64 RTOS
+ * Copyright (C) 2024 Zixiao System <https://github.com/Zixiao-System>
+ *
+ * This file is part of Gracemont Industrial Control Framework.
+ * Repository: https://github.com/Zixiao-System/gracemont
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * ARP Neighbor Table
+ *
+ * Hashed table with aging, LRU replacement and a per-entry queue of
+ * packets held while the address is being resolved. Entries are keyed
+ * by interface and address, so the same IP on two segments resolves
+ * independently.
+ */
+
+#define ZBUF_OWNER  ZBUF_OWNER_NET
+
+#include "net_stack.h"
+#include "rtos_config.h"
+#include "rtos.h"
+
+/* Neighbor States */
+#define ARP_STATE_FREE          0
+#define ARP_STATE_INCOMPLETE    1   /* Request sent, no reply yet */
+#define ARP_STATE_REACHABLE     2   /* Confirmed within the timeout */
+#define ARP_STATE_STALE         3   /* Timed out, still used while re-probing */
+
+/* Timing */
+#define ARP_RETRANS_TICKS       ((tick_t)CONFIG_TICK_RATE_HZ)   /* 1 s between requests */
+#define ARP_MAX_PROBES          3
+#define ARP_TIMEOUT_TICKS       ((tick_t)CONFIG_NET_ARP_TIMEOUT * CONFIG_TICK_RATE_HZ)
+
+/* Requests sent per aging pass; the rest wait for the next second */
+#define ARP_PROBES_PER_PASS     16
+
+#define ARP_HASH_SIZE           CONFIG_NET_ARP_ENTRIES
+
+typedef struct arp_entry {
+    struct arp_entry *hnext;        /* Hash chain / free list */
+    netif_t     *nif;
+    uint32_t    ip;
+    uint8_t     mac[6];
+    uint8_t     state;
+    uint8_t     probes;             /* Requests sent without a reply */
+    tick_t      confirmed;          /* Last reply from the neighbor */
+    tick_t      used;               /* Last lookup (LRU) */
+    tick_t      probed;             /* Last request sent */
+
+    /* Packets waiting for resolution */
+    zbuf_t      *pend_head;
+    zbuf_t      *pend_tail;
+    uint16_t    pend_count;
+} arp_entry_t;
+
+static arp_entry_t arp_table[CONFIG_NET_ARP_ENTRIES];
+static arp_entry_t *arp_hash[ARP_HASH_SIZE];
+static arp_entry_t *arp_free_list;
+static spinlock_t arp_lock = SPINLOCK_INIT;
+static timer_t arp_age_timer;
+static arp_stats_t arp_stats;
+
+static const uint8_t arp_broadcast[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+static inline uint32_t arp_hashfn(uint32_t ip)
+{
+    return ((ip * 0x9E3779B1) >> 16) % ARP_HASH_SIZE;
+}
+
+static inline void arp_copy_mac(uint8_t *dst, const uint8_t *src)
+{
+    for (int i = 0; i < 6; i++) {
+        dst[i] = src[i];
+    }
+}
+
+/*
+ * Table Internals (arp_lock held)
+ */
+static arp_entry_t *arp_lookup(netif_t *nif, uint32_t ip)
+{
+    arp_entry_t *e = arp_hash[arp_hashfn(ip)];
+
+    while (e != NULL && (e->ip != ip || e->nif != nif)) {
+        e = e->hnext;
+    }
+    return e;
+}
+
+static void arp_drop_pending(arp_entry_t *e)
+{
+    zbuf_t *zb = e->pend_head;
+
+    while (zb != NULL) {
+        zbuf_t *next = zb->next;
+        zb->next = NULL;
+        zbuf_free(zb);
+        zb = next;
+    }
+
+    arp_stats.dropped += e->pend_count;
+    e->pend_head = NULL;
+    e->pend_tail = NULL;
+    e->pend_count = 0;
+}
+
+static void arp_release(arp_entry_t *e)
+{
+    arp_entry_t **pp = &arp_hash[arp_hashfn(e->ip)];
+
+    while (*pp != e) {
+        pp = &(*pp)->hnext;
+    }
+    *pp = e->hnext;
+
+    arp_drop_pending(e);
+    e->state = ARP_STATE_FREE;
+    e->hnext = arp_free_list;
+    arp_free_list = e;
+    arp_stats.entries--;
+}
+
+/*
+ * Take a free entry, evicting the least recently used one when the
+ * table is full. Resolved entries go first so pending resolutions are
+ * not thrashed by a burst of new neighbors.
+ */
+static arp_entry_t *arp_alloc(netif_t *nif, uint32_t ip, tick_t now)
+{
+    if (arp_free_list == NULL) {
+        arp_entry_t *victim = NULL;
+
+        for (int pass = 0; pass < 2 && victim == NULL; pass++) {
+            for (int i = 0; i < CONFIG_NET_ARP_ENTRIES; i++) {
+                arp_entry_t *e = &arp_table[i];
+                if (pass == 0 && e->state == ARP_STATE_INCOMPLETE) {
+                    continue;
+                }
+                if (victim == NULL || (tick_t)(now - e->used) > (tick_t)(now - victim->used)) {
+                    victim = e;
+                }
+            }
+        }
+
+        arp_release(victim);
+        arp_stats.evictions++;
+    }
+
+    arp_entry_t *e = arp_free_list;
+    arp_free_list = e->hnext;
+
+    e->nif = nif;
+    e->ip = ip;
+    e->state = ARP_STATE_INCOMPLETE;
+    e->probes = 0;
+    e->confirmed = now;
+    e->used = now;
+    e->probed = now;
+    e->pend_head = NULL;
+    e->pend_tail = NULL;
+    e->pend_count = 0;
+
+    uint32_t h = arp_hashfn(ip);
+    e->hnext = arp_hash[h];
+    arp_hash[h] = e;
+    arp_stats.entries++;
+
+    return e;
+}
+
+/*
+ * Send ARP Packet
+ */
+static void arp_send(netif_t *nif, uint16_t oper, const uint8_t *tha,
+                     uint32_t tpa, const uint8_t *dst_mac)
+{
+    zbuf_t *zb = zbuf_alloc_tx(sizeof(arp_hdr_t));
+    if (zb == NULL) return;
+
+    arp_hdr_t *arp = (arp_hdr_t *)zbuf_put(zb, sizeof(arp_hdr_t));
+    arp->htype = htons(1);
+    arp->ptype = htons(ETH_TYPE_IP);
+    arp->hlen = 6;
+    arp->plen = 4;
+    arp->oper = htons(oper);
+    arp_copy_mac(arp->sha, nif->mac);
+    arp_copy_mac(arp->tha, tha);
+    arp->spa = htonl(nif->ip);
+    arp->tpa = htonl(tpa);
+
+    eth_output(nif, zb, dst_mac, ETH_TYPE_ARP);
+}
+
+static void arp_send_request(netif_t *nif, uint32_t ip)
+{
+    arp_send(nif, ARP_OP_REQUEST, arp_broadcast, ip, arp_broadcast);
+}
+
+static void arp_age_handler(void *arg)
+{
+    (void)arg;
+    arp_age(get_system_ticks());
+}
+
+/*
+ * Initialize Neighbor Table
+ *
+ * May be called again to flush the table; held packets are dropped.
+ */
+void arp_init(void)
+{
+    timer_stop(&arp_age_timer);
+
+    spin_lock_irq(&arp_lock);
+
+    arp_free_list = NULL;
+    for (int i = CONFIG_NET_ARP_ENTRIES - 1; i >= 0; i--) {
+        arp_drop_pending(&arp_table[i]);
+        arp_table[i].state = ARP_STATE_FREE;
+        arp_table[i].hnext = arp_free_list;
+        arp_free_list = &arp_table[i];
+    }
+    for (int i = 0; i < ARP_HASH_SIZE; i++) {
+        arp_hash[i] = NULL;
+    }
+
+    arp_stats.entries = 0;
+    arp_stats.hits = 0;
+    arp_stats.misses = 0;
+    arp_stats.queued = 0;
+    arp_stats.dropped = 0;
+    arp_stats.evictions = 0;
+
+    spin_unlock_irq(&arp_lock);
+
+    /* Aging runs once a second */
+    timer_init(&arp_age_timer, arp_age_handler, NULL);
+    timer_start(&arp_age_timer, ARP_RETRANS_TICKS, true);
+}
+
+/*
+ * Resolve a neighbor without queueing
+ *
+ * Returns STATUS_WOULD_BLOCK after starting resolution on a miss.
+ */
+status_t arp_resolve(netif_t *nif, uint32_t ip, uint8_t *mac)
+{
+    tick_t now = get_system_ticks();
+    bool probe = false;
+
+    spin_lock_irq(&arp_lock);
+
+    arp_entry_t *e = arp_lookup(nif, ip);
+    if (e != NULL && e->state != ARP_STATE_INCOMPLETE) {
+        arp_copy_mac(mac, e->mac);
+        e->used = now;
+        arp_stats.hits++;
+        spin_unlock_irq(&arp_lock);
+        return STATUS_OK;
+    }
+
+    arp_stats.misses++;
+    if (e == NULL && nif != NULL) {
+        arp_alloc(nif, ip, now);
+        probe = true;
+    }
+
+    spin_unlock_irq(&arp_lock);
+
+    if (probe) {
+        arp_send_request(nif, ip);
+    }
+    return STATUS_WOULD_BLOCK;
+}
+
+/*
+ * Send an IP packet to a neighbor
+ *
+ * On a miss the packet is held on the entry (oldest dropped beyond
+ * CONFIG_NET_ARP_QUEUE_LEN) and sent when the reply arrives.
+ */
+status_t arp_output(netif_t *nif, zbuf_t *zb, uint32_t next_hop)
+{
+    tick_t now = get_system_ticks();
+    uint8_t mac[6];
+    bool probe = false;
+
+    spin_lock_irq(&arp_lock);
+
+    arp_entry_t *e = arp_lookup(nif, next_hop);
+    if (e != NULL && e->state != ARP_STATE_INCOMPLETE) {
+        arp_copy_mac(mac, e->mac);
+        e->used = now;
+        arp_stats.hits++;
+        spin_unlock_irq(&arp_lock);
+        return eth_output(nif, zb, mac, ETH_TYPE_IP);
+    }
+
+    arp_stats.misses++;
+    if (e == NULL) {
+        e = arp_alloc(nif, next_hop, now);
+        probe = true;
+    }
+
+    /* Hold the packet until resolution */
+    if (e->pend_count >= CONFIG_NET_ARP_QUEUE_LEN) {
+        zbuf_t *old = e->pend_head;
+        e->pend_head = old->next;
+        e->pend_count--;
+        old->next = NULL;
+        zbuf_free(old);
+        arp_stats.dropped++;
+    }
+
+    zb->next = NULL;
+    if (e->pend_tail != NULL && e->pend_head != NULL) {
+        e->pend_tail->next = zb;
+    } else {
+        e->pend_head = zb;
+    }
+    e->pend_tail = zb;
+    e->pend_count++;
+    arp_stats.queued++;
+
+    spin_unlock_irq(&arp_lock);
+
+    if (probe) {
+        arp_send_request(nif, next_hop);
+    }
+    return STATUS_OK;
+}
+
+/*
+ * ARP Input
+ *
+ * A known sender is always refreshed (RFC 826 merge); a new one is only
+ * learned from packets addressed to us, so broadcast chatter does not
+ * fill the table.
+ */
+void arp_input(netif_t *nif, zbuf_t *zb)
+{
+    if (zb->len < sizeof(arp_hdr_t)) {
+        zbuf_free(zb);
+        return;
+    }
+
+    arp_hdr_t *arp = (arp_hdr_t *)zb->data;
+
+    /* Only handle Ethernet/IPv4 */
+    if (ntohs(arp->htype) != 1 || ntohs(arp->ptype) != ETH_TYPE_IP) {
+        zbuf_free(zb);
+        return;
+    }
+
+    uint32_t spa = ntohl(arp->spa);
+    uint32_t tpa = ntohl(arp->tpa);
+    bool for_us = (tpa == nif->ip);
+    tick_t now = get_system_ticks();
+    zbuf_t *pending = NULL;
+    uint8_t mac[6];
+
+    arp_copy_mac(mac, arp->sha);
+
+    /* Ignore probes (sender 0.0.0.0) and our own address */
+    if (spa != 0 && spa != nif->ip) {
+        spin_lock_irq(&arp_lock);
+
+        arp_entry_t *e = arp_lookup(nif, spa);
+        if (e == NULL && for_us) {
+            e = arp_alloc(nif, spa, now);
+        }
+
+        if (e != NULL) {
+            arp_copy_mac(e->mac, mac);
+            e->state = ARP_STATE_REACHABLE;
+            e->probes = 0;
+            e->confirmed = now;
+
+            /* Take the held packets; they are sent outside the lock */
+            pending = e->pend_head;
+            e->pend_head = NULL;
+            e->pend_tail = NULL;
+            e->pend_count = 0;
+        }
+
+        spin_unlock_irq(&arp_lock);
+    }
+
+    /* Release held packets with one driver call */
+    zbuf_t *batch[CONFIG_NET_ARP_QUEUE_LEN];
+    uint32_t count = 0;
+
+    while (pending != NULL) {
+        zbuf_t *next = pending->next;
+        pending->next = NULL;
+        if (eth_header(nif, pending, mac, ETH_TYPE_IP) == STATUS_OK) {
+            batch[count++] = pending;
+        }
+        pending = next;
+    }
+    if (count > 0) {
+        netif_send_batch(nif, batch, count);
+    }
+
+    /* Check if request is for us */
+    if (ntohs(arp->oper) == ARP_OP_REQUEST && for_us) {
+        arp_send(nif, ARP_OP_REPLY, mac, spa, mac);
+    }
+
+    zbuf_free(zb);
+}
+
+/*
+ * Aging, called once a second
+ *
+ * Unanswered requests are repeated ARP_MAX_PROBES times before the entry
+ * and its held packets are dropped. A timed-out entry still in use turns
+ * STALE and keeps working while it is re-probed; an idle one is freed.
+ */
+void arp_age(tick_t now)
+{
+    struct {
+        netif_t     *nif;
+        uint32_t    ip;
+    } probe[ARP_PROBES_PER_PASS];
+    int nprobe = 0;
+
+    spin_lock_irq(&arp_lock);
+
+    for (int i = 0; i < CONFIG_NET_ARP_ENTRIES; i++) {
+        arp_entry_t *e = &arp_table[i];
+
+        switch (e->state) {
+        case ARP_STATE_REACHABLE:
+            if ((tick_t)(now - e->confirmed) < ARP_TIMEOUT_TICKS) {
+                continue;
+            }
+            if ((tick_t)(now - e->used) >= ARP_TIMEOUT_TICKS) {
+                arp_release(e);
+                continue;
+            }
+            e->state = ARP_STATE_STALE;
+            e->probes = 0;
+            break;
+
+        case ARP_STATE_INCOMPLETE:
+        case ARP_STATE_STALE:
+            if ((tick_t)(now - e->probed) < ARP_RETRANS_TICKS) {
+                continue;
+            }
+            if (e->probes >= ARP_MAX_PROBES) {
+                arp_release(e);
+                continue;
+            }
+            break;
+
+        default:
+            continue;
+        }
+
+        /* Probe; entries beyond this pass's budget wait a second */
+        if (nprobe < ARP_PROBES_PER_PASS) {
+            e->probes++;
+            e->probed = now;
+            probe[nprobe].nif = e->nif;
+            probe[nprobe].ip = e->ip;
+            nprobe++;
+        }
+    }
+
+    spin_unlock_irq(&arp_lock);
+
+    for (int i = 0; i < nprobe; i++) {
+        arp_send_request(probe[i].nif, probe[i].ip);
+    }
+}
+
+/*
+ * Get Statistics
+ */
+void arp_get_stats(arp_stats_t *stats)
+{
+    if (stats == NULL) return;
+
+    spin_lock_irq(&arp_lock);
+    stats->entries = arp_stats.entries;
+    stats->hits = arp_stats.hits;
+    stats->misses = arp_stats.misses;
+    stats->queued = arp_stats.queued;
+    stats->dropped = arp_stats.dropped;
+    stats->evictions = arp_stats.evictions;
+    spin_unlock_irq(&arp_lock);
+}
@@ -23,34 +23,36 @@
  * Lightweight TCP/IP Stack Implementation
  */
 
+#define ZBUF_OWNER  ZBUF_OWNER_NET
+
 #include "net_stack.h"
 #include "rtos_config.h"
 #include "rtos_types.h"
 
 extern void sem_post(semaphore_t *sem);
+extern uint64_t timer_get_ns(void);
 
 /* Network Interface List */
 static netif_t *netif_list = NULL;
 static netif_t *netif_default = NULL;
 static spinlock_t netif_lock = SPINLOCK_INIT;
 
+/* Link-Layer Protocol Handlers; a slot is live while handler != NULL */
+typedef struct {
+    uint16_t                        type;
+    netif_t                         *nif;
+    void                            *arg;
+    volatile netif_proto_handler_t  handler;
+} netif_proto_t;
+
+static netif_proto_t netif_protos[CONFIG_NET_PROTO_HANDLERS];
+static spinlock_t netif_proto_lock = SPINLOCK_INIT;
+
 /* Socket Table */
 socket_t *socket_table[CONFIG_NET_MAX_SOCKETS];
 spinlock_t socket_lock = SPINLOCK_INIT;
 static int next_fd __attribute__((unused)) = 0;
 
-/* ARP Cache */
-#define ARP_CACHE_SIZE  64
-typedef struct {
-    uint32_t    ip;
-    uint8_t     mac[6];
-    tick_t      expire;
-    bool        valid;
-} arp_entry_t;
-
-static arp_entry_t arp_cache[ARP_CACHE_SIZE];
-static spinlock_t arp_lock = SPINLOCK_INIT;
-
 /* TCP Connections */
 static socket_t *tcp_listen_list __attribute__((unused)) = NULL;
 static socket_t *tcp_conn_list __attribute__((unused)) = NULL;
@@ -73,65 +75,33 @@ uint32_t htonl(uint32_t h)
 uint16_t ntohs(uint16_t n) { return htons(n); }
 uint32_t ntohl(uint32_t n) { return htonl(n); }
 
-/*
- * Internet Checksum
- */
-uint16_t inet_checksum(const void *data, size_t len)
-{
-    const uint16_t *ptr = (const uint16_t *)data;
-    uint32_t sum = 0;
-
-    while (len > 1) {
-        sum += *ptr++;
-        len -= 2;
-    }
-
-    if (len == 1) {
-        sum += *(const uint8_t *)ptr;
-    }
-
-    while (sum >> 16) {
-        sum = (sum & 0xFFFF) + (sum >> 16);
-    }
-
-    return ~sum;
-}
-
-uint16_t inet_pseudo_checksum(uint32_t src, uint32_t dst, uint8_t proto, uint16_t len)
-{
-    uint32_t sum = 0;
-    sum += (src >> 16) & 0xFFFF;
-    sum += src & 0xFFFF;
-    sum += (dst >> 16) & 0xFFFF;
-    sum += dst & 0xFFFF;
-    sum += htons(proto);
-    sum += htons(len);
-
-    while (sum >> 16) {
-        sum = (sum & 0xFFFF) + (sum >> 16);
-    }
-
-    return sum;
-}
-
 /*
  * Network Stack Initialization
  */
 void net_stack_init(void)
 {
-    /* Initialize ARP cache */
-    for (int i = 0; i < ARP_CACHE_SIZE; i++) {
-        arp_cache[i].valid = false;
+    /* Initialize neighbor and routing tables */
+    arp_init();
+    route_init();
+    net_cls_init();
+
+    for (int i = 0; i < CONFIG_NET_PROTO_HANDLERS; i++) {
+        netif_protos[i].handler = NULL;
     }
 
     /* Initialize socket table */
     for (int i = 0; i < CONFIG_NET_MAX_SOCKETS; i++) {
         socket_table[i] = NULL;
     }
+    sock_hash_init();
+    tcp_init();
 }
 
 /*
  * Network Interface Management
+ *
+ * An interface with an address gets a connected route for its subnet
+ * and, if it has a gateway and none exists yet, the default route.
  */
 status_t netif_register(netif_t *nif)
 {
@@ -145,6 +115,22 @@ status_t netif_register(netif_t *nif)
     }
 
     spin_unlock_irq(&netif_lock);
+
+    route_iface_update(nif);
+    return STATUS_OK;
+}
+
+status_t netif_set_addr(netif_t *nif, uint32_t ip, uint32_t netmask, uint32_t gateway)
+{
+    if (nif == NULL) return STATUS_INVALID;
+
+    spin_lock_irq(&netif_lock);
+    nif->ip = ip;
+    nif->netmask = netmask;
+    nif->gateway = gateway;
+    spin_unlock_irq(&netif_lock);
+
+    route_iface_update(nif);
     return STATUS_OK;
 }
 
@@ -154,12 +140,34 @@ netif_t *netif_get_default(void)
 }
 
 /*
- * Ethernet Output
+ * Interface owning a local address, NULL if none
+ */
+netif_t *netif_find_addr(uint32_t ip)
+{
+    spin_lock_irq(&netif_lock);
+
+    netif_t *nif = netif_list;
+    while (nif != NULL && nif->ip != ip) {
+        nif = nif->next;
+    }
+
+    spin_unlock_irq(&netif_lock);
+    return nif;
+}
+
+/*
+ * Ethernet Header
+ *
+ * Tagged when the interface is on a VLAN or the sender asked for a
+ * priority tag (ZBUF_F_VLAN, VID 0); the tag carries zb->priority.
  */
-static status_t eth_output(netif_t *nif, zbuf_t *zb, const uint8_t *dst_mac, uint16_t type)
+status_t eth_header(netif_t *nif, zbuf_t *zb, const uint8_t *dst_mac, uint16_t type)
 {
+    bool tagged = nif->vlan_id != 0 || (zb->flags & ZBUF_F_VLAN);
+    uint16_t hdr_len = tagged ? ETH_HDR_LEN + VLAN_HDR_LEN : ETH_HDR_LEN;
+
     /* Push Ethernet header */
-    eth_hdr_t *eth = (eth_hdr_t *)zbuf_push(zb, ETH_HDR_LEN);
+    eth_hdr_t *eth = (eth_hdr_t *)zbuf_push(zb, hdr_len);
     if (eth == NULL) {
         zbuf_free(zb);
         return STATUS_NO_MEM;
@@ -170,17 +178,139 @@ static status_t eth_output(netif_t *nif, zbuf_t *zb, const uint8_t *dst_mac, uin
         eth->dst[i] = dst_mac[i];
         eth->src[i] = nif->mac[i];
     }
-    eth->type = htons(type);
+
+    if (tagged) {
+        vlan_hdr_t *vh = (vlan_hdr_t *)(eth + 1);
+        zb->vlan_tci = VLAN_TCI(zb->priority & 7, nif->vlan_id);
+        zb->flags |= ZBUF_F_VLAN;
+        eth->type = htons(ETH_TYPE_VLAN);
+        vh->tci = htons(zb->vlan_tci);
+        vh->type = htons(type);
+    } else {
+        eth->type = htons(type);
+    }
 
     /* Set protocol offsets */
     zb->l2_offset = 0;
     zb->protocol = type;
 
-    /* Send via driver */
-    nif->tx_packets++;
-    nif->tx_bytes += zb->len;
+    return STATUS_OK;
+}
+
+/*
+ * Ethernet Output
+ */
+status_t eth_output(netif_t *nif, zbuf_t *zb, const uint8_t *dst_mac, uint16_t type)
+{
+    status_t ret = eth_header(nif, zb, dst_mac, type);
+    if (ret != STATUS_OK) {
+        return ret;
+    }
+
+    /* Through the priority queues to the driver */
+    return netif_xmit(nif, zb);
+}
+
+/*
+ * Link-Layer Protocol Handlers
+ *
+ * Protocol modules that run directly on Ethernet (PROFINET RT and DCP)
+ * register their ethertype and get frames straight from netif_input(),
+ * in the driver's RX context, without copying or queueing. nif == NULL
+ * registers for every interface; a per-interface entry wins over it.
+ * The RX path reads the table without the lock: a slot's fields are
+ * written before its handler is published.
+ */
+status_t netif_add_proto(netif_t *nif, uint16_t type, netif_proto_handler_t handler, void *arg)
+{
+    if (handler == NULL || type == ETH_TYPE_IP || type == ETH_TYPE_ARP ||
+        type == ETH_TYPE_VLAN) {
+        return STATUS_INVALID;
+    }
+
+    netif_proto_t *slot = NULL;
+    status_t ret = STATUS_OK;
+
+    spin_lock_irq(&netif_proto_lock);
+
+    for (int i = 0; i < CONFIG_NET_PROTO_HANDLERS; i++) {
+        netif_proto_t *p = &netif_protos[i];
+        if (p->handler == NULL) {
+            if (slot == NULL) {
+                slot = p;
+            }
+        } else if (p->type == type && p->nif == nif) {
+            ret = STATUS_BUSY;
+            break;
+        }
+    }
+
+    if (ret == STATUS_OK) {
+        if (slot == NULL) {
+            ret = STATUS_NO_MEM;
+        } else {
+            slot->type = type;
+            slot->nif = nif;
+            slot->arg = arg;
+            dmb();
+            slot->handler = handler;
+        }
+    }
+
+    spin_unlock_irq(&netif_proto_lock);
 
-    return nif->send(nif, zb);
+    return ret;
+}
+
+status_t netif_del_proto(netif_t *nif, uint16_t type)
+{
+    status_t ret = STATUS_INVALID;
+
+    spin_lock_irq(&netif_proto_lock);
+
+    for (int i = 0; i < CONFIG_NET_PROTO_HANDLERS; i++) {
+        netif_proto_t *p = &netif_protos[i];
+        if (p->handler != NULL && p->type == type && p->nif == nif) {
+            p->handler = NULL;
+            dmb();
+            ret = STATUS_OK;
+            break;
+        }
+    }
+
+    spin_unlock_irq(&netif_proto_lock);
+
+    return ret;
+}
+
+static void netif_proto_input(netif_t *nif, zbuf_t *zb)
+{
+    netif_proto_t *match = NULL;
+    netif_proto_handler_t handler = NULL;
+
+    for (int i = 0; i < CONFIG_NET_PROTO_HANDLERS; i++) {
+        netif_proto_t *p = &netif_protos[i];
+        netif_proto_handler_t h = p->handler;
+
+        if (h == NULL || p->type != zb->protocol) continue;
+
+        if (p->nif == nif) {
+            match = p;
+            handler = h;
+            break;
+        }
+        if (p->nif == NULL && match == NULL) {
+            match = p;
+            handler = h;
+        }
+    }
+
+    if (match == NULL) {
+        zbuf_free(zb);
+        return;
+    }
+
+    handler(nif, zb, match->arg);
 }
 
 /*
@@ -195,19 +325,48 @@ void netif_input(netif_t *nif, zbuf_t *zb)
 
     eth_hdr_t *eth = (eth_hdr_t *)zb->data;
     uint16_t type = ntohs(eth->type);
+    uint16_t hdr_len = ETH_HDR_LEN;
+
+    /* Strip an 802.1Q tag; other VLANs than ours are not for us */
+    if (type == ETH_TYPE_VLAN) {
+        if (zb->len < ETH_HDR_LEN + VLAN_HDR_LEN) {
+            zbuf_free(zb);
+            return;
+        }
+
+        vlan_hdr_t *vh = (vlan_hdr_t *)(eth + 1);
+        uint16_t tci = ntohs(vh->tci);
+        uint16_t vid = tci & VLAN_VID_MASK;
+
+        if (vid != 0 && vid != nif->vlan_id) {
+            zbuf_free(zb);
+            return;
+        }
+
+        zb->vlan_tci = tci;
+        zb->priority = tci >> VLAN_PCP_SHIFT;
+        zb->flags |= ZBUF_F_VLAN;
+        type = ntohs(vh->type);
+        hdr_len += VLAN_HDR_LEN;
+    }
 
     /* Set layer offsets */
     zb->l2_offset = 0;
-    zb->l3_offset = ETH_HDR_LEN;
+    zb->l3_offset = hdr_len;
     zb->protocol = type;
     zb->netif = nif;
 
     /* Pull Ethernet header */
-    zbuf_pull(zb, ETH_HDR_LEN);
+    zbuf_pull(zb, hdr_len);
 
     nif->rx_packets++;
     nif->rx_bytes += zb->len;
 
+    /* Early classifier: drop, queue or redirect before protocol work */
+    if (net_classify(nif, zb)) {
+        return;
+    }
+
     /* Dispatch by protocol */
     switch (type) {
     case ETH_TYPE_IP:
@@ -216,118 +375,12 @@ void netif_input(netif_t *nif, zbuf_t *zb)
     case ETH_TYPE_ARP:
         arp_input(nif, zb);
         break;
-    case ETH_TYPE_PNIO:
-        /* PROFINET - handled separately */
-        zbuf_free(zb);
-        break;
     default:
-        zbuf_free(zb);
+        netif_proto_input(nif, zb);
         break;
     }
 }
 
-/*
- * ARP Functions
- */
-void arp_input(netif_t *nif, zbuf_t *zb)
-{
-    if (zb->len < sizeof(arp_hdr_t)) {
-        zbuf_free(zb);
-        return;
-    }
-
-    arp_hdr_t *arp = (arp_hdr_t *)zb->data;
-
-    /* Only handle Ethernet/IPv4 */
-    if (ntohs(arp->htype) != 1 || ntohs(arp->ptype) != ETH_TYPE_IP) {
-        zbuf_free(zb);
-        return;
-    }
-
-    uint32_t spa = ntohl(arp->spa);
-    uint32_t tpa = ntohl(arp->tpa);
-
-    /* Update ARP cache */
-    spin_lock(&arp_lock);
-    for (int i = 0; i < ARP_CACHE_SIZE; i++) {
-        if (!arp_cache[i].valid) {
-            arp_cache[i].ip = spa;
-            for (int j = 0; j < 6; j++) {
-                arp_cache[i].mac[j] = arp->sha[j];
-            }
-            arp_cache[i].expire = get_system_ticks() + 300000; /* 5 min */
-            arp_cache[i].valid = true;
-            break;
-        }
-    }
-    spin_unlock(&arp_lock);
-
-    /* Check if request is for us */
-    if (ntohs(arp->oper) == ARP_OP_REQUEST && tpa == nif->ip) {
-        /* Send reply */
-        zbuf_t *reply = zbuf_alloc_tx(sizeof(arp_hdr_t));
-        if (reply != NULL) {
-            arp_hdr_t *rep = (arp_hdr_t *)zbuf_put(reply, sizeof(arp_hdr_t));
-            rep->htype = htons(1);
-            rep->ptype = htons(ETH_TYPE_IP);
-            rep->hlen = 6;
-            rep->plen = 4;
-            rep->oper = htons(ARP_OP_REPLY);
-            for (int i = 0; i < 6; i++) {
-                rep->sha[i] = nif->mac[i];
-                rep->tha[i] = arp->sha[i];
-            }
-            rep->spa = htonl(nif->ip);
-            rep->tpa = arp->spa;
-
-            eth_output(nif, reply, arp->sha, ETH_TYPE_ARP);
-        }
-    }
-
-    zbuf_free(zb);
-}
-
-status_t arp_resolve(uint32_t ip, uint8_t *mac)
-{
-    /* Check cache */
-    spin_lock(&arp_lock);
-    for (int i = 0; i < ARP_CACHE_SIZE; i++) {
-        if (arp_cache[i].valid && arp_cache[i].ip == ip) {
-            for (int j = 0; j < 6; j++) {
-                mac[j] = arp_cache[i].mac[j];
-            }
-            spin_unlock(&arp_lock);
-            return STATUS_OK;
-        }
-    }
-    spin_unlock(&arp_lock);
-
-    /* Send ARP request */
-    netif_t *nif = netif_default;
-    if (nif == NULL) return STATUS_ERROR;
-
-    zbuf_t *zb = zbuf_alloc_tx(sizeof(arp_hdr_t));
-    if (zb == NULL) return STATUS_NO_MEM;
-
-    arp_hdr_t *arp = (arp_hdr_t *)zbuf_put(zb, sizeof(arp_hdr_t));
-    arp->htype = htons(1);
-    arp->ptype = htons(ETH_TYPE_IP);
-    arp->hlen = 6;
-    arp->plen = 4;
-    arp->oper = htons(ARP_OP_REQUEST);
-    for (int i = 0; i < 6; i++) {
-        arp->sha[i] = nif->mac[i];
-        arp->tha[i] = 0xFF;
-    }
-    arp->spa = htonl(nif->ip);
-    arp->tpa = htonl(ip);
-
-    uint8_t broadcast[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
-    eth_output(nif, zb, broadcast, ETH_TYPE_ARP);
-
-    return STATUS_WOULD_BLOCK;
-}
-
 /*
  * IP Functions
  */
@@ -340,17 +393,22 @@ void ip_input(netif_t *nif, zbuf_t *zb)
 
     ip_hdr_t *ip = (ip_hdr_t *)zb->data;
     uint8_t ihl = IP_HDR_LEN(ip);
+    uint16_t tot_len = ntohs(ip->len);
 
     /* Verify checksum */
-    if (inet_checksum(ip, ihl) != 0) {
+    if (ihl < sizeof(ip_hdr_t) || tot_len < ihl || tot_len > zb->len ||
+        inet_checksum(ip, ihl) != 0) {
         nif->rx_errors++;
         zbuf_free(zb);
         return;
     }
 
-    /* Check destination */
+    /* Drop Ethernet padding so L4 sees its real length */
+    zbuf_trim(zb, zb->len - tot_len);
+
+    /* Check destination; any local address is accepted on any port */
     uint32_t dst = ntohl(ip->dst);
-    if (dst != nif->ip && dst != IP4_ADDR_BROADCAST) {
+    if (dst != nif->ip && dst != IP4_ADDR_BROADCAST && netif_find_addr(dst) == NULL) {
         zbuf_free(zb);
         return;
     }
@@ -378,9 +436,35 @@ void ip_input(netif_t *nif, zbuf_t *zb)
     }
 }
 
+static status_t ip_transmit(netif_t *nif, zbuf_t *zb, uint32_t dst, uint32_t next_hop);
+
 status_t ip_output(zbuf_t *zb, uint32_t src, uint32_t dst, uint8_t proto)
 {
-    netif_t *nif = netif_default;
+    return ip_output_route(zb, src, dst, proto, NULL);
+}
+
+/*
+ * IP Output with Route Selection
+ *
+ * The interface and next hop come from the routing table, through the
+ * caller's cache when one is given. Limited broadcast has no route and
+ * leaves on the interface owning src, or the default one.
+ */
+status_t ip_output_route(zbuf_t *zb, uint32_t src, uint32_t dst, uint8_t proto,
+                         route_cache_t *rc)
+{
+    netif_t *nif;
+    uint32_t next_hop = dst;
+
+    if (dst == IP4_ADDR_BROADCAST) {
+        nif = (src != 0) ? netif_find_addr(src) : NULL;
+        if (nif == NULL) nif = netif_default;
+    } else if (rc != NULL) {
+        nif = route_lookup_cached(rc, dst, &next_hop);
+    } else {
+        nif = route_lookup(dst, &next_hop);
+    }
+
     if (nif == NULL) {
         zbuf_free(zb);
         return STATUS_ERROR;
@@ -399,38 +483,88 @@ status_t ip_output(zbuf_t *zb, uint32_t src, uint32_t dst, uint8_t proto)
 
     ip->ver_ihl = 0x45;  /* IPv4, 5 words */
     ip->tos = 0;
-    ip->len = htons(zb->len);
+    ip->len = htons(zbuf_pkt_len(zb));
     ip->id = htons(ip_id++);
-    ip->frag = 0;
-    ip->ttl = 64;
+    ip->frag = zb->gso_size ? htons(0x4000) : 0;  /* DF on TSO packets */
+    ip->ttl = IP_DEFAULT_TTL;
     ip->proto = proto;
     ip->checksum = 0;
     ip->src = htonl(src);
     ip->dst = htonl(dst);
     ip->checksum = inet_checksum(ip, sizeof(ip_hdr_t));
 
-    /* Resolve MAC address */
-    uint8_t dst_mac[6];
-    uint32_t next_hop = dst;
+    return ip_transmit(nif, zb, dst, next_hop);
+}
 
-    /* Use gateway for non-local addresses */
-    if ((dst & nif->netmask) != (nif->ip & nif->netmask)) {
-        next_hop = nif->gateway;
+/*
+ * Hand a packet with its IP header in place to the link layer
+ */
+static status_t ip_transmit(netif_t *nif, zbuf_t *zb, uint32_t dst, uint32_t next_hop)
+{
+    /* Limited or on-link directed broadcast */
+    uint32_t host = ~nif->netmask;
+    if (dst == IP4_ADDR_BROADCAST ||
+        (next_hop == dst && host != 0 && (dst & host) == host)) {
+        uint8_t dst_mac[6];
+        for (int i = 0; i < 6; i++) dst_mac[i] = 0xFF;
+        return eth_output(nif, zb, dst_mac, ETH_TYPE_IP);
     }
 
-    /* Broadcast */
-    if (dst == IP4_ADDR_BROADCAST || (dst & ~nif->netmask) == ~nif->netmask) {
-        for (int i = 0; i < 6; i++) dst_mac[i] = 0xFF;
-    } else {
-        status_t ret = arp_resolve(next_hop, dst_mac);
-        if (ret != STATUS_OK) {
-            /* Queue packet for ARP resolution */
-            zbuf_free(zb);
-            return ret;
-        }
+    /* Unicast: held by the neighbor table until resolved */
+    return arp_output(nif, zb, next_hop);
+}
+
+/*
+ * Rewrite TTL in place, patching the header checksum (RFC 1624)
+ */
+void ip_set_ttl(ip_hdr_t *ip, uint8_t ttl)
+{
+    uint16_t *word = (uint16_t *)&ip->ttl;  /* TTL and protocol share a word */
+    uint16_t old_word = *word;
+
+    ip->ttl = ttl;
+    ip->checksum = inet_csum_update16(ip->checksum, old_word, *word);
+}
+
+/*
+ * Send a packet back in the IP header it arrived with
+ *
+ * zb->data is the L4 header, ihl bytes past the received IP header.
+ * Swapping the addresses leaves the header sum as it was; the TTL, and
+ * the source when the request went to the broadcast address, are
+ * patched (RFC 1624), so the header is never summed again. Headers with
+ * options or fragment fields get a fresh one from ip_output() instead.
+ */
+static status_t ip_reply(zbuf_t *zb, uint16_t ihl)
+{
+    ip_hdr_t *ip = (ip_hdr_t *)(zb->data - ihl);
+    uint32_t src = ntohl(ip->dst);
+    uint32_t dst = ntohl(ip->src);
+
+    if (src == IP4_ADDR_BROADCAST) src = 0;
+
+    if (ihl != sizeof(ip_hdr_t) || (ip->frag & ~htons(0x4000)) != 0) {
+        return ip_output(zb, src, dst, ip->proto);
+    }
+
+    uint32_t next_hop = dst;
+    netif_t *nif = route_lookup(dst, &next_hop);
+    if (nif == NULL) {
+        zbuf_free(zb);
+        return STATUS_ERROR;
+    }
+
+    uint32_t old_src = ip->dst;
+    ip->dst = ip->src;
+    ip->src = old_src;
+    if (src == 0) {
+        ip->src = htonl(nif->ip);
+        ip->checksum = inet_csum_update32(ip->checksum, old_src, ip->src);
     }
+    ip_set_ttl(ip, IP_DEFAULT_TTL);
 
-    return eth_output(nif, zb, dst_mac, ETH_TYPE_IP);
+    zbuf_push(zb, ihl);
+    return ip_transmit(nif, zb, dst, next_hop);
 }
 
 /*
@@ -446,18 +580,14 @@ void icmp_input(netif_t *nif __attribute__((unused)), zbuf_t *zb)
     icmp_hdr_t *icmp = (icmp_hdr_t *)zb->data;
 
     if (icmp->type == ICMP_ECHO_REQUEST) {
-        /* Get original IP header */
-        ip_hdr_t *orig_ip = (ip_hdr_t *)(zb->data - sizeof(ip_hdr_t));
-        uint32_t src = ntohl(orig_ip->src);
-        uint32_t dst = ntohl(orig_ip->dst);
-
-        /* Modify ICMP header for reply */
+        /* Modify ICMP header for reply; only the type word changes */
+        uint16_t old_word = *(const uint16_t *)icmp;
         icmp->type = ICMP_ECHO_REPLY;
-        icmp->checksum = 0;
-        icmp->checksum = inet_checksum(icmp, zb->len);
+        icmp->checksum = inet_csum_update16(icmp->checksum, old_word,
+                                            *(const uint16_t *)icmp);
 
-        /* Send reply */
-        ip_output(zb, dst, src, IP_PROTO_ICMP);
+        /* Send reply in the request's own IP header */
+        ip_reply(zb, zb->l4_offset - zb->l3_offset);
     } else {
         zbuf_free(zb);
     }
@@ -480,37 +610,34 @@ void udp_input(netif_t *nif __attribute__((unused)), zbuf_t *zb)
     /* Get IP addresses from IP header */
     ip_hdr_t *ip = (ip_hdr_t *)(zb->data - sizeof(ip_hdr_t));
     uint32_t src_ip = ntohl(ip->src);
-    (void)src_ip;
-    uint32_t dst_ip __attribute__((unused)) = ntohl(ip->dst);
+    uint32_t dst_ip = ntohl(ip->dst);
 
     /* Find matching socket */
-    spin_lock(&socket_lock);
-    for (int i = 0; i < CONFIG_NET_MAX_SOCKETS; i++) {
-        socket_t *sock = socket_table[i];
-        if (sock != NULL && sock->type == SOCK_DGRAM) {
-            if (sock->local.port == dport) {
-                /* Set remote address */
-                sock->remote.addr = src_ip;
-                sock->remote.port = sport;
-
-                /* Pull UDP header */
-                zbuf_pull(zb, UDP_HDR_LEN);
-
-                /* Queue packet */
-                zbuf_queue_push(&sock->rx_queue, zb);
-                sem_post(&sock->rx_sem);
-
-                spin_unlock(&socket_lock);
-                return;
-            }
-        }
+    socket_t *sock = sock_lookup(SOCK_DGRAM, dst_ip, dport, src_ip, sport);
+    if (sock == NULL) {
+        zbuf_free(zb);
+        return;
     }
-    spin_unlock(&socket_lock);
 
-    zbuf_free(zb);
+    /* Sender and arrival time go with the datagram, not the socket */
+    zb->peer_addr = src_ip;
+    zb->peer_port = sport;
+    if (!(zb->flags & ZBUF_F_TIMESTAMP)) {
+        zb->timestamp = timer_get_ns();
+    }
+
+    /* Pull UDP header */
+    zbuf_pull(zb, UDP_HDR_LEN);
+
+    /* Queue packet */
+    zbuf_set_owner(zb, ZBUF_OWNER_SOCK);
+    zbuf_queue_push(&sock->rx_queue, zb);
+    sem_post(&sock->rx_sem);
+    sock_poll_notify(sock, SOCK_EV_IN);
+    sock_put(sock);
 }
 
-status_t udp_output(zbuf_t *zb, sockaddr_t *src, sockaddr_t *dst)
+status_t udp_output(zbuf_t *zb, sockaddr_t *src, sockaddr_t *dst, route_cache_t *rc)
 {
     /* Push UDP header */
     udp_hdr_t *udp = (udp_hdr_t *)zbuf_push(zb, UDP_HDR_LEN);
@@ -524,5 +651,5 @@ status_t udp_output(zbuf_t *zb, sockaddr_t *src, sockaddr_t *dst)
     udp->len = htons(zb->len);
     udp->checksum = 0;  /* Optional for UDP over IPv4 */
 
-    return ip_output(zb, src->addr, dst->addr, IP_PROTO_UDP);
+    return ip_output_route(zb, src->addr, dst->addr, IP_PROTO_UDP, rc);
 }
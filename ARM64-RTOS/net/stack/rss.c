@@ -0,0 +1,152 @@
+/*
+ * Gracemont Industrial Control Framework - ARM64 RTOS
+ * Copyright (C) 2024 Zixiao System <https://github.com/Zixiao-System>
+ *
+ * This file is part of Gracemont Industrial Control Framework.
+ * Repository: https://github.com/Zixiao-System/gracemont
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * Receive Side Scaling Flow Hash
+ *
+ * Toeplitz hash over the IPv4 addresses and, for unfragmented TCP and
+ * UDP, the ports, keyed with the well-known default RSS key so results
+ * match what RSS capable hardware reports for the same packet. The
+ * multi-queue Ethernet driver uses it to keep every flow on one queue
+ * pair; the result is left in zb->hash for the rest of the stack.
+ */
+
+#include "net_stack.h"
+
+/* Default RSS key (Microsoft RSS verification suite) */
+static const uint8_t rss_key[40] = {
+    0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2,
+    0x41, 0x67, 0x25, 0x3d, 0x43, 0xa3, 0x8f, 0xb0,
+    0xd0, 0xca, 0x2b, 0xcb, 0xae, 0x7b, 0x30, 0xb4,
+    0x77, 0xcb, 0x2d, 0xa3, 0x80, 0x30, 0xf2, 0x0c,
+    0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa
+};
+
+/* IP fragment fields */
+#define IP_FRAG_MF          0x2000
+#define IP_FRAG_OFFSET      0x1FFF
+
+static inline uint8_t rss_key_byte(const uint8_t *key, size_t key_len, size_t i)
+{
+    return i < key_len ? key[i] : 0;
+}
+
+/*
+ * Toeplitz Hash
+ *
+ * For every set input bit the 32-bit key window starting at that bit
+ * position is XORed into the result. Key bits past key_len read as zero.
+ */
+uint32_t rss_toeplitz(const uint8_t *key, size_t key_len, const uint8_t *data, size_t len)
+{
+    uint32_t result = 0;
+    uint32_t window = ((uint32_t)rss_key_byte(key, key_len, 0) << 24) |
+                      ((uint32_t)rss_key_byte(key, key_len, 1) << 16) |
+                      ((uint32_t)rss_key_byte(key, key_len, 2) << 8) |
+                      (uint32_t)rss_key_byte(key, key_len, 3);
+
+    for (size_t i = 0; i < len; i++) {
+        uint8_t in = data[i];
+        uint8_t next = rss_key_byte(key, key_len, i + 4);
+
+        for (int bit = 7; bit >= 0; bit--) {
+            if (in & (1 << bit)) {
+                result ^= window;
+            }
+            window = (window << 1) | ((next >> bit) & 1);
+        }
+    }
+
+    return result;
+}
+
+static inline void rss_put32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+/*
+ * Hash an IPv4 flow as seen on receive (host byte order arguments)
+ */
+uint32_t rss_hash_ipv4(uint32_t saddr, uint32_t daddr, uint16_t sport, uint16_t dport,
+                       bool ports)
+{
+    uint8_t input[12];
+
+    rss_put32(&input[0], saddr);
+    rss_put32(&input[4], daddr);
+    if (!ports) {
+        return rss_toeplitz(rss_key, sizeof(rss_key), input, 8);
+    }
+
+    rss_put32(&input[8], ((uint32_t)sport << 16) | dport);
+    return rss_toeplitz(rss_key, sizeof(rss_key), input, 12);
+}
+
+/*
+ * Hash the Ethernet frame at zb->data into zb->hash
+ *
+ * With reverse set the addresses and ports are swapped first, so an
+ * outgoing packet hashes like the replies it will get. Returns false,
+ * leaving the zbuf alone, for anything but IPv4.
+ */
+bool rss_hash_frame(zbuf_t *zb, bool reverse)
+{
+    const uint8_t *p = zb->data;
+    uint32_t len = zb->len;
+    uint32_t off = ETH_HDR_LEN;
+
+    if (len < ETH_HDR_LEN + sizeof(ip_hdr_t)) return false;
+
+    uint16_t type = ntohs(((const eth_hdr_t *)p)->type);
+    if (type == ETH_TYPE_VLAN) {
+        if (len < ETH_HDR_LEN + 4 + sizeof(ip_hdr_t)) return false;
+        type = ((uint16_t)p[16] << 8) | p[17];
+        off += 4;
+    }
+    if (type != ETH_TYPE_IP) return false;
+
+    const ip_hdr_t *ip = (const ip_hdr_t *)(p + off);
+    uint32_t ihl = IP_HDR_LEN(ip);
+    uint32_t saddr = ntohl(ip->src);
+    uint32_t daddr = ntohl(ip->dst);
+    uint16_t sport = 0;
+    uint16_t dport = 0;
+    bool ports = false;
+
+    /* Only the first fragment has ports; hash all fragments on addresses */
+    if ((ip->proto == IP_PROTO_TCP || ip->proto == IP_PROTO_UDP) &&
+        !(ntohs(ip->frag) & (IP_FRAG_MF | IP_FRAG_OFFSET)) &&
+        ihl >= sizeof(ip_hdr_t) && off + ihl + 4 <= len) {
+        const uint8_t *l4 = p + off + ihl;
+        sport = ((uint16_t)l4[0] << 8) | l4[1];
+        dport = ((uint16_t)l4[2] << 8) | l4[3];
+        ports = true;
+    }
+
+    zb->hash = reverse ? rss_hash_ipv4(daddr, saddr, dport, sport, ports)
+                       : rss_hash_ipv4(saddr, daddr, sport, dport, ports);
+    zb->flags |= ZBUF_F_HASH_VALID;
+    return true;
+}
@@ -0,0 +1,232 @@
+/*
+ * Gracemont Industrial Control Framework - ARM64 RTOS
+ * Copyright (C) 2024 Zixiao System <https://github.com/Zixiao-System>
+ *
+ * This file is part of Gracemont Industrial Control Framework.
+ * Repository: https://github.com/Zixiao-System/gracemont
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * Socket Demultiplexing
+ *
+ * Two hash tables replace the linear socket scans on the receive path:
+ * a 4-tuple table for TCP connections and a port table for listeners
+ * and bound UDP sockets.
+ *
+ * Each bucket has its own lock, taken with interrupts masked and held
+ * only for a walk of that one chain, so lookups that land in different
+ * buckets do not serialize on each other. Sockets are found from the
+ * eth-poll task, which a task closing the socket can preempt, so a
+ * lookup takes a reference before the bucket lock is dropped; the input
+ * path returns it with sock_put() and the last reference frees the
+ * socket. Once sock_hash_remove() returns no new lookup can find the
+ * socket, and any earlier one still holds its reference.
+ *
+ * A rehash unlinks the socket from its old chain before linking it on
+ * the new one, so a lookup racing it may miss the socket for that
+ * window, as it would had the segment arrived just before the bind or
+ * connect. Insert and remove of one socket are serialized by its owner.
+ */
+
+#include "net_stack.h"
+#include "rtos_config.h"
+#include "rtos.h"
+
+#define SOCK_HASH_MASK      (CONFIG_NET_SOCK_HASH_SIZE - 1)
+
+#if (CONFIG_NET_SOCK_HASH_SIZE & SOCK_HASH_MASK) != 0
+#error "CONFIG_NET_SOCK_HASH_SIZE must be a power of two"
+#endif
+
+struct sock_bucket {
+    socket_t        *head;
+    spinlock_t      lock;
+};
+
+static struct sock_bucket sock_conn_hash[CONFIG_NET_SOCK_HASH_SIZE];
+static struct sock_bucket sock_port_hash[CONFIG_NET_SOCK_HASH_SIZE];
+static uint32_t sock_hash_seed;
+
+/*
+ * The local address is left out of the 4-tuple hash so a connection
+ * bound to the wildcard address hashes the same as one bound to a
+ * specific address; it is still compared on lookup.
+ */
+static inline uint32_t sock_conn_hashfn(uint16_t lport, uint32_t raddr, uint16_t rport)
+{
+    uint32_t h = sock_hash_seed;
+
+    h ^= raddr;
+    h *= 0x9E3779B1;
+    h ^= ((uint32_t)lport << 16) | rport;
+    h *= 0x85EBCA6B;
+    h ^= h >> 16;
+
+    return h & SOCK_HASH_MASK;
+}
+
+static inline uint32_t sock_port_hashfn(uint16_t lport)
+{
+    return ((lport * 0x9E3779B1) >> 16) & SOCK_HASH_MASK;
+}
+
+/*
+ * The chain is the one recorded at insert: bind and connect change the
+ * key before they rehash, so it cannot be found from the key again.
+ */
+static void sock_hash_unlink(socket_t *sock)
+{
+    struct sock_bucket *b = sock->hbucket;
+    if (b == NULL) return;
+
+    spin_lock_irq(&b->lock);
+
+    socket_t **pp = &b->head;
+    while (*pp != NULL && *pp != sock) {
+        pp = &(*pp)->hnext;
+    }
+    if (*pp == sock) {
+        *pp = sock->hnext;
+    }
+    sock->hbucket = NULL;
+
+    spin_unlock_irq(&b->lock);
+}
+
+/*
+ * Initialize Demux Tables
+ */
+void sock_hash_init(void)
+{
+    static const spinlock_t unlocked = SPINLOCK_INIT;
+
+    for (int i = 0; i < CONFIG_NET_SOCK_HASH_SIZE; i++) {
+        sock_conn_hash[i].head = NULL;
+        sock_conn_hash[i].lock = unlocked;
+        sock_port_hash[i].head = NULL;
+        sock_port_hash[i].lock = unlocked;
+    }
+
+    /* Keep bucket placement from being predictable off the wire */
+    sock_hash_seed = get_system_ticks() * 0x9E3779B1;
+}
+
+/*
+ * Insert a socket
+ *
+ * TCP sockets with a remote endpoint go into the 4-tuple table,
+ * listeners and UDP sockets into the port table. A socket already in a
+ * table is moved, so this is also the rehash after bind or connect.
+ */
+void sock_hash_insert(socket_t *sock)
+{
+    sock_hash_unlink(sock);
+
+    struct sock_bucket *b;
+    if (sock->type == SOCK_STREAM && sock->state != TCP_LISTEN &&
+        sock->remote.port != 0) {
+        b = &sock_conn_hash[sock_conn_hashfn(sock->local.port,
+                                             sock->remote.addr,
+                                             sock->remote.port)];
+    } else {
+        b = &sock_port_hash[sock_port_hashfn(sock->local.port)];
+    }
+
+    spin_lock_irq(&b->lock);
+    sock->hnext = b->head;
+    sock->hbucket = b;
+    b->head = sock;
+    spin_unlock_irq(&b->lock);
+}
+
+/*
+ * Remove a socket
+ */
+void sock_hash_remove(socket_t *sock)
+{
+    sock_hash_unlink(sock);
+}
+
+/* Walk one bucket and return its match with a reference held */
+static socket_t *sock_conn_find(uint32_t laddr, uint16_t lport,
+                                uint32_t raddr, uint16_t rport)
+{
+    struct sock_bucket *b = &sock_conn_hash[sock_conn_hashfn(lport, raddr, rport)];
+    socket_t *sock;
+
+    spin_lock_irq(&b->lock);
+    for (sock = b->head; sock != NULL; sock = sock->hnext) {
+        if (sock->local.port == lport &&
+            sock->remote.port == rport &&
+            sock->remote.addr == raddr &&
+            (sock->local.addr == 0 || sock->local.addr == laddr)) {
+            atomic_add(&sock->refcnt, 1);
+            break;
+        }
+    }
+    spin_unlock_irq(&b->lock);
+
+    return sock;
+}
+
+static socket_t *sock_port_find(int type, uint32_t laddr, uint16_t lport)
+{
+    struct sock_bucket *b = &sock_port_hash[sock_port_hashfn(lport)];
+    socket_t *sock, *wildcard = NULL;
+
+    spin_lock_irq(&b->lock);
+    for (sock = b->head; sock != NULL; sock = sock->hnext) {
+        if (sock->type != type || sock->local.port != lport) {
+            continue;
+        }
+        if (sock->local.addr == laddr) {
+            break;
+        }
+        if (sock->local.addr == 0 && wildcard == NULL) {
+            wildcard = sock;
+        }
+    }
+    if (sock == NULL) {
+        sock = wildcard;
+    }
+    if (sock != NULL) {
+        atomic_add(&sock->refcnt, 1);
+    }
+    spin_unlock_irq(&b->lock);
+
+    return sock;
+}
+
+/*
+ * Find the socket for an incoming segment or datagram
+ *
+ * A TCP connection matching the full 4-tuple wins over a listener. In
+ * the port table a socket bound to the destination address wins over
+ * one bound to the wildcard address. The socket comes with a reference
+ * the caller drops with sock_put().
+ */
+socket_t *sock_lookup(int type, uint32_t laddr, uint16_t lport,
+                      uint32_t raddr, uint16_t rport)
+{
+    if (type == SOCK_STREAM) {
+        socket_t *sock = sock_conn_find(laddr, lport, raddr, rport);
+        if (sock != NULL) {
+            return sock;
+        }
+    }
+
+    return sock_port_find(type, laddr, lport);
+}
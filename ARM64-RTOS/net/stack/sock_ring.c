@@ -0,0 +1,437 @@
+/*
+ * Gracemont Industrial Control Framework - ARM64 RTOS
+ * Copyright (C) 2024 Zixiao System <https://github.com/Zixiao-System>
+ *
+ * This file is part of Gracemont Industrial Control Framework.
+ * Repository: https://github.com/Zixiao-System/gracemont
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * Asynchronous Socket Operations
+ *
+ * A ring lets one task keep many sends, receives and accepts in flight.
+ * Operations are written to the submission ring and started in a batch
+ * by sock_ring_submit(); results are reaped from the completion ring by
+ * sock_ring_wait(). Buffers move by pointer both ways.
+ *
+ * An operation that can complete at once does so during submit. The
+ * rest wait in submission order, and their sockets are watched through
+ * the ring's own poll set; a wait sleeps on that one semaphore and
+ * retries only the operations of the sockets reported. Operations in
+ * the same direction on a socket complete in the order submitted.
+ *
+ * A ring belongs to the task that uses it. Cancel the operations on a
+ * socket before closing it.
+ */
+
+#include "net_stack.h"
+#include "rtos_config.h"
+#include "rtos.h"
+
+extern socket_t *socket_table[CONFIG_NET_MAX_SOCKETS];
+
+typedef struct sock_ring_op {
+    sock_sqe_t          sqe;
+    socket_t            *sock;
+    struct sock_ring_op *next;
+} sock_ring_op_t;
+
+struct sock_ring {
+    uint32_t            mask;       /* Entries - 1 */
+    uint32_t            sq_head;    /* Next to start */
+    uint32_t            sq_tail;    /* Next handed out */
+    uint32_t            cq_head;    /* Next to reap */
+    uint32_t            cq_tail;
+    uint32_t            inflight;   /* Started, not yet reaped */
+    sock_ring_op_t      *pend;      /* Waiting on their sockets, in order */
+    sock_ring_op_t      *pend_tail;
+    sock_ring_op_t      *free;
+    sock_poll_t         *ps;        /* Sockets with operations waiting */
+    uint8_t             watch[CONFIG_NET_MAX_SOCKETS];  /* SOCK_EV_* watched, by slot */
+    sock_sqe_t          *sq;
+    sock_cqe_t          *cq;
+    sock_event_t        *ev;
+    sock_ring_op_t      op[];
+};
+
+/* What an operation waits for: room to send, or something to take */
+static uint32_t sock_ring_dir(const sock_ring_op_t *op)
+{
+    return (op->sqe.op == SOCK_OP_SEND) ? SOCK_EV_OUT : SOCK_EV_IN;
+}
+
+static void sock_ring_complete(sock_ring_t *ring, const sock_cqe_t *cqe)
+{
+    ring->cq[ring->cq_tail++ & ring->mask] = *cqe;
+}
+
+static void sock_ring_fail(sock_ring_t *ring, const sock_sqe_t *sqe)
+{
+    sock_cqe_t cqe = { .res = -1, .zb = NULL, .addr = { 0, 0 }, .data = sqe->data };
+
+    if (sqe->op == SOCK_OP_SEND && sqe->zb != NULL) {
+        zbuf_free(sqe->zb);
+    }
+    sock_ring_complete(ring, &cqe);
+}
+
+/* An earlier operation in the same direction on the socket, before stop */
+static bool sock_ring_behind(sock_ring_t *ring, const sock_ring_op_t *op,
+                             const sock_ring_op_t *stop)
+{
+    for (sock_ring_op_t *p = ring->pend; p != stop; p = p->next) {
+        if (p->sqe.fd == op->sqe.fd && sock_ring_dir(p) == sock_ring_dir(op)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Run an operation without waiting; true if it completed */
+static bool sock_ring_try(sock_ring_t *ring, sock_ring_op_t *op)
+{
+    socket_t *sock = op->sock;
+    sock_cqe_t cqe = { .res = -1, .zb = NULL, .addr = { 0, 0 }, .data = op->sqe.data };
+    status_t ret;
+
+    switch (op->sqe.op) {
+    case SOCK_OP_SEND: {
+        uint32_t len = zbuf_pkt_len(op->sqe.zb);
+        ret = tcp_send_zbuf(sock, op->sqe.zb, false);
+        if (ret == STATUS_WOULD_BLOCK) return false;
+        if (ret == STATUS_OK) {
+            cqe.res = (int)len;
+        }
+        break;
+    }
+
+    case SOCK_OP_RECV:
+        ret = sock_rx_pop(sock, false, &cqe.zb);
+        if (ret == STATUS_WOULD_BLOCK) return false;
+        if (cqe.zb != NULL) {
+            cqe.res = cqe.zb->len;
+        } else if (sock->type == SOCK_STREAM && sock->state != TCP_CLOSED) {
+            cqe.res = 0;    /* End of stream */
+        }
+        break;
+
+    default: {      /* SOCK_OP_ACCEPT */
+        socket_t *conn;
+        ret = tcp_accept_conn(sock, false, &conn);
+        if (ret == STATUS_WOULD_BLOCK) return false;
+        if (ret == STATUS_OK) {
+            cqe.res = conn->fd;
+            cqe.addr = conn->remote;
+        }
+        break;
+    }
+    }
+
+    sock_ring_complete(ring, &cqe);
+    return true;
+}
+
+/* Watch the socket for what its waiting operations need, if anything */
+static void sock_ring_watch(sock_ring_t *ring, int fd)
+{
+    uint32_t ev = 0;
+    for (sock_ring_op_t *p = ring->pend; p != NULL; p = p->next) {
+        if (p->sqe.fd == fd) {
+            ev |= sock_ring_dir(p);
+        }
+    }
+
+    uint8_t *w = &ring->watch[fd % CONFIG_NET_MAX_SOCKETS];
+    if (ev == *w) return;
+
+    if (ev == 0) {
+        sock_poll_ctl(ring->ps, SOCK_POLL_DEL, fd, 0, NULL);
+    } else if (*w == 0 ||
+               sock_poll_ctl(ring->ps, SOCK_POLL_MOD, fd, ev | SOCK_EV_ET, NULL) != 0) {
+        sock_poll_ctl(ring->ps, SOCK_POLL_ADD, fd, ev | SOCK_EV_ET, NULL);
+    }
+    *w = (uint8_t)ev;
+}
+
+/* Start one submission: complete it now or leave it waiting */
+static void sock_ring_start(sock_ring_t *ring, const sock_sqe_t *sqe)
+{
+    socket_t *sock = socket_table[sqe->fd % CONFIG_NET_MAX_SOCKETS];
+    bool ok = (sock != NULL && sock->fd == sqe->fd);
+
+    if (ok) {
+        switch (sqe->op) {
+        case SOCK_OP_SEND:
+            ok = (sock->type == SOCK_STREAM && sqe->zb != NULL);
+            break;
+        case SOCK_OP_RECV:
+            break;
+        case SOCK_OP_ACCEPT:
+            ok = (sock->state == TCP_LISTEN);
+            break;
+        default:
+            ok = false;
+            break;
+        }
+    }
+    if (!ok) {
+        sock_ring_fail(ring, sqe);
+        return;
+    }
+
+    /* inflight bounds the operations, so one is always free */
+    sock_ring_op_t *op = ring->free;
+    ring->free = op->next;
+    op->sqe = *sqe;
+    op->sock = sock;
+    op->next = NULL;
+
+    if (!sock_ring_behind(ring, op, NULL) && sock_ring_try(ring, op)) {
+        op->next = ring->free;
+        ring->free = op;
+        return;
+    }
+
+    if (ring->pend_tail != NULL) {
+        ring->pend_tail->next = op;
+    } else {
+        ring->pend = op;
+    }
+    ring->pend_tail = op;
+    sock_ring_watch(ring, sqe->fd);
+}
+
+/* Take op off the waiting list; prev is the one before it */
+static void sock_ring_unlink(sock_ring_t *ring, sock_ring_op_t *prev, sock_ring_op_t *op)
+{
+    if (prev != NULL) {
+        prev->next = op->next;
+    } else {
+        ring->pend = op->next;
+    }
+    if (ring->pend_tail == op) {
+        ring->pend_tail = prev;
+    }
+
+    op->next = ring->free;
+    ring->free = op;
+}
+
+/* Retry the waiting operations of the nev sockets in ring->ev */
+static void sock_ring_progress(sock_ring_t *ring, int nev)
+{
+    sock_ring_op_t *prev = NULL;
+    sock_ring_op_t *op = ring->pend;
+
+    while (op != NULL) {
+        sock_ring_op_t *next = op->next;
+        bool reported = false;
+
+        for (int i = 0; i < nev; i++) {
+            if (ring->ev[i].fd == op->sqe.fd) {
+                reported = true;
+                break;
+            }
+        }
+
+        if (reported && !sock_ring_behind(ring, op, op) && sock_ring_try(ring, op)) {
+            sock_ring_unlink(ring, prev, op);
+        } else {
+            prev = op;
+        }
+        op = next;
+    }
+
+    for (int i = 0; i < nev; i++) {
+        sock_ring_watch(ring, ring->ev[i].fd);
+    }
+}
+
+/*
+ * Create a ring of entries submissions and completions
+ *
+ * entries must be a power of two; it also bounds the operations in
+ * flight, counted from submit until reaped.
+ */
+sock_ring_t *sock_ring_create(uint32_t entries)
+{
+    if (entries == 0 || (entries & (entries - 1)) != 0) return NULL;
+
+    size_t size = sizeof(sock_ring_t) + entries * (sizeof(sock_ring_op_t) +
+                  sizeof(sock_sqe_t) + sizeof(sock_cqe_t) + sizeof(sock_event_t));
+    sock_ring_t *ring = heap_alloc(size);
+    if (ring == NULL) return NULL;
+
+    ring->ps = sock_poll_create(entries);
+    if (ring->ps == NULL) {
+        heap_free(ring);
+        return NULL;
+    }
+
+    ring->mask = entries - 1;
+    ring->sq_head = 0;
+    ring->sq_tail = 0;
+    ring->cq_head = 0;
+    ring->cq_tail = 0;
+    ring->inflight = 0;
+    ring->pend = NULL;
+    ring->pend_tail = NULL;
+    ring->sq = (sock_sqe_t *)&ring->op[entries];
+    ring->cq = (sock_cqe_t *)&ring->sq[entries];
+    ring->ev = (sock_event_t *)&ring->cq[entries];
+
+    for (uint32_t i = 0; i < CONFIG_NET_MAX_SOCKETS; i++) {
+        ring->watch[i] = 0;
+    }
+
+    ring->free = NULL;
+    for (uint32_t i = 0; i < entries; i++) {
+        ring->op[i].next = ring->free;
+        ring->free = &ring->op[i];
+    }
+
+    return ring;
+}
+
+/*
+ * Destroy a ring
+ *
+ * Waiting operations are dropped with their send buffers, and so are
+ * buffers received but not reaped.
+ */
+void sock_ring_destroy(sock_ring_t *ring)
+{
+    if (ring == NULL) return;
+
+    for (sock_ring_op_t *op = ring->pend; op != NULL; op = op->next) {
+        if (op->sqe.op == SOCK_OP_SEND) {
+            zbuf_free(op->sqe.zb);
+        }
+    }
+    while (ring->cq_head != ring->cq_tail) {
+        sock_cqe_t *cqe = &ring->cq[ring->cq_head++ & ring->mask];
+        if (cqe->zb != NULL) {
+            zbuf_free(cqe->zb);
+        }
+    }
+
+    sock_poll_destroy(ring->ps);
+    heap_free(ring);
+}
+
+/*
+ * Next free submission entry, or NULL while the ring is full
+ *
+ * The entry is started by the next sock_ring_submit().
+ */
+sock_sqe_t *sock_ring_get_sqe(sock_ring_t *ring)
+{
+    if (ring == NULL || ring->sq_tail - ring->sq_head > ring->mask) return NULL;
+
+    return &ring->sq[ring->sq_tail++ & ring->mask];
+}
+
+/*
+ * Start the entries filled in since the last submit
+ *
+ * Returns how many were started; the rest stay queued while the ring
+ * has as many operations in flight as entries.
+ */
+int sock_ring_submit(sock_ring_t *ring)
+{
+    if (ring == NULL) return -1;
+
+    int n = 0;
+    while (ring->sq_head != ring->sq_tail && ring->inflight <= ring->mask) {
+        sock_sqe_t *sqe = &ring->sq[ring->sq_head++ & ring->mask];
+        ring->inflight++;
+        sock_ring_start(ring, sqe);
+        n++;
+    }
+
+    return n;
+}
+
+/*
+ * Reap completions
+ *
+ * Fills up to max completions and returns how many. timeout is in
+ * ticks as for sock_poll_wait(). Returns 0 at once if nothing is in
+ * flight.
+ */
+int sock_ring_wait(sock_ring_t *ring, sock_cqe_t *cqe, uint32_t max, tick_t timeout)
+{
+    if (ring == NULL || cqe == NULL || max == 0) return -1;
+
+    tick_t start = get_system_ticks();
+
+    for (;;) {
+        uint32_t n = 0;
+        while (n < max && ring->cq_head != ring->cq_tail) {
+            cqe[n++] = ring->cq[ring->cq_head++ & ring->mask];
+        }
+        if (n > 0) {
+            ring->inflight -= n;
+            return (int)n;
+        }
+        if (ring->pend == NULL) {
+            return 0;
+        }
+
+        tick_t left = timeout;
+        if (timeout != 0 && timeout != SOCK_POLL_FOREVER) {
+            tick_t spent = get_system_ticks() - start;
+            if (spent >= timeout) return 0;
+            left = timeout - spent;
+        }
+
+        int nev = sock_poll_wait(ring->ps, ring->ev, ring->mask + 1, left);
+        sock_ring_progress(ring, nev);
+
+        if (timeout == 0 && ring->cq_head == ring->cq_tail) {
+            return 0;
+        }
+    }
+}
+
+/*
+ * Fail the waiting operations on a socket
+ *
+ * Each completes with -1, its send buffer freed. Returns how many.
+ */
+int sock_ring_cancel(sock_ring_t *ring, int fd)
+{
+    if (ring == NULL) return -1;
+
+    int n = 0;
+    sock_ring_op_t *prev = NULL;
+    sock_ring_op_t *op = ring->pend;
+
+    while (op != NULL) {
+        sock_ring_op_t *next = op->next;
+        if (op->sqe.fd == fd) {
+            sock_ring_fail(ring, &op->sqe);
+            sock_ring_unlink(ring, prev, op);
+            n++;
+        } else {
+            prev = op;
+        }
+        op = next;
+    }
+
+    sock_ring_watch(ring, fd);
+    return n;
+}
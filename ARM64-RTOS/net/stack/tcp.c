@@ -23,6 +23,8 @@
  * TCP Implementation with Zero-Copy Support
  */
 
+#define ZBUF_OWNER  ZBUF_OWNER_TCP
+
 #include "net_stack.h"
 #include "rtos_config.h"
 #include "rtos_types.h"
@@ -34,36 +36,100 @@ extern void *heap_alloc(size_t size);
 extern void heap_free(void *ptr);
 extern void sem_init(semaphore_t *sem, int32_t initial);
 extern status_t sem_wait(semaphore_t *sem);
+extern status_t sem_trywait(semaphore_t *sem);
 extern void sem_post(semaphore_t *sem);
 extern void mutex_init(mutex_t *mutex);
 extern status_t mutex_lock(mutex_t *mutex);
 extern void mutex_unlock(mutex_t *mutex);
+extern void timer_init(timer_t *timer, timer_callback_t callback, void *arg);
+extern status_t timer_start(timer_t *timer, tick_t delay, bool periodic);
+extern void timer_stop(timer_t *timer);
+extern status_t task_create(tcb_t *tcb, const char *name, void (*entry)(void *),
+                            void *arg, uint8_t priority, void *stack, size_t stack_size);
+extern status_t task_start(tcb_t *tcb);
 
 static int next_fd = 0;
 #define MS_TO_TICKS(ms) ((ms) * CONFIG_TICK_RATE_HZ / 1000)
+#define S_TO_TICKS(s)   ((s) * CONFIG_TICK_RATE_HZ)
 
-static socket_t *tcp_listen_list = NULL;
-static socket_t *tcp_conn_list = NULL;
 static spinlock_t tcp_lock = SPINLOCK_INIT;
 
+/* Sockets whose timer expired, for the timer task; under tcp_lock */
+static socket_t *tcp_timer_head = NULL;
+static socket_t *tcp_timer_tail = NULL;
+static socket_t *tcp_timer_cur = NULL;     /* The one tcp_timer() works on */
+static semaphore_t tcp_timer_sem;
+
 /* TCP Timers */
 #define TCP_RTO_MIN         200     /* Minimum RTO in ms */
 #define TCP_RTO_MAX         60000   /* Maximum RTO in ms */
 #define TCP_RTO_INITIAL     1000    /* Initial RTO in ms */
 #define TCP_MSL             30000   /* Maximum Segment Lifetime in ms */
 #define TCP_TIME_WAIT_TIME  (2 * TCP_MSL)
+#define TCP_FIN_TIMEOUT     60000   /* FIN_WAIT_2 of a closed socket in ms */
 
-/* Retransmission state */
-typedef struct {
-    tick_t      rto;            /* Retransmission timeout */
-    tick_t      srtt;           /* Smoothed RTT */
-    tick_t      rttvar;         /* RTT variance */
-    tick_t      last_tx_time;   /* Last transmission time */
-    uint8_t     retries;        /* Retry count */
-    bool        timer_active;   /* Timer is running */
-} tcp_rto_t;
+/* Connection timer states (socket tmr_state) */
+#define TCP_TMR_IDLE        0
+#define TCP_TMR_QUEUED      1       /* On the expired list */
+#define TCP_TMR_DEAD        2       /* Socket closing: never armed or queued again */
+
+/* Congestion Control */
+#define TCP_DUPACK_THRESH   3       /* Duplicate ACKs before fast retransmit */
+#define TCP_IW_MAX          14600   /* Initial window cap in bytes (RFC 6928) */
+
+/* Options */
+#define TCP_MSS_DEFAULT     536     /* Peer sent no MSS option (RFC 9293 3.7.1) */
+#define TCP_TS_LEN          12      /* Timestamp option with its padding */
+
+/* Sequence number comparison, modulo 2^32 */
+#define SEQ_LT(a, b)        ((int32_t)((a) - (b)) < 0)
+#define SEQ_LEQ(a, b)       ((int32_t)((a) - (b)) <= 0)
+#define SEQ_GT(a, b)        ((int32_t)((a) - (b)) > 0)
+#define SEQ_GEQ(a, b)       ((int32_t)((a) - (b)) >= 0)
+
+/*
+ * TCP Checksum Calculation
+ */
+static uint16_t tcp_checksum(ip_hdr_t *ip, tcp_hdr_t *tcp, uint16_t tcp_len)
+{
+    uint32_t sum = inet_pseudo_checksum(ntohl(ip->src), ntohl(ip->dst),
+                                        IP_PROTO_TCP, tcp_len);
+
+    return inet_csum_fold(inet_csum_partial(tcp, tcp_len, sum));
+}
 
-static tcp_rto_t tcp_rto[CONFIG_NET_MAX_SOCKETS];
+/*
+ * TCP Checksum for an outgoing segment (TCP header at zb->data)
+ *
+ * With NETIF_F_TX_CSUM the field is seeded with the pseudo-header sum
+ * and the device completes it. Otherwise a payload sum left by
+ * inet_csum_copy() is reused, so only the header is read here.
+ */
+static void tcp_tx_checksum(zbuf_t *zb, netif_t *nif, uint32_t src, uint32_t dst)
+{
+    tcp_hdr_t *tcp = (tcp_hdr_t *)zb->data;
+    uint32_t sum = inet_pseudo_checksum(src, dst, IP_PROTO_TCP, zbuf_pkt_len(zb));
+
+    tcp->checksum = 0;
+
+    if (nif != NULL && (nif->features & NETIF_F_TX_CSUM)) {
+        tcp->checksum = (uint16_t)sum;
+        zb->csum_start = zbuf_headroom(zb);
+        zb->csum_offset = offsetof(tcp_hdr_t, checksum);
+        zb->flags |= ZBUF_F_CHECKSUM;
+        return;
+    }
+
+    if (zb->flags & ZBUF_F_CSUM_PARTIAL) {
+        sum = inet_csum_partial(zb->data, TCP_HDR_LEN(tcp), sum + zb->csum);
+    } else {
+        for (zbuf_t *f = zb; f != NULL; f = f->frag) {
+            sum = inet_csum_partial(f->data, f->len, sum);
+        }
+    }
+
+    tcp->checksum = inet_csum_fold(sum);
+}
 
 /*
  * Send RST segment
@@ -106,459 +172,2170 @@ static void tcp_send_rst(netif_t *nif __attribute__((unused)), ip_hdr_t *ip, tcp
     tcp->win = 0;
     tcp->checksum = 0;
     tcp->urgent = 0;
+    tcp_tx_checksum(zb, NULL, ntohl(ip->dst), ntohl(ip->src));
 
     ip_output(zb, ntohl(ip->dst), ntohl(ip->src), IP_PROTO_TCP);
 }
 
 /*
- * Update RTO based on RTT measurement
+ * Update RTO based on RTT measurement (RFC 6298)
+ *
+ * srtt and rttvar are kept scaled by 8 and 4, so the 1/8 and 1/4 gains
+ * work in whole ticks.
  */
-static void __attribute__((unused)) tcp_update_rto(int fd, tick_t rtt)
+static void tcp_update_rto(socket_t *sock, tick_t rtt)
 {
-    tcp_rto_t *rto = &tcp_rto[fd % CONFIG_NET_MAX_SOCKETS];
+    if (rtt == 0) {
+        rtt = 1;    /* Clock granularity */
+    }
 
-    if (rto->srtt == 0) {
+    if (sock->srtt == 0) {
         /* First measurement */
-        rto->srtt = rtt;
-        rto->rttvar = rtt / 2;
+        sock->srtt = rtt << 3;
+        sock->rttvar = rtt << 1;
     } else {
-        /* RFC 6298 algorithm */
-        tick_t delta = (rtt > rto->srtt) ? (rtt - rto->srtt) : (rto->srtt - rtt);
-        rto->rttvar = (3 * rto->rttvar + delta) / 4;
-        rto->srtt = (7 * rto->srtt + rtt) / 8;
+        int32_t delta = (int32_t)rtt - (int32_t)(sock->srtt >> 3);
+        sock->srtt += delta;
+        if (delta < 0) delta = -delta;
+        sock->rttvar += delta - (int32_t)(sock->rttvar >> 2);
     }
 
     /* RTO = SRTT + 4 * RTTVAR */
-    rto->rto = rto->srtt + 4 * rto->rttvar;
+    sock->rto = (sock->srtt >> 3) + sock->rttvar;
 
     /* Clamp to min/max */
-    if (rto->rto < TCP_RTO_MIN) rto->rto = TCP_RTO_MIN;
-    if (rto->rto > TCP_RTO_MAX) rto->rto = TCP_RTO_MAX;
+    if (sock->rto < MS_TO_TICKS(TCP_RTO_MIN)) sock->rto = MS_TO_TICKS(TCP_RTO_MIN);
+    if (sock->rto > MS_TO_TICKS(TCP_RTO_MAX)) sock->rto = MS_TO_TICKS(TCP_RTO_MAX);
+}
+
+/* Initial window: min(10 * MSS, max(2 * MSS, 14600)) */
+static inline uint32_t tcp_initial_cwnd(uint32_t mss)
+{
+    uint32_t cwnd = (2 * mss > TCP_IW_MAX) ? 2 * mss : TCP_IW_MAX;
+    return (cwnd > 10 * mss) ? 10 * mss : cwnd;
 }
 
 /*
- * Initialize RTO state for socket
+ * Initialize send state for a new connection starting at isn
  */
-static void __attribute__((unused)) tcp_init_rto(int fd)
+static void tcp_init_conn(socket_t *sock, uint32_t isn)
 {
-    tcp_rto_t *rto = &tcp_rto[fd % CONFIG_NET_MAX_SOCKETS];
-    rto->rto = TCP_RTO_INITIAL;
-    rto->srtt = 0;
-    rto->rttvar = 0;
-    rto->last_tx_time = 0;
-    rto->retries = 0;
-    rto->timer_active = false;
+    uint32_t mss = sock->mss;
+
+    sock->snd_una = isn;
+    sock->snd_nxt = isn;
+    sock->snd_max = isn;
+    sock->snd_sml = isn;
+    sock->snd_wl1 = 0;
+    sock->snd_wl2 = 0;
+    sock->tx_seq = isn;
+
+    sock->cwnd = tcp_initial_cwnd(mss);
+    sock->ssthresh = 0xFFFFFFFF;
+    sock->recover = isn;
+    sock->dupacks = 0;
+    sock->in_recovery = 0;
+    sock->sack_high = isn;
+    sock->rtx_hole = isn;
+
+    sock->rto = MS_TO_TICKS(TCP_RTO_INITIAL);
+    sock->srtt = 0;
+    sock->rttvar = 0;
+    sock->rtx_armed = 0;
+    sock->rtx_start = 0;
+    sock->retries = 0;
+    sock->rtt_active = 0;
 }
 
 /*
- * TCP Checksum Calculation
+ * Connection Timers
+ *
+ * A connection has one kernel timer for the earliest of its deadlines:
+ * retransmission, which also probes a zero window, TIME_WAIT on the
+ * same fields, delayed ACK and keepalive. Only a deadline that moves
+ * earlier restarts it; one that moves later lets it fire early, find
+ * nothing due and re-arm. So the timer list is not touched per segment,
+ * and a connection with nothing pending has no timer at all.
+ *
+ * The kernel timer fires in interrupt context, where the socket mutex
+ * cannot be taken: it only queues the socket for tcp_timer().
  */
-static uint16_t tcp_checksum(ip_hdr_t *ip, tcp_hdr_t *tcp, uint16_t tcp_len)
+
+static inline bool tcp_keepalive_on(socket_t *sock)
 {
-    uint32_t sum = inet_pseudo_checksum(ntohl(ip->src), ntohl(ip->dst),
-                                        IP_PROTO_TCP, tcp_len);
+    return (sock->flags & SOCK_F_KEEPALIVE) && !sock->rtx_armed &&
+           (sock->state == TCP_ESTABLISHED || sock->state == TCP_CLOSE_WAIT);
+}
+
+/* Silence after the last segment from the peer before the next probe */
+static inline tick_t tcp_keepalive_wait(socket_t *sock)
+{
+    return S_TO_TICKS(CONFIG_TCP_KEEPALIVE_IDLE) +
+           sock->ka_probes * S_TO_TICKS(CONFIG_TCP_KEEPALIVE_INTVL);
+}
 
-    /* Use byte-by-byte access to avoid packed pointer alignment issues */
-    const uint8_t *ptr = (const uint8_t *)tcp;
-    uint16_t remaining = tcp_len;
-    while (remaining > 1) {
-        sum += ((uint16_t)ptr[0] << 8) | ptr[1];
-        ptr += 2;
-        remaining -= 2;
+static inline int32_t tcp_timer_min(int32_t next, tick_t deadline, tick_t now)
+{
+    int32_t t = (int32_t)(deadline - now);
+    if (t < 0) t = 0;
+    return (next < 0 || t < next) ? t : next;
+}
+
+/* Ticks until the earliest deadline, -1 if there is none */
+static int32_t tcp_timer_next(socket_t *sock, tick_t now)
+{
+    int32_t next = -1;
+
+    if (sock->rtx_armed) {
+        tick_t ivl = sock->rto;
+        if (sock->state == TCP_TIME_WAIT) {
+            ivl = MS_TO_TICKS(TCP_TIME_WAIT_TIME);
+        } else if (sock->state == TCP_FIN_WAIT_2) {
+            ivl = MS_TO_TICKS(TCP_FIN_TIMEOUT);
+        }
+        next = tcp_timer_min(next, sock->rtx_start + ivl, now);
     }
-    if (remaining == 1) {
-        sum += (uint16_t)ptr[0] << 8;
+    if (sock->ack_pending) {
+        next = tcp_timer_min(next, sock->ack_start + MS_TO_TICKS(CONFIG_TCP_DELACK_MS), now);
     }
-
-    while (sum >> 16) {
-        sum = (sum & 0xFFFF) + (sum >> 16);
+    if (tcp_keepalive_on(sock)) {
+        next = tcp_timer_min(next, sock->rcv_time + tcp_keepalive_wait(sock), now);
     }
 
-    return ~sum;
+    return next;
 }
 
 /*
- * TCP Output
+ * Arm the timer for a deadline that may be earlier than the one it
+ * waits for, called with sock->lock held
  */
-static status_t tcp_send_segment(socket_t *sock, uint8_t flags, zbuf_t *data)
+static void tcp_timer_arm(socket_t *sock)
 {
-    zbuf_t *zb;
-
-    if (data != NULL) {
-        zb = data;
-    } else {
-        zb = zbuf_alloc_tx(0);
-        if (zb == NULL) return STATUS_NO_MEM;
-    }
+    tick_t now = get_system_ticks();
+    int32_t next = tcp_timer_next(sock, now);
 
-    /* Push TCP header */
-    tcp_hdr_t *tcp = (tcp_hdr_t *)zbuf_push(zb, sizeof(tcp_hdr_t));
-    if (tcp == NULL) {
-        if (data == NULL) zbuf_free(zb);
-        return STATUS_NO_MEM;
+    if (next < 0 || sock->tmr_state == TCP_TMR_DEAD ||
+        (sock->tmr_armed && (int32_t)(sock->tmr_due - (now + next)) <= 0)) {
+        return;
     }
 
-    tcp->sport = htons(sock->local.port);
-    tcp->dport = htons(sock->remote.port);
-    tcp->seq = htonl(sock->snd_nxt);
-    tcp->ack = htonl(sock->rcv_nxt);
-    tcp->off_rsvd = (5 << 4);  /* 20 bytes header */
-    tcp->flags = flags;
-    tcp->win = htons(sock->rcv_wnd);
-    tcp->checksum = 0;
-    tcp->urgent = 0;
+    sock->tmr_armed = 1;
+    sock->tmr_due = now + (tick_t)next;
+    timer_start(&sock->tmr, (tick_t)next, false);
+}
 
-    /* Calculate data length */
-    uint16_t data_len = zb->len - sizeof(tcp_hdr_t);
+/* Kernel timer callback, in interrupt context */
+static void tcp_timer_expire(void *arg)
+{
+    socket_t *sock = (socket_t *)arg;
 
-    /* Update sequence number */
-    if (flags & (TCP_FLAG_SYN | TCP_FLAG_FIN)) {
-        sock->snd_nxt++;
+    spin_lock_irq(&tcp_lock);
+    if (sock->tmr_state == TCP_TMR_IDLE) {
+        sock->tmr_state = TCP_TMR_QUEUED;
+        sock->next = NULL;
+        if (tcp_timer_tail != NULL) {
+            tcp_timer_tail->next = sock;
+        } else {
+            tcp_timer_head = sock;
+        }
+        tcp_timer_tail = sock;
     }
-    sock->snd_nxt += data_len;
+    spin_unlock_irq(&tcp_lock);
 
-    return ip_output(zb, sock->local.addr, sock->remote.addr, IP_PROTO_TCP);
+    sem_post(&tcp_timer_sem);
 }
 
 /*
- * TCP Connection Lookup
+ * Stop the timer of a closing socket for good, called with sock->lock
+ * held so that tcp_timer_arm() cannot start it again
  */
-static socket_t *tcp_find_socket(uint32_t local_ip __attribute__((unused)), uint16_t local_port,
-                                  uint32_t remote_ip, uint16_t remote_port)
+static void tcp_timer_kill(socket_t *sock)
 {
-    socket_t *sock;
+    timer_stop(&sock->tmr);
 
-    /* First look for exact match (established connections) */
-    spin_lock(&tcp_lock);
-    for (sock = tcp_conn_list; sock != NULL; sock = sock->next) {
-        if (sock->local.port == local_port &&
-            sock->remote.port == remote_port &&
-            sock->remote.addr == remote_ip) {
-            spin_unlock(&tcp_lock);
-            return sock;
+    spin_lock_irq(&tcp_lock);
+    if (sock->tmr_state == TCP_TMR_QUEUED) {
+        socket_t **pp = &tcp_timer_head;
+        socket_t *prev = NULL;
+        while (*pp != sock) {
+            prev = *pp;
+            pp = &(*pp)->next;
         }
-    }
-
-    /* Then look for listening socket */
-    for (sock = tcp_listen_list; sock != NULL; sock = sock->next) {
-        if (sock->local.port == local_port) {
-            spin_unlock(&tcp_lock);
-            return sock;
+        *pp = sock->next;
+        if (tcp_timer_tail == sock) {
+            tcp_timer_tail = prev;
         }
     }
-    spin_unlock(&tcp_lock);
-
-    return NULL;
+    sock->tmr_state = TCP_TMR_DEAD;
+    spin_unlock_irq(&tcp_lock);
 }
 
 /*
- * TCP Input Handler
+ * Stop the timer of a closing socket for good
+ *
+ * Returns once tcp_timer() is done with it, so the socket can be freed.
  */
-void tcp_input(netif_t *nif, zbuf_t *zb)
+static void tcp_timer_cancel(socket_t *sock)
 {
-    if (zb->len < sizeof(tcp_hdr_t)) {
-        zbuf_free(zb);
-        return;
-    }
-
-    tcp_hdr_t *tcp = (tcp_hdr_t *)zb->data;
-    ip_hdr_t *ip = (ip_hdr_t *)(zb->data - sizeof(ip_hdr_t));
-
-    uint16_t tcp_len = zb->len;
-    uint8_t tcp_hdr_len = TCP_HDR_LEN(tcp);
-
-    /* Verify checksum */
-    if (tcp_checksum(ip, tcp, tcp_len) != 0) {
-        nif->rx_errors++;
-        zbuf_free(zb);
-        return;
-    }
-
-    uint32_t src_ip = ntohl(ip->src);
-    uint32_t dst_ip = ntohl(ip->dst);
-    uint16_t src_port = ntohs(tcp->sport);
-    uint16_t dst_port = ntohs(tcp->dport);
-    uint32_t seq = ntohl(tcp->seq);
-    uint32_t ack = ntohl(tcp->ack);
-    uint8_t flags = tcp->flags;
-
-    /* Find socket */
-    socket_t *sock = tcp_find_socket(dst_ip, dst_port, src_ip, src_port);
-    if (sock == NULL) {
-        /* Send RST for unknown connection */
-        if (!(flags & TCP_FLAG_RST)) {
-            tcp_send_rst(nif, ip, tcp, tcp_len);
-        }
-        zbuf_free(zb);
-        return;
-    }
-
     mutex_lock(&sock->lock);
+    tcp_timer_kill(sock);
+    mutex_unlock(&sock->lock);
 
-    /* TCP State Machine */
-    switch (sock->state) {
-    case TCP_LISTEN:
-        if (flags & TCP_FLAG_SYN) {
-            /* Create new connection socket */
-            /* For simplicity, accept on same socket */
-            sock->remote.addr = src_ip;
-            sock->remote.port = src_port;
-            sock->rcv_nxt = seq + 1;
-            sock->snd_nxt = get_system_ticks();  /* ISN */
-            sock->snd_una = sock->snd_nxt;
-            sock->state = TCP_SYN_RECEIVED;
+    spin_lock_irq(&tcp_lock);
+    while (tcp_timer_cur == sock) {
+        spin_unlock_irq(&tcp_lock);
+        task_sleep(1);
+        spin_lock_irq(&tcp_lock);
+    }
+    spin_unlock_irq(&tcp_lock);
+}
 
-            /* Send SYN-ACK */
-            tcp_send_segment(sock, TCP_FLAG_SYN | TCP_FLAG_ACK, NULL);
-        }
-        break;
+static inline void tcp_timer_restart(socket_t *sock)
+{
+    sock->rtx_armed = 1;
+    sock->rtx_start = get_system_ticks();
+    tcp_timer_arm(sock);
+}
 
-    case TCP_SYN_SENT:
-        if ((flags & (TCP_FLAG_SYN | TCP_FLAG_ACK)) == (TCP_FLAG_SYN | TCP_FLAG_ACK)) {
-            sock->rcv_nxt = seq + 1;
-            sock->snd_una = ack;
-            sock->state = TCP_ESTABLISHED;
+/*
+ * TCP Options
+ */
+typedef struct {
+    uint16_t    mss;                        /* 0: none (SYN only) */
+    uint8_t     ws_ok;                      /* Window scale offered (SYN only) */
+    uint8_t     wscale;
+    uint8_t     sack_ok;                    /* SACK permitted (SYN only) */
+    uint8_t     ts_ok;
+    uint32_t    tsval;
+    uint32_t    tsecr;
+    uint8_t     nsack;
+    uint32_t    sack[TCP_SACK_MAX][2];      /* Left and right edges */
+} tcp_opts_t;
+
+static inline uint32_t tcp_get32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
 
-            /* Send ACK */
-            tcp_send_segment(sock, TCP_FLAG_ACK, NULL);
-            sem_post(&sock->tx_sem);  /* Wake connect() */
-        }
-        break;
+static inline void tcp_put32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
 
-    case TCP_SYN_RECEIVED:
-        if (flags & TCP_FLAG_ACK) {
-            sock->snd_una = ack;
-            sock->state = TCP_ESTABLISHED;
-            sem_post(&sock->rx_sem);  /* Wake accept() */
+static void tcp_parse_options(const tcp_hdr_t *tcp, tcp_opts_t *opt)
+{
+    const uint8_t *p = (const uint8_t *)(tcp + 1);
+    const uint8_t *end = (const uint8_t *)tcp + TCP_HDR_LEN(tcp);
+
+    opt->mss = 0;
+    opt->ws_ok = 0;
+    opt->sack_ok = 0;
+    opt->ts_ok = 0;
+    opt->nsack = 0;
+
+    while (p < end && p[0] != TCP_OPT_EOL) {
+        if (p[0] == TCP_OPT_NOP) {
+            p++;
+            continue;
         }
-        break;
 
-    case TCP_ESTABLISHED:
-        /* Handle incoming data */
-        if (flags & TCP_FLAG_ACK) {
-            sock->snd_una = ack;
+        /* Malformed length: ignore the rest */
+        if (end - p < 2 || p[1] < 2 || p[1] > end - p) {
+            break;
         }
 
-        /* Process data */
-        if (tcp_hdr_len < zb->len) {
-            zbuf_pull(zb, tcp_hdr_len);
-
-            /* Check sequence number */
-            if (seq == sock->rcv_nxt) {
-                sock->rcv_nxt += zb->len;
-
-                /* Queue data (zero-copy) */
-                zbuf_queue_push(&sock->rx_queue, zb);
-                sem_post(&sock->rx_sem);
-                zb = NULL;  /* Don't free */
-
-                /* Send ACK */
-                tcp_send_segment(sock, TCP_FLAG_ACK, NULL);
+        switch (p[0]) {
+        case TCP_OPT_MSS:
+            if (p[1] == 4) {
+                opt->mss = (uint16_t)((p[2] << 8) | p[3]);
+            }
+            break;
+        case TCP_OPT_WSCALE:
+            if (p[1] == 3) {
+                opt->ws_ok = 1;
+                opt->wscale = p[2];
+            }
+            break;
+        case TCP_OPT_SACK_PERM:
+            opt->sack_ok = (p[1] == 2);
+            break;
+        case TCP_OPT_TS:
+            if (p[1] == 10) {
+                opt->ts_ok = 1;
+                opt->tsval = tcp_get32(p + 2);
+                opt->tsecr = tcp_get32(p + 6);
             }
+            break;
+        case TCP_OPT_SACK:
+            for (uint8_t i = 2; i + 8 <= p[1] && opt->nsack < TCP_SACK_MAX; i += 8) {
+                opt->sack[opt->nsack][0] = tcp_get32(p + i);
+                opt->sack[opt->nsack][1] = tcp_get32(p + i + 4);
+                opt->nsack++;
+            }
+            break;
+        default:
+            break;
         }
 
-        /* Handle FIN */
-        if (flags & TCP_FLAG_FIN) {
-            sock->rcv_nxt++;
-            sock->state = TCP_CLOSE_WAIT;
-            tcp_send_segment(sock, TCP_FLAG_ACK, NULL);
-            sem_post(&sock->rx_sem);  /* Wake recv() */
-        }
-        break;
+        p += p[1];
+    }
+}
 
-    case TCP_FIN_WAIT_1:
-        if (flags & TCP_FLAG_ACK) {
-            sock->snd_una = ack;
-            if (flags & TCP_FLAG_FIN) {
-                sock->rcv_nxt++;
-                sock->state = TCP_TIME_WAIT;
-                tcp_send_segment(sock, TCP_FLAG_ACK, NULL);
-            } else {
-                sock->state = TCP_FIN_WAIT_2;
-            }
+/*
+ * SACK blocks for the reassembly queue (RFC 2018 section 4): the block
+ * holding the latest arrival first, then the others in sequence order.
+ */
+static uint32_t tcp_sack_blocks(socket_t *sock, uint32_t blocks[][2], uint32_t max)
+{
+    uint32_t n = 1;
+    bool latest_found = false;
+    zbuf_t *zb = sock->ooo_head;
+
+    while (zb != NULL) {
+        uint32_t start = zb->seq;
+        uint32_t end;
+        bool latest = false;
+
+        /* Merge contiguous segments into one block */
+        do {
+            latest |= (zb->seq == sock->ooo_last);
+            end = zb->seq + zb->len;
+            zb = zb->next;
+        } while (zb != NULL && zb->seq == end);
+
+        if (latest) {
+            blocks[0][0] = start;
+            blocks[0][1] = end;
+            latest_found = true;
+        } else if (n < max) {
+            blocks[n][0] = start;
+            blocks[n][1] = end;
+            n++;
         }
-        break;
+    }
 
-    case TCP_FIN_WAIT_2:
-        if (flags & TCP_FLAG_FIN) {
-            sock->rcv_nxt++;
-            sock->state = TCP_TIME_WAIT;
-            tcp_send_segment(sock, TCP_FLAG_ACK, NULL);
+    if (!latest_found) {
+        for (uint32_t i = 1; i < n; i++) {
+            blocks[i - 1][0] = blocks[i][0];
+            blocks[i - 1][1] = blocks[i][1];
         }
-        break;
-
-    case TCP_CLOSE_WAIT:
-        /* Application must call close() */
-        break;
+        n--;
+    }
 
-    case TCP_LAST_ACK:
-        if (flags & TCP_FLAG_ACK) {
-            sock->state = TCP_CLOSED;
-        }
-        break;
+    return n;
+}
 
-    case TCP_TIME_WAIT:
-        /* Wait for 2*MSL then close */
-        break;
+/* MSS we can receive: the route's MTU less the IP and TCP headers */
+static uint16_t tcp_adv_mss(socket_t *sock)
+{
+    uint32_t next_hop;
+    netif_t *nif = route_lookup_cached(&sock->route, sock->remote.addr, &next_hop);
+    uint32_t hdrs = sizeof(ip_hdr_t) + sizeof(tcp_hdr_t);
+    uint32_t mss = CONFIG_TCP_MSS;
 
-    default:
-        break;
+    if (nif != NULL && nif->mtu > hdrs + TCP_MSS_DEFAULT && nif->mtu - hdrs < mss) {
+        mss = nif->mtu - hdrs;
     }
+    return (uint16_t)mss;
+}
 
-    mutex_unlock(&sock->lock);
+/* Smallest window shift that can advertise the largest receive buffer */
+static uint8_t tcp_wscale(socket_t *sock)
+{
+    uint32_t max = (sock->flags & SOCK_F_RCVBUF) ? sock->rcvbuf : CONFIG_TCP_RCVBUF_MAX;
+    uint8_t shift = 0;
 
-    if (zb != NULL) {
-        zbuf_free(zb);
+    while (shift < TCP_WSCALE_MAX && (max >> shift) > 0xFFFF) {
+        shift++;
     }
+    return shift;
 }
 
-status_t tcp_output(socket_t *sock, zbuf_t *zb)
+static uint32_t tcp_put_ts(socket_t *sock, uint8_t *opt)
 {
-    if (sock->state != TCP_ESTABLISHED) {
-        zbuf_free(zb);
-        return STATUS_ERROR;
-    }
-
-    return tcp_send_segment(sock, TCP_FLAG_ACK | TCP_FLAG_PSH, zb);
+    opt[0] = TCP_OPT_TS;
+    opt[1] = 10;
+    tcp_put32(opt + 2, get_system_ticks());
+    tcp_put32(opt + 6, sock->ts_recent);
+    return 10;
 }
 
 /*
- * Socket API Implementation
+ * RTT from the echo of one of our timestamps, 0 if it is no sample
+ *
+ * TSval carries the tick count cut to 32 bits, so the difference is
+ * taken in 32 bits. An echo from the future or older than the largest
+ * RTO is not one we sent lately and is ignored (RFC 7323 4.3).
  */
-int sock_socket(int type)
+static tick_t tcp_ts_rtt(uint32_t tsecr)
 {
-    socket_t *sock = heap_alloc(sizeof(socket_t));
-    if (sock == NULL) {
-        return -1;
+    uint32_t rtt = (uint32_t)get_system_ticks() - tsecr;
+
+    if ((int32_t)rtt < 0 || rtt > MS_TO_TICKS(TCP_RTO_MAX)) {
+        return 0;
     }
+    return rtt ? rtt : 1;
+}
 
-    sock->type = type;
-    sock->state = TCP_CLOSED;
-    sock->local.addr = 0;
-    sock->local.port = 0;
-    sock->remote.addr = 0;
-    sock->remote.port = 0;
-    sock->snd_una = 0;
-    sock->snd_nxt = 0;
-    sock->snd_wnd = CONFIG_TCP_WINDOW_SIZE;
-    sock->rcv_nxt = 0;
-    sock->rcv_wnd = CONFIG_TCP_WINDOW_SIZE;
-    sock->flags = 0;
-    sock->timeout = 0;
+/*
+ * Options for an outgoing segment, padded to a multiple of 4 bytes
+ *
+ * A SYN offers every option configured, a SYN-ACK those the peer
+ * offered. SACK blocks go on segments without data only, as a full
+ * data segment has no room for them under the MTU.
+ */
+static uint32_t tcp_build_options(socket_t *sock, uint8_t flags, bool data, uint8_t *opt)
+{
+    uint32_t len = 0;
+
+    if (flags & TCP_FLAG_SYN) {
+        bool synack = (flags & TCP_FLAG_ACK) != 0;
+        bool sack = CONFIG_TCP_SACK && (sock->sack_ok || !synack);
+        bool ts = CONFIG_TCP_TIMESTAMPS && (sock->ts_ok || !synack);
+        bool ws = CONFIG_TCP_WSCALE && (sock->ws_ok || !synack);
+        uint16_t mss = tcp_adv_mss(sock);
+
+        opt[len++] = TCP_OPT_MSS;
+        opt[len++] = 4;
+        opt[len++] = (uint8_t)(mss >> 8);
+        opt[len++] = (uint8_t)mss;
+
+        if (sack && ts) {
+            opt[len++] = TCP_OPT_SACK_PERM;
+            opt[len++] = 2;
+        } else if (sack) {
+            opt[len++] = TCP_OPT_NOP;
+            opt[len++] = TCP_OPT_NOP;
+            opt[len++] = TCP_OPT_SACK_PERM;
+            opt[len++] = 2;
+        } else if (ts) {
+            opt[len++] = TCP_OPT_NOP;
+            opt[len++] = TCP_OPT_NOP;
+        }
+        if (ts) {
+            len += tcp_put_ts(sock, opt + len);
+        }
 
-    zbuf_queue_init(&sock->rx_queue);
-    zbuf_queue_init(&sock->tx_queue);
-    sem_init(&sock->rx_sem, 0);
-    sem_init(&sock->tx_sem, 0);
-    mutex_init(&sock->lock);
+        if (ws) {
+            opt[len++] = TCP_OPT_NOP;
+            opt[len++] = TCP_OPT_WSCALE;
+            opt[len++] = 3;
+            opt[len++] = sock->rcv_wscale;
+        }
+        return len;
+    }
 
-    spin_lock_irq(&socket_lock);
-    int fd = next_fd++;
-    sock->fd = fd;
-    socket_table[fd % CONFIG_NET_MAX_SOCKETS] = sock;
-    spin_unlock_irq(&socket_lock);
+    if (sock->ts_ok) {
+        opt[len++] = TCP_OPT_NOP;
+        opt[len++] = TCP_OPT_NOP;
+        len += tcp_put_ts(sock, opt + len);
+    }
+
+    if (sock->sack_ok && sock->ooo_head != NULL && !data) {
+        uint32_t blocks[TCP_SACK_MAX][2];
+        uint32_t n = tcp_sack_blocks(sock, blocks, sock->ts_ok ? TCP_SACK_MAX_TS : TCP_SACK_MAX);
+
+        opt[len++] = TCP_OPT_NOP;
+        opt[len++] = TCP_OPT_NOP;
+        opt[len++] = TCP_OPT_SACK;
+        opt[len++] = (uint8_t)(2 + 8 * n);
+        for (uint32_t i = 0; i < n; i++) {
+            tcp_put32(opt + len, blocks[i][0]);
+            tcp_put32(opt + len + 4, blocks[i][1]);
+            len += 8;
+        }
+    }
 
-    return fd;
+    return len;
 }
 
-int sock_bind(int fd, sockaddr_t *addr)
+/*
+ * Receive window: what is left of the buffer after unread data
+ *
+ * It never offers more than half the free zbufs can hold, one segment
+ * each, so one fast sender cannot drain the pool. Data is accepted up
+ * to the edge last advertised. The edge moves back only when SO_RCVBUF
+ * is lowered or the pool runs low.
+ */
+static inline uint32_t tcp_rcv_window(socket_t *sock)
 {
-    socket_t *sock = socket_table[fd % CONFIG_NET_MAX_SOCKETS];
-    if (sock == NULL) return -1;
+    uint32_t wnd = (sock->rx_queued < sock->rcvbuf) ? sock->rcvbuf - sock->rx_queued : 0;
+    uint32_t pool = (zbuf_pool.free_count / 2) * sock->mss;
+    uint32_t max = 0xFFFFu << sock->rcv_wscale;
 
-    mutex_lock(&sock->lock);
-    sock->local = *addr;
-    mutex_unlock(&sock->lock);
+    if (wnd > pool) wnd = pool;
+    if (wnd > max) wnd = max;
 
-    return 0;
+    /* What the shifted window field can express */
+    return wnd & ~((1u << sock->rcv_wscale) - 1);
 }
 
-int sock_listen(int fd, int backlog __attribute__((unused)))
-{
-    socket_t *sock = socket_table[fd % CONFIG_NET_MAX_SOCKETS];
+/*
+ * TCP Output
+ *
+ * Builds one segment at seq. Payload is referenced, not copied: a fresh
+ * buffer carries the headers and chains the queued segment on zb->frag,
+ * so the retransmission queue keeps its buffer while the driver holds
+ * the packet.
+ */
+static status_t tcp_xmit(socket_t *sock, uint8_t flags, uint32_t seq, zbuf_t *payload)
+{
+    uint8_t opt[40];
+    uint32_t opt_len = tcp_build_options(sock, flags, payload != NULL, opt);
+
+    zbuf_t *zb = zbuf_alloc_tx(0);
+    if (zb == NULL) return STATUS_NO_MEM;
+
+    /* Push TCP header and options */
+    tcp_hdr_t *tcp = (tcp_hdr_t *)zbuf_push(zb, sizeof(tcp_hdr_t) + opt_len);
+    if (tcp == NULL) {
+        zbuf_free(zb);
+        return STATUS_NO_MEM;
+    }
+
+    uint8_t *p = (uint8_t *)(tcp + 1);
+    for (uint32_t i = 0; i < opt_len; i++) {
+        p[i] = opt[i];
+    }
+
+    if (payload != NULL) {
+        zb->frag = zbuf_ref(payload);
+        zb->gso_size = payload->gso_size;
+        if (payload->flags & ZBUF_F_CSUM_PARTIAL) {
+            zb->csum = payload->csum;
+            zb->flags |= ZBUF_F_CSUM_PARTIAL;
+        }
+    }
+
+    tcp->sport = htons(sock->local.port);
+    tcp->dport = htons(sock->remote.port);
+    tcp->seq = htonl(seq);
+    tcp->ack = htonl(sock->rcv_nxt);
+    tcp->off_rsvd = (uint8_t)(((sizeof(tcp_hdr_t) + opt_len) / 4) << 4);
+    tcp->flags = flags;
+    tcp->checksum = 0;
+    tcp->urgent = 0;
+
+    /* The window in a SYN is never scaled (RFC 7323 2.2) */
+    uint32_t wnd = tcp_rcv_window(sock);
+    if (flags & TCP_FLAG_SYN) {
+        if (wnd > 0xFFFF) wnd = 0xFFFF;
+        tcp->win = htons((uint16_t)wnd);
+    } else {
+        tcp->win = htons((uint16_t)(wnd >> sock->rcv_wscale));
+    }
+    sock->rcv_wnd = wnd;
+
+    /* Any ACK, on data or not, covers what was held back */
+    if (flags & TCP_FLAG_ACK) {
+        sock->ack_pending = 0;
+        sock->last_ack_sent = sock->rcv_nxt;
+    }
+
+    /* Same route ip_output_route() will take, from the socket's cache */
+    uint32_t next_hop;
+    netif_t *nif = route_lookup_cached(&sock->route, sock->remote.addr, &next_hop);
+    uint32_t src = sock->local.addr;
+    if (src == 0 && nif != NULL) {
+        src = nif->ip;
+    }
+    tcp_tx_checksum(zb, nif, src, sock->remote.addr);
+    zb->priority = sock->priority;
+
+    return ip_output_route(zb, src, sock->remote.addr, IP_PROTO_TCP, &sock->route);
+}
+
+/*
+ * Send a control segment (no payload) at snd_nxt
+ */
+static status_t tcp_send_segment(socket_t *sock, uint8_t flags)
+{
+    status_t ret = tcp_xmit(sock, flags, sock->snd_nxt, NULL);
+
+    /* SYN and FIN take a sequence number and are retransmitted */
+    if (flags & (TCP_FLAG_SYN | TCP_FLAG_FIN)) {
+        sock->snd_nxt++;
+        if (SEQ_GT(sock->snd_nxt, sock->snd_max)) {
+            sock->snd_max = sock->snd_nxt;
+        }
+        if (!sock->rtx_armed) {
+            tcp_timer_restart(sock);
+        }
+    }
+
+    return ret;
+}
+
+/*
+ * Send queued segments while the congestion and send windows allow
+ *
+ * A segment larger than the whole window still goes out when nothing
+ * is in flight, so an oversized TSO segment cannot stall the queue. A
+ * zero send window is probed from the retransmission timer instead.
+ *
+ * A last segment short of one MSS waits while corked, or by Nagle's
+ * rule (RFC 896, Minshall's variant) while an earlier short segment is
+ * unacknowledged unless TCP_NODELAY is set. Later writes are appended
+ * to it in the meantime.
+ *
+ * A closed socket's FIN goes out once the last queued byte has, and
+ * again behind the data whenever that is resent.
+ */
+static void tcp_push(socket_t *sock)
+{
+    while (sock->tx_next != NULL) {
+        zbuf_t *seg = sock->tx_next;
+        uint32_t len = zbuf_pkt_len(seg);
+        uint32_t flight = SEQ_GT(sock->snd_nxt, sock->snd_una) ? sock->snd_nxt - sock->snd_una : 0;
+        uint32_t wnd = (sock->cwnd < sock->snd_wnd) ? sock->cwnd : sock->snd_wnd;
+
+        if (flight + len > wnd && (flight != 0 || sock->snd_wnd == 0)) {
+            break;
+        }
+
+        if (seg->next == NULL && len < sock->mss &&
+            ((sock->flags & SOCK_F_CORK) ||
+             (!(sock->flags & SOCK_F_NODELAY) && SEQ_GT(sock->snd_sml, sock->snd_una)))) {
+            break;
+        }
+
+        uint8_t flags = TCP_FLAG_ACK;
+        if (seg->next == NULL) {
+            flags |= TCP_FLAG_PSH;  /* Last queued segment */
+        }
+
+        if (tcp_xmit(sock, flags, sock->snd_nxt, seg) == STATUS_NO_MEM) {
+            break;  /* Retried from the timer */
+        }
+
+        /* Time one segment per window, never a retransmitted one (Karn) */
+        if (!sock->rtt_active && sock->snd_nxt == sock->snd_max) {
+            sock->rtt_active = 1;
+            sock->rtt_seq = sock->snd_nxt;
+            sock->rtt_start = get_system_ticks();
+        }
+
+        sock->snd_nxt += len;
+        if (SEQ_GT(sock->snd_nxt, sock->snd_max)) {
+            sock->snd_max = sock->snd_nxt;
+        }
+        if (len < sock->mss) {
+            sock->snd_sml = sock->snd_nxt;
+        }
+        sock->tx_next = seg->next;
+    }
+
+    if ((sock->flags & SOCK_F_FIN) && sock->tx_next == NULL &&
+        sock->snd_nxt == sock->tx_seq + sock->tx_queued) {
+        tcp_send_segment(sock, TCP_FLAG_FIN | TCP_FLAG_ACK);
+    }
+
+    if (!sock->rtx_armed && (sock->tx_next != NULL || sock->snd_una != sock->snd_max)) {
+        tcp_timer_restart(sock);
+    }
+}
+
+/* The peer has everything we queued and our FIN */
+static inline bool tcp_fin_acked(socket_t *sock)
+{
+    return (sock->flags & SOCK_F_FIN) && sock->snd_una == sock->tx_seq + sock->tx_queued + 1;
+}
+
+/*
+ * Resend the next hole
+ *
+ * With SACK information that is the first segment from rtx_hole on that
+ * is not SACKed but lies below a SACKed one, so several holes are
+ * repaired in one recovery. Without it, the oldest segment (NewReno).
+ */
+static void tcp_retransmit(socket_t *sock)
+{
+    zbuf_t *seg = zbuf_queue_peek(&sock->tx_queue);
+    uint32_t seq = sock->tx_seq;
+
+    if (SEQ_GT(sock->sack_high, sock->snd_una)) {
+        if (SEQ_LT(sock->rtx_hole, sock->snd_una)) {
+            sock->rtx_hole = sock->snd_una;
+        }
+
+        while (seg != NULL && seg != sock->tx_next) {
+            uint32_t len = zbuf_pkt_len(seg);
+            if (SEQ_GEQ(seq, sock->sack_high)) {
+                return;     /* Not known to be lost */
+            }
+            if (SEQ_GEQ(seq, sock->rtx_hole) && !(seg->flags & ZBUF_F_SACKED)) {
+                break;
+            }
+            seq += len;
+            seg = seg->next;
+        }
+    }
+
+    if (seg == NULL || seg == sock->tx_next) {
+        return;
+    }
+
+    sock->rtt_active = 0;
+    sock->rtx_hole = seq + zbuf_pkt_len(seg);
+    tcp_xmit(sock, TCP_FLAG_ACK, seq, seg);
+}
+
+/*
+ * Mark queued segments the peer holds (SACK scoreboard)
+ */
+static void tcp_sack_update(socket_t *sock, const tcp_opts_t *opt)
+{
+    for (uint32_t i = 0; i < opt->nsack; i++) {
+        uint32_t start = opt->sack[i][0];
+        uint32_t end = opt->sack[i][1];
+
+        /* Ignore D-SACK and bogus blocks */
+        if (!SEQ_LT(start, end) || SEQ_LT(start, sock->snd_una) || SEQ_GT(end, sock->snd_max)) {
+            continue;
+        }
+
+        uint32_t seq = sock->tx_seq;
+        for (zbuf_t *seg = zbuf_queue_peek(&sock->tx_queue);
+             seg != NULL && seg != sock->tx_next && SEQ_LT(seq, end);
+             seg = seg->next) {
+            uint32_t len = zbuf_pkt_len(seg);
+
+            if (SEQ_GEQ(seq, start) && SEQ_LEQ(seq + len, end)) {
+                seg->flags |= ZBUF_F_SACKED;
+                if (SEQ_GT(seq + len, sock->sack_high)) {
+                    sock->sack_high = seq + len;
+                }
+            }
+            seq += len;
+        }
+    }
+}
+
+/*
+ * Queue a segment behind the ones already waiting
+ */
+static void tcp_queue(socket_t *sock, zbuf_t *seg)
+{
+    if (sock->tx_queued == 0) {
+        sock->tx_seq = sock->snd_max;
+    }
+
+    zbuf_set_owner(seg, ZBUF_OWNER_TCP);
+    zbuf_queue_push(&sock->tx_queue, seg);
+    sock->tx_queued += zbuf_pkt_len(seg);
+
+    if (sock->tx_next == NULL) {
+        sock->tx_next = seg;
+    }
+}
+
+/*
+ * Free segments acknowledged in full
+ */
+static void tcp_clean_rtx(socket_t *sock, uint32_t ack)
+{
+    zbuf_t *seg;
+
+    while ((seg = zbuf_queue_peek(&sock->tx_queue)) != NULL) {
+        uint32_t len = zbuf_pkt_len(seg);
+        if (SEQ_GT(sock->tx_seq + len, ack)) {
+            break;
+        }
+
+        if (seg == sock->tx_next) {
+            sock->tx_next = seg->next;
+        }
+
+        zbuf_queue_pop(&sock->tx_queue);
+        sock->tx_seq += len;
+        sock->tx_queued -= len;
+        zbuf_free(seg);
+    }
+}
+
+/*
+ * Duplicate ACK: fast retransmit and fast recovery (RFC 5681, 6582)
+ */
+static void tcp_dupack(socket_t *sock)
+{
+    uint32_t mss = sock->mss;
+
+    if (sock->in_recovery) {
+        /* Each further duplicate is a segment that left the network */
+        sock->cwnd += mss;
+        if (sock->sack_ok) {
+            tcp_retransmit(sock);
+        }
+        return;
+    }
+
+    /* Not for losses in data sent before the last timeout */
+    if (++sock->dupacks != TCP_DUPACK_THRESH || SEQ_LT(sock->snd_una, sock->recover)) {
+        return;
+    }
+
+    uint32_t flight = sock->snd_max - sock->snd_una;
+    sock->ssthresh = (flight / 2 > 2 * mss) ? flight / 2 : 2 * mss;
+    sock->recover = sock->snd_max;
+    sock->in_recovery = 1;
+    sock->rtx_hole = sock->snd_una;
+
+    tcp_retransmit(sock);
+    sock->cwnd = sock->ssthresh + TCP_DUPACK_THRESH * mss;
+}
+
+/*
+ * Process the ACK of a segment in a synchronized state
+ *
+ * Frees acknowledged segments, samples the RTT, grows or deflates the
+ * congestion window and sends what the windows now allow.
+ */
+static void tcp_ack(socket_t *sock, uint32_t seq, uint32_t ack, uint32_t win, bool has_data,
+                    const tcp_opts_t *opt)
+{
+    uint32_t mss = sock->mss;
+
+    if (SEQ_GT(ack, sock->snd_max)) {
+        /* Acknowledges something not yet sent */
+        tcp_send_segment(sock, TCP_FLAG_ACK);
+        return;
+    }
+    if (SEQ_LT(ack, sock->snd_una)) {
+        return;     /* Old duplicate */
+    }
+
+    bool dup = (ack == sock->snd_una && !has_data && win == sock->snd_wnd &&
+                sock->snd_max != sock->snd_una);
+
+    /* Window update, unless from an older segment than the last one */
+    if (SEQ_LT(sock->snd_wl1, seq) ||
+        (sock->snd_wl1 == seq && SEQ_LEQ(sock->snd_wl2, ack))) {
+        sock->snd_wnd = win;
+        sock->snd_wl1 = seq;
+        sock->snd_wl2 = ack;
+    }
+
+    /*
+     * The peer answers window probes: not a dead connection. A closed
+     * socket gives up after the usual retries all the same.
+     */
+    if (sock->snd_wnd == 0 && !(sock->flags & SOCK_F_ORPHAN)) {
+        sock->retries = 0;
+    }
+
+    if (ack == sock->snd_una) {
+        if (sock->sack_ok) {
+            tcp_sack_update(sock, opt);
+        }
+        if (dup) {
+            tcp_dupack(sock);
+        }
+        tcp_push(sock);
+        return;
+    }
+
+    uint32_t acked = ack - sock->snd_una;
+    sock->snd_una = ack;
+    tcp_clean_rtx(sock, ack);
+    if (sock->sack_ok) {
+        tcp_sack_update(sock, opt);
+    }
+
+    /* Data resent after a timeout had arrived after all */
+    if (SEQ_GT(ack, sock->snd_nxt)) {
+        zbuf_t *head = zbuf_queue_peek(&sock->tx_queue);
+        sock->tx_next = head;
+        sock->snd_nxt = (head != NULL) ? sock->tx_seq : ack;
+    }
+
+    /* With timestamps every ACK of new data is a sample (RFC 7323 4) */
+    tick_t ts_rtt = (sock->ts_ok && opt->ts_ok && opt->tsecr != 0) ? tcp_ts_rtt(opt->tsecr) : 0;
+    if (ts_rtt != 0) {
+        sock->rtt_active = 0;
+        tcp_update_rto(sock, ts_rtt);
+    } else if (sock->rtt_active && SEQ_GT(ack, sock->rtt_seq)) {
+        sock->rtt_active = 0;
+        tcp_update_rto(sock, get_system_ticks() - sock->rtt_start);
+    }
+
+    /* RFC 6298 5.2/5.3: stop when all is acknowledged, else restart */
+    sock->retries = 0;
+    if (sock->snd_una == sock->snd_max) {
+        sock->rtx_armed = 0;
+    } else {
+        tcp_timer_restart(sock);
+    }
+
+    if (sock->in_recovery) {
+        if (SEQ_GEQ(ack, sock->recover)) {
+            /* Full ACK: deflate to min(ssthresh, max(FlightSize, SMSS) + SMSS) */
+            uint32_t flight = sock->snd_max - sock->snd_una;
+            uint32_t cwnd = ((flight > mss) ? flight : mss) + mss;
+            sock->cwnd = (cwnd < sock->ssthresh) ? cwnd : sock->ssthresh;
+            sock->in_recovery = 0;
+            sock->dupacks = 0;
+        } else {
+            /* Partial ACK: the first unacknowledged segment is lost too */
+            tcp_retransmit(sock);
+            sock->cwnd = (acked < sock->cwnd) ? sock->cwnd - acked : 0;
+            if (acked >= mss || sock->cwnd < mss) {
+                sock->cwnd += mss;
+            }
+        }
+    } else {
+        sock->dupacks = 0;
+        if (sock->cwnd < sock->ssthresh) {
+            /* Slow start, at most one segment per ACK (RFC 3465, L = 1) */
+            sock->cwnd += (acked < mss) ? acked : mss;
+        } else {
+            /* Congestion avoidance: about one segment per RTT */
+            uint32_t inc = mss * mss / sock->cwnd;
+            sock->cwnd += inc ? inc : 1;
+        }
+    }
+
+    if ((sock->flags & SOCK_F_TX_WAIT) && sock->tx_queued < sock->sndbuf) {
+        sock->flags &= ~SOCK_F_TX_WAIT;
+        sem_post(&sock->tx_sem);
+        sock_poll_notify(sock, SOCK_EV_OUT);
+    }
+
+    tcp_push(sock);
+}
+
+/*
+ * Retransmission timer expiry (RFC 6298 5.4-5.6, RFC 5681 3.1)
+ */
+static void tcp_timeout(socket_t *sock)
+{
+    uint32_t mss = sock->mss;
+
+    switch (sock->state) {
+    case TCP_SYN_SENT:
+        sock->snd_nxt = sock->snd_una;
+        tcp_send_segment(sock, TCP_FLAG_SYN);
+        return;
+    case TCP_SYN_RECEIVED:
+        sock->snd_nxt = sock->snd_una;
+        tcp_send_segment(sock, TCP_FLAG_SYN | TCP_FLAG_ACK);
+        return;
+    default:
+        break;
+    }
+
+    zbuf_t *head = zbuf_queue_peek(&sock->tx_queue);
+    if (head == NULL) {
+        /* Only our FIN is outstanding */
+        if (sock->state == TCP_FIN_WAIT_1 || sock->state == TCP_CLOSING ||
+            sock->state == TCP_LAST_ACK) {
+            sock->snd_nxt = sock->snd_una;
+            tcp_send_segment(sock, TCP_FLAG_FIN | TCP_FLAG_ACK);
+        }
+        return;
+    }
+
+    if (sock->snd_una == sock->snd_max) {
+        /* Nothing in flight against a zero window: probe with the next segment */
+        zbuf_t *seg = sock->tx_next;
+        if (seg != NULL && tcp_xmit(sock, TCP_FLAG_ACK | TCP_FLAG_PSH, sock->snd_nxt, seg) != STATUS_NO_MEM) {
+            sock->snd_nxt += zbuf_pkt_len(seg);
+            sock->snd_max = sock->snd_nxt;
+            sock->tx_next = seg->next;
+        }
+        return;
+    }
+
+    /* The peer may have dropped what it SACKed (RFC 2018 section 8) */
+    for (zbuf_t *seg = head; seg != NULL; seg = seg->next) {
+        seg->flags &= ~ZBUF_F_SACKED;
+    }
+    sock->sack_high = sock->snd_una;
+
+    /* Loss: one segment, back to the oldest unacknowledged */
+    uint32_t flight = sock->snd_max - sock->snd_una;
+    sock->ssthresh = (flight / 2 > 2 * mss) ? flight / 2 : 2 * mss;
+    sock->cwnd = mss;
+    sock->recover = sock->snd_max;
+    sock->in_recovery = 0;
+    sock->dupacks = 0;
+    sock->rtt_active = 0;
+
+    sock->tx_next = head;
+    sock->snd_nxt = sock->tx_seq;
+    tcp_push(sock);
+}
+
+/* Handshake complete: the ACK covers our SYN and opens the send window */
+static void tcp_established(socket_t *sock, uint32_t seq, uint32_t ack, uint32_t win)
+{
+    sock->snd_una = ack;
+    sock->snd_wnd = win;
+    sock->snd_wl1 = seq;
+    sock->snd_wl2 = ack;
+    sock->tx_seq = ack;
+    sock->rtx_armed = 0;
+    sock->retries = 0;
+    sock->state = TCP_ESTABLISHED;
+
+    sock->rcv_space_seq = sock->rcv_nxt;
+    sock->rcv_space_time = get_system_ticks();
+}
+
+/*
+ * Adopt the options of the peer's SYN or SYN-ACK
+ *
+ * What we offered and the peer did not is off. Segments are cut to the
+ * peer's MSS, 536 if it sent none, less the room a timestamp takes.
+ */
+static void tcp_syn_options(socket_t *sock, const tcp_opts_t *opt)
+{
+    uint32_t mss = tcp_adv_mss(sock);
+    uint32_t peer = opt->mss ? opt->mss : TCP_MSS_DEFAULT;
+    if (peer < mss) mss = peer;
+
+    sock->sack_ok = CONFIG_TCP_SACK && opt->sack_ok;
+
+    sock->ws_ok = CONFIG_TCP_WSCALE && opt->ws_ok;
+    if (sock->ws_ok) {
+        sock->snd_wscale = (opt->wscale > TCP_WSCALE_MAX) ? TCP_WSCALE_MAX : opt->wscale;
+        sock->rcv_wscale = tcp_wscale(sock);
+    } else {
+        sock->snd_wscale = 0;
+        sock->rcv_wscale = 0;
+    }
+
+    sock->ts_ok = CONFIG_TCP_TIMESTAMPS && opt->ts_ok;
+    if (sock->ts_ok) {
+        sock->ts_recent = opt->tsval;
+        mss -= TCP_TS_LEN;
+    }
+
+    sock->mss = (uint16_t)mss;
+}
+
+/* In-order data to the application (zero-copy) */
+static void tcp_deliver(socket_t *sock, zbuf_t *zb)
+{
+    sock->rcv_nxt += zb->len;
+    sock->rx_queued += zb->len;
+    zbuf_set_owner(zb, ZBUF_OWNER_SOCK);
+    zbuf_queue_push(&sock->rx_queue, zb);
+    sem_post(&sock->rx_sem);
+    sock_poll_notify(sock, SOCK_EV_IN);
+}
+
+/*
+ * Hold a segment beyond rcv_nxt on the reassembly queue
+ *
+ * The queue is sorted by sequence and never overlaps: what is already
+ * held is cut from the new segment, held segments it covers are freed.
+ */
+static void tcp_ooo_insert(socket_t *sock, zbuf_t *zb, uint32_t seq)
+{
+    zbuf_t **pp = &sock->ooo_head;
+    uint32_t end = seq + zb->len;
+
+    /* First held segment that ends after seq */
+    while (*pp != NULL && SEQ_LEQ((*pp)->seq + (*pp)->len, seq)) {
+        pp = &(*pp)->next;
+    }
+
+    if (*pp != NULL && SEQ_LEQ((*pp)->seq, seq)) {
+        uint32_t held_end = (*pp)->seq + (*pp)->len;
+        if (SEQ_GEQ(held_end, end)) {
+            zbuf_free(zb);      /* Nothing new */
+            return;
+        }
+        zbuf_pull(zb, held_end - seq);
+        seq = held_end;
+        pp = &(*pp)->next;
+    }
+
+    while (*pp != NULL && SEQ_LEQ((*pp)->seq + (*pp)->len, end)) {
+        zbuf_t *covered = *pp;
+        *pp = covered->next;
+        sock->ooo_count--;
+        zbuf_free(covered);
+    }
+
+    if (*pp != NULL && SEQ_LT((*pp)->seq, end)) {
+        zbuf_trim(zb, end - (*pp)->seq);
+    }
+
+    if (zb->len == 0 || sock->ooo_count >= CONFIG_TCP_OOO_SEGS) {
+        zbuf_free(zb);
+        return;
+    }
+
+    zbuf_set_owner(zb, ZBUF_OWNER_TCP);
+    zb->seq = seq;
+    zb->next = *pp;
+    *pp = zb;
+    sock->ooo_count++;
+    sock->ooo_last = seq;
+}
+
+static void tcp_ooo_flush(socket_t *sock)
+{
+    while (sock->ooo_head != NULL) {
+        zbuf_t *zb = sock->ooo_head;
+        sock->ooo_head = zb->next;
+        zbuf_free(zb);
+    }
+    sock->ooo_count = 0;
+}
+
+/*
+ * Acknowledge in-order data (RFC 1122 4.2.3.2)
+ *
+ * Every second segment is acknowledged at once, a single one within
+ * CONFIG_TCP_DELACK_MS unless data going back carries the ACK first.
+ * Quick-ACK mode acknowledges each segment.
+ */
+static void tcp_ack_delayed(socket_t *sock)
+{
+    if ((sock->flags & SOCK_F_QUICKACK) || ++sock->ack_pending >= 2) {
+        tcp_send_segment(sock, TCP_FLAG_ACK);
+        return;
+    }
+
+    sock->ack_start = get_system_ticks();
+    tcp_timer_arm(sock);
+}
+
+/*
+ * Receive segment payload (TCP header already pulled)
+ *
+ * In-order data is delivered along with whatever it makes contiguous
+ * on the reassembly queue; data beyond a hole is held there. Anything
+ * but plain in-order data is acknowledged at once, so a hole shows up
+ * at the sender as duplicate ACKs carrying SACK blocks. Returns true
+ * if zb was taken.
+ */
+static bool tcp_data(socket_t *sock, zbuf_t *zb, uint32_t seq)
+{
+    uint32_t end = seq + zb->len;
+    bool taken = false;
+    bool delay = false;
+
+    if (SEQ_GT(end, sock->rcv_nxt) && SEQ_LT(seq, sock->rcv_nxt + sock->rcv_wnd)) {
+        if (SEQ_LT(seq, sock->rcv_nxt)) {
+            zbuf_pull(zb, sock->rcv_nxt - seq);     /* Partly old */
+            seq = sock->rcv_nxt;
+        }
+
+        if (seq == sock->rcv_nxt) {
+            delay = (sock->ooo_head == NULL);
+            tcp_deliver(sock, zb);
+
+            /* Drain what is now contiguous */
+            while (sock->ooo_head != NULL && SEQ_LEQ(sock->ooo_head->seq, sock->rcv_nxt)) {
+                zbuf_t *held = sock->ooo_head;
+                sock->ooo_head = held->next;
+                held->next = NULL;
+                sock->ooo_count--;
+
+                if (SEQ_LEQ(held->seq + held->len, sock->rcv_nxt)) {
+                    zbuf_free(held);
+                    continue;
+                }
+                zbuf_pull(held, sock->rcv_nxt - held->seq);
+                tcp_deliver(sock, held);
+            }
+        } else {
+            tcp_ooo_insert(sock, zb, seq);
+        }
+        taken = true;
+    }
+
+    if (delay) {
+        tcp_ack_delayed(sock);
+    } else {
+        /* Also answers duplicates and out-of-window data */
+        tcp_send_segment(sock, TCP_FLAG_ACK);
+    }
+    return taken;
+}
+
+/*
+ * Allocate a socket and give it a descriptor
+ */
+static socket_t *sock_alloc(int type)
+{
+    socket_t *sock = heap_alloc(sizeof(socket_t));
+    if (sock == NULL) {
+        return NULL;
+    }
+
+    sock->type = type;
+    sock->state = TCP_CLOSED;
+    sock->local.addr = 0;
+    sock->local.port = 0;
+    sock->remote.addr = 0;
+    sock->remote.port = 0;
+    route_cache_init(&sock->route);
+    sock->priority = 0;
+    sock->mss = CONFIG_TCP_MSS;
+    tcp_init_conn(sock, 0);
+    sock->snd_wnd = CONFIG_TCP_WINDOW_SIZE;
+    sock->rcv_nxt = 0;
+    sock->rcv_wnd = CONFIG_TCP_WINDOW_SIZE;
+    sock->ack_pending = 0;
+    sock->sack_ok = 0;
+    sock->ws_ok = 0;
+    sock->snd_wscale = 0;
+    sock->rcv_wscale = 0;
+    sock->ts_ok = 0;
+    sock->ts_recent = 0;
+    sock->last_ack_sent = 0;
+    sock->rcv_space_seq = 0;
+    sock->rcv_space_time = 0;
+    sock->rcv_rtt = 0;
+    sock->rcv_time = 0;
+    sock->ka_probes = 0;
+    timer_init(&sock->tmr, tcp_timer_expire, sock);
+    sock->tmr_due = 0;
+    sock->tmr_armed = 0;
+    sock->tmr_state = TCP_TMR_IDLE;
+    sock->next = NULL;
+    sock->watch = NULL;
+    sock->flags = 0;
+    sock->timeout = 0;
+    sock->hnext = NULL;
+    sock->hbucket = NULL;
+    sock->parent = NULL;
+    sock->qnext = NULL;
+    sock->pending = NULL;
+    sock->npending = 0;
+    sock->backlog = 0;
+
+    zbuf_queue_init(&sock->rx_queue);
+    zbuf_queue_init(&sock->tx_queue);
+    sock->tx_next = NULL;
+    sock->tx_queued = 0;
+    sock->sndbuf = CONFIG_TCP_SNDBUF;
+    sock->rx_queued = 0;
+    sock->rcvbuf = CONFIG_TCP_WINDOW_SIZE;
+    sock->ooo_head = NULL;
+    sock->ooo_count = 0;
+    sem_init(&sock->rx_sem, 0);
+    sem_init(&sock->tx_sem, 0);
+    mutex_init(&sock->lock);
+    sock->refcnt = 1;
+
+    /* Next descriptor whose table slot is free */
+    spin_lock_irq(&socket_lock);
+    int fd = -1;
+    for (int i = 0; i < CONFIG_NET_MAX_SOCKETS; i++) {
+        int n = next_fd++;
+        if (socket_table[n % CONFIG_NET_MAX_SOCKETS] == NULL) {
+            fd = n;
+            sock->fd = fd;
+            socket_table[fd % CONFIG_NET_MAX_SOCKETS] = sock;
+            break;
+        }
+    }
+    spin_unlock_irq(&socket_lock);
+
+    if (fd < 0) {
+        heap_free(sock);
+        return NULL;
+    }
+
+    return sock;
+}
+
+/*
+ * Passive Open
+ *
+ * A SYN to a listener creates a child socket in SYN_RECEIVED, hashed on
+ * its 4-tuple so the rest of the handshake goes straight to it, and
+ * puts it on the listener's pending list. Children that complete the
+ * handshake are handed out by sock_accept() in the order their SYNs
+ * came; ones that fail are reaped from the list. The backlog bounds
+ * the list as a whole, SYN_RECEIVED and ready children alike.
+ */
+#define TCP_PENDING_READY   0   /* Handshake complete, not yet accepted */
+#define TCP_PENDING_DEAD    1   /* Reset or timed out before accept */
+#define TCP_PENDING_ANY     2
+
+static bool tcp_pending_match(socket_t *child, int which)
+{
+    switch (which) {
+    case TCP_PENDING_READY:
+        return child->state != TCP_SYN_RECEIVED && child->state != TCP_CLOSED;
+    case TCP_PENDING_DEAD:
+        return child->state == TCP_CLOSED;
+    default:
+        return true;
+    }
+}
+
+/*
+ * Take the first matching child off a listener's pending list, or NULL
+ */
+static socket_t *tcp_dequeue(socket_t *lsock, int which)
+{
+    spin_lock_irq(&tcp_lock);
+
+    socket_t **pp = &lsock->pending;
+    while (*pp != NULL && !tcp_pending_match(*pp, which)) {
+        pp = &(*pp)->qnext;
+    }
+
+    socket_t *child = *pp;
+    if (child != NULL) {
+        *pp = child->qnext;
+        child->qnext = NULL;
+        child->parent = NULL;
+        lsock->npending--;
+    }
+
+    spin_unlock_irq(&tcp_lock);
+    return child;
+}
+
+/* Free children whose handshake failed, or that were reset unaccepted */
+static void tcp_reap(socket_t *lsock)
+{
+    socket_t *child;
+
+    while ((child = tcp_dequeue(lsock, TCP_PENDING_DEAD)) != NULL) {
+        sock_close(child->fd);
+    }
+}
+
+/*
+ * Child socket for a SYN to a listener, called with lsock->lock held
+ *
+ * Takes the listener's options. A SYN beyond the backlog is dropped,
+ * and the peer retries it.
+ */
+static void tcp_spawn(socket_t *lsock, uint32_t laddr, uint32_t raddr, uint16_t rport,
+                      uint32_t seq, const tcp_opts_t *opt)
+{
+    if (lsock->npending >= lsock->backlog) {
+        tcp_reap(lsock);
+        if (lsock->npending >= lsock->backlog) {
+            return;
+        }
+    }
+
+    socket_t *sock = sock_alloc(SOCK_STREAM);
+    if (sock == NULL) {
+        return;
+    }
+
+    sock->local.addr = laddr;
+    sock->local.port = lsock->local.port;
+    sock->remote.addr = raddr;
+    sock->remote.port = rport;
+    sock->priority = lsock->priority;
+    sock->sndbuf = lsock->sndbuf;
+    sock->rcvbuf = lsock->rcvbuf;
+    sock->flags = lsock->flags & (SOCK_F_QUICKACK | SOCK_F_NODELAY | SOCK_F_CORK |
+                                  SOCK_F_RCVBUF | SOCK_F_KEEPALIVE);
+
+    sock->rcv_nxt = seq + 1;
+    tcp_syn_options(sock, opt);
+    tcp_init_conn(sock, get_system_ticks());  /* ISN */
+    sock->state = TCP_SYN_RECEIVED;
+    tcp_send_segment(sock, TCP_FLAG_SYN | TCP_FLAG_ACK);
+
+    spin_lock_irq(&tcp_lock);
+    socket_t **pp = &lsock->pending;
+    while (*pp != NULL) {
+        pp = &(*pp)->qnext;
+    }
+    *pp = sock;
+    sock->parent = lsock;
+    lsock->npending++;
+    spin_unlock_irq(&tcp_lock);
+
+    sock_hash_insert(sock);
+}
+
+/*
+ * Handshake complete: wake sock_accept() on the listener
+ *
+ * Poll sets are told after tcp_lock is dropped; tcp_poll() takes it.
+ */
+static void tcp_accept_ready(socket_t *sock)
+{
+    spin_lock_irq(&tcp_lock);
+    socket_t *parent = sock->parent;
+    if (parent != NULL) {
+        sem_post(&parent->rx_sem);
+    }
+    spin_unlock_irq(&tcp_lock);
+
+    if (parent != NULL) {
+        sock_poll_notify(parent, SOCK_EV_IN);
+    }
+}
+
+/*
+ * Readiness of a TCP socket, for poll sets
+ *
+ * A listener is readable with a connection to accept. A connection is
+ * readable with data queued or once the peer has closed, writable while
+ * the send buffer has room; a dropped one reports an error.
+ */
+uint32_t tcp_poll(socket_t *sock)
+{
+    uint32_t ev = 0;
+
+    if (sock->state == TCP_LISTEN) {
+        spin_lock_irq(&tcp_lock);
+        for (socket_t *child = sock->pending; child != NULL; child = child->qnext) {
+            if (tcp_pending_match(child, TCP_PENDING_READY)) {
+                ev = SOCK_EV_IN;
+                break;
+            }
+        }
+        spin_unlock_irq(&tcp_lock);
+        return ev;
+    }
+
+    if (zbuf_queue_len(&sock->rx_queue) > 0) {
+        ev |= SOCK_EV_IN;
+    }
+
+    switch (sock->state) {
+    case TCP_ESTABLISHED:
+        break;
+    case TCP_CLOSE_WAIT:
+        ev |= SOCK_EV_IN | SOCK_EV_HUP;
+        break;
+    case TCP_CLOSED:
+        if (sock->remote.port != 0) {
+            ev |= SOCK_EV_IN | SOCK_EV_ERR | SOCK_EV_HUP;  /* Dropped */
+        }
+        return ev;
+    default:
+        return ev;
+    }
+
+    if (sock->tx_queued < sock->sndbuf) {
+        ev |= SOCK_EV_OUT;
+    }
+    return ev;
+}
+
+/*
+ * Closed Connections
+ *
+ * sock_close() hands the descriptor's reference to the connection,
+ * which sends what is left and its FIN. Once it reaches CLOSED the
+ * input path or the timer task, whichever gets there first, frees it.
+ */
+
+/* Claim a finished orphan for freeing, called with sock->lock held */
+static bool tcp_orphan_done(socket_t *sock)
+{
+    if (!(sock->flags & SOCK_F_ORPHAN) || sock->state != TCP_CLOSED) {
+        return false;
+    }
+    sock->flags &= ~SOCK_F_ORPHAN;
+    return true;
+}
+
+/* Drop a claimed orphan, its timer already stopped */
+static void tcp_orphan_free(socket_t *sock)
+{
+    sock_hash_remove(sock);
+    sock_put(sock);
+}
+
+/* Both sides closed: the connection lingers 2*MSL, from rtx_start */
+static void tcp_time_wait(socket_t *sock)
+{
+    sock->state = TCP_TIME_WAIT;
+    tcp_timer_restart(sock);
+}
+
+/*
+ * TCP Input Handler
+ */
+void tcp_input(netif_t *nif, zbuf_t *zb)
+{
+    if (zb->len < sizeof(tcp_hdr_t)) {
+        zbuf_free(zb);
+        return;
+    }
+
+    tcp_hdr_t *tcp = (tcp_hdr_t *)zb->data;
+    ip_hdr_t *ip = (ip_hdr_t *)(zb->data - sizeof(ip_hdr_t));
+
+    uint16_t tcp_len = zb->len;
+    uint8_t tcp_hdr_len = TCP_HDR_LEN(tcp);
+
+    if (tcp_hdr_len < sizeof(tcp_hdr_t) || tcp_hdr_len > tcp_len) {
+        zbuf_free(zb);
+        return;
+    }
+
+    /* Verify checksum unless the device already did */
+    if (!(zb->flags & ZBUF_F_CSUM_VALID) && tcp_checksum(ip, tcp, tcp_len) != 0) {
+        nif->rx_errors++;
+        zbuf_free(zb);
+        return;
+    }
+
+    uint32_t src_ip = ntohl(ip->src);
+    uint32_t dst_ip = ntohl(ip->dst);
+    uint16_t src_port = ntohs(tcp->sport);
+    uint16_t dst_port = ntohs(tcp->dport);
+    uint32_t seq = ntohl(tcp->seq);
+    uint32_t ack = ntohl(tcp->ack);
+    uint32_t win = ntohs(tcp->win);
+    uint8_t flags = tcp->flags;
+    bool has_data = (tcp_hdr_len < zb->len) || (flags & (TCP_FLAG_SYN | TCP_FLAG_FIN));
+    uint32_t fin_seq = seq + tcp_len - tcp_hdr_len;
+    tcp_opts_t opt;
+
+    tcp_parse_options(tcp, &opt);
+
+    /* Find socket */
+    socket_t *sock = sock_lookup(SOCK_STREAM, dst_ip, dst_port, src_ip, src_port);
+    if (sock == NULL) {
+        /* Send RST for unknown connection */
+        if (!(flags & TCP_FLAG_RST)) {
+            tcp_send_rst(nif, ip, tcp, tcp_len);
+        }
+        zbuf_free(zb);
+        return;
+    }
+
+    mutex_lock(&sock->lock);
+
+    /* Anything from the peer shows it is alive */
+    sock->rcv_time = get_system_ticks();
+    sock->ka_probes = 0;
+
+    if (!(flags & TCP_FLAG_SYN)) {
+        win <<= sock->snd_wscale;
+    }
+
+    /* Timestamps (RFC 7323): PAWS, the value to echo, the receiver's RTT */
+    if (sock->ts_ok && opt.ts_ok && sock->state >= TCP_SYN_RECEIVED && !(flags & TCP_FLAG_RST)) {
+        if (SEQ_LT(opt.tsval, sock->ts_recent)) {
+            /* Older than the last one: an old duplicate from a wrapped sequence */
+            tcp_send_segment(sock, TCP_FLAG_ACK);
+            mutex_unlock(&sock->lock);
+            sock_put(sock);
+            zbuf_free(zb);
+            return;
+        }
+        if (SEQ_LEQ(seq, sock->last_ack_sent)) {
+            sock->ts_recent = opt.tsval;
+        }
+        tick_t rtt = (opt.tsecr != 0 && tcp_len > tcp_hdr_len) ? tcp_ts_rtt(opt.tsecr) : 0;
+        if (rtt != 0) {
+            sock->rcv_rtt = sock->rcv_rtt ? (7 * sock->rcv_rtt + rtt) / 8 : rtt;
+        }
+    }
+
+    /* A reset ends a closed connection at once, short of TIME_WAIT (RFC 1337) */
+    if ((flags & TCP_FLAG_RST) && (sock->flags & SOCK_F_ORPHAN) && sock->state != TCP_TIME_WAIT) {
+        sock->state = TCP_CLOSED;
+        sock->rtx_armed = 0;
+    }
+
+    /* TCP State Machine */
+    switch (sock->state) {
+    case TCP_LISTEN:
+        if ((flags & (TCP_FLAG_SYN | TCP_FLAG_ACK | TCP_FLAG_RST)) == TCP_FLAG_SYN) {
+            tcp_spawn(sock, dst_ip, src_ip, src_port, seq, &opt);
+        } else if ((flags & TCP_FLAG_ACK) && !(flags & TCP_FLAG_RST)) {
+            tcp_send_rst(nif, ip, tcp, tcp_len);    /* No such handshake */
+        }
+        break;
+
+    case TCP_SYN_SENT:
+        if ((flags & (TCP_FLAG_SYN | TCP_FLAG_ACK)) == (TCP_FLAG_SYN | TCP_FLAG_ACK)) {
+            sock->rcv_nxt = seq + 1;
+            tcp_syn_options(sock, &opt);
+            sock->cwnd = tcp_initial_cwnd(sock->mss);
+            tcp_established(sock, seq, ack, win);
+
+            /* Send ACK */
+            tcp_send_segment(sock, TCP_FLAG_ACK);
+            sem_post(&sock->tx_sem);  /* Wake connect() */
+            sock_poll_notify(sock, SOCK_EV_OUT);
+        }
+        break;
+
+    case TCP_SYN_RECEIVED:
+        if (flags & TCP_FLAG_RST) {
+            sock->state = TCP_CLOSED;   /* Reaped by the listener */
+            sock->rtx_armed = 0;
+            break;
+        }
+        if ((flags & (TCP_FLAG_SYN | TCP_FLAG_ACK)) == TCP_FLAG_SYN) {
+            /* SYN retransmitted: our SYN-ACK was lost */
+            sock->snd_nxt = sock->snd_una;
+            tcp_send_segment(sock, TCP_FLAG_SYN | TCP_FLAG_ACK);
+            break;
+        }
+        if (!(flags & TCP_FLAG_ACK) || ack != sock->snd_max) {
+            break;
+        }
+        tcp_established(sock, seq, ack, win);
+        tcp_accept_ready(sock);
+        /* The ACK may carry data or FIN already */
+        /* fall through */
+
+    case TCP_ESTABLISHED:
+    case TCP_FIN_WAIT_1:
+    case TCP_FIN_WAIT_2:
+    case TCP_CLOSING:
+        /* Handle incoming data */
+        if (flags & TCP_FLAG_ACK) {
+            tcp_ack(sock, seq, ack, win, has_data, &opt);
+        }
+
+        /* Our FIN is acknowledged */
+        if (tcp_fin_acked(sock)) {
+            if (sock->state == TCP_FIN_WAIT_1) {
+                /* Linger for the peer's FIN, rtx_start marks the entry */
+                sock->state = TCP_FIN_WAIT_2;
+                tcp_timer_restart(sock);
+            } else if (sock->state == TCP_CLOSING) {
+                tcp_time_wait(sock);
+            }
+        }
+
+        /* Process data */
+        if (tcp_hdr_len < zb->len) {
+            zbuf_pull(zb, tcp_hdr_len);
+            if (tcp_data(sock, zb, seq)) {
+                zb = NULL;  /* Don't free */
+            }
+        }
+
+        /* Handle FIN, once everything before it has arrived */
+        if ((flags & TCP_FLAG_FIN) && fin_seq == sock->rcv_nxt) {
+            sock->rcv_nxt++;
+            tcp_send_segment(sock, TCP_FLAG_ACK);
+
+            if (sock->state == TCP_ESTABLISHED) {
+                sock->state = TCP_CLOSE_WAIT;
+                sem_post(&sock->rx_sem);  /* Wake recv() */
+                sock_poll_notify(sock, SOCK_EV_IN | SOCK_EV_HUP);
+            } else if (sock->state == TCP_FIN_WAIT_1) {
+                sock->state = TCP_CLOSING;  /* Both FINs crossed */
+            } else if (sock->state == TCP_FIN_WAIT_2) {
+                tcp_time_wait(sock);
+            }
+        }
+        break;
+
+    case TCP_CLOSE_WAIT:
+        /* Application must call close(); until then it may still send */
+        if (flags & TCP_FLAG_ACK) {
+            tcp_ack(sock, seq, ack, win, has_data, &opt);
+        }
+        break;
+
+    case TCP_LAST_ACK:
+        if (flags & TCP_FLAG_ACK) {
+            tcp_ack(sock, seq, ack, win, has_data, &opt);
+            if (tcp_fin_acked(sock)) {
+                sock->state = TCP_CLOSED;
+            }
+        }
+        break;
+
+    case TCP_TIME_WAIT:
+        /* The peer resent its FIN, so our ACK was lost: again, and 2*MSL anew */
+        if ((flags & TCP_FLAG_FIN) && fin_seq + 1 == sock->rcv_nxt) {
+            tcp_send_segment(sock, TCP_FLAG_ACK);
+            tcp_timer_restart(sock);
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    bool done = tcp_orphan_done(sock);
+    mutex_unlock(&sock->lock);
+
+    if (done) {
+        tcp_timer_cancel(sock);
+        tcp_orphan_free(sock);
+    }
+    sock_put(sock);
+
+    if (zb != NULL) {
+        zbuf_free(zb);
+    }
+}
+
+/*
+ * Socket API Implementation
+ */
+int sock_socket(int type)
+{
+    socket_t *sock = sock_alloc(type);
+    return (sock != NULL) ? sock->fd : -1;
+}
+
+int sock_bind(int fd, sockaddr_t *addr)
+{
+    socket_t *sock = socket_table[fd % CONFIG_NET_MAX_SOCKETS];
+    if (sock == NULL) return -1;
+
+    mutex_lock(&sock->lock);
+    sock->local = *addr;
+    mutex_unlock(&sock->lock);
+
+    /* UDP receives from here on; TCP is hashed by listen/connect */
+    if (sock->type == SOCK_DGRAM) {
+        sock_hash_insert(sock);
+    }
+
+    return 0;
+}
+
+/*
+ * Listen for connections, at most backlog of them pending accept
+ */
+int sock_listen(int fd, int backlog)
+{
+    socket_t *sock = socket_table[fd % CONFIG_NET_MAX_SOCKETS];
     if (sock == NULL || sock->type != SOCK_STREAM) return -1;
 
+    if (backlog < 1) backlog = 1;
+    if (backlog > CONFIG_NET_MAX_SOCKETS) backlog = CONFIG_NET_MAX_SOCKETS;
+
     mutex_lock(&sock->lock);
+    sock->backlog = (uint16_t)backlog;
     sock->state = TCP_LISTEN;
     mutex_unlock(&sock->lock);
 
-    /* Add to listen list */
-    spin_lock_irq(&tcp_lock);
-    sock->next = tcp_listen_list;
-    tcp_listen_list = sock;
-    spin_unlock_irq(&tcp_lock);
+    sock_hash_insert(sock);
+    return 0;
+}
+
+/* Whether calls on the socket wait, or fail with nothing ready */
+static bool sock_blocking(socket_t *sock)
+{
+    return !(sock->flags & SOCK_F_NONBLOCK);
+}
+
+/* Wait for a buffer, a connection or end of stream, or just look */
+static status_t sock_wait_rx(socket_t *sock, bool wait)
+{
+    return wait ? sem_wait(&sock->rx_sem) : sem_trywait(&sock->rx_sem);
+}
+
+/*
+ * Take a completed connection off a listener
+ *
+ * Without wait, STATUS_WOULD_BLOCK if no handshake has completed yet.
+ * STATUS_ERROR once the listener is closed.
+ */
+status_t tcp_accept_conn(socket_t *sock, bool wait, socket_t **conn)
+{
+    for (;;) {
+        tcp_reap(sock);
+
+        socket_t *child = tcp_dequeue(sock, TCP_PENDING_READY);
+        if (child != NULL) {
+            *conn = child;
+            return STATUS_OK;
+        }
+
+        if (sock->state != TCP_LISTEN) {
+            return STATUS_ERROR;    /* Closed while waiting */
+        }
+        status_t ret = sock_wait_rx(sock, wait);
+        if (ret != STATUS_OK) {
+            return ret;
+        }
+    }
+}
+
+/*
+ * Accept a connection: returns the descriptor of a new socket, at once
+ * if a handshake has already completed
+ */
+int sock_accept(int fd, sockaddr_t *addr)
+{
+    socket_t *sock = socket_table[fd % CONFIG_NET_MAX_SOCKETS];
+    if (sock == NULL || sock->state != TCP_LISTEN) return -1;
+
+    socket_t *child;
+    if (tcp_accept_conn(sock, sock_blocking(sock), &child) != STATUS_OK) {
+        return -1;
+    }
+
+    if (addr != NULL) {
+        *addr = child->remote;
+    }
+    return child->fd;
+}
+
+int sock_connect(int fd, sockaddr_t *addr)
+{
+    socket_t *sock = socket_table[fd % CONFIG_NET_MAX_SOCKETS];
+    if (sock == NULL) return -1;
+
+    mutex_lock(&sock->lock);
+
+    sock->remote = *addr;
+    if (sock->local.port == 0) {
+        sock->local.port = 49152 + (get_system_ticks() % 16384);
+    }
+    if (sock->local.addr == 0) {
+        /* Source address of the interface the route leaves on */
+        uint32_t next_hop;
+        netif_t *nif = route_lookup_cached(&sock->route, addr->addr, &next_hop);
+        if (nif) sock->local.addr = nif->ip;
+    }
+
+    /* Offered on the SYN; tcp_syn_options() settles them */
+    sock->mss = tcp_adv_mss(sock);
+    sock->rcv_wscale = CONFIG_TCP_WSCALE ? tcp_wscale(sock) : 0;
+    sock->snd_wscale = 0;
+    sock->sack_ok = 0;
+    sock->ws_ok = 0;
+    sock->ts_ok = 0;
+    sock->ts_recent = 0;
+
+    tcp_init_conn(sock, get_system_ticks());  /* ISN */
+    sock->state = TCP_SYN_SENT;
+
+    /* Hashed before the SYN goes out so the SYN-ACK finds us */
+    sock_hash_insert(sock);
+
+    /* Send SYN */
+    tcp_send_segment(sock, TCP_FLAG_SYN);
+    mutex_unlock(&sock->lock);
+
+    /* Wait for connection */
+    sem_wait(&sock->tx_sem);
+
+    return (sock->state == TCP_ESTABLISHED) ? 0 : -1;
+}
+
+/*
+ * Copy user data into a TX buffer chain, summing it on the way for the
+ * TCP checksum. Every buffer but the last holds an even byte count.
+ */
+static zbuf_t *tcp_copy_payload(const uint8_t *src, size_t len)
+{
+    zbuf_t *head = NULL;
+    zbuf_t **link = &head;
+    uint32_t sum = 0;
+
+    while (len > 0) {
+        uint16_t n = (len > ZBUF_DATA_MAX) ? (ZBUF_DATA_MAX & ~1) : len;
+
+        zbuf_t *zb = zbuf_alloc_tx(n);
+        if (zb == NULL) {
+            zbuf_free(head);
+            return NULL;
+        }
+
+        sum = inet_csum_copy(zbuf_put(zb, n), src, n, sum);
+        *link = zb;
+        link = &zb->frag;
+
+        src += n;
+        len -= n;
+    }
+
+    head->csum = sum;
+    head->flags |= ZBUF_F_CSUM_PARTIAL;
+    return head;
+}
+
+/*
+ * Copy len bytes at offset off of a buffer chain into a new TX chain,
+ * for a buffer too long to queue as one segment. Every buffer but the
+ * last holds an even byte count, as the checksum sums them one by one.
+ */
+static zbuf_t *tcp_copy_range(zbuf_t *src, uint32_t off, uint32_t len)
+{
+    zbuf_t *head = NULL;
+    zbuf_t **link = &head;
+
+    while (src != NULL && off >= src->len) {
+        off -= src->len;
+        src = src->frag;
+    }
+
+    while (len > 0 && src != NULL) {
+        uint16_t n = (len > ZBUF_DATA_MAX) ? (ZBUF_DATA_MAX & ~1) : len;
+
+        zbuf_t *zb = zbuf_alloc_tx(n);
+        if (zb == NULL) {
+            zbuf_free(head);
+            return NULL;
+        }
+
+        uint8_t *dst = zbuf_put(zb, n);
+        for (uint16_t i = 0; i < n && src != NULL; i++) {
+            dst[i] = src->data[off++];
+            if (off == src->len) {
+                src = src->frag;
+                off = 0;
+            }
+        }
+
+        *link = zb;
+        link = &zb->frag;
+        len -= n;
+    }
+
+    return head;
+}
+
+/*
+ * Append to the unsent segment at the tail of the queue, up to one MSS
+ *
+ * Small writes held back by Nagle or cork leave as one segment. The
+ * payload sum is extended in place, byte-swapped when the segment so
+ * far has odd length. Returns the number of bytes taken.
+ */
+static uint32_t tcp_append(socket_t *sock, const uint8_t *src, uint32_t len)
+{
+    zbuf_t *tail = sock->tx_queue.tail;
+
+    if (sock->tx_next == NULL || tail->frag != NULL || tail->refcount != 1 ||
+        tail->len >= sock->mss) {
+        return 0;
+    }
+
+    uint32_t n = sock->mss - tail->len;
+    if (n > zbuf_tailroom(tail)) n = zbuf_tailroom(tail);
+    if (n > len) n = len;
+    if (n == 0) {
+        return 0;
+    }
+
+    bool odd = (tail->len & 1) != 0;
+    uint32_t sum = inet_csum_copy(zbuf_put(tail, n), src, n, 0);
+    if (tail->flags & ZBUF_F_CSUM_PARTIAL) {
+        tail->csum += odd ? (((sum & 0xFF) << 8) | (sum >> 8)) : sum;
+    }
+
+    sock->tx_queued += n;
+    return n;
+}
+
+/*
+ * Largest payload queued as one segment: one MSS, or with TSO a
+ * super-segment of whole MSS-sized segments for the device to split.
+ * A queued segment is never split again, so it is kept within cwnd.
+ */
+static uint32_t tcp_send_size(socket_t *sock)
+{
+    uint32_t next_hop;
+    netif_t *nif = route_lookup_cached(&sock->route, sock->remote.addr, &next_hop);
+    uint32_t mss = sock->mss;
+
+    if (nif != NULL && (nif->features & NETIF_F_TSO)) {
+        uint32_t max = nif->gso_max_size - sizeof(ip_hdr_t) - sizeof(tcp_hdr_t);
+        if (max > sock->cwnd) max = sock->cwnd;
+        if (max >= 2 * mss) {
+            return max - (max % mss);
+        }
+    }
+
+    return mss;
+}
+
+/*
+ * Wait for room in the send buffer, called with sock->lock held
+ *
+ * A send larger than the whole buffer goes through once the queue has
+ * drained, rather than never. Without wait the caller gets
+ * STATUS_WOULD_BLOCK instead, and SOCK_EV_OUT once the room is made.
+ */
+static status_t tcp_wait_space(socket_t *sock, uint32_t len, bool wait)
+{
+    for (;;) {
+        if (sock->state != TCP_ESTABLISHED && sock->state != TCP_CLOSE_WAIT) {
+            return STATUS_ERROR;
+        }
+        if (sock->tx_queued == 0 || sock->tx_queued + len <= sock->sndbuf) {
+            return STATUS_OK;
+        }
 
-    return 0;
+        /* What is queued goes out first; its ACKs make the room */
+        tcp_push(sock);
+
+        sock->flags |= SOCK_F_TX_WAIT;
+        if (!wait) {
+            return STATUS_WOULD_BLOCK;
+        }
+        mutex_unlock(&sock->lock);
+        sem_wait(&sock->tx_sem);
+        mutex_lock(&sock->lock);
+    }
 }
 
-int sock_accept(int fd, sockaddr_t *addr)
+/*
+ * Queue a buffer for sending and push what the windows allow
+ *
+ * Takes ownership of zb, except that without wait a full send buffer
+ * returns STATUS_WOULD_BLOCK and leaves zb with the caller. A buffer of
+ * up to one segment is queued as it is, zero-copy; a longer one is cut
+ * into segments by copying.
+ */
+status_t tcp_send_zbuf(socket_t *sock, zbuf_t *zb, bool wait)
 {
-    socket_t *sock = socket_table[fd % CONFIG_NET_MAX_SOCKETS];
-    if (sock == NULL || sock->state != TCP_LISTEN) return -1;
+    uint32_t len = zbuf_pkt_len(zb);
+    if (len == 0) {
+        zbuf_free(zb);
+        return STATUS_OK;
+    }
 
-    /* Wait for connection */
-    sem_wait(&sock->rx_sem);
+    mutex_lock(&sock->lock);
 
-    if (addr != NULL) {
-        *addr = sock->remote;
+    status_t ret = tcp_wait_space(sock, len, wait);
+    if (ret != STATUS_OK) {
+        mutex_unlock(&sock->lock);
+        if (ret != STATUS_WOULD_BLOCK) {
+            zbuf_free(zb);
+        }
+        return ret;
+    }
+
+    uint32_t seg_max = tcp_send_size(sock);
+    if (len <= seg_max) {
+        zb->gso_size = (len > sock->mss) ? sock->mss : 0;
+        tcp_queue(sock, zb);
+    } else {
+        for (uint32_t off = 0; off < len; off += seg_max) {
+            uint32_t n = (len - off < seg_max) ? len - off : seg_max;
+
+            zbuf_t *seg = tcp_copy_range(zb, off, n);
+            if (seg == NULL) {
+                ret = STATUS_NO_MEM;
+                break;
+            }
+
+            seg->gso_size = (n > sock->mss) ? sock->mss : 0;
+            tcp_queue(sock, seg);
+        }
+        zbuf_free(zb);
     }
 
-    return fd;  /* Simplified: return same fd */
+    tcp_push(sock);
+    mutex_unlock(&sock->lock);
+    return ret;
 }
 
-int sock_connect(int fd, sockaddr_t *addr)
+/* Queue a buffer for sending; takes ownership of zb */
+status_t tcp_output(socket_t *sock, zbuf_t *zb)
+{
+    status_t ret = tcp_send_zbuf(sock, zb, sock_blocking(sock));
+    if (ret == STATUS_WOULD_BLOCK) {
+        zbuf_free(zb);
+    }
+    return ret;
+}
+
+int sock_send(int fd, const void *data, size_t len)
 {
     socket_t *sock = socket_table[fd % CONFIG_NET_MAX_SOCKETS];
     if (sock == NULL) return -1;
 
+    const uint8_t *src = (const uint8_t *)data;
+    size_t sent = 0;
+
     mutex_lock(&sock->lock);
 
-    sock->remote = *addr;
-    if (sock->local.port == 0) {
-        sock->local.port = 49152 + (get_system_ticks() % 16384);
-    }
-    if (sock->local.addr == 0) {
-        netif_t *nif = netif_get_default();
-        if (nif) sock->local.addr = nif->ip;
-    }
+    while (sent < len) {
+        size_t seg_max = tcp_send_size(sock);
+        size_t seg = (len - sent < seg_max) ? len - sent : seg_max;
 
-    sock->snd_nxt = get_system_ticks();  /* ISN */
-    sock->snd_una = sock->snd_nxt;
-    sock->state = TCP_SYN_SENT;
+        if (tcp_wait_space(sock, seg, sock_blocking(sock)) != STATUS_OK) break;
 
-    /* Send SYN */
-    tcp_send_segment(sock, TCP_FLAG_SYN, NULL);
+        uint32_t n = tcp_append(sock, src + sent, seg);
+        if (n > 0) {
+            sent += n;
+            continue;
+        }
+
+        zbuf_t *zb = tcp_copy_payload(src + sent, seg);
+        if (zb == NULL) break;
+
+        if (seg > sock->mss) {
+            zb->gso_size = sock->mss;
+        }
+
+        tcp_queue(sock, zb);
+        sent += seg;
+    }
+
+    /* One push for the whole write: PSH marks its last segment */
+    tcp_push(sock);
     mutex_unlock(&sock->lock);
 
-    /* Add to connection list */
-    spin_lock_irq(&tcp_lock);
-    sock->next = tcp_conn_list;
-    tcp_conn_list = sock;
-    spin_unlock_irq(&tcp_lock);
+    return (sent > 0 || len == 0) ? (int)sent : -1;
+}
 
-    /* Wait for connection */
-    sem_wait(&sock->tx_sem);
+/*
+ * Receive buffer autosizing
+ *
+ * Once per receiver RTT: if at least half the buffer arrived in it, the
+ * window is what limits the peer, so the buffer doubles, up to
+ * CONFIG_TCP_RCVBUF_MAX. The RTT comes from echoed timestamps, else
+ * from our own sends; with neither the buffer stays as it is.
+ */
+static void tcp_rcvbuf_grow(socket_t *sock)
+{
+    tick_t rtt = sock->rcv_rtt ? sock->rcv_rtt : (sock->srtt >> 3);
+    tick_t now = get_system_ticks();
 
-    return (sock->state == TCP_ESTABLISHED) ? 0 : -1;
+    if (rtt == 0 || now - sock->rcv_space_time < rtt) {
+        return;
+    }
+
+    uint32_t rcvd = sock->rcv_nxt - sock->rcv_space_seq;
+    if (rcvd >= sock->rcvbuf / 2 && sock->rcvbuf < CONFIG_TCP_RCVBUF_MAX) {
+        sock->rcvbuf = (sock->rcvbuf > CONFIG_TCP_RCVBUF_MAX / 2) ?
+                       CONFIG_TCP_RCVBUF_MAX : sock->rcvbuf * 2;
+    }
+
+    sock->rcv_space_seq = sock->rcv_nxt;
+    sock->rcv_space_time = now;
 }
 
-int sock_send(int fd, const void *data, size_t len)
+/*
+ * The application took a buffer off rx_queue: reopen the window
+ *
+ * An update is sent once the window has grown by an MSS or half the
+ * buffer over what was last advertised (RFC 1122 4.2.3.3), so a peer
+ * stopped by a closed window resumes without small-window traffic.
+ */
+static void tcp_recv_done(socket_t *sock, uint32_t len)
 {
-    socket_t *sock = socket_table[fd % CONFIG_NET_MAX_SOCKETS];
-    if (sock == NULL) return -1;
+    mutex_lock(&sock->lock);
 
-    zbuf_t *zb = zbuf_alloc_tx(len);
-    if (zb == NULL) return -1;
+    sock->rx_queued = (len < sock->rx_queued) ? sock->rx_queued - len : 0;
+    if (!(sock->flags & SOCK_F_RCVBUF)) {
+        tcp_rcvbuf_grow(sock);
+    }
 
-    /* Copy data to buffer */
-    uint8_t *dst = zbuf_put(zb, len);
-    const uint8_t *src = (const uint8_t *)data;
-    for (size_t i = 0; i < len; i++) {
-        dst[i] = src[i];
+    uint32_t wnd = tcp_rcv_window(sock);
+    uint32_t thresh = (sock->rcvbuf / 2 < sock->mss) ? sock->rcvbuf / 2 : sock->mss;
+    if ((sock->state == TCP_ESTABLISHED || sock->state == TCP_FIN_WAIT_1 ||
+         sock->state == TCP_FIN_WAIT_2) &&
+        wnd > sock->rcv_wnd && wnd - sock->rcv_wnd >= thresh) {
+        tcp_send_segment(sock, TCP_FLAG_ACK);
     }
 
-    status_t ret = tcp_output(sock, zb);
-    return (ret == STATUS_OK) ? (int)len : -1;
+    mutex_unlock(&sock->lock);
 }
 
 int sock_recv(int fd, void *data, size_t len)
@@ -567,7 +2344,7 @@ int sock_recv(int fd, void *data, size_t len)
     if (sock == NULL) return -1;
 
     /* Wait for data */
-    sem_wait(&sock->rx_sem);
+    if (sock_wait_rx(sock, sock_blocking(sock)) != STATUS_OK) return -1;
 
     /* Get buffer from queue */
     zbuf_t *zb = zbuf_queue_pop(&sock->rx_queue);
@@ -586,6 +2363,9 @@ int sock_recv(int fd, void *data, size_t len)
         dst[i] = src[i];
     }
 
+    if (sock->type == SOCK_STREAM) {
+        tcp_recv_done(sock, zb->len);
+    }
     zbuf_free(zb);
     return (int)copy_len;
 }
@@ -593,13 +2373,36 @@ int sock_recv(int fd, void *data, size_t len)
 /*
  * Zero-Copy Socket API
  */
+
+/*
+ * Take the next received buffer off a socket, for the application
+ *
+ * STATUS_OK with *zb NULL is the end of the stream. Without wait,
+ * STATUS_WOULD_BLOCK if nothing has arrived.
+ */
+status_t sock_rx_pop(socket_t *sock, bool wait, zbuf_t **zb)
+{
+    status_t ret = sock_wait_rx(sock, wait);
+    if (ret != STATUS_OK) {
+        return ret;
+    }
+
+    *zb = zbuf_queue_pop(&sock->rx_queue);
+    if (*zb != NULL && sock->type == SOCK_STREAM) {
+        tcp_recv_done(sock, (*zb)->len);
+    }
+    zbuf_set_owner(*zb, ZBUF_OWNER_APP);
+    return STATUS_OK;
+}
+
 zbuf_t *sock_recv_zbuf(int fd)
 {
     socket_t *sock = socket_table[fd % CONFIG_NET_MAX_SOCKETS];
     if (sock == NULL) return NULL;
 
-    sem_wait(&sock->rx_sem);
-    return zbuf_queue_pop(&sock->rx_queue);
+    zbuf_t *zb;
+    if (sock_rx_pop(sock, sock_blocking(sock), &zb) != STATUS_OK) return NULL;
+    return zb;
 }
 
 int sock_send_zbuf(int fd, zbuf_t *zb)
@@ -628,22 +2431,88 @@ int sock_sendto(int fd, const void *data, size_t len, sockaddr_t *dst)
         buf[i] = src[i];
     }
 
-    status_t ret = udp_output(zb, &sock->local, dst);
+    /* The socket lock serializes use of the route cache */
+    zb->priority = sock->priority;
+    mutex_lock(&sock->lock);
+    status_t ret = udp_output(zb, &sock->local, dst, &sock->route);
+    mutex_unlock(&sock->lock);
     return (ret == STATUS_OK) ? (int)len : -1;
 }
 
+/*
+ * Receive up to max datagrams without copying
+ *
+ * Waits for the first unless the socket is non-blocking, then takes
+ * whatever else has already arrived. Each buffer carries its sender in
+ * peer_addr/peer_port and its arrival time in timestamp, and is the
+ * caller's to free. Returns how many, or -1 if none.
+ */
+int sock_recvmmsg_zbuf(int fd, zbuf_t **zbs, uint32_t max)
+{
+    socket_t *sock = socket_table[fd % CONFIG_NET_MAX_SOCKETS];
+    if (sock == NULL || sock->type != SOCK_DGRAM || zbs == NULL) return -1;
+
+    uint32_t n = 0;
+    bool wait = sock_blocking(sock);
+
+    while (n < max) {
+        zbuf_t *zb;
+        if (sock_rx_pop(sock, wait, &zb) != STATUS_OK || zb == NULL) break;
+        zbs[n++] = zb;
+        wait = false;
+    }
+
+    return (n > 0) ? (int)n : -1;
+}
+
+/*
+ * Send n datagrams without copying
+ *
+ * Each buffer goes to its own peer_addr/peer_port, with headroom for
+ * the headers as from zbuf_alloc_tx(). All n buffers are taken, sent
+ * or not. Returns how many were sent.
+ */
+int sock_sendmmsg_zbuf(int fd, zbuf_t **zbs, uint32_t n)
+{
+    socket_t *sock = socket_table[fd % CONFIG_NET_MAX_SOCKETS];
+    if (zbs == NULL) return -1;
+    if (sock == NULL || sock->type != SOCK_DGRAM) {
+        for (uint32_t i = 0; i < n; i++) {
+            zbuf_free(zbs[i]);
+        }
+        return -1;
+    }
+
+    /* One hold of the socket lock, which guards the route cache, per batch */
+    uint32_t sent = 0;
+    mutex_lock(&sock->lock);
+    for (uint32_t i = 0; i < n; i++) {
+        zbuf_t *zb = zbs[i];
+        sockaddr_t dst = { .addr = zb->peer_addr, .port = zb->peer_port };
+
+        zb->priority = sock->priority;
+        if (udp_output(zb, &sock->local, &dst, &sock->route) == STATUS_OK) {
+            sent++;
+        }
+    }
+    mutex_unlock(&sock->lock);
+
+    return (int)sent;
+}
+
 int sock_recvfrom(int fd, void *data, size_t len, sockaddr_t *src)
 {
     socket_t *sock = socket_table[fd % CONFIG_NET_MAX_SOCKETS];
     if (sock == NULL || sock->type != SOCK_DGRAM) return -1;
 
-    sem_wait(&sock->rx_sem);
+    if (sock_wait_rx(sock, sock_blocking(sock)) != STATUS_OK) return -1;
 
     zbuf_t *zb = zbuf_queue_pop(&sock->rx_queue);
     if (zb == NULL) return -1;
 
     if (src != NULL) {
-        *src = sock->remote;
+        src->addr = zb->peer_addr;
+        src->port = zb->peer_port;
     }
 
     size_t copy_len = (zb->len < len) ? zb->len : len;
@@ -662,130 +2531,340 @@ int sock_close(int fd)
     socket_t *sock = socket_table[fd % CONFIG_NET_MAX_SOCKETS];
     if (sock == NULL) return -1;
 
+    /* The descriptor goes first: no call or poll set reaches the socket */
+    spin_lock_irq(&socket_lock);
+    socket_table[fd % CONFIG_NET_MAX_SOCKETS] = NULL;
+    spin_unlock_irq(&socket_lock);
+    sock_poll_forget(sock);
+
     mutex_lock(&sock->lock);
 
-    if (sock->type == SOCK_STREAM && sock->state == TCP_ESTABLISHED) {
-        sock->state = TCP_FIN_WAIT_1;
-        tcp_send_segment(sock, TCP_FLAG_FIN | TCP_FLAG_ACK, NULL);
+    if (sock->type == SOCK_STREAM &&
+        (sock->state == TCP_ESTABLISHED || sock->state == TCP_CLOSE_WAIT)) {
+        /*
+         * Whatever Nagle or cork still holds goes first, then the FIN.
+         * The connection keeps the socket until the peer has both, or
+         * the retransmission or FIN_WAIT_2 limit aborts it.
+         */
+        sock->flags = (sock->flags & ~SOCK_F_CORK) | SOCK_F_NODELAY | SOCK_F_FIN | SOCK_F_ORPHAN;
+        sock->state = (sock->state == TCP_ESTABLISHED) ? TCP_FIN_WAIT_1 : TCP_LAST_ACK;
+        tcp_push(sock);
+        mutex_unlock(&sock->lock);
+        return 0;
+    }
+
+    bool listener = (sock->state == TCP_LISTEN);
+    if (listener) {
+        sock->state = TCP_CLOSED;   /* No more children */
     }
 
     mutex_unlock(&sock->lock);
 
-    /* Flush queues */
+    /* Connections never accepted go with the listener */
+    if (listener) {
+        socket_t *child;
+        while ((child = tcp_dequeue(sock, TCP_PENDING_ANY)) != NULL) {
+            sock_close(child->fd);
+        }
+        sem_post(&sock->rx_sem);    /* Fail a waiting sock_accept() */
+    }
+
+    /* Stop demux and the timer from reaching the socket */
+    sock_hash_remove(sock);
+    tcp_timer_cancel(sock);
+
+    /* Freed here, or by the input path still holding it */
+    sock_put(sock);
+    return 0;
+}
+
+/*
+ * Drop a reference; the last one frees the socket and what it queued
+ */
+void sock_put(socket_t *sock)
+{
+    if (atomic_sub(&sock->refcnt, 1) != 0) {
+        return;
+    }
+
     zbuf_queue_flush(&sock->rx_queue);
     zbuf_queue_flush(&sock->tx_queue);
+    tcp_ooo_flush(sock);
+    heap_free(sock);
+}
 
-    spin_lock_irq(&socket_lock);
-    socket_table[fd % CONFIG_NET_MAX_SOCKETS] = NULL;
-    spin_unlock_irq(&socket_lock);
+/*
+ * 802.1p priority of everything the socket sends: selects the TX band
+ * and, on a VLAN interface, the PCP of the tag
+ */
+int sock_set_priority(int fd, uint8_t pcp)
+{
+    socket_t *sock = socket_table[fd % CONFIG_NET_MAX_SOCKETS];
+    if (sock == NULL || pcp > 7) return -1;
 
-    heap_free(sock);
+    sock->priority = pcp;
     return 0;
 }
 
 /*
- * TCP Timer - called periodically to handle timeouts
+ * Quick-ACK mode: acknowledge every segment at once, for interactive
+ * peers that wait on each ACK
  */
-void tcp_timer(void)
+int sock_set_quickack(int fd, bool on)
 {
-    tick_t now = get_system_ticks();
+    socket_t *sock = socket_table[fd % CONFIG_NET_MAX_SOCKETS];
+    if (sock == NULL || sock->type != SOCK_STREAM) return -1;
+
+    mutex_lock(&sock->lock);
+    if (on) {
+        sock->flags |= SOCK_F_QUICKACK;
+        if (sock->ack_pending) {
+            tcp_send_segment(sock, TCP_FLAG_ACK);
+        }
+    } else {
+        sock->flags &= ~SOCK_F_QUICKACK;
+    }
+    mutex_unlock(&sock->lock);
 
-    spin_lock(&tcp_lock);
+    return 0;
+}
 
-    /* Process connected sockets for retransmission */
-    socket_t *sock = tcp_conn_list;
-    while (sock != NULL) {
-        socket_t *next = sock->next;
-        tcp_rto_t *rto = &tcp_rto[sock->fd % CONFIG_NET_MAX_SOCKETS];
+/*
+ * Set a socket option
+ *
+ * Clearing TCP_CORK, or setting TCP_NODELAY, sends what was held back
+ * at once. Buffer sizes apply to later writes and to the next window
+ * advertised.
+ */
+int sock_setopt(int fd, int opt, uint32_t val)
+{
+    socket_t *sock = socket_table[fd % CONFIG_NET_MAX_SOCKETS];
+    if (sock == NULL) return -1;
 
+    if (opt == SO_PRIORITY) {
+        return (val <= 7) ? sock_set_priority(fd, (uint8_t)val) : -1;
+    }
+    if (opt == TCP_QUICKACK) {
+        return sock_set_quickack(fd, val != 0);
+    }
+    if (opt == SO_NONBLOCK) {
         mutex_lock(&sock->lock);
+        if (val) {
+            sock->flags |= SOCK_F_NONBLOCK;
+        } else {
+            sock->flags &= ~SOCK_F_NONBLOCK;
+        }
+        mutex_unlock(&sock->lock);
+        return 0;
+    }
+    if (sock->type != SOCK_STREAM) return -1;
 
-        /* Handle TIME_WAIT timeout */
-        if (sock->state == TCP_TIME_WAIT) {
-            tick_t time_wait_ticks = MS_TO_TICKS(TCP_TIME_WAIT_TIME);
-            if (now - rto->last_tx_time >= time_wait_ticks) {
-                sock->state = TCP_CLOSED;
-            }
+    int ret = 0;
+    mutex_lock(&sock->lock);
+
+    switch (opt) {
+    case SO_SNDBUF:
+        if (val < sock->mss) {
+            ret = -1;
+            break;
         }
+        sock->sndbuf = val;
+        if ((sock->flags & SOCK_F_TX_WAIT) && sock->tx_queued < sock->sndbuf) {
+            sock->flags &= ~SOCK_F_TX_WAIT;
+            sem_post(&sock->tx_sem);
+            sock_poll_notify(sock, SOCK_EV_OUT);
+        }
+        break;
 
-        /* Handle retransmission timeout for SYN_SENT, SYN_RECEIVED */
-        if (sock->state == TCP_SYN_SENT || sock->state == TCP_SYN_RECEIVED) {
-            if (rto->timer_active) {
-                tick_t timeout_ticks = MS_TO_TICKS(rto->rto);
-                if (now - rto->last_tx_time >= timeout_ticks) {
-                    if (rto->retries < 5) {
-                        /* Retransmit SYN or SYN-ACK */
-                        rto->retries++;
-                        rto->rto *= 2;  /* Exponential backoff */
-                        if (rto->rto > TCP_RTO_MAX) rto->rto = TCP_RTO_MAX;
-                        rto->last_tx_time = now;
-
-                        if (sock->state == TCP_SYN_SENT) {
-                            sock->snd_nxt = sock->snd_una;
-                            tcp_send_segment(sock, TCP_FLAG_SYN, NULL);
-                        } else {
-                            sock->snd_nxt = sock->snd_una;
-                            tcp_send_segment(sock, TCP_FLAG_SYN | TCP_FLAG_ACK, NULL);
-                        }
-                    } else {
-                        /* Connection failed */
-                        sock->state = TCP_CLOSED;
-                        sem_post(&sock->tx_sem);  /* Wake waiting task */
-                    }
-                }
-            }
+    case SO_RCVBUF:
+        if (val < sock->mss) {
+            ret = -1;
+            break;
         }
+        sock->rcvbuf = val;
+        sock->flags |= SOCK_F_RCVBUF;   /* No more autosizing */
+        break;
 
-        /* Handle retransmission for ESTABLISHED connections */
-        if (sock->state == TCP_ESTABLISHED) {
-            if (rto->timer_active && sock->snd_una < sock->snd_nxt) {
-                tick_t timeout_ticks = MS_TO_TICKS(rto->rto);
-                if (now - rto->last_tx_time >= timeout_ticks) {
-                    if (rto->retries < 10) {
-                        rto->retries++;
-                        rto->rto *= 2;
-                        if (rto->rto > TCP_RTO_MAX) rto->rto = TCP_RTO_MAX;
-                        rto->last_tx_time = now;
-
-                        /* Retransmit unacknowledged data from TX queue */
-                        zbuf_t *zb = zbuf_queue_peek(&sock->tx_queue);
-                        if (zb) {
-                            zbuf_ref(zb);
-                            sock->snd_nxt = sock->snd_una;
-                            tcp_send_segment(sock, TCP_FLAG_ACK | TCP_FLAG_PSH, zb);
-                        }
-                    } else {
-                        /* Connection timed out */
-                        sock->state = TCP_CLOSED;
-                        sem_post(&sock->rx_sem);
-                    }
-                }
-            }
+    case TCP_NODELAY:
+        if (val) {
+            sock->flags |= SOCK_F_NODELAY;
+            tcp_push(sock);
+        } else {
+            sock->flags &= ~SOCK_F_NODELAY;
         }
+        break;
 
-        /* Handle FIN_WAIT_1 and LAST_ACK retransmission */
-        if (sock->state == TCP_FIN_WAIT_1 || sock->state == TCP_LAST_ACK) {
-            if (rto->timer_active) {
-                tick_t timeout_ticks = MS_TO_TICKS(rto->rto);
-                if (now - rto->last_tx_time >= timeout_ticks) {
-                    if (rto->retries < 5) {
-                        rto->retries++;
-                        rto->rto *= 2;
-                        if (rto->rto > TCP_RTO_MAX) rto->rto = TCP_RTO_MAX;
-                        rto->last_tx_time = now;
-
-                        sock->snd_nxt = sock->snd_una;
-                        tcp_send_segment(sock, TCP_FLAG_FIN | TCP_FLAG_ACK, NULL);
-                    } else {
-                        sock->state = TCP_CLOSED;
-                    }
-                }
+    case TCP_CORK:
+        if (val) {
+            sock->flags |= SOCK_F_CORK;
+        } else {
+            sock->flags &= ~SOCK_F_CORK;
+            tcp_push(sock);
+        }
+        break;
+
+    case SO_KEEPALIVE:
+        if (val) {
+            sock->flags |= SOCK_F_KEEPALIVE;
+            tcp_timer_arm(sock);
+        } else {
+            sock->flags &= ~SOCK_F_KEEPALIVE;
+        }
+        break;
+
+    default:
+        ret = -1;
+        break;
+    }
+
+    mutex_unlock(&sock->lock);
+    return ret;
+}
+
+int sock_getopt(int fd, int opt, uint32_t *val)
+{
+    socket_t *sock = socket_table[fd % CONFIG_NET_MAX_SOCKETS];
+    if (sock == NULL || val == NULL) return -1;
+
+    switch (opt) {
+    case SO_SNDBUF:     *val = sock->sndbuf; break;
+    case SO_RCVBUF:     *val = sock->rcvbuf; break;
+    case SO_PRIORITY:   *val = sock->priority; break;
+    case TCP_NODELAY:   *val = (sock->flags & SOCK_F_NODELAY) ? 1 : 0; break;
+    case TCP_CORK:      *val = (sock->flags & SOCK_F_CORK) ? 1 : 0; break;
+    case TCP_QUICKACK:  *val = (sock->flags & SOCK_F_QUICKACK) ? 1 : 0; break;
+    case SO_KEEPALIVE:  *val = (sock->flags & SOCK_F_KEEPALIVE) ? 1 : 0; break;
+    case SO_NONBLOCK:   *val = (sock->flags & SOCK_F_NONBLOCK) ? 1 : 0; break;
+    default:            return -1;
+    }
+
+    return 0;
+}
+
+/* The peer is gone: fail connect, send and recv, or reset an orphan */
+static void tcp_drop(socket_t *sock)
+{
+    if (sock->flags & SOCK_F_ORPHAN) {
+        tcp_xmit(sock, TCP_FLAG_RST | TCP_FLAG_ACK, sock->snd_nxt, NULL);
+    }
+
+    sock->state = TCP_CLOSED;
+    sock->rtx_armed = 0;
+    sem_post(&sock->tx_sem);
+    sem_post(&sock->rx_sem);
+    sock_poll_notify(sock, SOCK_EV_IN | SOCK_EV_ERR | SOCK_EV_HUP);
+}
+
+/* Whatever of a connection's deadlines has passed */
+static void tcp_timer_run(socket_t *sock)
+{
+    tick_t now = get_system_ticks();
+
+    /* Delayed ACK */
+    if (sock->ack_pending && now - sock->ack_start >= MS_TO_TICKS(CONFIG_TCP_DELACK_MS)) {
+        tcp_send_segment(sock, TCP_FLAG_ACK);
+    }
+
+    if (sock->state == TCP_TIME_WAIT) {
+        /* rtx_start marks the entry to TIME_WAIT */
+        if (now - sock->rtx_start >= MS_TO_TICKS(TCP_TIME_WAIT_TIME)) {
+            sock->state = TCP_CLOSED;
+            sock->rtx_armed = 0;
+        }
+    } else if (sock->state == TCP_FIN_WAIT_2) {
+        /* The peer never closes its side: give up on it */
+        if (sock->rtx_armed && now - sock->rtx_start >= MS_TO_TICKS(TCP_FIN_TIMEOUT)) {
+            tcp_drop(sock);
+        }
+    } else if (sock->rtx_armed && now - sock->rtx_start >= sock->rto) {
+        if (sock->retries >= CONFIG_TCP_RETRIES) {
+            tcp_drop(sock);
+        } else {
+            /* Exponential backoff */
+            sock->retries++;
+            sock->rto *= 2;
+            if (sock->rto > MS_TO_TICKS(TCP_RTO_MAX)) sock->rto = MS_TO_TICKS(TCP_RTO_MAX);
+            tcp_timer_restart(sock);
+            tcp_timeout(sock);
+        }
+    } else if (tcp_keepalive_on(sock) && now - sock->rcv_time >= tcp_keepalive_wait(sock)) {
+        if (sock->ka_probes >= CONFIG_TCP_KEEPALIVE_PROBES) {
+            tcp_drop(sock);
+        } else {
+            /* An old sequence number: the peer answers with an ACK (RFC 1122 4.2.3.6) */
+            sock->ka_probes++;
+            tcp_xmit(sock, TCP_FLAG_ACK, sock->snd_una - 1, NULL);
+        }
+    }
+}
+
+/*
+ * TCP Timer - runs the connections whose timer expired
+ *
+ * Sockets come off the expired list one at a time, and the socket mutex
+ * is taken with no spinlock held. An orphan that reaches CLOSED here is
+ * freed once tcp_timer_cur no longer points at it.
+ */
+void tcp_timer(void)
+{
+    while (1) {
+        spin_lock_irq(&tcp_lock);
+        socket_t *sock = tcp_timer_head;
+        if (sock != NULL) {
+            tcp_timer_head = sock->next;
+            if (tcp_timer_head == NULL) {
+                tcp_timer_tail = NULL;
             }
+            sock->tmr_state = TCP_TMR_IDLE;
+        }
+        tcp_timer_cur = sock;
+        spin_unlock_irq(&tcp_lock);
+
+        if (sock == NULL) {
+            return;
         }
 
+        bool done = false;
+        mutex_lock(&sock->lock);
+        if (sock->tmr_state != TCP_TMR_DEAD) {
+            sock->tmr_armed = 0;
+            tcp_timer_run(sock);
+            tcp_timer_arm(sock);
+            done = tcp_orphan_done(sock);
+            if (done) {
+                tcp_timer_kill(sock);
+            }
+        }
         mutex_unlock(&sock->lock);
-        sock = next;
+
+        spin_lock_irq(&tcp_lock);
+        tcp_timer_cur = NULL;
+        spin_unlock_irq(&tcp_lock);
+
+        if (done) {
+            tcp_orphan_free(sock);
+        }
+    }
+}
+
+static tcb_t tcp_timer_tcb;
+static uint8_t tcp_timer_stack[CONFIG_TASK_STACK_SIZE] ALIGNED(16);
+
+static void tcp_timer_task(void *arg __attribute__((unused)))
+{
+    while (1) {
+        sem_wait(&tcp_timer_sem);
+        tcp_timer();
     }
+}
 
-    spin_unlock(&tcp_lock);
+/*
+ * TCP Initialization: the task that runs expired connection timers
+ */
+void tcp_init(void)
+{
+    sem_init(&tcp_timer_sem, 0);
+    task_create(&tcp_timer_tcb, "tcp-timer", tcp_timer_task, NULL,
+                CONFIG_TCP_TIMER_PRIORITY, tcp_timer_stack, sizeof(tcp_timer_stack));
+    task_start(&tcp_timer_tcb);
 }
@@ -23,6 +23,8 @@
  * Zero-Copy Modbus TCP/RTU Implementation
  */
 
+#define ZBUF_OWNER  ZBUF_OWNER_MODBUS
+
 #include "modbus.h"
 #include "rtos_config.h"
 
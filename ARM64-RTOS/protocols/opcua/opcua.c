@@ -23,6 +23,8 @@
  * Zero-Copy OPC UA Implementation
  */
 
+#define ZBUF_OWNER  ZBUF_OWNER_OPCUA
+
 #include "opcua.h"
 #include "rtos_config.h"
 
@@ -23,8 +23,11 @@
  * Zero-Copy PROFINET RT Implementation
  */
 
+#define ZBUF_OWNER  ZBUF_OWNER_PROFINET
+
 #include "profinet.h"
 #include "rtos_config.h"
+#include "rtos.h"
 
 extern void *heap_alloc(size_t size);
 
@@ -32,6 +35,13 @@ extern void *heap_alloc(size_t size);
 static const uint8_t pnio_mc_rt[6] __attribute__((unused)) = {0x01, 0x0E, 0xCF, 0x00, 0x00, 0x00};
 static const uint8_t pnio_mc_dcp[6] __attribute__((unused)) = {0x01, 0x0E, 0xCF, 0x00, 0x00, 0x00};
 
+/* RT and DCP frames straight from netif_input(), without copying */
+static void pnio_eth_input(netif_t *nif, zbuf_t *zb, void *arg)
+{
+    (void)nif;
+    pnio_rt_input((pnio_device_t *)arg, zb);
+}
+
 /*
  * Device Initialization
  */
@@ -63,6 +73,7 @@ status_t pnio_device_init(pnio_device_t *dev, netif_t *netif,
     dev->cycle_time_us = CONFIG_PROFINET_CYCLE_TIME;
     dev->cycle_count = 0;
     dev->last_cycle_time = 0;
+    dev->next_launch = 0;
 
     dev->tx_buffer = NULL;
     dev->rx_buffer = NULL;
@@ -76,7 +87,8 @@ status_t pnio_device_init(pnio_device_t *dev, netif_t *netif,
 
     dev->lock = (spinlock_t)SPINLOCK_INIT;
 
-    return STATUS_OK;
+    /* DCP must answer before any AR exists, so receive from now on */
+    return netif_add_proto(netif, ETH_TYPE_PROFINET, pnio_eth_input, dev);
 }
 
 /*
@@ -266,7 +278,7 @@ uint8_t pnio_get_iocs(pnio_device_t *dev, uint16_t slot_num, uint16_t subslot_nu
  */
 void pnio_dcp_input(pnio_device_t *dev, zbuf_t *zb)
 {
-    if (zb->len < sizeof(dcp_hdr_t)) {
+    if (zb->len < 2 + sizeof(dcp_hdr_t)) {
         zbuf_free(zb);
         return;
     }
@@ -277,6 +289,11 @@ void pnio_dcp_input(pnio_device_t *dev, zbuf_t *zb)
     uint32_t xid = ntohl(dcp->xid);
     uint16_t data_len = ntohs(dcp->data_length);
 
+    /* Blocks are parsed from the wire: stay inside the frame */
+    if (data_len > zb->len - 2 - sizeof(dcp_hdr_t)) {
+        data_len = zb->len - 2 - sizeof(dcp_hdr_t);
+    }
+
     uint8_t *data = (uint8_t *)(dcp + 1);
 
     if (service_id == DCP_SERVICE_IDENTIFY && service_type == DCP_SERVICE_TYPE_REQUEST) {
@@ -285,10 +302,11 @@ void pnio_dcp_input(pnio_device_t *dev, zbuf_t *zb)
 
         /* Parse request blocks */
         uint16_t offset = 0;
-        while (offset < data_len) {
+        while (offset + 4 <= data_len) {
             uint8_t option = data[offset];
             uint8_t suboption = data[offset + 1];
             uint16_t block_len = (data[offset + 2] << 8) | data[offset + 3];
+            if (block_len > data_len - offset - 4) break;
 
             if (option == DCP_OPT_DEVICE && suboption == DCP_SUBOPT_DEV_NAME) {
                 /* Check name */
@@ -303,6 +321,8 @@ void pnio_dcp_input(pnio_device_t *dev, zbuf_t *zb)
                 }
                 if (i < block_len && req_name[i] != '\0') {
                     match = false;
+                } else if (i == block_len && dev->name_of_station[i] != '\0') {
+                    match = false;  /* Request is only a prefix of our name */
                 }
             } else if (option == DCP_OPT_ALL) {
                 /* Match all */
@@ -402,19 +422,20 @@ void pnio_dcp_input(pnio_device_t *dev, zbuf_t *zb)
             resp->tail = p;
             resp->len = p - resp->data;
 
-            /* Send response via Ethernet */
-            (void)(zb->data - ETH_HDR_LEN - 2); /* eth_req unused */
-            dev->netif->send(dev->netif, resp);
+            /* Unicast back to the requester */
+            const eth_hdr_t *eth_req = (const eth_hdr_t *)(zb->data - zb->l3_offset);
+            eth_output(dev->netif, resp, eth_req->src, ETH_TYPE_PROFINET);
         }
     } else if (service_id == DCP_SERVICE_SET && service_type == DCP_SERVICE_TYPE_REQUEST) {
         /* Handle Set requests */
         uint16_t offset = 0;
-        while (offset < data_len) {
+        while (offset + 4 <= data_len) {
             uint8_t option = data[offset];
             uint8_t suboption = data[offset + 1];
             uint16_t block_len = (data[offset + 2] << 8) | data[offset + 3];
+            if (block_len > data_len - offset - 4) break;
 
-            if (option == DCP_OPT_IP && suboption == DCP_SUBOPT_IP_PARAM) {
+            if (option == DCP_OPT_IP && suboption == DCP_SUBOPT_IP_PARAM && block_len >= 14) {
                 /* Set IP parameters */
                 uint8_t *ip_data = &data[offset + 6];  /* Skip block info */
                 dev->ip_addr = (ip_data[0] << 24) | (ip_data[1] << 16) |
@@ -587,16 +608,24 @@ status_t pnio_rt_send(pnio_device_t *dev)
     /* Transfer status */
     *p++ = 0;
 
-    /* Push Ethernet header */
-    eth_hdr_t *eth = (eth_hdr_t *)zbuf_push(zb, ETH_HDR_LEN);
-    for (int i = 0; i < 6; i++) {
-        eth->dst[i] = ar->peer_mac[i];
-        eth->src[i] = dev->netif->mac[i];
+    /* Priority-tagged, ahead of best-effort traffic in the TX queues */
+    zb->priority = PNIO_PCP_RT;
+    zb->flags |= ZBUF_F_VLAN;
+
+#if CONFIG_PROFINET_LAUNCH_TIME
+    /* Released on the cycle boundary, not when this task happened to run */
+    uint64_t cycle_ns = (uint64_t)dev->cycle_time_us * 1000;
+    uint64_t now = timer_get_ns();
+    if (dev->next_launch < now + CONFIG_NET_TAS_LEAD_NS) {
+        /* First frame, or cycles were missed: restart the schedule */
+        dev->next_launch = now + cycle_ns;
     }
-    eth->type = htons(ETH_TYPE_PROFINET);
+    zb->timestamp = dev->next_launch;
+    zb->flags |= ZBUF_F_TXTIME;
+    dev->next_launch += cycle_ns;
+#endif
 
-    /* Send via network interface */
-    status_t ret = dev->netif->send(dev->netif, zb);
+    status_t ret = eth_output(dev->netif, zb, ar->peer_mac, ETH_TYPE_PROFINET);
 
     dev->last_cycle_time = get_system_ticks();
     dev->cycle_count++;
@@ -611,6 +640,7 @@ status_t pnio_device_start(pnio_device_t *dev)
 {
     dev->running = true;
     dev->cycle_count = 0;
+    dev->next_launch = 0;
     return STATUS_OK;
 }
 
@@ -635,11 +665,18 @@ void pnio_device_poll(pnio_device_t *dev)
 {
     if (!dev->running) return;
 
+#if CONFIG_PROFINET_LAUNCH_TIME
+    /* Build each frame within one cycle of its launch time */
+    bool due = dev->next_launch <=
+               timer_get_ns() + (uint64_t)dev->cycle_time_us * 1000;
+#else
     /* Check cycle time */
     tick_t now = get_system_ticks();
     tick_t elapsed = now - dev->last_cycle_time;
+    bool due = elapsed >= (dev->cycle_time_us / 1000);
+#endif
 
-    if (elapsed >= (dev->cycle_time_us / 1000)) {
+    if (due) {
         /* Time to send cyclic data */
         for (uint16_t i = 0; i < dev->ar_count; i++) {
             if (dev->ar[i].active) {
@@ -715,15 +752,10 @@ status_t pnio_send_alarm(pnio_device_t *dev, pnio_alarm_t *alarm)
         *p++ = alarm->data[i];
     }
 
-    /* Push Ethernet header */
-    eth_hdr_t *eth = (eth_hdr_t *)zbuf_push(zb, ETH_HDR_LEN);
-    for (int i = 0; i < 6; i++) {
-        eth->dst[i] = ar->peer_mac[i];
-        eth->src[i] = dev->netif->mac[i];
-    }
-    eth->type = htons(ETH_TYPE_PROFINET);
-
-    return dev->netif->send(dev->netif, zb);
+    zb->priority = (frame_id == PNIO_FRAME_ID_ALARM_HIGH) ?
+                   PNIO_PCP_ALARM_HIGH : PNIO_PCP_ALARM_LOW;
+    zb->flags |= ZBUF_F_VLAN;
+    return eth_output(dev->netif, zb, ar->peer_mac, ETH_TYPE_PROFINET);
 }
 
 status_t pnio_send_diag_alarm(pnio_device_t *dev, uint16_t slot, uint16_t subslot,
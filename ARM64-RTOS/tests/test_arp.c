@@ -0,0 +1,309 @@
+/*
+ * Gracemont Industrial Control Framework - ARM64 RTOS
+ * Copyright (C) 2024 Zixiao System <https://github.com/Zixiao-System>
+ *
+ * This file is part of Gracemont Industrial Control Framework.
+ * Repository: https://github.com/Zixiao-System/gracemont
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ *
+ * ARP Neighbor Table Unit Tests
+ */
+
+#include "test_framework.h"
+#include "net_stack.h"
+#include "rtos_config.h"
+#include "rtos.h"
+#include "test_net.h"
+
+#define ARP_TEST_IP         0x0A000001      /* 10.0.0.1 (us) */
+#define ARP_TEST_PEER       0x0A000002      /* 10.0.0.2 */
+#define ARP_TEST_MAX_TX     16
+
+static netif_t arp_test_nif;
+static zbuf_t *arp_test_tx[ARP_TEST_MAX_TX];
+static int arp_test_tx_count;
+static int arp_test_batches;
+
+static status_t arp_test_send(netif_t *nif, zbuf_t *zb)
+{
+    (void)nif;
+
+    if (arp_test_tx_count >= ARP_TEST_MAX_TX) {
+        zbuf_free(zb);
+        return STATUS_NO_MEM;
+    }
+    arp_test_tx[arp_test_tx_count++] = zb;
+    return STATUS_OK;
+}
+
+static uint32_t arp_test_send_batch(netif_t *nif, zbuf_t **pkts, uint32_t count)
+{
+    uint32_t sent = 0;
+
+    arp_test_batches++;
+    for (uint32_t i = 0; i < count; i++) {
+        if (arp_test_send(nif, pkts[i]) == STATUS_OK) {
+            sent++;
+        }
+    }
+    return sent;
+}
+
+static void arp_test_flush_tx(void)
+{
+    for (int i = 0; i < arp_test_tx_count; i++) {
+        zbuf_free(arp_test_tx[i]);
+    }
+    arp_test_tx_count = 0;
+}
+
+static void arp_test_setup(void)
+{
+    test_netif_init(&arp_test_nif, 0x10, ARP_TEST_IP, 0xFFFFFF00, arp_test_send);
+
+    arp_test_tx_count = 0;
+    arp_test_batches = 0;
+    arp_init();
+}
+
+static void arp_test_teardown(void)
+{
+    arp_test_flush_tx();
+    arp_init();
+}
+
+static zbuf_t *arp_test_packet(uint8_t tag)
+{
+    zbuf_t *zb = zbuf_alloc_tx(64);
+    if (zb != NULL) {
+        uint8_t *p = zbuf_put(zb, 64);
+        for (int i = 0; i < 64; i++) {
+            p[i] = tag;
+        }
+    }
+    return zb;
+}
+
+/* Feed an ARP packet from the peer into the stack */
+static void arp_test_input(uint16_t oper, uint32_t spa, uint32_t tpa)
+{
+    test_arp_input(&arp_test_nif, oper, test_peer_mac, spa, tpa);
+}
+
+static uint16_t arp_test_type(zbuf_t *zb)
+{
+    return ntohs(((eth_hdr_t *)zb->data)->type);
+}
+
+/*
+ * Test: A miss holds the packet and broadcasts one request
+ */
+TEST_CASE(arp_miss_queues)
+{
+    arp_stats_t stats;
+
+    TEST_ASSERT_EQ(arp_output(&arp_test_nif, arp_test_packet(1), ARP_TEST_PEER), STATUS_OK);
+    TEST_ASSERT_EQ(arp_output(&arp_test_nif, arp_test_packet(2), ARP_TEST_PEER), STATUS_OK);
+
+    /* Only the first miss sends a request */
+    TEST_ASSERT_EQ(arp_test_tx_count, 1);
+    TEST_ASSERT_EQ(arp_test_type(arp_test_tx[0]), ETH_TYPE_ARP);
+
+    eth_hdr_t *eth = (eth_hdr_t *)arp_test_tx[0]->data;
+    arp_hdr_t *arp = (arp_hdr_t *)(arp_test_tx[0]->data + ETH_HDR_LEN);
+    TEST_ASSERT_EQ(eth->dst[0], 0xFF);
+    TEST_ASSERT_EQ(ntohs(arp->oper), ARP_OP_REQUEST);
+    TEST_ASSERT_EQ(ntohl(arp->tpa), ARP_TEST_PEER);
+    TEST_ASSERT_EQ(ntohl(arp->spa), ARP_TEST_IP);
+
+    arp_get_stats(&stats);
+    TEST_ASSERT_EQ(stats.entries, 1);
+    TEST_ASSERT_EQ(stats.misses, 2);
+    TEST_ASSERT_EQ(stats.queued, 2);
+
+    uint8_t mac[6];
+    TEST_ASSERT_EQ(arp_resolve(&arp_test_nif, ARP_TEST_PEER, mac), STATUS_WOULD_BLOCK);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: The reply releases held packets in order with the learned MAC
+ */
+TEST_CASE(arp_reply_flushes)
+{
+    arp_output(&arp_test_nif, arp_test_packet(1), ARP_TEST_PEER);
+    arp_output(&arp_test_nif, arp_test_packet(2), ARP_TEST_PEER);
+    arp_test_flush_tx();
+
+    arp_test_input(ARP_OP_REPLY, ARP_TEST_PEER, ARP_TEST_IP);
+
+    TEST_ASSERT_EQ(arp_test_tx_count, 2);
+    for (int i = 0; i < 2; i++) {
+        eth_hdr_t *eth = (eth_hdr_t *)arp_test_tx[i]->data;
+        TEST_ASSERT_EQ(arp_test_type(arp_test_tx[i]), ETH_TYPE_IP);
+        TEST_ASSERT_MEM_EQ(eth->dst, test_peer_mac, 6);
+        TEST_ASSERT_EQ(arp_test_tx[i]->data[ETH_HDR_LEN], i + 1);
+    }
+    arp_test_flush_tx();
+
+    /* Now a hit goes straight out */
+    TEST_ASSERT_EQ(arp_output(&arp_test_nif, arp_test_packet(3), ARP_TEST_PEER), STATUS_OK);
+    TEST_ASSERT_EQ(arp_test_tx_count, 1);
+    TEST_ASSERT_EQ(arp_test_type(arp_test_tx[0]), ETH_TYPE_IP);
+
+    uint8_t mac[6];
+    TEST_ASSERT_EQ(arp_resolve(&arp_test_nif, ARP_TEST_PEER, mac), STATUS_OK);
+    TEST_ASSERT_MEM_EQ(mac, test_peer_mac, 6);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: Held packets reach a batching driver in a single call
+ */
+TEST_CASE(arp_flush_batched)
+{
+    arp_test_nif.send_batch = arp_test_send_batch;
+
+    for (int i = 0; i < 3; i++) {
+        arp_output(&arp_test_nif, arp_test_packet((uint8_t)(i + 1)), ARP_TEST_PEER);
+    }
+    arp_test_flush_tx();
+
+    arp_test_input(ARP_OP_REPLY, ARP_TEST_PEER, ARP_TEST_IP);
+
+    TEST_ASSERT_EQ(arp_test_batches, 1);
+    TEST_ASSERT_EQ(arp_test_tx_count, 3);
+    for (int i = 0; i < 3; i++) {
+        TEST_ASSERT_EQ(arp_test_type(arp_test_tx[i]), ETH_TYPE_IP);
+        TEST_ASSERT_EQ(arp_test_tx[i]->data[ETH_HDR_LEN], i + 1);
+    }
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: Traffic between other hosts is not learned
+ */
+TEST_CASE(arp_no_learn_foreign)
+{
+    arp_stats_t stats;
+
+    arp_test_input(ARP_OP_REQUEST, ARP_TEST_PEER, 0x0A000003);
+
+    arp_get_stats(&stats);
+    TEST_ASSERT_EQ(stats.entries, 0);
+    TEST_ASSERT_EQ(arp_test_tx_count, 0);
+
+    /* A request for us is learned and answered */
+    arp_test_input(ARP_OP_REQUEST, ARP_TEST_PEER, ARP_TEST_IP);
+
+    arp_get_stats(&stats);
+    TEST_ASSERT_EQ(stats.entries, 1);
+    TEST_ASSERT_EQ(arp_test_tx_count, 1);
+
+    arp_hdr_t *arp = (arp_hdr_t *)(arp_test_tx[0]->data + ETH_HDR_LEN);
+    TEST_ASSERT_EQ(ntohs(arp->oper), ARP_OP_REPLY);
+    TEST_ASSERT_MEM_EQ(arp->tha, test_peer_mac, 6);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: The pending queue is bounded, oldest packet dropped
+ */
+TEST_CASE(arp_queue_limit)
+{
+    arp_stats_t stats;
+
+    for (int i = 0; i < CONFIG_NET_ARP_QUEUE_LEN + 2; i++) {
+        arp_output(&arp_test_nif, arp_test_packet((uint8_t)(i + 1)), ARP_TEST_PEER);
+    }
+    arp_test_flush_tx();
+
+    arp_get_stats(&stats);
+    TEST_ASSERT_EQ(stats.dropped, 2);
+
+    arp_test_input(ARP_OP_REPLY, ARP_TEST_PEER, ARP_TEST_IP);
+
+    TEST_ASSERT_EQ(arp_test_tx_count, CONFIG_NET_ARP_QUEUE_LEN);
+    TEST_ASSERT_EQ(arp_test_tx[0]->data[ETH_HDR_LEN], 3);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: Unanswered requests give up, idle entries expire
+ */
+TEST_CASE(arp_aging)
+{
+    arp_stats_t stats;
+    arp_output(&arp_test_nif, arp_test_packet(1), ARP_TEST_PEER);
+    arp_test_flush_tx();
+
+    /* One retransmission per second, three at most */
+    tick_t now = get_system_ticks();
+    for (int i = 1; i <= 3; i++) {
+        arp_age(now + (tick_t)i * CONFIG_TICK_RATE_HZ);
+        TEST_ASSERT_EQ(arp_test_tx_count, i);
+    }
+    arp_age(now + 4 * CONFIG_TICK_RATE_HZ);
+    arp_test_flush_tx();
+
+    arp_get_stats(&stats);
+    TEST_ASSERT_EQ(stats.entries, 0);
+    TEST_ASSERT_EQ(stats.dropped, 1);
+
+    /* A resolved entry that is never used expires after the timeout */
+    arp_test_input(ARP_OP_REPLY, ARP_TEST_PEER, ARP_TEST_IP);
+    arp_get_stats(&stats);
+    TEST_ASSERT_EQ(stats.entries, 1);
+
+    now = get_system_ticks();
+    arp_age(now + (tick_t)(CONFIG_NET_ARP_TIMEOUT - 1) * CONFIG_TICK_RATE_HZ);
+    arp_get_stats(&stats);
+    TEST_ASSERT_EQ(stats.entries, 1);
+
+    arp_age(now + (tick_t)(CONFIG_NET_ARP_TIMEOUT + 1) * CONFIG_TICK_RATE_HZ);
+    arp_get_stats(&stats);
+    TEST_ASSERT_EQ(stats.entries, 0);
+    TEST_ASSERT_EQ(arp_test_tx_count, 0);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test Suite Definition
+ */
+static test_case_t arp_tests[] = {
+    { "arp_miss_queues", test_arp_miss_queues },
+    { "arp_reply_flushes", test_arp_reply_flushes },
+    { "arp_flush_batched", test_arp_flush_batched },
+    { "arp_no_learn_foreign", test_arp_no_learn_foreign },
+    { "arp_queue_limit", test_arp_queue_limit },
+    { "arp_aging", test_arp_aging },
+};
+
+test_suite_t arp_test_suite = {
+    .name = "ARP Neighbor Table",
+    .tests = arp_tests,
+    .test_count = sizeof(arp_tests) / sizeof(test_case_t),
+    .setup = arp_test_setup,
+    .teardown = arp_test_teardown
+};
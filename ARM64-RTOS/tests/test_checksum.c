@@ -0,0 +1,248 @@
+/*
+ * Gracemont Industrial Control Framework - ARM64 RTOS
+ * Copyright (C) 2024 Zixiao System <https://github.com/Zixiao-System>
+ *
+ * This file is part of Gracemont Industrial Control Framework.
+ * Repository: https://github.com/Zixiao-System/gracemont
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * Internet Checksum Unit Tests and Benchmark
+ */
+
+#include "test_framework.h"
+#include "net_stack.h"
+
+static uint8_t csum_src[2048] __attribute__((aligned(64)));
+static uint8_t csum_dst[2048] __attribute__((aligned(64)));
+
+/*
+ * Reference RFC 1071 checksum, one big-endian word at a time
+ */
+static uint16_t csum_reference(const uint8_t *p, size_t len)
+{
+    uint32_t sum = 0;
+
+    while (len > 1) {
+        sum += ((uint32_t)p[0] << 8) | p[1];
+        p += 2;
+        len -= 2;
+    }
+    if (len == 1) {
+        sum += (uint32_t)p[0] << 8;
+    }
+
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+
+    return htons((uint16_t)~sum);
+}
+
+static void csum_fill(void)
+{
+    uint32_t seed = 0x12345678;
+
+    for (size_t i = 0; i < sizeof(csum_src); i++) {
+        seed = seed * 1103515245 + 12345;
+        csum_src[i] = (uint8_t)(seed >> 16);
+    }
+}
+
+/*
+ * Test: Matches the reference for every alignment and tail length
+ */
+TEST_CASE(csum_alignment)
+{
+    csum_fill();
+
+    for (size_t off = 0; off < 8; off++) {
+        for (size_t len = 1; len < 600; len++) {
+            TEST_ASSERT_EQ(inet_checksum(csum_src + off, len),
+                           csum_reference(csum_src + off, len));
+        }
+    }
+
+    /* Long enough for the vector path */
+    TEST_ASSERT_EQ(inet_checksum(csum_src + 3, 1500),
+                   csum_reference(csum_src + 3, 1500));
+    TEST_ASSERT_EQ(inet_checksum(csum_src, sizeof(csum_src)),
+                   csum_reference(csum_src, sizeof(csum_src)));
+    return TEST_PASS;
+}
+
+/*
+ * Test: Chained partial sums
+ */
+TEST_CASE(csum_partial_chain)
+{
+    csum_fill();
+
+    uint32_t sum = inet_csum_partial(csum_src, 20, 0);
+    sum = inet_csum_partial(csum_src + 20, 1000, sum);
+    sum = inet_csum_partial(csum_src + 1020, 481, sum);
+
+    TEST_ASSERT_EQ(inet_csum_fold(sum), csum_reference(csum_src, 1501));
+    return TEST_PASS;
+}
+
+/*
+ * Test: Copy and checksum
+ */
+TEST_CASE(csum_copy)
+{
+    csum_fill();
+
+    for (size_t off = 0; off < 4; off++) {
+        for (size_t len = 1; len < 300; len += 7) {
+            uint32_t sum = inet_csum_copy(csum_dst + 1, csum_src + off, len, 0);
+            TEST_ASSERT_EQ(inet_csum_fold(sum), csum_reference(csum_src + off, len));
+            TEST_ASSERT_MEM_EQ(csum_dst + 1, csum_src + off, len);
+        }
+    }
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: Pseudo-header seeds a TCP checksum
+ */
+TEST_CASE(csum_pseudo_header)
+{
+    /* Pseudo-header followed by a 20-byte segment */
+    static const uint8_t pkt[32] = {
+        192, 168, 1, 1,   10, 0, 0, 2,   0, IP_PROTO_TCP, 0, 20,
+        0x04, 0xD2, 0x01, 0xF6, 0x00, 0x00, 0x00, 0x01,
+        0x00, 0x00, 0x00, 0x00, 0x50, 0x02, 0xFF, 0xFF,
+        0x00, 0x00, 0x00, 0x00
+    };
+
+    uint16_t ph = inet_pseudo_checksum(IP4_ADDR(192, 168, 1, 1), IP4_ADDR(10, 0, 0, 2),
+                                       IP_PROTO_TCP, 20);
+
+    TEST_ASSERT_EQ(inet_csum_fold(inet_csum_partial(pkt + 12, 20, ph)),
+                   csum_reference(pkt, sizeof(pkt)));
+    return TEST_PASS;
+}
+
+/*
+ * Test: RFC 1624 update equals recomputation (echo reply, TTL)
+ */
+TEST_CASE(csum_incremental)
+{
+    uint8_t buf[64];
+    icmp_hdr_t *icmp = (icmp_hdr_t *)buf;
+
+    csum_fill();
+    for (size_t i = 0; i < sizeof(buf); i++) {
+        buf[i] = csum_src[i];
+    }
+
+    /* ICMP echo request -> reply */
+    icmp->type = ICMP_ECHO_REQUEST;
+    icmp->code = 0;
+    icmp->checksum = 0;
+    icmp->checksum = inet_checksum(buf, sizeof(buf));
+
+    uint16_t old_word = *(const uint16_t *)buf;
+    icmp->type = ICMP_ECHO_REPLY;
+    icmp->checksum = inet_csum_update16(icmp->checksum, old_word, *(const uint16_t *)buf);
+    TEST_ASSERT_EQ(inet_checksum(buf, sizeof(buf)), 0);
+
+    /* TTL rewrite */
+    ip_hdr_t *ip = (ip_hdr_t *)buf;
+    ip->ver_ihl = 0x45;
+    ip->checksum = 0;
+    ip->checksum = inet_checksum(ip, sizeof(ip_hdr_t));
+    for (int ttl = 255; ttl >= 0; ttl -= 17) {
+        ip_set_ttl(ip, (uint8_t)ttl);
+        TEST_ASSERT_EQ(ip->ttl, ttl);
+        TEST_ASSERT_EQ(inet_checksum(ip, sizeof(ip_hdr_t)), 0);
+    }
+
+    /* Address rewrite */
+    uint32_t old_addr = ip->src;
+    ip->src = htonl(IP4_ADDR(172, 16, 0, 9));
+    ip->checksum = inet_csum_update32(ip->checksum, old_addr, ip->src);
+    TEST_ASSERT_EQ(inet_checksum(ip, sizeof(ip_hdr_t)), 0);
+
+    return TEST_PASS;
+}
+
+/*
+ * Benchmark: cycles per byte on an MTU-sized payload
+ */
+#define CSUM_BENCH_LEN      1460
+#define CSUM_BENCH_ROUNDS   256
+
+TEST_CASE(csum_benchmark)
+{
+    volatile uint32_t sink = 0;
+    uint64_t bytes = (uint64_t)CSUM_BENCH_LEN * CSUM_BENCH_ROUNDS;
+    uint64_t start;
+
+    csum_fill();
+
+    start = test_cycles();
+    for (int i = 0; i < CSUM_BENCH_ROUNDS; i++) {
+        sink += csum_reference(csum_src, CSUM_BENCH_LEN);
+    }
+    test_report("reference (16-bit)", test_cycles() - start, bytes, "cycles/byte");
+
+    start = test_cycles();
+    for (int i = 0; i < CSUM_BENCH_ROUNDS; i++) {
+        sink += inet_checksum(csum_src, CSUM_BENCH_LEN);
+    }
+    test_report("inet_checksum", test_cycles() - start, bytes, "cycles/byte");
+
+    start = test_cycles();
+    for (int i = 0; i < CSUM_BENCH_ROUNDS; i++) {
+        sink += inet_csum_copy(csum_dst, csum_src, CSUM_BENCH_LEN, 0);
+    }
+    test_report("inet_csum_copy", test_cycles() - start, bytes, "cycles/byte");
+
+    start = test_cycles();
+    for (int i = 0; i < CSUM_BENCH_ROUNDS; i++) {
+        for (int j = 0; j < CSUM_BENCH_LEN; j++) {
+            csum_dst[j] = csum_src[j];
+        }
+        sink += inet_checksum(csum_dst, CSUM_BENCH_LEN);
+    }
+    test_report("copy, then checksum", test_cycles() - start, bytes, "cycles/byte");
+
+    (void)sink;
+    return TEST_PASS;
+}
+
+/*
+ * Test Suite Definition
+ */
+static test_case_t checksum_tests[] = {
+    { "csum_alignment", test_csum_alignment },
+    { "csum_partial_chain", test_csum_partial_chain },
+    { "csum_copy", test_csum_copy },
+    { "csum_pseudo_header", test_csum_pseudo_header },
+    { "csum_incremental", test_csum_incremental },
+    { "csum_benchmark", test_csum_benchmark },
+};
+
+test_suite_t checksum_test_suite = {
+    .name = "Internet Checksum",
+    .tests = checksum_tests,
+    .test_count = sizeof(checksum_tests) / sizeof(test_case_t),
+    .setup = NULL,
+    .teardown = NULL
+};
@@ -0,0 +1,374 @@
+/*
+ * Gracemont Industrial Control Framework - ARM64 RTOS
+ * Copyright (C) 2024 Zixiao System <https://github.com/Zixiao-System>
+ *
+ * This file is part of Gracemont Industrial Control Framework.
+ * Repository: https://github.com/Zixiao-System/gracemont
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ *
+ *
+ * Early RX Classifier and Protocol Handler Unit Tests
+ */
+
+#include "test_framework.h"
+#include "net_stack.h"
+#include "rtos_config.h"
+#include "rtos.h"
+#include "test_net.h"
+
+#define CLS_TEST_IP         0x0A000001      /* 10.0.0.1 (us) */
+#define CLS_TEST_PEER       0x0A000002
+#define CLS_TEST_SCANNER    0x0A000063
+#define CLS_TEST_ETH_TYPE   0x88B5          /* IEEE local experimental */
+
+static const uint8_t cls_bcast_mac[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+static netif_t cls_test_nif;
+static zbuf_queue_t cls_test_queue;
+
+/* Redirect handler record */
+static int cls_test_redirects;
+static uint16_t cls_test_frame_id;
+
+static status_t cls_test_send(netif_t *nif, zbuf_t *zb)
+{
+    (void)nif;
+    zbuf_free(zb);
+    return STATUS_OK;
+}
+
+static void cls_test_setup(void)
+{
+    test_netif_init(&cls_test_nif, 0x10, CLS_TEST_IP, 0xFFFFFF00, cls_test_send);
+
+    zbuf_queue_init(&cls_test_queue);
+    cls_test_redirects = 0;
+    cls_test_frame_id = 0;
+    net_cls_init();
+}
+
+static void cls_test_teardown(void)
+{
+    netif_del_proto(&cls_test_nif, CLS_TEST_ETH_TYPE);
+    netif_del_proto(NULL, CLS_TEST_ETH_TYPE);
+    net_cls_init();
+    zbuf_queue_flush(&cls_test_queue);
+}
+
+/* Ethernet frame with payload_len bytes after the header */
+static zbuf_t *cls_test_frame(const uint8_t *dst, uint16_t type, uint16_t payload_len)
+{
+    zbuf_t *zb = zbuf_alloc(ETH_HDR_LEN + payload_len);
+    if (zb == NULL) return NULL;
+
+    eth_hdr_t *eth = (eth_hdr_t *)zbuf_put(zb, ETH_HDR_LEN);
+    for (int i = 0; i < 6; i++) {
+        eth->dst[i] = dst[i];
+        eth->src[i] = test_peer_mac[i];
+    }
+    eth->type = htons(type);
+
+    uint8_t *p = zbuf_put(zb, payload_len);
+    for (uint16_t i = 0; i < payload_len; i++) {
+        p[i] = 0;
+    }
+    return zb;
+}
+
+/*
+ * UDP datagram from src to dport. A bad IP checksum is the probe: the
+ * stack counts it in rx_errors, a classifier drop does not.
+ */
+static void cls_test_udp_input(const uint8_t *dst_mac, uint32_t src, uint16_t dport,
+                               bool good_csum)
+{
+    uint16_t len = sizeof(ip_hdr_t) + UDP_HDR_LEN;
+    zbuf_t *zb = cls_test_frame(dst_mac, ETH_TYPE_IP, len);
+    if (zb == NULL) return;
+
+    ip_hdr_t *ip = (ip_hdr_t *)(zb->data + ETH_HDR_LEN);
+    ip->ver_ihl = 0x45;
+    ip->len = htons(len);
+    ip->ttl = 64;
+    ip->proto = IP_PROTO_UDP;
+    ip->src = htonl(src);
+    ip->dst = htonl(CLS_TEST_IP);
+    ip->checksum = 0;
+    ip->checksum = inet_checksum(ip, sizeof(ip_hdr_t));
+    if (!good_csum) {
+        ip->checksum ^= 0x1234;
+    }
+
+    udp_hdr_t *udp = (udp_hdr_t *)(ip + 1);
+    udp->sport = htons(40000);
+    udp->dport = htons(dport);
+    udp->len = htons(UDP_HDR_LEN);
+
+    netif_input(&cls_test_nif, zb);
+}
+
+static void cls_test_pnio_input(uint16_t frame_id)
+{
+    zbuf_t *zb = cls_test_frame(cls_bcast_mac, ETH_TYPE_PNIO, 40);
+    if (zb == NULL) return;
+
+    zb->data[ETH_HDR_LEN] = (uint8_t)(frame_id >> 8);
+    zb->data[ETH_HDR_LEN + 1] = (uint8_t)frame_id;
+
+    netif_input(&cls_test_nif, zb);
+}
+
+static void cls_test_handler(netif_t *nif, zbuf_t *zb, void *arg)
+{
+    (void)arg;
+
+    if (nif == &cls_test_nif && zb->len >= 2) {
+        cls_test_frame_id = (uint16_t)((zb->data[0] << 8) | zb->data[1]);
+    }
+    cls_test_redirects++;
+    zbuf_free(zb);
+}
+
+/* Protocol handler: arg says which registration received the frame */
+static void cls_test_proto(netif_t *nif, zbuf_t *zb, void *arg)
+{
+    (void)nif;
+    cls_test_redirects += (int)(uintptr_t)arg;
+    zbuf_free(zb);
+}
+
+static uint32_t cls_test_hits(int id)
+{
+    net_cls_stats_t stats;
+    net_cls_get_stats(id, &stats);
+    return stats.hits;
+}
+
+/*
+ * Test: A port-range drop sheds packets before checksum verification
+ */
+TEST_CASE(cls_drop_port_range)
+{
+    net_cls_rule_t rule = {
+        .match = NET_CLS_M_PROTO | NET_CLS_M_DPORT,
+        .proto = IP_PROTO_UDP,
+        .dport_lo = 1000,
+        .dport_hi = 2000,
+        .action = NET_CLS_DROP,
+    };
+    int id = net_cls_add(&rule);
+    TEST_ASSERT(id >= 0);
+
+    cls_test_udp_input(cls_test_nif.mac, CLS_TEST_SCANNER, 1500, false);
+    TEST_ASSERT_EQ(cls_test_hits(id), 1);
+    TEST_ASSERT_EQ(cls_test_nif.rx_errors, 0);
+
+    /* Outside the range: on to ip_input, which rejects the checksum */
+    cls_test_udp_input(cls_test_nif.mac, CLS_TEST_SCANNER, 2001, false);
+    TEST_ASSERT_EQ(cls_test_hits(id), 1);
+    TEST_ASSERT_EQ(cls_test_nif.rx_errors, 1);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: The first matching rule decides; PASS lets a host through a
+ * broadcast drop
+ */
+TEST_CASE(cls_first_match)
+{
+    net_cls_rule_t pass = {
+        .match = NET_CLS_M_SRC_IP,
+        .src_ip = CLS_TEST_PEER,
+        .src_mask = 0xFFFFFFFF,
+        .action = NET_CLS_PASS,
+    };
+    net_cls_rule_t storm = {
+        .nif = &cls_test_nif,
+        .match = NET_CLS_M_BCAST,
+        .action = NET_CLS_DROP,
+    };
+    int pass_id = net_cls_add(&pass);
+    int storm_id = net_cls_add(&storm);
+    TEST_ASSERT_EQ(pass_id, 0);
+    TEST_ASSERT_EQ(storm_id, 1);
+
+    cls_test_udp_input(cls_bcast_mac, CLS_TEST_PEER, 9999, false);
+    TEST_ASSERT_EQ(cls_test_hits(pass_id), 1);
+    TEST_ASSERT_EQ(cls_test_hits(storm_id), 0);
+    TEST_ASSERT_EQ(cls_test_nif.rx_errors, 1);
+
+    cls_test_udp_input(cls_bcast_mac, CLS_TEST_SCANNER, 9999, false);
+    TEST_ASSERT_EQ(cls_test_hits(storm_id), 1);
+    TEST_ASSERT_EQ(cls_test_nif.rx_errors, 1);
+
+    /* Unicast is not matched by the storm rule */
+    cls_test_udp_input(cls_test_nif.mac, CLS_TEST_SCANNER, 9999, false);
+    TEST_ASSERT_EQ(cls_test_hits(storm_id), 1);
+    TEST_ASSERT_EQ(cls_test_nif.rx_errors, 2);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: Queue delivery stops at the limit and counts the overflow
+ */
+TEST_CASE(cls_queue_limit)
+{
+    net_cls_rule_t rule = {
+        .match = NET_CLS_M_ETHERTYPE,
+        .ethertype = CLS_TEST_ETH_TYPE,
+        .action = NET_CLS_QUEUE,
+        .queue = &cls_test_queue,
+        .queue_limit = 2,
+    };
+    int id = net_cls_add(&rule);
+    TEST_ASSERT(id >= 0);
+
+    for (int i = 0; i < 3; i++) {
+        netif_input(&cls_test_nif, cls_test_frame(cls_test_nif.mac, CLS_TEST_ETH_TYPE, 46));
+    }
+
+    net_cls_stats_t stats;
+    TEST_ASSERT_EQ(net_cls_get_stats(id, &stats), STATUS_OK);
+    TEST_ASSERT_EQ(stats.hits, 3);
+    TEST_ASSERT_EQ(stats.drops, 1);
+    TEST_ASSERT_EQ(zbuf_queue_len(&cls_test_queue), 2);
+
+    /* Delivered with the link header pulled */
+    zbuf_t *zb = zbuf_queue_pop(&cls_test_queue);
+    TEST_ASSERT_NOT_NULL(zb);
+    TEST_ASSERT_EQ(zb->len, 46);
+    TEST_ASSERT_EQ(zb->protocol, CLS_TEST_ETH_TYPE);
+    zbuf_free(zb);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: A PROFINET frame ID range is redirected to its handler
+ */
+TEST_CASE(cls_redirect_frame_id)
+{
+    net_cls_rule_t rule = {
+        .match = NET_CLS_M_ETHERTYPE | NET_CLS_M_FRAME_ID,
+        .ethertype = ETH_TYPE_PNIO,
+        .frame_id_lo = 0x8000,
+        .frame_id_hi = 0xBFFF,
+        .action = NET_CLS_REDIRECT,
+        .handler = cls_test_handler,
+    };
+    int id = net_cls_add(&rule);
+    TEST_ASSERT(id >= 0);
+
+    cls_test_pnio_input(0x8001);
+    TEST_ASSERT_EQ(cls_test_redirects, 1);
+    TEST_ASSERT_EQ(cls_test_frame_id, 0x8001);
+
+    /* DCP is outside the range */
+    cls_test_pnio_input(0xFEFE);
+    TEST_ASSERT_EQ(cls_test_redirects, 1);
+    TEST_ASSERT_EQ(cls_test_hits(id), 1);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: Registered ethertypes reach their handler; an interface's own
+ * entry wins over a wildcard one, and the classifier still runs first
+ */
+TEST_CASE(proto_handler_dispatch)
+{
+    TEST_ASSERT_EQ(netif_add_proto(NULL, ETH_TYPE_IP, cls_test_proto, NULL), STATUS_INVALID);
+    TEST_ASSERT_EQ(netif_add_proto(NULL, CLS_TEST_ETH_TYPE, cls_test_proto, (void *)1), STATUS_OK);
+    TEST_ASSERT_EQ(netif_add_proto(NULL, CLS_TEST_ETH_TYPE, cls_test_proto, (void *)1), STATUS_BUSY);
+    TEST_ASSERT_EQ(netif_add_proto(&cls_test_nif, CLS_TEST_ETH_TYPE, cls_test_proto, (void *)100),
+                   STATUS_OK);
+
+    netif_input(&cls_test_nif, cls_test_frame(cls_test_nif.mac, CLS_TEST_ETH_TYPE, 46));
+    TEST_ASSERT_EQ(cls_test_redirects, 100);
+
+    TEST_ASSERT_EQ(netif_del_proto(&cls_test_nif, CLS_TEST_ETH_TYPE), STATUS_OK);
+    netif_input(&cls_test_nif, cls_test_frame(cls_test_nif.mac, CLS_TEST_ETH_TYPE, 46));
+    TEST_ASSERT_EQ(cls_test_redirects, 101);
+
+    /* A classifier drop is decided before the handler is looked up */
+    net_cls_rule_t rule = {
+        .match = NET_CLS_M_ETHERTYPE,
+        .ethertype = CLS_TEST_ETH_TYPE,
+        .action = NET_CLS_DROP,
+    };
+    int id = net_cls_add(&rule);
+    TEST_ASSERT(id >= 0);
+    netif_input(&cls_test_nif, cls_test_frame(cls_test_nif.mac, CLS_TEST_ETH_TYPE, 46));
+    TEST_ASSERT_EQ(cls_test_redirects, 101);
+    TEST_ASSERT_EQ(net_cls_del(id), STATUS_OK);
+
+    /* Unclaimed ethertypes are freed */
+    TEST_ASSERT_EQ(netif_del_proto(NULL, CLS_TEST_ETH_TYPE), STATUS_OK);
+    TEST_ASSERT_EQ(netif_del_proto(NULL, CLS_TEST_ETH_TYPE), STATUS_INVALID);
+    netif_input(&cls_test_nif, cls_test_frame(cls_test_nif.mac, CLS_TEST_ETH_TYPE, 46));
+    TEST_ASSERT_EQ(cls_test_redirects, 101);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: Table limits and argument checks
+ */
+TEST_CASE(cls_add_del)
+{
+    net_cls_rule_t drop = { .action = NET_CLS_DROP };
+    net_cls_rule_t bad = { .action = NET_CLS_QUEUE };
+
+    TEST_ASSERT_EQ(net_cls_add(&bad), STATUS_INVALID);
+    TEST_ASSERT_EQ(net_cls_add(NULL), STATUS_INVALID);
+
+    for (int i = 0; i < CONFIG_NET_CLS_RULES; i++) {
+        TEST_ASSERT_EQ(net_cls_add(&drop), i);
+    }
+    TEST_ASSERT_EQ(net_cls_add(&drop), STATUS_NO_MEM);
+
+    /* A freed slot is reused */
+    TEST_ASSERT_EQ(net_cls_del(3), STATUS_OK);
+    TEST_ASSERT_EQ(net_cls_del(3), STATUS_INVALID);
+    TEST_ASSERT_EQ(net_cls_add(&drop), 3);
+    TEST_ASSERT_EQ(net_cls_del(CONFIG_NET_CLS_RULES), STATUS_INVALID);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test Suite Definition
+ */
+static test_case_t cls_tests[] = {
+    { "cls_drop_port_range", test_cls_drop_port_range },
+    { "cls_first_match", test_cls_first_match },
+    { "cls_queue_limit", test_cls_queue_limit },
+    { "cls_redirect_frame_id", test_cls_redirect_frame_id },
+    { "cls_add_del", test_cls_add_del },
+    { "proto_handler_dispatch", test_proto_handler_dispatch },
+};
+
+test_suite_t cls_test_suite = {
+    .name = "RX Classifier",
+    .tests = cls_tests,
+    .test_count = sizeof(cls_tests) / sizeof(test_case_t),
+    .setup = cls_test_setup,
+    .teardown = cls_test_teardown
+};
@@ -0,0 +1,129 @@
+/*
+ * Gracemont Industrial Control Framework - ARM64 RTOS
+ * Copyright (C) 2024 Zixiao System <https://github.com/Zixiao-System>
+ *
+ * This file is part of Gracemont Industrial Control Framework.
+ * Repository: https://github.com/Zixiao-System/gracemont
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ *
+ * Ethernet Driver Benchmark
+ *
+ * Needs a virtio-net device (make qemu-test provides one) and is
+ * skipped without it. Frames use the local experimental EtherType and
+ * go to the broadcast address, so the host side just drops them.
+ */
+
+#include "test_framework.h"
+#include "net_stack.h"
+#include "eth.h"
+
+#define ETH_BENCH_TYPE      0x88B5      /* IEEE local experimental */
+#define ETH_BENCH_LEN       60          /* Minimum frame without FCS */
+#define ETH_BENCH_BATCH     32
+#define ETH_BENCH_PACKETS   100000
+
+static inline uint64_t eth_bench_counter(void)
+{
+    uint64_t cnt;
+    __asm__ volatile("isb; mrs %0, cntvct_el0" : "=r"(cnt));
+    return cnt;
+}
+
+static inline uint64_t eth_bench_freq(void)
+{
+    uint64_t freq;
+    __asm__ volatile("mrs %0, cntfrq_el0" : "=r"(freq));
+    return freq;
+}
+
+static zbuf_t *eth_bench_frame(netif_t *nif)
+{
+    zbuf_t *zb = zbuf_alloc_tx(ETH_BENCH_LEN);
+    if (!zb) return NULL;
+
+    uint8_t *p = zbuf_put(zb, ETH_BENCH_LEN);
+    eth_hdr_t *eth = (eth_hdr_t *)p;
+
+    for (int i = 0; i < 6; i++) {
+        eth->dst[i] = 0xFF;
+        eth->src[i] = nif->mac[i];
+    }
+    eth->type = htons(ETH_BENCH_TYPE);
+    for (uint32_t i = ETH_HDR_LEN; i < ETH_BENCH_LEN; i++) {
+        p[i] = (uint8_t)i;
+    }
+
+    return zb;
+}
+
+/*
+ * Benchmark: Minimum-size frame TX rate in batches of ETH_BENCH_BATCH
+ */
+TEST_CASE(eth_tx_pps)
+{
+    if (eth_init() != STATUS_OK) {
+        return TEST_SKIP;
+    }
+
+    netif_t *nif = eth_get_netif();
+    TEST_ASSERT_NOT_NULL(nif);
+
+    eth_stats_t before;
+    eth_stats_t after;
+    eth_get_stats(&before);
+
+    uint64_t sent = 0;
+    uint64_t start = eth_bench_counter();
+
+    for (uint32_t n = 0; n < ETH_BENCH_PACKETS; n += ETH_BENCH_BATCH) {
+        zbuf_t *batch[ETH_BENCH_BATCH];
+        uint32_t count = 0;
+
+        while (count < ETH_BENCH_BATCH) {
+            zbuf_t *zb = eth_bench_frame(nif);
+            if (!zb) break;
+            batch[count++] = zb;
+        }
+        sent += netif_send_batch(nif, batch, count);
+    }
+
+    uint64_t elapsed = eth_bench_counter() - start;
+    eth_get_stats(&after);
+
+    TEST_ASSERT(sent > 0);
+    test_report(after.ring_packed ? "tx 60B packed ring" : "tx 60B split ring",
+                sent * eth_bench_freq(), elapsed, "pps");
+    test_report("tx doorbells", after.tx_kicks - before.tx_kicks, sent, "per packet");
+
+    return TEST_PASS;
+}
+
+/*
+ * Test Suite Definition
+ */
+static test_case_t eth_tests[] = {
+    { "eth_tx_pps", test_eth_tx_pps },
+};
+
+test_suite_t eth_test_suite = {
+    .name = "Ethernet Driver",
+    .tests = eth_tests,
+    .test_count = sizeof(eth_tests) / sizeof(test_case_t),
+    .setup = NULL,
+    .teardown = NULL
+};
@@ -149,6 +149,45 @@ test_stats_t *test_get_stats(void)
     return &test_stats;
 }
 
+/*
+ * CPU cycle counter for benchmarks (PMU PMCCNTR_EL0)
+ */
+uint64_t test_cycles(void)
+{
+    static bool enabled = false;
+    uint64_t cnt;
+
+    if (!enabled) {
+        /* PMCR_EL0.E enables the PMU, PMCNTENSET_EL0.C the cycle counter */
+        __asm__ volatile("msr pmcr_el0, %0" : : "r"((uint64_t)1));
+        __asm__ volatile("msr pmcntenset_el0, %0" : : "r"((uint64_t)1 << 31));
+        __asm__ volatile("isb");
+        enabled = true;
+    }
+
+    __asm__ volatile("isb; mrs %0, pmccntr_el0" : "=r"(cnt));
+    return cnt;
+}
+
+/*
+ * Print a benchmark result as num/den with two decimals
+ */
+void test_report(const char *label, uint64_t num, uint64_t den, const char *unit)
+{
+    uint64_t scaled = (den != 0) ? (num * 100) / den : 0;
+    uint32_t frac = (uint32_t)(scaled % 100);
+
+    test_print("\n    ");
+    test_print(label);
+    test_print(": ");
+    test_print_num((uint32_t)(scaled / 100));
+    test_print(".");
+    uart_putc(0, '0' + frac / 10);
+    uart_putc(0, '0' + frac % 10);
+    test_print(" ");
+    test_print(unit);
+}
+
 void test_assert_failed(const char *file, int line, const char *cond)
 {
     test_print("\n    Assertion failed: ");
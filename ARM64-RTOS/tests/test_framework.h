@@ -124,6 +124,10 @@ void test_run_all(void);
 void test_print_summary(void);
 test_stats_t *test_get_stats(void);
 
+/* Benchmark helpers */
+uint64_t test_cycles(void);
+void test_report(const char *label, uint64_t num, uint64_t den, const char *unit);
+
 /* Internal functions for assertions */
 void test_assert_failed(const char *file, int line, const char *cond);
 void test_assert_eq_failed(const char *file, int line, uint64_t a, uint64_t b);
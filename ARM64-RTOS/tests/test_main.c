@@ -30,6 +30,18 @@
 extern test_suite_t memory_test_suite;
 extern test_suite_t zbuf_test_suite;
 extern test_suite_t sync_test_suite;
+extern test_suite_t checksum_test_suite;
+extern test_suite_t arp_test_suite;
+extern test_suite_t route_test_suite;
+extern test_suite_t txq_test_suite;
+extern test_suite_t cls_test_suite;
+extern test_suite_t tcp_test_suite;
+extern test_suite_t udp_test_suite;
+extern test_suite_t sock_hash_test_suite;
+extern test_suite_t sock_poll_test_suite;
+extern test_suite_t sock_ring_test_suite;
+extern test_suite_t rss_test_suite;
+extern test_suite_t eth_test_suite;
 extern test_suite_t modbus_test_suite;
 
 /*
@@ -42,6 +54,18 @@ void test_run_all(void)
     test_run_suite(&memory_test_suite);
     test_run_suite(&zbuf_test_suite);
     test_run_suite(&sync_test_suite);
+    test_run_suite(&checksum_test_suite);
+    test_run_suite(&arp_test_suite);
+    test_run_suite(&route_test_suite);
+    test_run_suite(&txq_test_suite);
+    test_run_suite(&cls_test_suite);
+    test_run_suite(&tcp_test_suite);
+    test_run_suite(&udp_test_suite);
+    test_run_suite(&sock_hash_test_suite);
+    test_run_suite(&sock_poll_test_suite);
+    test_run_suite(&sock_ring_test_suite);
+    test_run_suite(&rss_test_suite);
+    test_run_suite(&eth_test_suite);
     test_run_suite(&modbus_test_suite);
 
     test_print_summary();
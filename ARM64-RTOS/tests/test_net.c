@@ -0,0 +1,83 @@
+/*
+ * Gracemont Industrial Control Framework - ARM64 RTOS
+ * Copyright (C) 2024 Zixiao System <https://github.com/Zixiao-System>
+ *
+ * This file is part of Gracemont Industrial Control Framework.
+ * Repository: https://github.com/Zixiao-System/gracemont
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * Network Test Fixtures
+ */
+
+#include "test_net.h"
+
+const uint8_t test_peer_mac[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x02};
+
+zbuf_queue_t test_net_wire;
+
+void test_netif_init(netif_t *nif, uint8_t mac0, uint32_t ip, uint32_t netmask,
+                     status_t (*send)(netif_t *nif, zbuf_t *zb))
+{
+    for (int i = 0; i < 6; i++) {
+        nif->mac[i] = (uint8_t)(mac0 + i);
+    }
+    nif->ip = ip;
+    nif->netmask = netmask;
+    nif->gateway = 0;
+    nif->mtu = 1500;
+    nif->vlan_id = 0;
+    nif->up = true;
+    nif->features = 0;
+    nif->send = send;
+    nif->send_batch = NULL;
+    nif->rx_errors = 0;
+    netif_txq_init(nif, 0);
+}
+
+status_t test_net_send(netif_t *nif, zbuf_t *zb)
+{
+    (void)nif;
+    zbuf_queue_push(&test_net_wire, zb);
+    return STATUS_OK;
+}
+
+void test_arp_input(netif_t *nif, uint16_t oper, const uint8_t *sha,
+                    uint32_t spa, uint32_t tpa)
+{
+    zbuf_t *zb = zbuf_alloc(sizeof(arp_hdr_t));
+    if (zb == NULL) return;
+
+    arp_hdr_t *arp = (arp_hdr_t *)zbuf_put(zb, sizeof(arp_hdr_t));
+    arp->htype = htons(1);
+    arp->ptype = htons(ETH_TYPE_IP);
+    arp->hlen = 6;
+    arp->plen = 4;
+    arp->oper = htons(oper);
+    for (int i = 0; i < 6; i++) {
+        arp->sha[i] = sha[i];
+        arp->tha[i] = nif->mac[i];
+    }
+    arp->spa = htonl(spa);
+    arp->tpa = htonl(tpa);
+
+    arp_input(nif, zb);
+}
+
+void test_arp_peer(netif_t *nif, const uint8_t *mac, uint32_t ip)
+{
+    test_arp_input(nif, ARP_OP_REPLY, mac, ip, nif->ip);
+}
@@ -0,0 +1,57 @@
+/*
+ * Gracemont Industrial Control Framework - ARM64 RTOS
+ * Copyright (C) 2024 Zixiao System <https://github.com/Zixiao-System>
+ *
+ * This file is part of Gracemont Industrial Control Framework.
+ * Repository: https://github.com/Zixiao-System/gracemont
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * Network Test Fixtures
+ *
+ * The fake interface, wire and ARP peer the stack suites share.
+ */
+
+#ifndef TEST_NET_H
+#define TEST_NET_H
+
+#include "net_stack.h"
+
+/* MAC of the peer the suites talk to */
+extern const uint8_t test_peer_mac[6];
+
+/* Frames sent through test_net_send(), oldest first */
+extern zbuf_queue_t test_net_wire;
+
+/*
+ * Bring up a fake interface: MAC mac0, mac0 + 1, ..., MTU 1500, no
+ * gateway, VLAN or offloads, and an unlimited transmit queue. Suites
+ * override any field afterwards.
+ */
+void test_netif_init(netif_t *nif, uint8_t mac0, uint32_t ip, uint32_t netmask,
+                     status_t (*send)(netif_t *nif, zbuf_t *zb));
+
+/* Send hook that queues every frame on test_net_wire */
+status_t test_net_send(netif_t *nif, zbuf_t *zb);
+
+/* Feed an ARP packet from sha/spa, addressed to tpa, into the stack */
+void test_arp_input(netif_t *nif, uint16_t oper, const uint8_t *sha,
+                    uint32_t spa, uint32_t tpa);
+
+/* ARP reply from a peer, so frames to it need no resolution */
+void test_arp_peer(netif_t *nif, const uint8_t *mac, uint32_t ip);
+
+#endif /* TEST_NET_H */
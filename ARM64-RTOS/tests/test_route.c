@@ -0,0 +1,370 @@
+/*
+ * Gracemont Industrial Control Framework - ARM64 RTOS
+ * Copyright (C) 2024 Zixiao System <https://github.com/Zixiao-System>
+ *
+ * This file is part of Gracemont Industrial Control Framework.
+ * Repository: https://github.com/Zixiao-System/gracemont
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ *
+ * Routing Table Unit Tests
+ */
+
+#include "test_framework.h"
+#include "net_stack.h"
+#include "rtos_config.h"
+#include "rtos.h"
+#include "test_net.h"
+
+#define ROUTE_TEST_PLANT_IP     0xC0A80001      /* 192.168.0.1/24 (PROFINET) */
+#define ROUTE_TEST_PLANT_GW     0xC0A800FE
+#define ROUTE_TEST_HMI_IP       0x0A010001      /* 10.1.0.1/16 (supervisory) */
+#define ROUTE_TEST_HMI_GW       0x0A0100FE
+#define ROUTE_TEST_MAX_TX       8
+
+typedef struct {
+    netif_t     nif;
+    zbuf_t      *tx[ROUTE_TEST_MAX_TX];
+    int         tx_count;
+} route_test_port_t;
+
+static route_test_port_t plant;
+static route_test_port_t hmi;
+
+static status_t route_test_send(netif_t *nif, zbuf_t *zb)
+{
+    route_test_port_t *port = (nif == &plant.nif) ? &plant : &hmi;
+
+    if (port->tx_count >= ROUTE_TEST_MAX_TX) {
+        zbuf_free(zb);
+        return STATUS_NO_MEM;
+    }
+    port->tx[port->tx_count++] = zb;
+    return STATUS_OK;
+}
+
+static void route_test_flush(route_test_port_t *port)
+{
+    for (int i = 0; i < port->tx_count; i++) {
+        zbuf_free(port->tx[i]);
+    }
+    port->tx_count = 0;
+}
+
+static void route_test_port(route_test_port_t *port, uint8_t id, uint32_t ip,
+                            uint32_t netmask, uint32_t gateway)
+{
+    test_netif_init(&port->nif, id, ip, netmask, route_test_send);
+    port->nif.gateway = gateway;
+    port->tx_count = 0;
+
+    /* What netif_register() does, without linking into the live list */
+    route_iface_update(&port->nif);
+}
+
+static void route_test_setup(void)
+{
+    arp_init();
+    route_init();
+
+    /* Plant network first: it owns the default route */
+    route_test_port(&plant, 0x10, ROUTE_TEST_PLANT_IP, 0xFFFFFF00, ROUTE_TEST_PLANT_GW);
+    route_test_port(&hmi, 0x20, ROUTE_TEST_HMI_IP, 0xFFFF0000, ROUTE_TEST_HMI_GW);
+}
+
+static void route_test_teardown(void)
+{
+    route_test_flush(&plant);
+    route_test_flush(&hmi);
+    arp_init();
+    route_init();
+}
+
+static zbuf_t *route_test_packet(void)
+{
+    zbuf_t *zb = zbuf_alloc_tx(32);
+    if (zb != NULL) {
+        zbuf_put(zb, 32);
+    }
+    return zb;
+}
+
+/* Target of the ARP request a port sent */
+static uint32_t route_test_arp_tpa(route_test_port_t *port, int i)
+{
+    arp_hdr_t *arp = (arp_hdr_t *)(port->tx[i]->data + ETH_HDR_LEN);
+    return ntohl(arp->tpa);
+}
+
+/* Peer MAC: the port's own with the low byte flipped */
+static void route_test_peer_mac(route_test_port_t *port, uint8_t *mac)
+{
+    for (int i = 0; i < 6; i++) {
+        mac[i] = port->nif.mac[i];
+    }
+    mac[5] ^= 0xFF;
+}
+
+/* ARP reply from a peer on the port, so it needs no resolution */
+static void route_test_arp_peer(route_test_port_t *port, uint32_t ip)
+{
+    uint8_t mac[6];
+
+    route_test_peer_mac(port, mac);
+    test_arp_peer(&port->nif, mac, ip);
+}
+
+/* Echo request from src to dst arriving on the port */
+static void route_test_echo(route_test_port_t *port, uint32_t src, uint32_t dst, uint8_t ttl)
+{
+    const uint16_t total = sizeof(ip_hdr_t) + sizeof(icmp_hdr_t) + 8;
+    zbuf_t *zb = zbuf_alloc(ETH_HDR_LEN + total);
+    if (zb == NULL) return;
+
+    eth_hdr_t *eth = (eth_hdr_t *)zbuf_put(zb, ETH_HDR_LEN);
+    route_test_peer_mac(port, eth->src);
+    for (int i = 0; i < 6; i++) {
+        eth->dst[i] = port->nif.mac[i];
+    }
+    eth->type = htons(ETH_TYPE_IP);
+
+    ip_hdr_t *ip = (ip_hdr_t *)zbuf_put(zb, total);
+    ip->ver_ihl = 0x45;
+    ip->tos = 0;
+    ip->len = htons(total);
+    ip->id = htons(0x1234);
+    ip->frag = htons(0x4000);
+    ip->ttl = ttl;
+    ip->proto = IP_PROTO_ICMP;
+    ip->src = htonl(src);
+    ip->dst = htonl(dst);
+    ip->checksum = 0;
+    ip->checksum = inet_checksum(ip, sizeof(ip_hdr_t));
+
+    icmp_hdr_t *icmp = (icmp_hdr_t *)(ip + 1);
+    icmp->type = ICMP_ECHO_REQUEST;
+    icmp->code = 0;
+    icmp->id = htons(7);
+    icmp->seq = htons(1);
+    uint8_t *p = (uint8_t *)(icmp + 1);
+    for (int i = 0; i < 8; i++) {
+        p[i] = (uint8_t)i;
+    }
+    icmp->checksum = 0;
+    icmp->checksum = inet_checksum(icmp, sizeof(icmp_hdr_t) + 8);
+
+    netif_input(&port->nif, zb);
+}
+
+/*
+ * Test: Connected routes and the default route come from the interfaces
+ */
+TEST_CASE(route_iface_routes)
+{
+    uint32_t next_hop;
+    route_stats_t stats;
+
+    route_get_stats(&stats);
+    TEST_ASSERT_EQ(stats.entries, 3);
+
+    TEST_ASSERT(route_lookup(0xC0A80042, &next_hop) == &plant.nif);
+    TEST_ASSERT_EQ(next_hop, 0xC0A80042);
+
+    TEST_ASSERT(route_lookup(0x0A01FF01, &next_hop) == &hmi.nif);
+    TEST_ASSERT_EQ(next_hop, 0x0A01FF01);
+
+    /* Off both subnets: the first gateway wins */
+    TEST_ASSERT(route_lookup(0x08080808, &next_hop) == &plant.nif);
+    TEST_ASSERT_EQ(next_hop, ROUTE_TEST_PLANT_GW);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: The longest matching prefix is chosen regardless of insert order
+ */
+TEST_CASE(route_longest_prefix)
+{
+    uint32_t next_hop;
+
+    /* Wide route through the HMI router, then a narrower one back out */
+    TEST_ASSERT_EQ(route_add(0xAC100000, 0xFFF00000, ROUTE_TEST_HMI_GW, &hmi.nif), STATUS_OK);
+    TEST_ASSERT_EQ(route_add(0xAC101000, 0xFFFFFF00, ROUTE_TEST_PLANT_GW, &plant.nif), STATUS_OK);
+
+    TEST_ASSERT(route_lookup(0xAC101005, &next_hop) == &plant.nif);
+    TEST_ASSERT_EQ(next_hop, ROUTE_TEST_PLANT_GW);
+    TEST_ASSERT(route_lookup(0xAC111005, &next_hop) == &hmi.nif);
+    TEST_ASSERT_EQ(next_hop, ROUTE_TEST_HMI_GW);
+
+    /* Non-contiguous masks are refused */
+    TEST_ASSERT_EQ(route_add(0xAC000000, 0xFF00FF00, 0, &hmi.nif), STATUS_INVALID);
+
+    /* Removing the narrow route falls back to the wide one */
+    TEST_ASSERT_EQ(route_del(0xAC101000, 0xFFFFFF00), STATUS_OK);
+    TEST_ASSERT(route_lookup(0xAC101005, &next_hop) == &hmi.nif);
+    TEST_ASSERT_EQ(route_del(0xAC101000, 0xFFFFFF00), STATUS_INVALID);
+
+    /* Without a default route, off-net is unreachable */
+    TEST_ASSERT_EQ(route_del(0, 0), STATUS_OK);
+    TEST_ASSERT(route_lookup(0x08080808, &next_hop) == NULL);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: A socket's cached route is reused until the table changes
+ */
+TEST_CASE(route_cache)
+{
+    route_cache_t rc;
+    route_stats_t before, after;
+    uint32_t next_hop;
+
+    route_cache_init(&rc);
+    route_get_stats(&before);
+
+    TEST_ASSERT(route_lookup_cached(&rc, 0x0A010203, &next_hop) == &hmi.nif);
+    for (int i = 0; i < 4; i++) {
+        TEST_ASSERT(route_lookup_cached(&rc, 0x0A010203, &next_hop) == &hmi.nif);
+    }
+
+    route_get_stats(&after);
+    TEST_ASSERT_EQ(after.lookups - before.lookups, 1);
+    TEST_ASSERT_EQ(after.cache_hits - before.cache_hits, 4);
+
+    /* A more specific route invalidates the cache */
+    route_add(0x0A010200, 0xFFFFFF00, ROUTE_TEST_PLANT_GW, &plant.nif);
+    TEST_ASSERT(route_lookup_cached(&rc, 0x0A010203, &next_hop) == &plant.nif);
+    TEST_ASSERT_EQ(next_hop, ROUTE_TEST_PLANT_GW);
+
+    /* So does a different destination */
+    TEST_ASSERT(route_lookup_cached(&rc, 0xC0A80007, &next_hop) == &plant.nif);
+    TEST_ASSERT_EQ(next_hop, 0xC0A80007);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: IP output leaves on the routed interface with its address
+ */
+TEST_CASE(route_ip_output)
+{
+    TEST_ASSERT_EQ(ip_output(route_test_packet(), 0, 0xC0A80042, IP_PROTO_UDP), STATUS_OK);
+    TEST_ASSERT_EQ(ip_output(route_test_packet(), 0, 0x0A010042, IP_PROTO_UDP), STATUS_OK);
+    TEST_ASSERT_EQ(ip_output(route_test_packet(), 0, 0x08080808, IP_PROTO_UDP), STATUS_OK);
+
+    /* Each miss probes from the right port, with that port's address */
+    TEST_ASSERT_EQ(plant.tx_count, 2);
+    TEST_ASSERT_EQ(hmi.tx_count, 1);
+    TEST_ASSERT_EQ(route_test_arp_tpa(&plant, 0), 0xC0A80042);
+    TEST_ASSERT_EQ(route_test_arp_tpa(&plant, 1), ROUTE_TEST_PLANT_GW);
+    TEST_ASSERT_EQ(route_test_arp_tpa(&hmi, 0), 0x0A010042);
+
+    arp_hdr_t *arp = (arp_hdr_t *)(hmi.tx[0]->data + ETH_HDR_LEN);
+    TEST_ASSERT_EQ(ntohl(arp->spa), ROUTE_TEST_HMI_IP);
+
+    /* Directed broadcast on a connected subnet needs no resolution */
+    TEST_ASSERT_EQ(ip_output(route_test_packet(), 0, 0x0A01FFFF, IP_PROTO_UDP), STATUS_OK);
+    TEST_ASSERT_EQ(hmi.tx_count, 2);
+    eth_hdr_t *eth = (eth_hdr_t *)hmi.tx[1]->data;
+    ip_hdr_t *ip = (ip_hdr_t *)(hmi.tx[1]->data + ETH_HDR_LEN);
+    TEST_ASSERT_EQ(eth->dst[0], 0xFF);
+    TEST_ASSERT_EQ(ntohs(eth->type), ETH_TYPE_IP);
+    TEST_ASSERT_EQ(ntohl(ip->src), ROUTE_TEST_HMI_IP);
+
+    /* No route: dropped, nothing sent */
+    route_del(0, 0);
+    TEST_ASSERT_EQ(ip_output(route_test_packet(), 0, 0x08080808, IP_PROTO_UDP), STATUS_ERROR);
+    TEST_ASSERT_EQ(plant.tx_count, 2);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: Neighbors are per interface
+ */
+TEST_CASE(route_arp_per_netif)
+{
+    arp_stats_t stats;
+
+    /* The same address probed on both ports is two entries */
+    arp_output(&plant.nif, route_test_packet(), 0x0A0A0A0A);
+    arp_output(&hmi.nif, route_test_packet(), 0x0A0A0A0A);
+
+    arp_get_stats(&stats);
+    TEST_ASSERT_EQ(stats.entries, 2);
+    TEST_ASSERT_EQ(plant.tx_count, 1);
+    TEST_ASSERT_EQ(hmi.tx_count, 1);
+
+    uint8_t mac[6];
+    TEST_ASSERT_EQ(arp_resolve(&plant.nif, 0x0A0A0A0A, mac), STATUS_WOULD_BLOCK);
+    TEST_ASSERT_EQ(arp_resolve(&hmi.nif, 0x0A0A0A0A, mac), STATUS_WOULD_BLOCK);
+
+    arp_get_stats(&stats);
+    TEST_ASSERT_EQ(stats.entries, 2);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: Echo replies reuse the request's IP header with valid checksums
+ */
+TEST_CASE(route_icmp_echo)
+{
+    const uint32_t peer = 0x0A010042;
+    const uint32_t dst[2] = { ROUTE_TEST_HMI_IP, IP4_ADDR_BROADCAST };
+
+    route_test_arp_peer(&hmi, peer);
+
+    for (int i = 0; i < 2; i++) {
+        route_test_echo(&hmi, peer, dst[i], 3);
+        TEST_ASSERT_EQ(hmi.tx_count, i + 1);
+
+        ip_hdr_t *ip = (ip_hdr_t *)(hmi.tx[i]->data + ETH_HDR_LEN);
+        icmp_hdr_t *icmp = (icmp_hdr_t *)(ip + 1);
+        TEST_ASSERT_EQ(ntohl(ip->src), ROUTE_TEST_HMI_IP);
+        TEST_ASSERT_EQ(ntohl(ip->dst), peer);
+        TEST_ASSERT_EQ(ip->ttl, IP_DEFAULT_TTL);
+        TEST_ASSERT_EQ(ntohs(ip->id), 0x1234);
+        TEST_ASSERT_EQ(inet_checksum(ip, sizeof(ip_hdr_t)), 0);
+        TEST_ASSERT_EQ(icmp->type, ICMP_ECHO_REPLY);
+        TEST_ASSERT_EQ(inet_checksum(icmp, sizeof(icmp_hdr_t) + 8), 0);
+    }
+    TEST_ASSERT_EQ(plant.tx_count, 0);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test Suite Definition
+ */
+static test_case_t route_tests[] = {
+    { "route_iface_routes", test_route_iface_routes },
+    { "route_longest_prefix", test_route_longest_prefix },
+    { "route_cache", test_route_cache },
+    { "route_ip_output", test_route_ip_output },
+    { "route_arp_per_netif", test_route_arp_per_netif },
+    { "route_icmp_echo", test_route_icmp_echo },
+};
+
+test_suite_t route_test_suite = {
+    .name = "IPv4 Routing",
+    .tests = route_tests,
+    .test_count = sizeof(route_tests) / sizeof(test_case_t),
+    .setup = route_test_setup,
+    .teardown = route_test_teardown
+};
@@ -0,0 +1,179 @@
+/*
+ * Gracemont Industrial Control Framework - ARM64 RTOS
+ * Copyright (C) 2024 Zixiao System <https://github.com/Zixiao-System>
+ *
+ * This file is part of Gracemont Industrial Control Framework.
+ * Repository: https://github.com/Zixiao-System/gracemont
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ *
+ * RSS Flow Hash Unit Tests and Benchmark
+ */
+
+#include "test_framework.h"
+#include "net_stack.h"
+
+#define RSS_BENCH_ROUNDS    4096
+
+/* Microsoft RSS verification suite, IPv4 */
+static const struct {
+    uint32_t    src;
+    uint32_t    dst;
+    uint16_t    sport;
+    uint16_t    dport;
+    uint32_t    hash_ip;
+    uint32_t    hash_l4;
+} rss_vectors[] = {
+    { IP4_ADDR(66, 9, 149, 187), IP4_ADDR(161, 142, 100, 80), 2794, 1766,
+      0x323e8fc2, 0x51ccc178 },
+    { IP4_ADDR(199, 92, 111, 2), IP4_ADDR(65, 69, 140, 83), 14230, 4739,
+      0xd718262a, 0xc626b0ea },
+    { IP4_ADDR(24, 19, 198, 95), IP4_ADDR(12, 22, 207, 184), 12898, 38024,
+      0xd2d0a5de, 0x5c2b394a },
+};
+
+#define RSS_VECTORS     (sizeof(rss_vectors) / sizeof(rss_vectors[0]))
+
+/* Ethernet + IPv4 + TCP header for vector i, reversed for TX */
+static zbuf_t *rss_frame(int i, bool tx, uint16_t frag)
+{
+    zbuf_t *zb = zbuf_alloc(ETH_HDR_LEN + sizeof(ip_hdr_t) + sizeof(tcp_hdr_t));
+    if (!zb) return NULL;
+
+    uint8_t *p = zbuf_put(zb, ETH_HDR_LEN + sizeof(ip_hdr_t) + sizeof(tcp_hdr_t));
+    for (uint32_t j = 0; j < zb->len; j++) {
+        p[j] = 0;
+    }
+
+    eth_hdr_t *eth = (eth_hdr_t *)p;
+    ip_hdr_t *ip = (ip_hdr_t *)(p + ETH_HDR_LEN);
+    tcp_hdr_t *tcp = (tcp_hdr_t *)(p + ETH_HDR_LEN + sizeof(ip_hdr_t));
+
+    eth->type = htons(ETH_TYPE_IP);
+    ip->ver_ihl = 0x45;
+    ip->proto = IP_PROTO_TCP;
+    ip->frag = htons(frag);
+    ip->src = htonl(tx ? rss_vectors[i].dst : rss_vectors[i].src);
+    ip->dst = htonl(tx ? rss_vectors[i].src : rss_vectors[i].dst);
+    tcp->sport = htons(tx ? rss_vectors[i].dport : rss_vectors[i].sport);
+    tcp->dport = htons(tx ? rss_vectors[i].sport : rss_vectors[i].dport);
+
+    return zb;
+}
+
+/*
+ * Test: Toeplitz hash matches the published verification values
+ */
+TEST_CASE(rss_vectors_ipv4)
+{
+    for (uint32_t i = 0; i < RSS_VECTORS; i++) {
+        TEST_ASSERT_EQ(rss_hash_ipv4(rss_vectors[i].src, rss_vectors[i].dst,
+                                     0, 0, false), rss_vectors[i].hash_ip);
+        TEST_ASSERT_EQ(rss_hash_ipv4(rss_vectors[i].src, rss_vectors[i].dst,
+                                     rss_vectors[i].sport, rss_vectors[i].dport, true),
+                       rss_vectors[i].hash_l4);
+    }
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: Both directions of a flow land on the same hash
+ */
+TEST_CASE(rss_frame_directions)
+{
+    for (uint32_t i = 0; i < RSS_VECTORS; i++) {
+        zbuf_t *rx = rss_frame(i, false, 0);
+        zbuf_t *tx = rss_frame(i, true, 0);
+        TEST_ASSERT_NOT_NULL(rx);
+        TEST_ASSERT_NOT_NULL(tx);
+
+        TEST_ASSERT(rss_hash_frame(rx, false));
+        TEST_ASSERT(rss_hash_frame(tx, true));
+        TEST_ASSERT(rx->flags & ZBUF_F_HASH_VALID);
+        TEST_ASSERT_EQ(rx->hash, rss_vectors[i].hash_l4);
+        TEST_ASSERT_EQ(tx->hash, rss_vectors[i].hash_l4);
+
+        zbuf_free(rx);
+        zbuf_free(tx);
+    }
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: Fragments hash on addresses only, non-IP is left alone
+ */
+TEST_CASE(rss_frame_fallbacks)
+{
+    zbuf_t *zb = rss_frame(0, false, 0x2000);   /* More fragments */
+    TEST_ASSERT_NOT_NULL(zb);
+    TEST_ASSERT(rss_hash_frame(zb, false));
+    TEST_ASSERT_EQ(zb->hash, rss_vectors[0].hash_ip);
+    zbuf_free(zb);
+
+    zb = rss_frame(0, false, 0);
+    TEST_ASSERT_NOT_NULL(zb);
+    ((eth_hdr_t *)zb->data)->type = htons(ETH_TYPE_PNIO);
+    zb->hash = 0;
+    zb->flags &= ~ZBUF_F_HASH_VALID;
+    TEST_ASSERT(!rss_hash_frame(zb, false));
+    TEST_ASSERT(!(zb->flags & ZBUF_F_HASH_VALID));
+    TEST_ASSERT_EQ(zb->hash, 0);
+    zbuf_free(zb);
+
+    return TEST_PASS;
+}
+
+/*
+ * Benchmark: Per-packet hashing cost
+ */
+TEST_CASE(rss_benchmark)
+{
+    zbuf_t *zb = rss_frame(0, false, 0);
+    TEST_ASSERT_NOT_NULL(zb);
+
+    uint64_t start = test_cycles();
+    uint32_t sink = 0;
+    for (int r = 0; r < RSS_BENCH_ROUNDS; r++) {
+        rss_hash_frame(zb, false);
+        sink ^= zb->hash;
+    }
+    test_report("rss_hash_frame", test_cycles() - start, RSS_BENCH_ROUNDS, "cycles/packet");
+
+    zbuf_free(zb);
+    (void)sink;
+    return TEST_PASS;
+}
+
+/*
+ * Test Suite Definition
+ */
+static test_case_t rss_tests[] = {
+    { "rss_vectors_ipv4", test_rss_vectors_ipv4 },
+    { "rss_frame_directions", test_rss_frame_directions },
+    { "rss_frame_fallbacks", test_rss_frame_fallbacks },
+    { "rss_benchmark", test_rss_benchmark },
+};
+
+test_suite_t rss_test_suite = {
+    .name = "RSS Flow Hash",
+    .tests = rss_tests,
+    .test_count = sizeof(rss_tests) / sizeof(test_case_t),
+    .setup = NULL,
+    .teardown = NULL
+};
@@ -0,0 +1,244 @@
+/*
+ * Gracemont Industrial Control Framework - ARM64 RTOS
+ * Copyright (C) 2024 Zixiao System <https://github.com/Zixiao-System>
+ *
+ * This file is part of Gracemont Industrial Control Framework.
+ * Repository: https://github.com/Zixiao-System/gracemont
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ *
+ * Socket Demux Unit Tests and Benchmark
+ */
+
+#include "test_framework.h"
+#include "net_stack.h"
+
+#define DEMUX_LOCAL_IP      0x0A000001      /* 10.0.0.1 */
+#define DEMUX_PEER_IP       0x0A000064      /* 10.0.0.100 */
+#define DEMUX_SOCKS         256
+#define DEMUX_BENCH_ROUNDS  64
+
+static socket_t demux_socks[DEMUX_SOCKS];
+
+static socket_t *demux_sock(int i, int type, int state, uint32_t laddr, uint16_t lport,
+                            uint32_t raddr, uint16_t rport)
+{
+    socket_t *sock = &demux_socks[i];
+
+    sock->fd = i;
+    sock->type = type;
+    sock->state = state;
+    sock->local.addr = laddr;
+    sock->local.port = lport;
+    sock->remote.addr = raddr;
+    sock->remote.port = rport;
+    sock->hnext = NULL;
+    sock->hbucket = NULL;
+    sock->refcnt = 1;       /* Static: the last reference is never dropped */
+
+    sock_hash_insert(sock);
+    return sock;
+}
+
+/* Lookup as the input path does it, handing the reference straight back */
+static socket_t *demux_find(int type, uint32_t laddr, uint16_t lport,
+                            uint32_t raddr, uint16_t rport)
+{
+    socket_t *sock = sock_lookup(type, laddr, lport, raddr, rport);
+    if (sock != NULL) {
+        sock_put(sock);
+    }
+    return sock;
+}
+
+static void demux_teardown(void)
+{
+    for (int i = 0; i < DEMUX_SOCKS; i++) {
+        sock_hash_remove(&demux_socks[i]);
+    }
+}
+
+/*
+ * Test: An established connection wins over the listener on its port
+ */
+TEST_CASE(demux_conn_over_listener)
+{
+    socket_t *lsn = demux_sock(0, SOCK_STREAM, TCP_LISTEN, 0, 502, 0, 0);
+    socket_t *conn = demux_sock(1, SOCK_STREAM, TCP_ESTABLISHED,
+                                DEMUX_LOCAL_IP, 502, DEMUX_PEER_IP, 40000);
+
+    TEST_ASSERT(demux_find(SOCK_STREAM, DEMUX_LOCAL_IP, 502, DEMUX_PEER_IP, 40000) == conn);
+    TEST_ASSERT(demux_find(SOCK_STREAM, DEMUX_LOCAL_IP, 502, DEMUX_PEER_IP, 40001) == lsn);
+    TEST_ASSERT(demux_find(SOCK_STREAM, DEMUX_LOCAL_IP, 502, DEMUX_PEER_IP + 1, 40000) == lsn);
+    TEST_ASSERT_NULL(demux_find(SOCK_STREAM, DEMUX_LOCAL_IP, 503, DEMUX_PEER_IP, 40000));
+
+    /* A connection bound to another address does not match */
+    TEST_ASSERT(demux_find(SOCK_STREAM, DEMUX_LOCAL_IP + 1, 502, DEMUX_PEER_IP, 40000) == lsn);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: Port table prefers an exact address and keeps protocols apart
+ */
+TEST_CASE(demux_port_table)
+{
+    socket_t *any = demux_sock(0, SOCK_DGRAM, TCP_CLOSED, 0, 4840, 0, 0);
+    socket_t *exact = demux_sock(1, SOCK_DGRAM, TCP_CLOSED, DEMUX_LOCAL_IP, 4840, 0, 0);
+
+    TEST_ASSERT(demux_find(SOCK_DGRAM, DEMUX_LOCAL_IP, 4840, DEMUX_PEER_IP, 1234) == exact);
+    TEST_ASSERT(demux_find(SOCK_DGRAM, 0xFFFFFFFF, 4840, DEMUX_PEER_IP, 1234) == any);
+    TEST_ASSERT_NULL(demux_find(SOCK_STREAM, DEMUX_LOCAL_IP, 4840, DEMUX_PEER_IP, 1234));
+
+    sock_hash_remove(exact);
+    TEST_ASSERT(demux_find(SOCK_DGRAM, DEMUX_LOCAL_IP, 4840, DEMUX_PEER_IP, 1234) == any);
+
+    sock_hash_remove(any);
+    TEST_ASSERT_NULL(demux_find(SOCK_DGRAM, DEMUX_LOCAL_IP, 4840, DEMUX_PEER_IP, 1234));
+
+    /* Removing twice is harmless */
+    sock_hash_remove(any);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: Re-inserting moves a socket between tables
+ */
+TEST_CASE(demux_rehash)
+{
+    socket_t *sock = demux_sock(0, SOCK_STREAM, TCP_LISTEN, 0, 8080, 0, 0);
+    TEST_ASSERT(demux_find(SOCK_STREAM, DEMUX_LOCAL_IP, 8080, DEMUX_PEER_IP, 5000) == sock);
+
+    sock->state = TCP_SYN_SENT;
+    sock->remote.addr = DEMUX_PEER_IP;
+    sock->remote.port = 5000;
+    sock_hash_insert(sock);
+
+    TEST_ASSERT(demux_find(SOCK_STREAM, DEMUX_LOCAL_IP, 8080, DEMUX_PEER_IP, 5000) == sock);
+    TEST_ASSERT_NULL(demux_find(SOCK_STREAM, DEMUX_LOCAL_IP, 8080, DEMUX_PEER_IP, 5001));
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: Rebinding, or connect choosing a port, moves the socket off the
+ * chain it was on and leaves that chain intact
+ */
+TEST_CASE(demux_rekey)
+{
+    socket_t *any = demux_sock(0, SOCK_DGRAM, TCP_CLOSED, 0, 4840, 0, 0);
+    socket_t *sock = demux_sock(1, SOCK_DGRAM, TCP_CLOSED, DEMUX_LOCAL_IP, 4840, 0, 0);
+
+    /* Rebind: the key changes before the rehash, as in sock_bind() */
+    sock->local.port = 4841;
+    sock_hash_insert(sock);
+    TEST_ASSERT(demux_find(SOCK_DGRAM, DEMUX_LOCAL_IP, 4840, DEMUX_PEER_IP, 1234) == any);
+    TEST_ASSERT(demux_find(SOCK_DGRAM, DEMUX_LOCAL_IP, 4841, DEMUX_PEER_IP, 1234) == sock);
+
+    sock_hash_remove(sock);
+    TEST_ASSERT(demux_find(SOCK_DGRAM, DEMUX_LOCAL_IP, 4840, DEMUX_PEER_IP, 1234) == any);
+    TEST_ASSERT_NULL(demux_find(SOCK_DGRAM, DEMUX_LOCAL_IP, 4841, DEMUX_PEER_IP, 1234));
+
+    /* Connect from port 0: an ephemeral port and a remote end at once */
+    socket_t *conn = demux_sock(2, SOCK_STREAM, TCP_LISTEN, 0, 0, 0, 0);
+    socket_t *lsn = demux_sock(3, SOCK_STREAM, TCP_LISTEN, 0, 0, 0, 0);
+    conn->state = TCP_SYN_SENT;
+    conn->local.port = 50000;
+    conn->remote.addr = DEMUX_PEER_IP;
+    conn->remote.port = 502;
+    sock_hash_insert(conn);
+    TEST_ASSERT(demux_find(SOCK_STREAM, DEMUX_LOCAL_IP, 0, DEMUX_PEER_IP, 502) == lsn);
+    TEST_ASSERT(demux_find(SOCK_STREAM, DEMUX_LOCAL_IP, 50000, DEMUX_PEER_IP, 502) == conn);
+
+    sock_hash_remove(conn);
+    TEST_ASSERT(demux_find(SOCK_STREAM, DEMUX_LOCAL_IP, 0, DEMUX_PEER_IP, 502) == lsn);
+    TEST_ASSERT_NULL(demux_find(SOCK_STREAM, DEMUX_LOCAL_IP, 50000, DEMUX_PEER_IP, 502));
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: A lookup holds the socket until it is put, even once unhashed
+ */
+TEST_CASE(demux_reference)
+{
+    socket_t *sock = demux_sock(0, SOCK_DGRAM, TCP_CLOSED, 0, 502, 0, 0);
+
+    TEST_ASSERT(sock_lookup(SOCK_DGRAM, DEMUX_LOCAL_IP, 502, DEMUX_PEER_IP, 1234) == sock);
+    TEST_ASSERT_EQ(sock->refcnt, 2);
+
+    sock_hash_remove(sock);
+    TEST_ASSERT_NULL(sock_lookup(SOCK_DGRAM, DEMUX_LOCAL_IP, 502, DEMUX_PEER_IP, 1234));
+    TEST_ASSERT_EQ(sock->refcnt, 2);
+
+    sock_put(sock);
+    TEST_ASSERT_EQ(sock->refcnt, 1);
+
+    return TEST_PASS;
+}
+
+/*
+ * Benchmark: Lookup cost with many connections on one server port
+ */
+TEST_CASE(demux_benchmark)
+{
+    demux_sock(0, SOCK_STREAM, TCP_LISTEN, 0, 502, 0, 0);
+    for (int i = 1; i < DEMUX_SOCKS; i++) {
+        demux_sock(i, SOCK_STREAM, TCP_ESTABLISHED, DEMUX_LOCAL_IP, 502,
+                   DEMUX_PEER_IP + (i & 7), (uint16_t)(40000 + i));
+    }
+
+    for (int i = 1; i < DEMUX_SOCKS; i++) {
+        TEST_ASSERT(demux_find(SOCK_STREAM, DEMUX_LOCAL_IP, 502,
+                               DEMUX_PEER_IP + (i & 7), (uint16_t)(40000 + i)) == &demux_socks[i]);
+    }
+
+    uint64_t start = test_cycles();
+    uintptr_t sink = 0;
+    for (int r = 0; r < DEMUX_BENCH_ROUNDS; r++) {
+        for (int i = 1; i < DEMUX_SOCKS; i++) {
+            sink += (uintptr_t)demux_find(SOCK_STREAM, DEMUX_LOCAL_IP, 502,
+                                          DEMUX_PEER_IP + (i & 7), (uint16_t)(40000 + i));
+        }
+    }
+    test_report("sock_lookup", test_cycles() - start,
+                (uint64_t)DEMUX_BENCH_ROUNDS * (DEMUX_SOCKS - 1), "cycles/lookup");
+
+    (void)sink;
+    return TEST_PASS;
+}
+
+/*
+ * Test Suite Definition
+ */
+static test_case_t sock_hash_tests[] = {
+    { "demux_conn_over_listener", test_demux_conn_over_listener },
+    { "demux_port_table", test_demux_port_table },
+    { "demux_rehash", test_demux_rehash },
+    { "demux_rekey", test_demux_rekey },
+    { "demux_reference", test_demux_reference },
+    { "demux_benchmark", test_demux_benchmark },
+};
+
+test_suite_t sock_hash_test_suite = {
+    .name = "Socket Demux",
+    .tests = sock_hash_tests,
+    .test_count = sizeof(sock_hash_tests) / sizeof(test_case_t),
+    .setup = NULL,
+    .teardown = demux_teardown
+};
@@ -0,0 +1,230 @@
+/*
+ * Gracemont Industrial Control Framework - ARM64 RTOS
+ * Copyright (C) 2024 Zixiao System <https://github.com/Zixiao-System>
+ *
+ * This file is part of Gracemont Industrial Control Framework.
+ * Repository: https://github.com/Zixiao-System/gracemont
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ *
+ * Socket Poll Set Unit Tests
+ */
+
+#include "test_framework.h"
+#include "net_stack.h"
+
+#define POLL_TEST_IP        0x0A000001      /* 10.0.0.1 (us) */
+#define POLL_TEST_PEER      0x0A000002
+#define POLL_TEST_PORT      4840
+#define POLL_TEST_SOCKS     3
+
+static int poll_test_fd[POLL_TEST_SOCKS];
+static sock_poll_t *poll_test_set;
+
+static void poll_test_setup(void)
+{
+    for (int i = 0; i < POLL_TEST_SOCKS; i++) {
+        sockaddr_t addr = { .addr = POLL_TEST_IP, .port = (uint16_t)(POLL_TEST_PORT + i) };
+
+        poll_test_fd[i] = sock_socket(SOCK_DGRAM);
+        if (poll_test_fd[i] >= 0) {
+            sock_bind(poll_test_fd[i], &addr);
+        }
+    }
+    poll_test_set = sock_poll_create(POLL_TEST_SOCKS);
+}
+
+static void poll_test_teardown(void)
+{
+    sock_poll_destroy(poll_test_set);
+    for (int i = 0; i < POLL_TEST_SOCKS; i++) {
+        if (poll_test_fd[i] >= 0) {
+            sock_close(poll_test_fd[i]);
+        }
+    }
+}
+
+/* Datagram from the peer to socket i, as the IP layer hands it up */
+static void poll_test_datagram(int i)
+{
+    const uint16_t len = sizeof(ip_hdr_t) + UDP_HDR_LEN + 4;
+    zbuf_t *zb = zbuf_alloc(len);
+    if (zb == NULL) return;
+
+    ip_hdr_t *ip = (ip_hdr_t *)zbuf_put(zb, len);
+    ip->ver_ihl = 0x45;
+    ip->len = htons(len);
+    ip->proto = IP_PROTO_UDP;
+    ip->src = htonl(POLL_TEST_PEER);
+    ip->dst = htonl(POLL_TEST_IP);
+
+    udp_hdr_t *udp = (udp_hdr_t *)(ip + 1);
+    udp->sport = htons(5000);
+    udp->dport = htons((uint16_t)(POLL_TEST_PORT + i));
+    udp->len = htons(UDP_HDR_LEN + 4);
+    udp->checksum = 0;
+
+    zbuf_pull(zb, sizeof(ip_hdr_t));
+    udp_input(NULL, zb);
+}
+
+/*
+ * Test: A level-triggered watch reports until the socket is drained
+ */
+TEST_CASE(poll_level_triggered)
+{
+    sock_event_t ev[POLL_TEST_SOCKS];
+    uint8_t buf[16];
+    int tag = 1;
+
+    TEST_ASSERT_NOT_NULL(poll_test_set);
+    for (int i = 0; i < POLL_TEST_SOCKS; i++) {
+        TEST_ASSERT_EQ(sock_poll_ctl(poll_test_set, SOCK_POLL_ADD, poll_test_fd[i],
+                                     SOCK_EV_IN, &poll_test_fd[i]), 0);
+    }
+    TEST_ASSERT_EQ(sock_poll_ctl(poll_test_set, SOCK_POLL_ADD, poll_test_fd[0],
+                                 SOCK_EV_IN, NULL), -1);
+    TEST_ASSERT_EQ(sock_poll_wait(poll_test_set, ev, POLL_TEST_SOCKS, 0), 0);
+
+    poll_test_datagram(1);
+    poll_test_datagram(1);
+    TEST_ASSERT_EQ(sock_poll_wait(poll_test_set, ev, POLL_TEST_SOCKS, 0), 1);
+    TEST_ASSERT_EQ(ev[0].fd, poll_test_fd[1]);
+    TEST_ASSERT_EQ(ev[0].events, SOCK_EV_IN);
+    TEST_ASSERT(ev[0].data == &poll_test_fd[1]);
+
+    /* Still readable after one datagram, silent after both */
+    TEST_ASSERT_EQ(sock_recv(poll_test_fd[1], buf, sizeof(buf)), 4);
+    TEST_ASSERT_EQ(sock_poll_wait(poll_test_set, ev, POLL_TEST_SOCKS, 0), 1);
+    TEST_ASSERT_EQ(sock_recv(poll_test_fd[1], buf, sizeof(buf)), 4);
+    TEST_ASSERT_EQ(sock_poll_wait(poll_test_set, ev, POLL_TEST_SOCKS, 0), 0);
+
+    /* A datagram socket is always writable */
+    TEST_ASSERT_EQ(sock_poll_ctl(poll_test_set, SOCK_POLL_MOD, poll_test_fd[2],
+                                 SOCK_EV_IN | SOCK_EV_OUT, &tag), 0);
+    TEST_ASSERT_EQ(sock_poll_wait(poll_test_set, ev, POLL_TEST_SOCKS, 0), 1);
+    TEST_ASSERT_EQ(ev[0].fd, poll_test_fd[2]);
+    TEST_ASSERT_EQ(ev[0].events, SOCK_EV_OUT);
+    TEST_ASSERT(ev[0].data == &tag);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: An edge-triggered watch reports each arrival once
+ */
+TEST_CASE(poll_edge_triggered)
+{
+    sock_event_t ev[POLL_TEST_SOCKS];
+    uint8_t buf[16];
+
+    TEST_ASSERT_NOT_NULL(poll_test_set);
+    TEST_ASSERT_EQ(sock_poll_ctl(poll_test_set, SOCK_POLL_ADD, poll_test_fd[0],
+                                 SOCK_EV_IN | SOCK_EV_ET, NULL), 0);
+    TEST_ASSERT_EQ(sock_setopt(poll_test_fd[0], SO_NONBLOCK, 1), 0);
+
+    poll_test_datagram(0);
+    poll_test_datagram(0);
+    TEST_ASSERT_EQ(sock_poll_wait(poll_test_set, ev, POLL_TEST_SOCKS, 0), 1);
+    TEST_ASSERT_EQ(sock_poll_wait(poll_test_set, ev, POLL_TEST_SOCKS, 0), 0);
+
+    poll_test_datagram(0);
+    TEST_ASSERT_EQ(sock_poll_wait(poll_test_set, ev, POLL_TEST_SOCKS, 0), 1);
+
+    /* Non-blocking reads drain the socket and then fail */
+    for (int i = 0; i < 3; i++) {
+        TEST_ASSERT_EQ(sock_recv(poll_test_fd[0], buf, sizeof(buf)), 4);
+    }
+    TEST_ASSERT_EQ(sock_recv(poll_test_fd[0], buf, sizeof(buf)), -1);
+    TEST_ASSERT_NULL(sock_recv_zbuf(poll_test_fd[0]));
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: Reports are batched, taken in turn, and stop with the watch
+ */
+TEST_CASE(poll_batch_and_remove)
+{
+    sock_event_t ev[POLL_TEST_SOCKS];
+
+    TEST_ASSERT_NOT_NULL(poll_test_set);
+    for (int i = 0; i < POLL_TEST_SOCKS; i++) {
+        TEST_ASSERT_EQ(sock_poll_ctl(poll_test_set, SOCK_POLL_ADD, poll_test_fd[i],
+                                     SOCK_EV_IN, NULL), 0);
+        poll_test_datagram(i);
+    }
+
+    /* Two at a time: the third socket comes first next time */
+    TEST_ASSERT_EQ(sock_poll_wait(poll_test_set, ev, 2, 0), 2);
+    TEST_ASSERT_EQ(ev[0].fd, poll_test_fd[0]);
+    TEST_ASSERT_EQ(ev[1].fd, poll_test_fd[1]);
+    TEST_ASSERT_EQ(sock_poll_wait(poll_test_set, ev, 2, 0), 2);
+    TEST_ASSERT_EQ(ev[0].fd, poll_test_fd[2]);
+    TEST_ASSERT_EQ(ev[1].fd, poll_test_fd[0]);
+
+    /* Removed or closed sockets are never reported */
+    TEST_ASSERT_EQ(sock_poll_ctl(poll_test_set, SOCK_POLL_DEL, poll_test_fd[0], 0, NULL), 0);
+    TEST_ASSERT_EQ(sock_poll_ctl(poll_test_set, SOCK_POLL_DEL, poll_test_fd[0], 0, NULL), -1);
+    sock_close(poll_test_fd[1]);
+    poll_test_fd[1] = -1;
+    TEST_ASSERT_EQ(sock_poll_wait(poll_test_set, ev, POLL_TEST_SOCKS, 0), 1);
+    TEST_ASSERT_EQ(ev[0].fd, poll_test_fd[2]);
+
+    /* The freed slot takes a new watch */
+    TEST_ASSERT_EQ(sock_poll_ctl(poll_test_set, SOCK_POLL_ADD, poll_test_fd[0],
+                                 SOCK_EV_IN, NULL), 0);
+    TEST_ASSERT_EQ(sock_poll_wait(poll_test_set, ev, POLL_TEST_SOCKS, 0), 2);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: A wait with nothing ready returns once the timeout passes
+ */
+TEST_CASE(poll_timeout)
+{
+    sock_event_t ev[1];
+
+    TEST_ASSERT_NOT_NULL(poll_test_set);
+    TEST_ASSERT_EQ(sock_poll_ctl(poll_test_set, SOCK_POLL_ADD, poll_test_fd[0],
+                                 SOCK_EV_IN, NULL), 0);
+
+    tick_t start = get_system_ticks();
+    TEST_ASSERT_EQ(sock_poll_wait(poll_test_set, ev, 1, 5), 0);
+    TEST_ASSERT(get_system_ticks() - start >= 5);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test Suite Definition
+ */
+static test_case_t sock_poll_tests[] = {
+    { "poll_level_triggered", test_poll_level_triggered },
+    { "poll_edge_triggered", test_poll_edge_triggered },
+    { "poll_batch_and_remove", test_poll_batch_and_remove },
+    { "poll_timeout", test_poll_timeout },
+};
+
+test_suite_t sock_poll_test_suite = {
+    .name = "Socket Poll",
+    .tests = sock_poll_tests,
+    .test_count = sizeof(sock_poll_tests) / sizeof(test_case_t),
+    .setup = poll_test_setup,
+    .teardown = poll_test_teardown
+};
@@ -0,0 +1,202 @@
+/*
+ * Gracemont Industrial Control Framework - ARM64 RTOS
+ * Copyright (C) 2024 Zixiao System <https://github.com/Zixiao-System>
+ *
+ * This file is part of Gracemont Industrial Control Framework.
+ * Repository: https://github.com/Zixiao-System/gracemont
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ *
+ * Asynchronous Socket Ring Unit Tests
+ */
+
+#include "test_framework.h"
+#include "net_stack.h"
+
+#define RING_TEST_IP        0x0A000001      /* 10.0.0.1 (us) */
+#define RING_TEST_PEER      0x0A000002
+#define RING_TEST_PORT      4840
+#define RING_TEST_ENTRIES   4
+
+static int ring_test_fd[2];
+static sock_ring_t *ring_test_ring;
+
+static void ring_test_setup(void)
+{
+    for (int i = 0; i < 2; i++) {
+        sockaddr_t addr = { .addr = RING_TEST_IP, .port = (uint16_t)(RING_TEST_PORT + i) };
+
+        ring_test_fd[i] = sock_socket(SOCK_DGRAM);
+        if (ring_test_fd[i] >= 0) {
+            sock_bind(ring_test_fd[i], &addr);
+        }
+    }
+    ring_test_ring = sock_ring_create(RING_TEST_ENTRIES);
+}
+
+static void ring_test_teardown(void)
+{
+    sock_ring_destroy(ring_test_ring);
+    for (int i = 0; i < 2; i++) {
+        if (ring_test_fd[i] >= 0) {
+            sock_close(ring_test_fd[i]);
+        }
+    }
+}
+
+/* Datagram of len bytes from the peer to socket i */
+static void ring_test_datagram(int i, uint16_t len)
+{
+    const uint16_t total = sizeof(ip_hdr_t) + UDP_HDR_LEN + len;
+    zbuf_t *zb = zbuf_alloc(total);
+    if (zb == NULL) return;
+
+    ip_hdr_t *ip = (ip_hdr_t *)zbuf_put(zb, total);
+    ip->ver_ihl = 0x45;
+    ip->len = htons(total);
+    ip->proto = IP_PROTO_UDP;
+    ip->src = htonl(RING_TEST_PEER);
+    ip->dst = htonl(RING_TEST_IP);
+
+    udp_hdr_t *udp = (udp_hdr_t *)(ip + 1);
+    udp->sport = htons(5000);
+    udp->dport = htons((uint16_t)(RING_TEST_PORT + i));
+    udp->len = htons(UDP_HDR_LEN + len);
+    udp->checksum = 0;
+
+    zbuf_pull(zb, sizeof(ip_hdr_t));
+    udp_input(NULL, zb);
+}
+
+static void ring_test_recv(int fd, void *data)
+{
+    sock_sqe_t *sqe = sock_ring_get_sqe(ring_test_ring);
+    if (sqe == NULL) return;
+
+    sqe->op = SOCK_OP_RECV;
+    sqe->fd = fd;
+    sqe->zb = NULL;
+    sqe->data = data;
+}
+
+/*
+ * Test: Receives complete at submit or on arrival, in submission order
+ */
+TEST_CASE(ring_recv)
+{
+    sock_cqe_t cqe[RING_TEST_ENTRIES];
+    int tag[3];
+
+    TEST_ASSERT_NOT_NULL(ring_test_ring);
+    TEST_ASSERT_EQ(sock_ring_wait(ring_test_ring, cqe, RING_TEST_ENTRIES, 0), 0);
+
+    /* Already queued: done during submit */
+    ring_test_datagram(0, 8);
+    ring_test_recv(ring_test_fd[0], &tag[0]);
+    TEST_ASSERT_EQ(sock_ring_submit(ring_test_ring), 1);
+    TEST_ASSERT_EQ(sock_ring_wait(ring_test_ring, cqe, RING_TEST_ENTRIES, 0), 1);
+    TEST_ASSERT_EQ(cqe[0].res, 8);
+    TEST_ASSERT(cqe[0].data == &tag[0]);
+    TEST_ASSERT_NOT_NULL(cqe[0].zb);
+    zbuf_free(cqe[0].zb);
+
+    /* Two waiting on one socket, one on the other */
+    ring_test_recv(ring_test_fd[0], &tag[0]);
+    ring_test_recv(ring_test_fd[0], &tag[1]);
+    ring_test_recv(ring_test_fd[1], &tag[2]);
+    TEST_ASSERT_EQ(sock_ring_submit(ring_test_ring), 3);
+    TEST_ASSERT_EQ(sock_ring_wait(ring_test_ring, cqe, RING_TEST_ENTRIES, 0), 0);
+
+    ring_test_datagram(1, 3);
+    ring_test_datagram(0, 1);
+    ring_test_datagram(0, 2);
+    TEST_ASSERT_EQ(sock_ring_wait(ring_test_ring, cqe, RING_TEST_ENTRIES, SOCK_POLL_FOREVER), 3);
+    TEST_ASSERT(cqe[0].data == &tag[0]);
+    TEST_ASSERT_EQ(cqe[0].res, 1);
+    TEST_ASSERT(cqe[1].data == &tag[1]);
+    TEST_ASSERT_EQ(cqe[1].res, 2);
+    TEST_ASSERT(cqe[2].data == &tag[2]);
+    TEST_ASSERT_EQ(cqe[2].res, 3);
+    for (int i = 0; i < 3; i++) {
+        zbuf_free(cqe[i].zb);
+    }
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: In-flight limit, cancellation, timeouts and bad submissions
+ */
+TEST_CASE(ring_limits)
+{
+    sock_cqe_t cqe[RING_TEST_ENTRIES];
+
+    TEST_ASSERT_NOT_NULL(ring_test_ring);
+    TEST_ASSERT_NULL(sock_ring_create(3));
+
+    for (int i = 0; i < RING_TEST_ENTRIES; i++) {
+        ring_test_recv(ring_test_fd[0], NULL);
+    }
+    TEST_ASSERT_NULL(sock_ring_get_sqe(ring_test_ring));
+    TEST_ASSERT_EQ(sock_ring_submit(ring_test_ring), RING_TEST_ENTRIES);
+
+    /* Every entry in flight: the next submission waits its turn */
+    ring_test_recv(ring_test_fd[1], NULL);
+    TEST_ASSERT_EQ(sock_ring_submit(ring_test_ring), 0);
+
+    tick_t start = get_system_ticks();
+    TEST_ASSERT_EQ(sock_ring_wait(ring_test_ring, cqe, RING_TEST_ENTRIES, 5), 0);
+    TEST_ASSERT(get_system_ticks() - start >= 5);
+
+    TEST_ASSERT_EQ(sock_ring_cancel(ring_test_ring, ring_test_fd[0]), RING_TEST_ENTRIES);
+    TEST_ASSERT_EQ(sock_ring_wait(ring_test_ring, cqe, RING_TEST_ENTRIES, 0), RING_TEST_ENTRIES);
+    for (int i = 0; i < RING_TEST_ENTRIES; i++) {
+        TEST_ASSERT_EQ(cqe[i].res, -1);
+        TEST_ASSERT_NULL(cqe[i].zb);
+    }
+
+    /* Room again; a datagram socket cannot accept or send a stream */
+    TEST_ASSERT_EQ(sock_ring_submit(ring_test_ring), 1);
+    sock_sqe_t *sqe = sock_ring_get_sqe(ring_test_ring);
+    TEST_ASSERT_NOT_NULL(sqe);
+    sqe->op = SOCK_OP_ACCEPT;
+    sqe->fd = ring_test_fd[0];
+    sqe->zb = NULL;
+    sqe->data = NULL;
+    TEST_ASSERT_EQ(sock_ring_submit(ring_test_ring), 1);
+    TEST_ASSERT_EQ(sock_ring_wait(ring_test_ring, cqe, RING_TEST_ENTRIES, 0), 1);
+    TEST_ASSERT_EQ(cqe[0].res, -1);
+
+    /* The receive left waiting goes with the ring */
+    return TEST_PASS;
+}
+
+/*
+ * Test Suite Definition
+ */
+static test_case_t sock_ring_tests[] = {
+    { "ring_recv", test_ring_recv },
+    { "ring_limits", test_ring_limits },
+};
+
+test_suite_t sock_ring_test_suite = {
+    .name = "Socket Ring",
+    .tests = sock_ring_tests,
+    .test_count = sizeof(sock_ring_tests) / sizeof(test_case_t),
+    .setup = ring_test_setup,
+    .teardown = ring_test_teardown
+};
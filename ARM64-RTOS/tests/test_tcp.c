@@ -0,0 +1,1350 @@
+/*
+ * Gracemont Industrial Control Framework - ARM64 RTOS
+ * Copyright (C) 2024 Zixiao System <https://github.com/Zixiao-System>
+ *
+ * This file is part of Gracemont Industrial Control Framework.
+ * Repository: https://github.com/Zixiao-System/gracemont
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ *
+ *
+ * TCP Send Path Unit Tests
+ */
+
+#include "test_framework.h"
+#include "net_stack.h"
+#include "rtos_config.h"
+#include "rtos.h"
+#include "test_net.h"
+
+#define TCP_TEST_IP         0x0A000001      /* 10.0.0.1 (us) */
+#define TCP_TEST_PEER       0x0A000002
+#define TCP_TEST_PORT       5020
+#define TCP_TEST_PEER_PORT  40000
+#define TCP_TEST_PEER_ISN   0x10000000
+#define TCP_TEST_MSS        CONFIG_TCP_MSS
+#define TCP_TEST_FIN_WAIT   (60 * CONFIG_TICK_RATE_HZ)     /* FIN_WAIT_2 limit */
+#define TCP_TEST_TIME_WAIT  (60 * CONFIG_TICK_RATE_HZ)     /* 2 * MSL */
+
+extern socket_t *socket_table[CONFIG_NET_MAX_SOCKETS];
+
+static netif_t tcp_test_nif;
+static int tcp_test_fd;
+static int tcp_test_lfd;        /* Listener */
+static uint16_t tcp_test_port;  /* Peer port of the segments sent */
+static uint32_t tcp_test_isn;   /* Our ISN, from the SYN-ACK */
+
+static void tcp_test_setup(void)
+{
+    test_netif_init(&tcp_test_nif, 0x10, TCP_TEST_IP, 0xFFFFFF00, test_net_send);
+
+    zbuf_queue_init(&test_net_wire);
+    arp_init();
+    route_init();
+    route_iface_update(&tcp_test_nif);
+    test_arp_peer(&tcp_test_nif, test_peer_mac, TCP_TEST_PEER);
+
+    tcp_test_fd = -1;
+    tcp_test_lfd = -1;
+    tcp_test_port = TCP_TEST_PEER_PORT;
+    tcp_test_isn = 0;
+}
+
+/*
+ * Segment from the peer, with options and payload_len bytes of data;
+ * the checksum is taken as verified by the device
+ */
+static void tcp_test_segment(uint8_t flags, uint32_t seq, uint32_t ack, uint16_t win,
+                             const uint8_t *opt, uint8_t opt_len, uint16_t payload_len)
+{
+    uint16_t len = sizeof(ip_hdr_t) + sizeof(tcp_hdr_t) + opt_len + payload_len;
+    zbuf_t *zb = zbuf_alloc(ETH_HDR_LEN + len);
+    if (zb == NULL) return;
+
+    eth_hdr_t *eth = (eth_hdr_t *)zbuf_put(zb, ETH_HDR_LEN);
+    for (int i = 0; i < 6; i++) {
+        eth->dst[i] = tcp_test_nif.mac[i];
+        eth->src[i] = test_peer_mac[i];
+    }
+    eth->type = htons(ETH_TYPE_IP);
+
+    ip_hdr_t *ip = (ip_hdr_t *)zbuf_put(zb, len);
+    ip->ver_ihl = 0x45;
+    ip->tos = 0;
+    ip->len = htons(len);
+    ip->id = 0;
+    ip->frag = 0;
+    ip->ttl = 64;
+    ip->proto = IP_PROTO_TCP;
+    ip->src = htonl(TCP_TEST_PEER);
+    ip->dst = htonl(TCP_TEST_IP);
+    ip->checksum = 0;
+    ip->checksum = inet_checksum(ip, sizeof(ip_hdr_t));
+
+    tcp_hdr_t *tcp = (tcp_hdr_t *)(ip + 1);
+    tcp->sport = htons(tcp_test_port);
+    tcp->dport = htons(TCP_TEST_PORT);
+    tcp->seq = htonl(seq);
+    tcp->ack = htonl(ack);
+    tcp->off_rsvd = (uint8_t)(((sizeof(tcp_hdr_t) + opt_len) / 4) << 4);
+    tcp->flags = flags;
+    tcp->win = htons(win);
+    tcp->checksum = 0;
+    tcp->urgent = 0;
+
+    uint8_t *p = (uint8_t *)(tcp + 1);
+    for (uint8_t i = 0; i < opt_len; i++) {
+        *p++ = opt[i];
+    }
+    for (uint16_t i = 0; i < payload_len; i++) {
+        *p++ = (uint8_t)(seq + i);
+    }
+
+    zb->flags |= ZBUF_F_CSUM_VALID;
+    netif_input(&tcp_test_nif, zb);
+}
+
+static void tcp_test_input(uint8_t flags, uint32_t seq, uint32_t ack, uint16_t win)
+{
+    tcp_test_segment(flags, seq, ack, win, NULL, 0, 0);
+}
+
+static void tcp_test_teardown(void)
+{
+    if (tcp_test_fd >= 0) {
+        /* The peer resets the closed connection, so none outlives the test */
+        sock_close(tcp_test_fd);
+        tcp_test_input(TCP_FLAG_RST, TCP_TEST_PEER_ISN + 1, 0, 0);
+    }
+    if (tcp_test_lfd >= 0) {
+        sock_close(tcp_test_lfd);
+    }
+    zbuf_queue_flush(&test_net_wire);
+    arp_init();
+    route_init();
+}
+
+/* Data from the peer at offset off of its stream */
+static void tcp_test_peer_data(uint32_t off, uint16_t len)
+{
+    tcp_test_segment(TCP_FLAG_ACK, TCP_TEST_PEER_ISN + 1 + off, tcp_test_isn + 1, 65535,
+                     NULL, 0, len);
+}
+
+static void tcp_test_put32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+static uint32_t tcp_test_get32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+/* ACK from the peer, which never sends data of its own */
+static void tcp_test_ack(uint32_t ack, uint16_t win)
+{
+    tcp_test_input(TCP_FLAG_ACK, TCP_TEST_PEER_ISN + 1, tcp_test_isn + ack, win);
+}
+
+static tcp_hdr_t *tcp_test_hdr(zbuf_t *zb)
+{
+    return (tcp_hdr_t *)(zb->data + ETH_HDR_LEN + sizeof(ip_hdr_t));
+}
+
+/* ACK from the peer with SACK blocks given as offsets of our stream */
+static void tcp_test_sack(uint32_t ack, const uint32_t (*blocks)[2], uint8_t n)
+{
+    uint8_t opt[4 + 8 * TCP_SACK_MAX];
+
+    opt[0] = TCP_OPT_NOP;
+    opt[1] = TCP_OPT_NOP;
+    opt[2] = TCP_OPT_SACK;
+    opt[3] = (uint8_t)(2 + 8 * n);
+    for (uint8_t i = 0; i < n; i++) {
+        tcp_test_put32(opt + 4 + 8 * i, tcp_test_isn + blocks[i][0]);
+        tcp_test_put32(opt + 8 + 8 * i, tcp_test_isn + blocks[i][1]);
+    }
+
+    tcp_test_segment(TCP_FLAG_ACK, TCP_TEST_PEER_ISN + 1, tcp_test_isn + ack, 65535,
+                     opt, (uint8_t)(4 + 8 * n), 0);
+}
+
+/*
+ * First SACK block of a captured ACK as offsets of the peer's stream;
+ * returns the number of blocks
+ */
+static uint32_t tcp_test_sack_block(zbuf_t *zb, uint32_t *start, uint32_t *end)
+{
+    tcp_hdr_t *tcp = tcp_test_hdr(zb);
+    const uint8_t *opt = (const uint8_t *)(tcp + 1);
+
+    if (TCP_HDR_LEN(tcp) < sizeof(tcp_hdr_t) + 12 || opt[2] != TCP_OPT_SACK) {
+        return 0;
+    }
+
+    *start = tcp_test_get32(opt + 4) - TCP_TEST_PEER_ISN - 1;
+    *end = tcp_test_get32(opt + 8) - TCP_TEST_PEER_ISN - 1;
+    return (opt[3] - 2) / 8;
+}
+
+/* Sequence offset from our ISN of a captured segment */
+static uint32_t tcp_test_seq(zbuf_t *zb)
+{
+    return ntohl(tcp_test_hdr(zb)->seq) - tcp_test_isn;
+}
+
+static uint32_t tcp_test_payload(zbuf_t *zb)
+{
+    return zbuf_pkt_len(zb) - ETH_HDR_LEN - sizeof(ip_hdr_t) - TCP_HDR_LEN(tcp_test_hdr(zb));
+}
+
+/* Checksum of a captured segment, header and payload chain: 0 if valid */
+static uint16_t tcp_test_csum(zbuf_t *zb)
+{
+    ip_hdr_t *ip = (ip_hdr_t *)(zb->data + ETH_HDR_LEN);
+    uint32_t sum = inet_pseudo_checksum(ntohl(ip->src), ntohl(ip->dst), IP_PROTO_TCP,
+                                        (uint16_t)(zbuf_pkt_len(zb) - ETH_HDR_LEN - sizeof(ip_hdr_t)));
+
+    sum = inet_csum_partial(tcp_test_hdr(zb), zb->len - ETH_HDR_LEN - sizeof(ip_hdr_t), sum);
+    for (zbuf_t *f = zb->frag; f != NULL; f = f->frag) {
+        sum = inet_csum_partial(f->data, f->len, sum);
+    }
+    return inet_csum_fold(sum);
+}
+
+/* Option of a captured segment, NULL if it has none of that kind */
+static const uint8_t *tcp_test_opt(zbuf_t *zb, uint8_t kind)
+{
+    tcp_hdr_t *tcp = tcp_test_hdr(zb);
+    const uint8_t *p = (const uint8_t *)(tcp + 1);
+    const uint8_t *end = (const uint8_t *)tcp + TCP_HDR_LEN(tcp);
+
+    while (p < end && p[0] != TCP_OPT_EOL) {
+        if (p[0] == TCP_OPT_NOP) {
+            p++;
+            continue;
+        }
+        if (p[0] == kind) {
+            return p;
+        }
+        p += p[1];
+    }
+    return NULL;
+}
+
+/* Timestamp option as the peer sends it on every segment */
+static void tcp_test_ts(uint8_t *opt, uint32_t tsval, uint32_t tsecr)
+{
+    opt[0] = TCP_OPT_NOP;
+    opt[1] = TCP_OPT_NOP;
+    opt[2] = TCP_OPT_TS;
+    opt[3] = 10;
+    tcp_test_put32(opt + 4, tsval);
+    tcp_test_put32(opt + 8, tsecr);
+}
+
+/* Passive open with the peer advertising win, and SACK if asked */
+static socket_t *tcp_test_open(uint16_t win, bool sack)
+{
+    static const uint8_t syn_opt[8] = {
+        TCP_OPT_MSS, 4, TCP_TEST_MSS >> 8, TCP_TEST_MSS & 0xFF,
+        TCP_OPT_NOP, TCP_OPT_NOP, TCP_OPT_SACK_PERM, 2
+    };
+    sockaddr_t addr = { .addr = TCP_TEST_IP, .port = TCP_TEST_PORT };
+
+    tcp_test_lfd = sock_socket(SOCK_STREAM);
+    if (tcp_test_lfd < 0) return NULL;
+    sock_bind(tcp_test_lfd, &addr);
+    sock_listen(tcp_test_lfd, 1);
+
+    tcp_test_segment(TCP_FLAG_SYN, TCP_TEST_PEER_ISN, 0, win, syn_opt, sack ? 8 : 4, 0);
+
+    zbuf_t *synack = zbuf_queue_pop(&test_net_wire);
+    if (synack == NULL) return NULL;
+    tcp_test_isn = ntohl(tcp_test_hdr(synack)->seq);
+    zbuf_free(synack);
+
+    tcp_test_ack(1, win);
+
+    tcp_test_fd = sock_accept(tcp_test_lfd, NULL);
+    if (tcp_test_fd < 0) return NULL;
+
+    socket_t *sock = socket_table[tcp_test_fd % CONFIG_NET_MAX_SOCKETS];
+    return (sock->state == TCP_ESTABLISHED) ? sock : NULL;
+}
+
+static uint8_t tcp_test_data[8 * TCP_TEST_MSS];
+
+/*
+ * Test: A write is cut at the MSS and freed once acknowledged
+ */
+TEST_CASE(tcp_send_segments)
+{
+    socket_t *sock = tcp_test_open(65535, false);
+    TEST_ASSERT_NOT_NULL(sock);
+
+    TEST_ASSERT_EQ(sock_send(tcp_test_fd, tcp_test_data, 3000), 3000);
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 3);
+    TEST_ASSERT_EQ(sock->tx_queued, 3000);
+
+    for (uint32_t i = 0; i < 3; i++) {
+        zbuf_t *zb = zbuf_queue_pop(&test_net_wire);
+        TEST_ASSERT_EQ(tcp_test_seq(zb), 1 + i * TCP_TEST_MSS);
+        TEST_ASSERT_EQ(tcp_test_payload(zb), (i < 2) ? TCP_TEST_MSS : 80);
+        /* PSH only on the last segment of the write */
+        TEST_ASSERT_EQ(!!(tcp_test_hdr(zb)->flags & TCP_FLAG_PSH), i == 2);
+        zbuf_free(zb);
+    }
+    TEST_ASSERT(sock->rtx_armed);
+
+    uint32_t cwnd = sock->cwnd;
+    tcp_test_ack(1 + 3000, 65535);
+    TEST_ASSERT_EQ(sock->tx_queued, 0);
+    TEST_ASSERT_EQ(zbuf_queue_len(&sock->tx_queue), 0);
+    TEST_ASSERT_EQ(sock->snd_una, sock->snd_max);
+    TEST_ASSERT(!sock->rtx_armed);
+    TEST_ASSERT(sock->cwnd > cwnd);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: The peer's window limits what is in flight
+ */
+TEST_CASE(tcp_send_window)
+{
+    socket_t *sock = tcp_test_open(2 * TCP_TEST_MSS, false);
+    TEST_ASSERT_NOT_NULL(sock);
+
+    TEST_ASSERT_EQ(sock_send(tcp_test_fd, tcp_test_data, 5000), 5000);
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 2);
+    zbuf_queue_flush(&test_net_wire);
+
+    /* The window slides by one segment */
+    tcp_test_ack(1 + TCP_TEST_MSS, 2 * TCP_TEST_MSS);
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 1);
+    zbuf_t *zb = zbuf_queue_pop(&test_net_wire);
+    TEST_ASSERT_EQ(tcp_test_seq(zb), 1 + 2 * TCP_TEST_MSS);
+    zbuf_free(zb);
+
+    /* Zero window: nothing more, the timer stays armed to probe */
+    tcp_test_ack(1 + 3 * TCP_TEST_MSS, 0);
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 0);
+    TEST_ASSERT(sock->rtx_armed);
+
+    /* Window update: the rest goes */
+    tcp_test_ack(1 + 3 * TCP_TEST_MSS, 4096);
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 1);
+    zb = zbuf_queue_pop(&test_net_wire);
+    TEST_ASSERT_EQ(tcp_test_seq(zb), 1 + 3 * TCP_TEST_MSS);
+    TEST_ASSERT_EQ(tcp_test_payload(zb), 5000 - 3 * TCP_TEST_MSS);
+    zbuf_free(zb);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: Three duplicate ACKs resend the hole and halve the window
+ */
+TEST_CASE(tcp_fast_retransmit)
+{
+    socket_t *sock = tcp_test_open(65535, false);
+    TEST_ASSERT_NOT_NULL(sock);
+
+    TEST_ASSERT_EQ(sock_send(tcp_test_fd, tcp_test_data, 5 * TCP_TEST_MSS), 5 * TCP_TEST_MSS);
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 5);
+    zbuf_queue_flush(&test_net_wire);
+
+    /* Second segment lost */
+    tcp_test_ack(1 + TCP_TEST_MSS, 65535);
+    tcp_test_ack(1 + TCP_TEST_MSS, 65535);
+    tcp_test_ack(1 + TCP_TEST_MSS, 65535);
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 0);
+    TEST_ASSERT(!sock->in_recovery);
+
+    tcp_test_ack(1 + TCP_TEST_MSS, 65535);
+    TEST_ASSERT(sock->in_recovery);
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 1);
+    zbuf_t *zb = zbuf_queue_pop(&test_net_wire);
+    TEST_ASSERT_EQ(tcp_test_seq(zb), 1 + TCP_TEST_MSS);
+    TEST_ASSERT_EQ(tcp_test_payload(zb), TCP_TEST_MSS);
+    zbuf_free(zb);
+
+    /* ssthresh is half of the 4 segments in flight */
+    TEST_ASSERT_EQ(sock->ssthresh, 2 * TCP_TEST_MSS);
+    TEST_ASSERT_EQ(sock->cwnd, sock->ssthresh + 3 * TCP_TEST_MSS);
+
+    /* Everything acknowledged: recovery ends with cwnd at ssthresh */
+    tcp_test_ack(1 + 5 * TCP_TEST_MSS, 65535);
+    TEST_ASSERT(!sock->in_recovery);
+    TEST_ASSERT_EQ(sock->cwnd, sock->ssthresh);
+    TEST_ASSERT_EQ(sock->tx_queued, 0);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: A timeout resends from the oldest segment with cwnd at one MSS
+ */
+TEST_CASE(tcp_rto_retransmit)
+{
+    socket_t *sock = tcp_test_open(65535, false);
+    TEST_ASSERT_NOT_NULL(sock);
+
+    TEST_ASSERT_EQ(sock_send(tcp_test_fd, tcp_test_data, 2 * TCP_TEST_MSS), 2 * TCP_TEST_MSS);
+    zbuf_queue_flush(&test_net_wire);
+
+    /* Not yet */
+    tcp_timer();
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 0);
+
+    tick_t rto = sock->rto;
+    task_sleep(rto);
+    tcp_timer();
+
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 1);
+    zbuf_t *zb = zbuf_queue_pop(&test_net_wire);
+    TEST_ASSERT_EQ(tcp_test_seq(zb), 1);
+    zbuf_free(zb);
+    TEST_ASSERT_EQ(sock->cwnd, TCP_TEST_MSS);
+    TEST_ASSERT_EQ(sock->rto, 2 * rto);
+    TEST_ASSERT_EQ(sock->retries, 1);
+
+    /* Its ACK lets the second segment go again */
+    tcp_test_ack(1 + TCP_TEST_MSS, 65535);
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 1);
+    zb = zbuf_queue_pop(&test_net_wire);
+    TEST_ASSERT_EQ(tcp_test_seq(zb), 1 + TCP_TEST_MSS);
+    zbuf_free(zb);
+    TEST_ASSERT_EQ(sock->retries, 0);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: Data past a hole is held and SACKed, then delivered in order
+ */
+TEST_CASE(tcp_ooo_reassembly)
+{
+    socket_t *sock = tcp_test_open(65535, true);
+    TEST_ASSERT_NOT_NULL(sock);
+    TEST_ASSERT(sock->sack_ok);
+
+    uint32_t start = 0;
+    uint32_t end = 0;
+
+    /* Third segment first */
+    tcp_test_peer_data(200, 100);
+    TEST_ASSERT_EQ(zbuf_queue_len(&sock->rx_queue), 0);
+    TEST_ASSERT_EQ(sock->ooo_count, 1);
+    zbuf_t *zb = zbuf_queue_pop(&test_net_wire);
+    TEST_ASSERT_NOT_NULL(zb);
+    TEST_ASSERT_EQ(ntohl(tcp_test_hdr(zb)->ack), TCP_TEST_PEER_ISN + 1);
+    TEST_ASSERT_EQ(tcp_test_sack_block(zb, &start, &end), 1);
+    TEST_ASSERT_EQ(start, 200);
+    TEST_ASSERT_EQ(end, 300);
+    zbuf_free(zb);
+
+    /* Second segment joins it into one block; a repeat changes nothing */
+    tcp_test_peer_data(100, 100);
+    tcp_test_peer_data(150, 100);
+    TEST_ASSERT_EQ(sock->ooo_count, 2);
+    zbuf_free(zbuf_queue_pop(&test_net_wire));
+    zb = zbuf_queue_pop(&test_net_wire);
+    TEST_ASSERT_EQ(tcp_test_sack_block(zb, &start, &end), 1);
+    TEST_ASSERT_EQ(start, 100);
+    TEST_ASSERT_EQ(end, 300);
+    zbuf_free(zb);
+
+    /* The hole fills: all three are delivered and the SACK goes away */
+    tcp_test_peer_data(0, 100);
+    TEST_ASSERT_EQ(zbuf_queue_len(&sock->rx_queue), 3);
+    TEST_ASSERT_EQ(sock->ooo_count, 0);
+    TEST_ASSERT_EQ(sock->rcv_nxt, TCP_TEST_PEER_ISN + 1 + 300);
+    zb = zbuf_queue_pop(&test_net_wire);
+    TEST_ASSERT_EQ(ntohl(tcp_test_hdr(zb)->ack), TCP_TEST_PEER_ISN + 1 + 300);
+    TEST_ASSERT_EQ(TCP_HDR_LEN(tcp_test_hdr(zb)), sizeof(tcp_hdr_t));
+    zbuf_free(zb);
+
+    /* In sequence order, no byte twice */
+    uint8_t expect = (uint8_t)(TCP_TEST_PEER_ISN + 1);
+    for (zbuf_t *rx = sock->rx_queue.head; rx != NULL; rx = rx->next) {
+        for (uint16_t i = 0; i < rx->len; i++) {
+            TEST_ASSERT_EQ(rx->data[i], expect++);
+        }
+    }
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: SACK lets one recovery repair two holes without a timeout
+ */
+TEST_CASE(tcp_sack_recovery)
+{
+    socket_t *sock = tcp_test_open(65535, true);
+    TEST_ASSERT_NOT_NULL(sock);
+
+    TEST_ASSERT_EQ(sock_send(tcp_test_fd, tcp_test_data, 6 * TCP_TEST_MSS), 6 * TCP_TEST_MSS);
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 6);
+    zbuf_queue_flush(&test_net_wire);
+
+    /* Segments 2 and 4 lost */
+    const uint32_t m = TCP_TEST_MSS;
+    const uint32_t seg3[1][2] = { { 1 + 2 * m, 1 + 3 * m } };
+    const uint32_t seg35[2][2] = { { 1 + 4 * m, 1 + 5 * m }, { 1 + 2 * m, 1 + 3 * m } };
+    const uint32_t seg356[2][2] = { { 1 + 4 * m, 1 + 6 * m }, { 1 + 2 * m, 1 + 3 * m } };
+
+    tcp_test_ack(1 + m, 65535);
+    tcp_test_sack(1 + m, seg3, 1);
+    tcp_test_sack(1 + m, seg35, 2);
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 0);
+
+    tcp_test_sack(1 + m, seg356, 2);
+    TEST_ASSERT(sock->in_recovery);
+    TEST_ASSERT_EQ(sock->sack_high, sock->snd_max);
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 1);
+    zbuf_t *zb = zbuf_queue_pop(&test_net_wire);
+    TEST_ASSERT_EQ(tcp_test_seq(zb), 1 + m);
+    zbuf_free(zb);
+
+    /* The next duplicate sends the second hole, not segment 3 */
+    tcp_test_sack(1 + m, seg356, 2);
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 1);
+    zb = zbuf_queue_pop(&test_net_wire);
+    TEST_ASSERT_EQ(tcp_test_seq(zb), 1 + 3 * m);
+    zbuf_free(zb);
+
+    /* Nothing left to repair */
+    tcp_test_sack(1 + m, seg356, 2);
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 0);
+
+    tcp_test_ack(1 + 6 * m, 65535);
+    TEST_ASSERT(!sock->in_recovery);
+    TEST_ASSERT_EQ(sock->tx_queued, 0);
+    TEST_ASSERT_EQ(sock->retries, 0);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: ACKs wait for a second segment, the response or the timeout
+ */
+TEST_CASE(tcp_delayed_ack)
+{
+    socket_t *sock = tcp_test_open(65535, false);
+    TEST_ASSERT_NOT_NULL(sock);
+
+    /* Request, then response: one packet carries both data and ACK */
+    tcp_test_peer_data(0, 100);
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 0);
+    TEST_ASSERT_EQ(sock_send(tcp_test_fd, tcp_test_data, 10), 10);
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 1);
+    zbuf_t *zb = zbuf_queue_pop(&test_net_wire);
+    TEST_ASSERT_EQ(ntohl(tcp_test_hdr(zb)->ack), TCP_TEST_PEER_ISN + 1 + 100);
+    TEST_ASSERT_EQ(tcp_test_payload(zb), 10);
+    zbuf_free(zb);
+    TEST_ASSERT_EQ(sock->ack_pending, 0);
+    tcp_test_ack(1 + 10, 65535);
+
+    /* Every second segment */
+    tcp_test_peer_data(100, 100);
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 0);
+    tcp_test_peer_data(200, 100);
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 1);
+    zb = zbuf_queue_pop(&test_net_wire);
+    TEST_ASSERT_EQ(ntohl(tcp_test_hdr(zb)->ack), TCP_TEST_PEER_ISN + 1 + 300);
+    zbuf_free(zb);
+
+    /* A lone segment on timeout */
+    tcp_test_peer_data(300, 100);
+    tcp_timer();
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 0);
+    task_sleep(CONFIG_TCP_DELACK_MS * CONFIG_TICK_RATE_HZ / 1000);
+    tcp_timer();
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 1);
+    zbuf_queue_flush(&test_net_wire);
+
+    /* Quick-ACK mode */
+    TEST_ASSERT_EQ(sock_set_quickack(tcp_test_fd, true), 0);
+    tcp_test_peer_data(400, 100);
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 1);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: Nagle and cork hold short writes and send them as one segment
+ */
+TEST_CASE(tcp_nagle_cork)
+{
+    static uint8_t msg[64];
+    for (uint32_t i = 0; i < sizeof(msg); i++) {
+        msg[i] = (uint8_t)(0xA5 ^ (i * 7));
+    }
+
+    socket_t *sock = tcp_test_open(65535, false);
+    TEST_ASSERT_NOT_NULL(sock);
+
+    /* Nothing short in flight: the first write goes at once */
+    TEST_ASSERT_EQ(sock_send(tcp_test_fd, msg, 20), 20);
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 1);
+    zbuf_queue_flush(&test_net_wire);
+
+    /* The next ones wait for its ACK and are coalesced, at odd offsets too */
+    TEST_ASSERT_EQ(sock_send(tcp_test_fd, msg, 33), 33);
+    TEST_ASSERT_EQ(sock_send(tcp_test_fd, msg + 33, 31), 31);
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 0);
+    TEST_ASSERT_EQ(sock->tx_queued, 20 + 64);
+
+    tcp_test_ack(1 + 20, 65535);
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 1);
+    zbuf_t *zb = zbuf_queue_pop(&test_net_wire);
+    TEST_ASSERT_EQ(tcp_test_seq(zb), 1 + 20);
+    TEST_ASSERT_EQ(tcp_test_payload(zb), 64);
+    TEST_ASSERT_EQ(tcp_test_csum(zb), 0);
+    zbuf_free(zb);
+
+    /* TCP_NODELAY: short writes go while one is unacknowledged */
+    uint32_t val = 0;
+    TEST_ASSERT_EQ(sock_setopt(tcp_test_fd, TCP_NODELAY, 1), 0);
+    TEST_ASSERT_EQ(sock_getopt(tcp_test_fd, TCP_NODELAY, &val), 0);
+    TEST_ASSERT_EQ(val, 1);
+    TEST_ASSERT_EQ(sock_send(tcp_test_fd, msg, 10), 10);
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 1);
+    zbuf_queue_flush(&test_net_wire);
+    tcp_test_ack(1 + 20 + 64 + 10, 65535);
+
+    /* TCP_CORK: held regardless, until uncorked */
+    TEST_ASSERT_EQ(sock_setopt(tcp_test_fd, TCP_CORK, 1), 0);
+    TEST_ASSERT_EQ(sock_send(tcp_test_fd, msg, 10), 10);
+    TEST_ASSERT_EQ(sock_send(tcp_test_fd, msg, 20), 20);
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 0);
+    TEST_ASSERT_EQ(sock_setopt(tcp_test_fd, TCP_CORK, 0), 0);
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 1);
+    zb = zbuf_queue_pop(&test_net_wire);
+    TEST_ASSERT_EQ(tcp_test_payload(zb), 30);
+    TEST_ASSERT_EQ(tcp_test_csum(zb), 0);
+    zbuf_free(zb);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: The advertised window follows unread data and SO_RCVBUF
+ */
+TEST_CASE(tcp_buffer_limits)
+{
+    socket_t *sock = tcp_test_open(65535, false);
+    TEST_ASSERT_NOT_NULL(sock);
+
+    uint32_t val = 0;
+    TEST_ASSERT_EQ(sock_getopt(tcp_test_fd, SO_SNDBUF, &val), 0);
+    TEST_ASSERT_EQ(val, CONFIG_TCP_SNDBUF);
+    TEST_ASSERT_EQ(sock_setopt(tcp_test_fd, SO_SNDBUF, 1), -1);
+    TEST_ASSERT_EQ(sock_setopt(tcp_test_fd, SO_RCVBUF, 4 * TCP_TEST_MSS), 0);
+    TEST_ASSERT_EQ(sock_setopt(tcp_test_fd, SO_PRIORITY, 6), 0);
+    TEST_ASSERT_EQ(sock->priority, 6);
+    TEST_ASSERT_EQ(sock_setopt(tcp_test_fd, SO_PRIORITY, 8), -1);
+
+    /* Two unread segments close half the window */
+    tcp_test_peer_data(0, TCP_TEST_MSS);
+    tcp_test_peer_data(TCP_TEST_MSS, TCP_TEST_MSS);
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 1);
+    zbuf_t *zb = zbuf_queue_pop(&test_net_wire);
+    TEST_ASSERT_EQ(ntohs(tcp_test_hdr(zb)->win), 2 * TCP_TEST_MSS);
+    zbuf_free(zb);
+
+    /* Reading one reopens it by an MSS: worth a window update */
+    zb = sock_recv_zbuf(tcp_test_fd);
+    TEST_ASSERT_NOT_NULL(zb);
+    zbuf_free(zb);
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 1);
+    zb = zbuf_queue_pop(&test_net_wire);
+    TEST_ASSERT_EQ(ntohs(tcp_test_hdr(zb)->win), 3 * TCP_TEST_MSS);
+    zbuf_free(zb);
+    TEST_ASSERT_EQ(sock->rx_queued, TCP_TEST_MSS);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: Each handshake gets its own socket, up to the backlog
+ */
+TEST_CASE(tcp_accept_queue)
+{
+    sockaddr_t addr = { .addr = TCP_TEST_IP, .port = TCP_TEST_PORT };
+
+    tcp_test_lfd = sock_socket(SOCK_STREAM);
+    TEST_ASSERT(tcp_test_lfd >= 0);
+    sock_bind(tcp_test_lfd, &addr);
+    TEST_ASSERT_EQ(sock_listen(tcp_test_lfd, 2), 0);
+    socket_t *lsock = socket_table[tcp_test_lfd % CONFIG_NET_MAX_SOCKETS];
+
+    /* Three clients, room for two */
+    uint32_t isn[3];
+    for (uint16_t i = 0; i < 3; i++) {
+        tcp_test_port = TCP_TEST_PEER_PORT + i;
+        tcp_test_input(TCP_FLAG_SYN, TCP_TEST_PEER_ISN, 0, 65535);
+        zbuf_t *zb = zbuf_queue_pop(&test_net_wire);
+        TEST_ASSERT_EQ(zb != NULL, i < 2);
+        if (zb != NULL) {
+            TEST_ASSERT_EQ(ntohs(tcp_test_hdr(zb)->dport), TCP_TEST_PEER_PORT + i);
+            isn[i] = ntohl(tcp_test_hdr(zb)->seq);
+            zbuf_free(zb);
+        }
+    }
+    TEST_ASSERT_EQ(lsock->state, TCP_LISTEN);
+    TEST_ASSERT_EQ(lsock->npending, 2);
+
+    /* The second client completes first, data on its ACK */
+    tcp_test_port = TCP_TEST_PEER_PORT + 1;
+    tcp_test_segment(TCP_FLAG_ACK, TCP_TEST_PEER_ISN + 1, isn[1] + 1, 65535, NULL, 0, 10);
+
+    sockaddr_t peer;
+    int fd = sock_accept(tcp_test_lfd, &peer);
+    TEST_ASSERT(fd >= 0 && fd != tcp_test_lfd);
+    TEST_ASSERT_EQ(peer.port, TCP_TEST_PEER_PORT + 1);
+    socket_t *child = socket_table[fd % CONFIG_NET_MAX_SOCKETS];
+    TEST_ASSERT_EQ(child->state, TCP_ESTABLISHED);
+    TEST_ASSERT_EQ(child->rx_queued, 10);
+    socket_t *found = sock_lookup(SOCK_STREAM, TCP_TEST_IP, TCP_TEST_PORT,
+                                  TCP_TEST_PEER, TCP_TEST_PEER_PORT + 1);
+    TEST_ASSERT(found == child);
+    sock_put(found);
+    TEST_ASSERT_EQ(lsock->npending, 1);
+    sock_close(fd);
+    tcp_test_input(TCP_FLAG_RST, TCP_TEST_PEER_ISN + 11, 0, 0);
+    zbuf_queue_flush(&test_net_wire);
+
+    /* The first resets and is reaped once its place is needed */
+    tcp_test_port = TCP_TEST_PEER_PORT;
+    tcp_test_input(TCP_FLAG_RST, TCP_TEST_PEER_ISN + 1, 0, 0);
+    for (uint16_t i = 2; i < 4; i++) {
+        tcp_test_port = TCP_TEST_PEER_PORT + i;
+        tcp_test_input(TCP_FLAG_SYN, TCP_TEST_PEER_ISN, 0, 65535);
+    }
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 2);
+    zbuf_queue_flush(&test_net_wire);
+    TEST_ASSERT_EQ(lsock->npending, 2);
+    found = sock_lookup(SOCK_STREAM, TCP_TEST_IP, TCP_TEST_PORT,
+                        TCP_TEST_PEER, TCP_TEST_PEER_PORT);
+    TEST_ASSERT(found == lsock);
+    sock_put(found);
+
+    /* A stray ACK to the listener is reset */
+    tcp_test_port = TCP_TEST_PEER_PORT + 4;
+    tcp_test_input(TCP_FLAG_ACK, TCP_TEST_PEER_ISN + 1, 1, 65535);
+    zbuf_t *zb = zbuf_queue_pop(&test_net_wire);
+    TEST_ASSERT_NOT_NULL(zb);
+    TEST_ASSERT(tcp_test_hdr(zb)->flags & TCP_FLAG_RST);
+    zbuf_free(zb);
+
+    /* Closing the listener takes the children still in handshake with it */
+    return TEST_PASS;
+}
+
+/*
+ * Test: MSS, window scale and timestamps are negotiated and applied
+ */
+TEST_CASE(tcp_wscale_timestamps)
+{
+    sockaddr_t addr = { .addr = TCP_TEST_IP, .port = TCP_TEST_PORT };
+    uint8_t opt[20] = {
+        TCP_OPT_MSS, 4, 1000 >> 8, 1000 & 0xFF,
+        TCP_OPT_SACK_PERM, 2, TCP_OPT_TS, 10, 0, 0, 0, 0, 0, 0, 0, 0,
+        TCP_OPT_NOP, TCP_OPT_WSCALE, 3, 7
+    };
+
+    tcp_test_lfd = sock_socket(SOCK_STREAM);
+    TEST_ASSERT(tcp_test_lfd >= 0);
+    sock_bind(tcp_test_lfd, &addr);
+    sock_listen(tcp_test_lfd, 1);
+
+    tcp_test_put32(opt + 8, 1000);
+    tcp_test_segment(TCP_FLAG_SYN, TCP_TEST_PEER_ISN, 0, 65535, opt, sizeof(opt), 0);
+
+    /* The SYN-ACK answers every option, window unscaled */
+    zbuf_t *zb = zbuf_queue_pop(&test_net_wire);
+    TEST_ASSERT_NOT_NULL(zb);
+    tcp_test_isn = ntohl(tcp_test_hdr(zb)->seq);
+    const uint8_t *o = tcp_test_opt(zb, TCP_OPT_MSS);
+    TEST_ASSERT_NOT_NULL(o);
+    TEST_ASSERT_EQ((o[2] << 8) | o[3], CONFIG_TCP_MSS);
+    o = tcp_test_opt(zb, TCP_OPT_WSCALE);
+    TEST_ASSERT_NOT_NULL(o);
+    uint8_t shift = o[2];
+    TEST_ASSERT_EQ(CONFIG_TCP_RCVBUF_MAX >> shift <= 0xFFFF, 1);
+    TEST_ASSERT_NOT_NULL(tcp_test_opt(zb, TCP_OPT_SACK_PERM));
+    o = tcp_test_opt(zb, TCP_OPT_TS);
+    TEST_ASSERT_NOT_NULL(o);
+    TEST_ASSERT_EQ(tcp_test_get32(o + 6), 1000);
+    uint32_t our_ts = tcp_test_get32(o + 2);
+    TEST_ASSERT(ntohs(tcp_test_hdr(zb)->win) > 0xFFFF >> shift);
+    zbuf_free(zb);
+
+    /* Final ACK: a window of 100 << 7 */
+    uint8_t ts[12];
+    tcp_test_ts(ts, 1001, our_ts);
+    tcp_test_segment(TCP_FLAG_ACK, TCP_TEST_PEER_ISN + 1, tcp_test_isn + 1, 100, ts, 12, 0);
+    tcp_test_fd = sock_accept(tcp_test_lfd, NULL);
+    TEST_ASSERT(tcp_test_fd >= 0);
+    socket_t *sock = socket_table[tcp_test_fd % CONFIG_NET_MAX_SOCKETS];
+
+    TEST_ASSERT_EQ(sock->mss, 1000 - 12);
+    TEST_ASSERT_EQ(sock->snd_wnd, 100 << 7);
+    TEST_ASSERT_EQ(sock->rcv_wscale, shift);
+    TEST_ASSERT(sock->ts_ok && sock->sack_ok);
+    TEST_ASSERT_EQ(sock->ts_recent, 1001);
+
+    /* Data carries the echo and a scaled window */
+    TEST_ASSERT_EQ(sock_send(tcp_test_fd, tcp_test_data, 2000), 2000);
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 3);
+    zb = zbuf_queue_pop(&test_net_wire);
+    TEST_ASSERT_EQ(tcp_test_payload(zb), 1000 - 12);
+    o = tcp_test_opt(zb, TCP_OPT_TS);
+    TEST_ASSERT_NOT_NULL(o);
+    TEST_ASSERT_EQ(tcp_test_get32(o + 6), 1001);
+    TEST_ASSERT_EQ((uint32_t)ntohs(tcp_test_hdr(zb)->win) << shift, sock->rcv_wnd);
+    zbuf_free(zb);
+    zbuf_queue_flush(&test_net_wire);
+
+    /* The ACK's echo is an RTT sample */
+    task_sleep(20);
+    tcp_test_ts(ts, 1002, our_ts);
+    tcp_test_segment(TCP_FLAG_ACK, TCP_TEST_PEER_ISN + 1, tcp_test_isn + 1 + 2000, 100,
+                     ts, 12, 0);
+    TEST_ASSERT(sock->srtt >> 3 >= 20);
+    TEST_ASSERT_EQ(sock->ts_recent, 1002);
+
+    /* An echo of a time not yet reached is no sample: the RTT stays small */
+    tick_t srtt = sock->srtt;
+    tick_t rto = sock->rto;
+    TEST_ASSERT_EQ(sock_send(tcp_test_fd, tcp_test_data, 100), 100);
+    zbuf_queue_flush(&test_net_wire);
+    tcp_test_ts(ts, 1003, our_ts + 0x10000000);
+    tcp_test_segment(TCP_FLAG_ACK, TCP_TEST_PEER_ISN + 1, tcp_test_isn + 1 + 2100, 100,
+                     ts, 12, 0);
+    TEST_ASSERT_EQ(sock->snd_una, tcp_test_isn + 1 + 2100);
+    TEST_ASSERT(sock->srtt <= srtt);
+    TEST_ASSERT(sock->rto <= rto);
+
+    /* PAWS: an older timestamp is dropped and answered with an ACK */
+    tcp_test_ts(ts, 900, our_ts);
+    tcp_test_segment(TCP_FLAG_ACK, TCP_TEST_PEER_ISN + 1, tcp_test_isn + 1 + 2100, 100,
+                     ts, 12, 100);
+    TEST_ASSERT_EQ(sock->rx_queued, 0);
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 1);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: The receive buffer grows while the window limits the peer
+ */
+TEST_CASE(tcp_rcvbuf_autosize)
+{
+    socket_t *sock = tcp_test_open(65535, false);
+    TEST_ASSERT_NOT_NULL(sock);
+    TEST_ASSERT_EQ(sock->rcvbuf, CONFIG_TCP_WINDOW_SIZE);
+
+    /* No RTT known yet: nothing to measure against */
+    tcp_test_peer_data(0, TCP_TEST_MSS);
+    zbuf_free(sock_recv_zbuf(tcp_test_fd));
+    TEST_ASSERT_EQ(sock->rcvbuf, CONFIG_TCP_WINDOW_SIZE);
+
+    /* Half the buffer and more within one RTT */
+    sock->rcv_rtt = 10;
+    task_sleep(10);
+    uint32_t off = TCP_TEST_MSS;
+    for (uint32_t i = 0; i < 24; i++, off += TCP_TEST_MSS) {
+        tcp_test_peer_data(off, TCP_TEST_MSS);
+    }
+    zbuf_free(sock_recv_zbuf(tcp_test_fd));
+    TEST_ASSERT_EQ(sock->rcvbuf, 2 * CONFIG_TCP_WINDOW_SIZE);
+    zbuf_queue_flush(&test_net_wire);
+
+    /* The next ACK offers more than the old buffer had room for */
+    tcp_test_peer_data(off, TCP_TEST_MSS);
+    tcp_test_peer_data(off + TCP_TEST_MSS, TCP_TEST_MSS);
+    zbuf_t *zb = zbuf_queue_pop(&test_net_wire);
+    TEST_ASSERT_NOT_NULL(zb);
+    TEST_ASSERT(sock->rx_queued > 2 * TCP_TEST_MSS);
+    TEST_ASSERT_EQ(ntohs(tcp_test_hdr(zb)->win), 0xFFFF);
+    zbuf_free(zb);
+
+    /* A fixed SO_RCVBUF is left alone */
+    TEST_ASSERT_EQ(sock_setopt(tcp_test_fd, SO_RCVBUF, 100000), 0);
+    task_sleep(10);
+    zbuf_free(sock_recv_zbuf(tcp_test_fd));
+    TEST_ASSERT_EQ(sock->rcvbuf, 100000);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: Timers run only when due; keepalive probes an idle peer, then drops it
+ */
+TEST_CASE(tcp_keepalive_timer)
+{
+    const tick_t idle = CONFIG_TCP_KEEPALIVE_IDLE * CONFIG_TICK_RATE_HZ;
+    const tick_t intvl = CONFIG_TCP_KEEPALIVE_INTVL * CONFIG_TICK_RATE_HZ;
+
+    socket_t *sock = tcp_test_open(65535, false);
+    TEST_ASSERT_NOT_NULL(sock);
+
+    /* All acknowledged: once the timer finds nothing due it stays off */
+    TEST_ASSERT_EQ(sock_send(tcp_test_fd, tcp_test_data, 100), 100);
+    tcp_test_ack(1 + 100, 65535);
+    zbuf_queue_flush(&test_net_wire);
+    task_sleep(2 * CONFIG_TICK_RATE_HZ);    /* Past the SYN-ACK's initial RTO */
+    tcp_timer();
+    TEST_ASSERT_EQ(sock->tmr_armed, 0);
+    task_sleep(idle);
+    tcp_timer();
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 0);
+
+    /* Probes carry the sequence before snd_una and no data */
+    TEST_ASSERT_EQ(sock_setopt(tcp_test_fd, SO_KEEPALIVE, 1), 0);
+    TEST_ASSERT_EQ(sock->tmr_armed, 1);
+    task_sleep(idle - 1);
+    tcp_timer();
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 1);
+    zbuf_t *zb = zbuf_queue_pop(&test_net_wire);
+    TEST_ASSERT_EQ(tcp_test_seq(zb), 100);
+    TEST_ASSERT_EQ(tcp_test_payload(zb), 0);
+    zbuf_free(zb);
+
+    /* An answer restarts the idle time */
+    tcp_test_ack(1 + 100, 65535);
+    TEST_ASSERT_EQ(sock->ka_probes, 0);
+    task_sleep(intvl);
+    tcp_timer();
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 0);
+
+    /* No answer: one probe per interval, then the connection is dropped */
+    task_sleep(idle - intvl);
+    tcp_timer();
+    for (uint32_t i = 1; i < CONFIG_TCP_KEEPALIVE_PROBES; i++) {
+        task_sleep(intvl);
+        tcp_timer();
+    }
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), CONFIG_TCP_KEEPALIVE_PROBES);
+    TEST_ASSERT_EQ(sock->state, TCP_ESTABLISHED);
+    task_sleep(intvl);
+    tcp_timer();
+    TEST_ASSERT_EQ(sock->state, TCP_CLOSED);
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), CONFIG_TCP_KEEPALIVE_PROBES);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: Close sends the data the window held back, then a FIN that is
+ * resent until acknowledged; the peer never closes, so it is reset
+ */
+TEST_CASE(tcp_close_deferred)
+{
+    socket_t *sock = tcp_test_open(2 * TCP_TEST_MSS, false);
+    TEST_ASSERT_NOT_NULL(sock);
+    socket_t *lsock = socket_table[tcp_test_lfd % CONFIG_NET_MAX_SOCKETS];
+
+    TEST_ASSERT_EQ(sock_send(tcp_test_fd, tcp_test_data, 4 * TCP_TEST_MSS), 4 * TCP_TEST_MSS);
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 2);
+    zbuf_queue_flush(&test_net_wire);
+
+    /* The descriptor goes at once, the connection stays */
+    TEST_ASSERT_EQ(sock_close(tcp_test_fd), 0);
+    TEST_ASSERT_NULL(socket_table[tcp_test_fd % CONFIG_NET_MAX_SOCKETS]);
+    tcp_test_fd = -1;
+    TEST_ASSERT_EQ(sock->state, TCP_FIN_WAIT_1);
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 0);
+
+    /* The window opens: the rest of the data, then the FIN */
+    tcp_test_ack(1 + 2 * TCP_TEST_MSS, 2 * TCP_TEST_MSS);
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 3);
+    for (uint32_t i = 2; i < 4; i++) {
+        zbuf_t *zb = zbuf_queue_pop(&test_net_wire);
+        TEST_ASSERT_EQ(tcp_test_seq(zb), 1 + i * TCP_TEST_MSS);
+        TEST_ASSERT_EQ(tcp_test_payload(zb), TCP_TEST_MSS);
+        zbuf_free(zb);
+    }
+    zbuf_t *zb = zbuf_queue_pop(&test_net_wire);
+    TEST_ASSERT(tcp_test_hdr(zb)->flags & TCP_FLAG_FIN);
+    TEST_ASSERT_EQ(tcp_test_seq(zb), 1 + 4 * TCP_TEST_MSS);
+    TEST_ASSERT_EQ(tcp_test_payload(zb), 0);
+    zbuf_free(zb);
+
+    /* The FIN is lost: the data alone is acknowledged, the FIN resent */
+    tcp_test_ack(1 + 4 * TCP_TEST_MSS, 2 * TCP_TEST_MSS);
+    TEST_ASSERT_EQ(sock->state, TCP_FIN_WAIT_1);
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 0);
+    task_sleep(sock->rto);
+    tcp_timer();
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 1);
+    zb = zbuf_queue_pop(&test_net_wire);
+    TEST_ASSERT(tcp_test_hdr(zb)->flags & TCP_FLAG_FIN);
+    TEST_ASSERT_EQ(tcp_test_seq(zb), 1 + 4 * TCP_TEST_MSS);
+    zbuf_free(zb);
+
+    tcp_test_ack(2 + 4 * TCP_TEST_MSS, 2 * TCP_TEST_MSS);
+    TEST_ASSERT_EQ(sock->state, TCP_FIN_WAIT_2);
+
+    /* The peer's FIN never comes: reset, and the socket is freed */
+    task_sleep(TCP_TEST_FIN_WAIT - 1);
+    tcp_timer();
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 0);
+    task_sleep(1);
+    tcp_timer();
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 1);
+    zb = zbuf_queue_pop(&test_net_wire);
+    TEST_ASSERT(tcp_test_hdr(zb)->flags & TCP_FLAG_RST);
+    TEST_ASSERT_EQ(tcp_test_seq(zb), 2 + 4 * TCP_TEST_MSS);
+    zbuf_free(zb);
+
+    socket_t *found = sock_lookup(SOCK_STREAM, TCP_TEST_IP, TCP_TEST_PORT,
+                                  TCP_TEST_PEER, TCP_TEST_PEER_PORT);
+    TEST_ASSERT(found == lsock);
+    sock_put(found);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: After both FINs a closed connection waits 2*MSL, answering a
+ * resent FIN, and is then freed
+ */
+TEST_CASE(tcp_close_time_wait)
+{
+    socket_t *sock = tcp_test_open(65535, false);
+    TEST_ASSERT_NOT_NULL(sock);
+    socket_t *lsock = socket_table[tcp_test_lfd % CONFIG_NET_MAX_SOCKETS];
+
+    TEST_ASSERT_EQ(sock_send(tcp_test_fd, tcp_test_data, 100), 100);
+    tcp_test_ack(1 + 100, 65535);
+    zbuf_queue_flush(&test_net_wire);
+
+    TEST_ASSERT_EQ(sock_close(tcp_test_fd), 0);
+    tcp_test_fd = -1;
+    TEST_ASSERT_EQ(sock->state, TCP_FIN_WAIT_1);
+    zbuf_t *zb = zbuf_queue_pop(&test_net_wire);
+    TEST_ASSERT_NOT_NULL(zb);
+    TEST_ASSERT(tcp_test_hdr(zb)->flags & TCP_FLAG_FIN);
+    TEST_ASSERT_EQ(tcp_test_seq(zb), 1 + 100);
+    zbuf_free(zb);
+
+    /* Data from the peer still arrives once our FIN is acknowledged */
+    tcp_test_ack(2 + 100, 65535);
+    TEST_ASSERT_EQ(sock->state, TCP_FIN_WAIT_2);
+    tcp_test_peer_data(0, 10);
+    TEST_ASSERT_EQ(sock->rcv_nxt, TCP_TEST_PEER_ISN + 1 + 10);
+    zbuf_queue_flush(&test_net_wire);
+
+    /* The peer's FIN: acknowledged, then TIME_WAIT */
+    tcp_test_input(TCP_FLAG_FIN | TCP_FLAG_ACK, TCP_TEST_PEER_ISN + 1 + 10,
+                   tcp_test_isn + 2 + 100, 65535);
+    TEST_ASSERT_EQ(sock->state, TCP_TIME_WAIT);
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 1);
+    zb = zbuf_queue_pop(&test_net_wire);
+    TEST_ASSERT_EQ(ntohl(tcp_test_hdr(zb)->ack), TCP_TEST_PEER_ISN + 2 + 10);
+    zbuf_free(zb);
+
+    /* That ACK is lost: the resent FIN is answered and 2*MSL starts over */
+    task_sleep(TCP_TEST_TIME_WAIT / 2);
+    tcp_timer();
+    tcp_test_input(TCP_FLAG_FIN | TCP_FLAG_ACK, TCP_TEST_PEER_ISN + 1 + 10,
+                   tcp_test_isn + 2 + 100, 65535);
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 1);
+    zb = zbuf_queue_pop(&test_net_wire);
+    TEST_ASSERT_EQ(ntohl(tcp_test_hdr(zb)->ack), TCP_TEST_PEER_ISN + 2 + 10);
+    zbuf_free(zb);
+
+    task_sleep(TCP_TEST_TIME_WAIT - 1);
+    tcp_timer();
+    TEST_ASSERT_EQ(sock->state, TCP_TIME_WAIT);
+    task_sleep(1);
+    tcp_timer();
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 0);
+
+    socket_t *found = sock_lookup(SOCK_STREAM, TCP_TEST_IP, TCP_TEST_PORT,
+                                  TCP_TEST_PEER, TCP_TEST_PEER_PORT);
+    TEST_ASSERT(found == lsock);
+    sock_put(found);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: FINs that cross go through CLOSING, not straight to TIME_WAIT
+ */
+TEST_CASE(tcp_close_simultaneous)
+{
+    socket_t *sock = tcp_test_open(65535, false);
+    TEST_ASSERT_NOT_NULL(sock);
+
+    TEST_ASSERT_EQ(sock_close(tcp_test_fd), 0);
+    tcp_test_fd = -1;
+    TEST_ASSERT_EQ(sock->state, TCP_FIN_WAIT_1);
+    zbuf_queue_flush(&test_net_wire);
+
+    /* The peer's FIN does not acknowledge ours */
+    tcp_test_input(TCP_FLAG_FIN | TCP_FLAG_ACK, TCP_TEST_PEER_ISN + 1, tcp_test_isn + 1, 65535);
+    TEST_ASSERT_EQ(sock->state, TCP_CLOSING);
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 1);
+    zbuf_queue_flush(&test_net_wire);
+
+    /* Ours is lost, so resent until the peer has it */
+    task_sleep(sock->rto);
+    tcp_timer();
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 1);
+    zbuf_t *zb = zbuf_queue_pop(&test_net_wire);
+    TEST_ASSERT(tcp_test_hdr(zb)->flags & TCP_FLAG_FIN);
+    TEST_ASSERT_EQ(tcp_test_seq(zb), 1);
+    zbuf_free(zb);
+
+    tcp_test_input(TCP_FLAG_ACK, TCP_TEST_PEER_ISN + 2, tcp_test_isn + 2, 65535);
+    TEST_ASSERT_EQ(sock->state, TCP_TIME_WAIT);
+
+    /* A reset does not cut TIME_WAIT short; 2*MSL does */
+    tcp_test_input(TCP_FLAG_RST, TCP_TEST_PEER_ISN + 2, 0, 0);
+    TEST_ASSERT_EQ(sock->state, TCP_TIME_WAIT);
+    task_sleep(TCP_TEST_TIME_WAIT);
+    tcp_timer();
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 0);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: Poll sets see connections, data, send space and the peer's FIN
+ */
+TEST_CASE(tcp_sock_poll)
+{
+    sockaddr_t addr = { .addr = TCP_TEST_IP, .port = TCP_TEST_PORT };
+    sock_event_t ev[2];
+    uint8_t buf[16];
+
+    sock_poll_t *ps = sock_poll_create(2);
+    TEST_ASSERT_NOT_NULL(ps);
+
+    tcp_test_lfd = sock_socket(SOCK_STREAM);
+    TEST_ASSERT(tcp_test_lfd >= 0);
+    sock_bind(tcp_test_lfd, &addr);
+    sock_listen(tcp_test_lfd, 1);
+    TEST_ASSERT_EQ(sock_poll_ctl(ps, SOCK_POLL_ADD, tcp_test_lfd, SOCK_EV_IN, NULL), 0);
+    TEST_ASSERT_EQ(sock_setopt(tcp_test_lfd, SO_NONBLOCK, 1), 0);
+    TEST_ASSERT_EQ(sock_accept(tcp_test_lfd, NULL), -1);
+
+    /* Readable only once the handshake completes */
+    tcp_test_input(TCP_FLAG_SYN, TCP_TEST_PEER_ISN, 0, 65535);
+    zbuf_t *zb = zbuf_queue_pop(&test_net_wire);
+    TEST_ASSERT_NOT_NULL(zb);
+    tcp_test_isn = ntohl(tcp_test_hdr(zb)->seq);
+    zbuf_free(zb);
+    TEST_ASSERT_EQ(sock_poll_wait(ps, ev, 2, 0), 0);
+    tcp_test_ack(1, 65535);
+    TEST_ASSERT_EQ(sock_poll_wait(ps, ev, 2, 0), 1);
+    TEST_ASSERT_EQ(ev[0].fd, tcp_test_lfd);
+
+    tcp_test_fd = sock_accept(tcp_test_lfd, NULL);
+    TEST_ASSERT(tcp_test_fd >= 0);
+    TEST_ASSERT_EQ(sock_poll_wait(ps, ev, 2, 0), 0);
+
+    /* Edge-triggered: writable when added, then only on events */
+    TEST_ASSERT_EQ(sock_poll_ctl(ps, SOCK_POLL_ADD, tcp_test_fd,
+                                 SOCK_EV_IN | SOCK_EV_OUT | SOCK_EV_ET, NULL), 0);
+    TEST_ASSERT_EQ(sock_setopt(tcp_test_fd, SO_NONBLOCK, 1), 0);
+    TEST_ASSERT_EQ(sock_poll_wait(ps, ev, 2, 0), 1);
+    TEST_ASSERT_EQ(ev[0].events, SOCK_EV_OUT);
+    TEST_ASSERT_EQ(sock_recv(tcp_test_fd, buf, sizeof(buf)), -1);
+
+    tcp_test_peer_data(0, 10);
+    TEST_ASSERT_EQ(sock_poll_wait(ps, ev, 2, 0), 1);
+    TEST_ASSERT_EQ(ev[0].events, SOCK_EV_IN | SOCK_EV_OUT);
+    TEST_ASSERT_EQ(sock_recv(tcp_test_fd, buf, sizeof(buf)), 10);
+
+    /* A full send buffer fails the write; the ACK that drains it reports */
+    TEST_ASSERT_EQ(sock_setopt(tcp_test_fd, SO_SNDBUF, TCP_TEST_MSS), 0);
+    TEST_ASSERT_EQ(sock_send(tcp_test_fd, tcp_test_data, TCP_TEST_MSS), TCP_TEST_MSS);
+    TEST_ASSERT_EQ(sock_send(tcp_test_fd, tcp_test_data, TCP_TEST_MSS), -1);
+    TEST_ASSERT_EQ(sock_poll_wait(ps, ev, 2, 0), 0);
+    tcp_test_ack(1 + TCP_TEST_MSS, 65535);
+    TEST_ASSERT_EQ(sock_poll_wait(ps, ev, 2, 0), 1);
+    TEST_ASSERT_EQ(ev[0].events, SOCK_EV_OUT);
+
+    /* The peer's FIN: end of stream */
+    tcp_test_input(TCP_FLAG_FIN | TCP_FLAG_ACK, TCP_TEST_PEER_ISN + 1 + 10,
+                   tcp_test_isn + 1 + TCP_TEST_MSS, 65535);
+    TEST_ASSERT_EQ(sock_poll_wait(ps, ev, 2, 0), 1);
+    TEST_ASSERT(ev[0].events & SOCK_EV_HUP);
+    TEST_ASSERT(ev[0].events & SOCK_EV_IN);
+
+    sock_poll_destroy(ps);
+    return TEST_PASS;
+}
+
+/* Queue an operation on a ring */
+static void tcp_test_sqe(sock_ring_t *ring, uint8_t op, int fd, zbuf_t *zb)
+{
+    sock_sqe_t *sqe = sock_ring_get_sqe(ring);
+    if (sqe == NULL) return;
+
+    sqe->op = op;
+    sqe->fd = fd;
+    sqe->zb = zb;
+    sqe->data = NULL;
+}
+
+/*
+ * Test: Accept, receive and send complete through a ring
+ */
+TEST_CASE(tcp_sock_ring)
+{
+    sockaddr_t addr = { .addr = TCP_TEST_IP, .port = TCP_TEST_PORT };
+    sock_cqe_t cqe[4];
+
+    sock_ring_t *ring = sock_ring_create(4);
+    TEST_ASSERT_NOT_NULL(ring);
+
+    tcp_test_lfd = sock_socket(SOCK_STREAM);
+    TEST_ASSERT(tcp_test_lfd >= 0);
+    sock_bind(tcp_test_lfd, &addr);
+    sock_listen(tcp_test_lfd, 1);
+
+    /* The accept waits for the handshake */
+    tcp_test_sqe(ring, SOCK_OP_ACCEPT, tcp_test_lfd, NULL);
+    TEST_ASSERT_EQ(sock_ring_submit(ring), 1);
+    TEST_ASSERT_EQ(sock_ring_wait(ring, cqe, 4, 0), 0);
+
+    tcp_test_input(TCP_FLAG_SYN, TCP_TEST_PEER_ISN, 0, 65535);
+    zbuf_t *zb = zbuf_queue_pop(&test_net_wire);
+    TEST_ASSERT_NOT_NULL(zb);
+    tcp_test_isn = ntohl(tcp_test_hdr(zb)->seq);
+    zbuf_free(zb);
+    tcp_test_ack(1, 65535);
+
+    TEST_ASSERT_EQ(sock_ring_wait(ring, cqe, 4, 0), 1);
+    tcp_test_fd = cqe[0].res;
+    TEST_ASSERT(tcp_test_fd >= 0);
+    TEST_ASSERT_EQ(cqe[0].addr.port, TCP_TEST_PEER_PORT);
+
+    /* A receive waits for data; the second send waits for the ACK */
+    TEST_ASSERT_EQ(sock_setopt(tcp_test_fd, SO_SNDBUF, TCP_TEST_MSS), 0);
+    tcp_test_sqe(ring, SOCK_OP_RECV, tcp_test_fd, NULL);
+    for (int i = 0; i < 2; i++) {
+        zb = zbuf_alloc_tx(TCP_TEST_MSS);
+        TEST_ASSERT_NOT_NULL(zb);
+        zbuf_put(zb, TCP_TEST_MSS);
+        tcp_test_sqe(ring, SOCK_OP_SEND, tcp_test_fd, zb);
+    }
+    TEST_ASSERT_EQ(sock_ring_submit(ring), 3);
+    TEST_ASSERT_EQ(sock_ring_wait(ring, cqe, 4, 0), 1);
+    TEST_ASSERT_EQ(cqe[0].res, TCP_TEST_MSS);
+    TEST_ASSERT(zbuf_queue_len(&test_net_wire) > 0);
+    zbuf_queue_flush(&test_net_wire);
+
+    tcp_test_ack(1 + TCP_TEST_MSS, 65535);
+    tcp_test_peer_data(0, 10);
+    TEST_ASSERT_EQ(sock_ring_wait(ring, cqe, 4, 0), 2);
+    TEST_ASSERT_EQ(cqe[0].res, 10);
+    TEST_ASSERT_NOT_NULL(cqe[0].zb);
+    zbuf_free(cqe[0].zb);
+    TEST_ASSERT_EQ(cqe[1].res, TCP_TEST_MSS);
+
+    /* End of stream */
+    tcp_test_sqe(ring, SOCK_OP_RECV, tcp_test_fd, NULL);
+    TEST_ASSERT_EQ(sock_ring_submit(ring), 1);
+    tcp_test_input(TCP_FLAG_FIN | TCP_FLAG_ACK, TCP_TEST_PEER_ISN + 1 + 10,
+                   tcp_test_isn + 1 + 2 * TCP_TEST_MSS, 65535);
+    TEST_ASSERT_EQ(sock_ring_wait(ring, cqe, 4, 0), 1);
+    TEST_ASSERT_EQ(cqe[0].res, 0);
+    TEST_ASSERT_NULL(cqe[0].zb);
+
+    sock_ring_destroy(ring);
+    return TEST_PASS;
+}
+
+/*
+ * Benchmark: cycles per KB of bulk send, the peer ACKing every segment
+ */
+#define TCP_BENCH_ROUNDS    64
+
+TEST_CASE(tcp_bulk_benchmark)
+{
+    socket_t *sock = tcp_test_open(65535, false);
+    TEST_ASSERT_NOT_NULL(sock);
+
+    uint64_t bytes = (uint64_t)sizeof(tcp_test_data) * TCP_BENCH_ROUNDS;
+    uint32_t acked = 1;
+    uint64_t start = test_cycles();
+
+    for (int i = 0; i < TCP_BENCH_ROUNDS; i++) {
+        TEST_ASSERT_EQ(sock_send(tcp_test_fd, tcp_test_data, sizeof(tcp_test_data)),
+                       sizeof(tcp_test_data));
+
+        zbuf_t *zb;
+        while ((zb = zbuf_queue_pop(&test_net_wire)) != NULL) {
+            acked = tcp_test_seq(zb) + tcp_test_payload(zb);
+            zbuf_free(zb);
+            tcp_test_ack(acked, 65535);
+        }
+    }
+
+    test_report("send + ACK", test_cycles() - start, bytes / 1024, "cycles/KB");
+
+    TEST_ASSERT_EQ(acked, 1 + bytes);
+    TEST_ASSERT_EQ(sock->tx_queued, 0);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test Suite Definition
+ */
+static test_case_t tcp_tests[] = {
+    { "tcp_send_segments", test_tcp_send_segments },
+    { "tcp_send_window", test_tcp_send_window },
+    { "tcp_fast_retransmit", test_tcp_fast_retransmit },
+    { "tcp_rto_retransmit", test_tcp_rto_retransmit },
+    { "tcp_ooo_reassembly", test_tcp_ooo_reassembly },
+    { "tcp_sack_recovery", test_tcp_sack_recovery },
+    { "tcp_delayed_ack", test_tcp_delayed_ack },
+    { "tcp_nagle_cork", test_tcp_nagle_cork },
+    { "tcp_buffer_limits", test_tcp_buffer_limits },
+    { "tcp_accept_queue", test_tcp_accept_queue },
+    { "tcp_wscale_timestamps", test_tcp_wscale_timestamps },
+    { "tcp_rcvbuf_autosize", test_tcp_rcvbuf_autosize },
+    { "tcp_keepalive_timer", test_tcp_keepalive_timer },
+    { "tcp_close_deferred", test_tcp_close_deferred },
+    { "tcp_close_time_wait", test_tcp_close_time_wait },
+    { "tcp_close_simultaneous", test_tcp_close_simultaneous },
+    { "tcp_sock_poll", test_tcp_sock_poll },
+    { "tcp_sock_ring", test_tcp_sock_ring },
+    { "tcp_bulk_benchmark", test_tcp_bulk_benchmark },
+};
+
+test_suite_t tcp_test_suite = {
+    .name = "TCP",
+    .tests = tcp_tests,
+    .test_count = sizeof(tcp_tests) / sizeof(test_case_t),
+    .setup = tcp_test_setup,
+    .teardown = tcp_test_teardown
+};
@@ -0,0 +1,417 @@
+/*
+ * Gracemont Industrial Control Framework - ARM64 RTOS
+ * Copyright (C) 2024 Zixiao System <https://github.com/Zixiao-System>
+ *
+ * This file is part of Gracemont Industrial Control Framework.
+ * Repository: https://github.com/Zixiao-System/gracemont
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ *
+ * VLAN, TX Priority Queue and Launch-Time Unit Tests
+ */
+
+#include "test_framework.h"
+#include "net_stack.h"
+#include "rtos_config.h"
+#include "rtos.h"
+#include "test_net.h"
+
+#define TXQ_TEST_IP         0x0A000001      /* 10.0.0.1 (us) */
+#define TXQ_TEST_PEER       0x0A000002
+#define TXQ_TEST_PAYLOAD    50              /* 64-byte frames */
+#define TXQ_TEST_FRAME      (TXQ_TEST_PAYLOAD + ETH_HDR_LEN)
+#define TXQ_TEST_MAX_TX     32
+#define TXQ_TEST_MS         1000000ULL      /* ns */
+
+static netif_t txq_test_nif;
+static zbuf_t *txq_test_tx[TXQ_TEST_MAX_TX];
+static int txq_test_tx_count;
+
+static status_t txq_test_send(netif_t *nif, zbuf_t *zb)
+{
+    (void)nif;
+
+    if (txq_test_tx_count >= TXQ_TEST_MAX_TX) {
+        zbuf_free(zb);
+        return STATUS_NO_MEM;
+    }
+    txq_test_tx[txq_test_tx_count++] = zb;
+    return STATUS_OK;
+}
+
+/* The "device" finishes everything it holds */
+static void txq_test_complete(void)
+{
+    uint32_t bytes = 0;
+
+    for (int i = 0; i < txq_test_tx_count; i++) {
+        bytes += zbuf_pkt_len(txq_test_tx[i]);
+        zbuf_free(txq_test_tx[i]);
+    }
+    txq_test_tx_count = 0;
+    netif_tx_done(&txq_test_nif, bytes);
+}
+
+static void txq_test_setup(void)
+{
+    test_netif_init(&txq_test_nif, 0x10, TXQ_TEST_IP, 0xFFFFFF00, txq_test_send);
+
+    /* Room for two frames on the "ring" */
+    netif_txq_init(&txq_test_nif, 2 * TXQ_TEST_FRAME);
+    txq_test_tx_count = 0;
+    arp_init();
+}
+
+/* Spin until the driver holds count frames or the deadline passes */
+static void txq_test_wait_tx(int count, uint64_t deadline)
+{
+    while (txq_test_tx_count < count && timer_get_ns() < deadline) {
+        /* Released from the timer interrupt */
+    }
+}
+
+static void txq_test_teardown(void)
+{
+    /* Let scheduled frames go before the interface is reset */
+    uint64_t deadline = timer_get_ns() + 100 * TXQ_TEST_MS;
+    while (txq_test_nif.txq.tas.count > 0 && timer_get_ns() < deadline) {
+        /* Released from the timer interrupt */
+    }
+
+    /* Drain whatever is still queued */
+    for (int i = 0; i < 64 && txq_test_nif.txq.backlog + txq_test_tx_count > 0; i++) {
+        txq_test_complete();
+        netif_tx_run(&txq_test_nif);
+    }
+    txq_test_complete();
+    arp_init();
+}
+
+/* Payload byte 0 tags the frame; launch 0 sends now */
+static status_t txq_test_output_at(uint8_t tag, uint8_t pcp, uint64_t launch)
+{
+    zbuf_t *zb = zbuf_alloc_tx(TXQ_TEST_PAYLOAD);
+    if (zb == NULL) return STATUS_NO_MEM;
+
+    uint8_t *p = zbuf_put(zb, TXQ_TEST_PAYLOAD);
+    for (int i = 0; i < TXQ_TEST_PAYLOAD; i++) {
+        p[i] = tag;
+    }
+    zb->priority = pcp;
+    if (launch != 0) {
+        zb->timestamp = launch;
+        zb->flags |= ZBUF_F_TXTIME;
+    }
+
+    return eth_output(&txq_test_nif, zb, test_peer_mac, ETH_TYPE_IP);
+}
+
+static status_t txq_test_output(uint8_t tag, uint8_t pcp)
+{
+    return txq_test_output_at(tag, pcp, 0);
+}
+
+static uint8_t txq_test_tag(int i)
+{
+    return txq_test_tx[i]->data[txq_test_tx[i]->len - 1];
+}
+
+/*
+ * Test: Within the ring limit frames go straight to the driver
+ */
+TEST_CASE(txq_direct)
+{
+    TEST_ASSERT_EQ(txq_test_output(1, 0), STATUS_OK);
+    TEST_ASSERT_EQ(txq_test_output(2, 0), STATUS_OK);
+
+    TEST_ASSERT_EQ(txq_test_tx_count, 2);
+    TEST_ASSERT_EQ(txq_test_nif.txq.backlog, 0);
+    TEST_ASSERT_EQ(txq_test_nif.txq.inflight, 2 * TXQ_TEST_FRAME);
+
+    /* Ring full: the next one waits */
+    TEST_ASSERT_EQ(txq_test_output(3, 0), STATUS_OK);
+    TEST_ASSERT_EQ(txq_test_tx_count, 2);
+    TEST_ASSERT_EQ(txq_test_nif.txq.backlog, 1);
+
+    txq_test_complete();
+    TEST_ASSERT_EQ(txq_test_nif.txq.inflight, 0);
+    netif_tx_run(&txq_test_nif);
+    TEST_ASSERT_EQ(txq_test_tx_count, 1);
+    TEST_ASSERT_EQ(txq_test_tag(0), 3);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: An RT frame overtakes queued bulk traffic
+ */
+TEST_CASE(txq_strict_priority)
+{
+    txq_test_output(1, 0);
+    txq_test_output(2, 0);
+
+    /* Ring full: bulk, then an RT frame, then more bulk */
+    txq_test_output(3, 0);
+    txq_test_output(4, 0);
+    txq_test_output(5, 6);
+    txq_test_output(6, 2);
+    txq_test_output(7, 4);
+    TEST_ASSERT_EQ(txq_test_nif.txq.backlog, 5);
+
+    /* Highest band first, FIFO within a band */
+    static const uint8_t order[] = {5, 7, 6, 3, 4};
+    int next = 0;
+
+    while (next < (int)sizeof(order)) {
+        txq_test_complete();
+        netif_tx_run(&txq_test_nif);
+        TEST_ASSERT(txq_test_tx_count > 0);
+        for (int i = 0; i < txq_test_tx_count; i++) {
+            TEST_ASSERT_EQ(txq_test_tag(i), order[next]);
+            next++;
+        }
+    }
+    TEST_ASSERT_EQ(txq_test_nif.txq.backlog, 0);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: A full band drops without touching the others
+ */
+TEST_CASE(txq_band_limit)
+{
+    txq_test_output(1, 0);
+    txq_test_output(2, 0);
+
+    for (int i = 0; i < CONFIG_NET_TX_QUEUE_LEN; i++) {
+        TEST_ASSERT_EQ(txq_test_output(3, 0), STATUS_OK);
+    }
+    TEST_ASSERT_EQ(txq_test_output(4, 0), STATUS_NO_MEM);
+    TEST_ASSERT_EQ(txq_test_nif.txq.band[0].drops, 1);
+
+    /* The RT band still takes frames */
+    TEST_ASSERT_EQ(txq_test_output(5, 6), STATUS_OK);
+    TEST_ASSERT_EQ(txq_test_nif.txq.band[(6 * CONFIG_NET_TX_BANDS) >> 3].drops, 0);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: VLAN interfaces tag with the frame's PCP; priority tags use VID 0
+ */
+TEST_CASE(vlan_tag_insert)
+{
+    txq_test_nif.vlan_id = 100;
+    TEST_ASSERT_EQ(txq_test_output(1, 5), STATUS_OK);
+
+    zbuf_t *zb = txq_test_tx[0];
+    eth_hdr_t *eth = (eth_hdr_t *)zb->data;
+    vlan_hdr_t *vh = (vlan_hdr_t *)(eth + 1);
+    TEST_ASSERT_EQ(zb->len, TXQ_TEST_FRAME + VLAN_HDR_LEN);
+    TEST_ASSERT_EQ(ntohs(eth->type), ETH_TYPE_VLAN);
+    TEST_ASSERT_EQ(ntohs(vh->tci), (5 << VLAN_PCP_SHIFT) | 100);
+    TEST_ASSERT_EQ(ntohs(vh->type), ETH_TYPE_IP);
+
+    /* Untagged interface: tagged only on request */
+    txq_test_nif.vlan_id = 0;
+    txq_test_complete();
+    txq_test_output(2, 6);
+    TEST_ASSERT_EQ(ntohs(((eth_hdr_t *)txq_test_tx[0]->data)->type), ETH_TYPE_IP);
+
+    zb = zbuf_alloc_tx(TXQ_TEST_PAYLOAD);
+    zbuf_put(zb, TXQ_TEST_PAYLOAD);
+    zb->priority = 6;
+    zb->flags |= ZBUF_F_VLAN;
+    eth_output(&txq_test_nif, zb, test_peer_mac, ETH_TYPE_PNIO);
+
+    vh = (vlan_hdr_t *)(txq_test_tx[1]->data + ETH_HDR_LEN);
+    TEST_ASSERT_EQ(ntohs(vh->tci), 6 << VLAN_PCP_SHIFT);
+    TEST_ASSERT_EQ(ntohs(vh->type), ETH_TYPE_PNIO);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: Scheduled frames leave in launch order, never early
+ */
+TEST_CASE(tas_launch_order)
+{
+    netif_tas_stats_t stats;
+    uint64_t now = timer_get_ns();
+
+    TEST_ASSERT_EQ(txq_test_output_at(1, 6, now + 3 * TXQ_TEST_MS), STATUS_OK);
+    TEST_ASSERT_EQ(txq_test_output_at(2, 6, now + 1 * TXQ_TEST_MS), STATUS_OK);
+    TEST_ASSERT_EQ(txq_test_output_at(3, 6, now + 2 * TXQ_TEST_MS), STATUS_OK);
+    TEST_ASSERT_EQ(txq_test_tx_count, 0);
+    TEST_ASSERT_EQ(txq_test_nif.txq.tas.count, 3);
+
+    txq_test_wait_tx(3, now + 100 * TXQ_TEST_MS);
+    TEST_ASSERT_EQ(txq_test_tx_count, 3);
+
+    /* Each carries its release time */
+    static const uint8_t order[] = {2, 3, 1};
+    for (int i = 0; i < 3; i++) {
+        TEST_ASSERT_EQ(txq_test_tag(i), order[i]);
+        TEST_ASSERT(txq_test_tx[i]->timestamp >= now + (uint64_t)(i + 1) * TXQ_TEST_MS);
+        TEST_ASSERT((txq_test_tx[i]->flags & ZBUF_F_TXTIME) == 0);
+    }
+
+    netif_tas_get_stats(&txq_test_nif, &stats);
+    TEST_ASSERT_EQ(stats.sent, 3);
+    TEST_ASSERT(stats.jitter_min <= stats.jitter_max);
+    TEST_ASSERT(stats.jitter_sum >= stats.jitter_max);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: A launch time already past is refused
+ */
+TEST_CASE(tas_missed_launch)
+{
+    netif_tas_stats_t stats;
+    uint64_t errors = txq_test_nif.tx_errors;
+
+    TEST_ASSERT_EQ(txq_test_output_at(1, 6, timer_get_ns() - TXQ_TEST_MS),
+                   STATUS_TIMEOUT);
+    TEST_ASSERT_EQ(txq_test_nif.txq.tas.count, 0);
+    TEST_ASSERT_EQ(txq_test_tx_count, 0);
+    TEST_ASSERT_EQ(txq_test_nif.tx_errors, errors + 1);
+
+    netif_tas_get_stats(&txq_test_nif, &stats);
+    TEST_ASSERT_EQ(stats.missed, 1);
+    TEST_ASSERT_EQ(stats.sent, 0);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: Best-effort frames wait out the protected window; the top
+ * band does not
+ */
+TEST_CASE(tas_protected_window)
+{
+    netif_txq_init(&txq_test_nif, 8 * TXQ_TEST_FRAME);
+    txq_test_nif.txq.tas.guard_ns = 50 * TXQ_TEST_MS;
+
+    uint64_t launch = timer_get_ns() + 2 * TXQ_TEST_MS;
+    TEST_ASSERT_EQ(txq_test_output_at(1, 6, launch), STATUS_OK);
+
+    /* Inside the window from the start */
+    TEST_ASSERT_EQ(txq_test_output(2, 0), STATUS_OK);
+    TEST_ASSERT_EQ(txq_test_tx_count, 0);
+    TEST_ASSERT_EQ(txq_test_nif.txq.backlog, 1);
+
+    TEST_ASSERT_EQ(txq_test_output(3, 7), STATUS_OK);
+    TEST_ASSERT_EQ(txq_test_tx_count, 1);
+
+    /* Held frame follows the scheduled one */
+    txq_test_wait_tx(3, launch + 100 * TXQ_TEST_MS);
+    TEST_ASSERT_EQ(txq_test_tx_count, 3);
+    TEST_ASSERT_EQ(txq_test_tag(0), 3);
+    TEST_ASSERT_EQ(txq_test_tag(1), 1);
+    TEST_ASSERT_EQ(txq_test_tag(2), 2);
+    TEST_ASSERT_EQ(txq_test_nif.txq.backlog, 0);
+
+    return TEST_PASS;
+}
+
+/* Tagged ARP request from the peer */
+static void txq_test_arp_input(uint16_t tci)
+{
+    zbuf_t *zb = zbuf_alloc(ETH_HDR_LEN + VLAN_HDR_LEN + sizeof(arp_hdr_t));
+    if (zb == NULL) return;
+
+    eth_hdr_t *eth = (eth_hdr_t *)zbuf_put(zb, ETH_HDR_LEN);
+    for (int i = 0; i < 6; i++) {
+        eth->dst[i] = 0xFF;
+        eth->src[i] = test_peer_mac[i];
+    }
+    eth->type = htons(ETH_TYPE_VLAN);
+
+    vlan_hdr_t *vh = (vlan_hdr_t *)zbuf_put(zb, VLAN_HDR_LEN);
+    vh->tci = htons(tci);
+    vh->type = htons(ETH_TYPE_ARP);
+
+    arp_hdr_t *arp = (arp_hdr_t *)zbuf_put(zb, sizeof(arp_hdr_t));
+    arp->htype = htons(1);
+    arp->ptype = htons(ETH_TYPE_IP);
+    arp->hlen = 6;
+    arp->plen = 4;
+    arp->oper = htons(ARP_OP_REQUEST);
+    for (int i = 0; i < 6; i++) {
+        arp->sha[i] = test_peer_mac[i];
+        arp->tha[i] = 0;
+    }
+    arp->spa = htonl(TXQ_TEST_PEER);
+    arp->tpa = htonl(TXQ_TEST_IP);
+
+    netif_input(&txq_test_nif, zb);
+}
+
+/*
+ * Test: Tags are stripped on input; foreign VLANs are dropped
+ */
+TEST_CASE(vlan_strip)
+{
+    arp_stats_t stats;
+
+    txq_test_nif.vlan_id = 100;
+
+    /* Another VLAN: not seen by ARP */
+    txq_test_arp_input(VLAN_TCI(0, 200));
+    arp_get_stats(&stats);
+    TEST_ASSERT_EQ(stats.entries, 0);
+    TEST_ASSERT_EQ(txq_test_tx_count, 0);
+
+    /* Ours: learned and answered on the VLAN */
+    txq_test_arp_input(VLAN_TCI(3, 100));
+    arp_get_stats(&stats);
+    TEST_ASSERT_EQ(stats.entries, 1);
+    TEST_ASSERT_EQ(txq_test_tx_count, 1);
+
+    eth_hdr_t *eth = (eth_hdr_t *)txq_test_tx[0]->data;
+    vlan_hdr_t *vh = (vlan_hdr_t *)(eth + 1);
+    TEST_ASSERT_EQ(ntohs(eth->type), ETH_TYPE_VLAN);
+    TEST_ASSERT_EQ(ntohs(vh->tci) & VLAN_VID_MASK, 100);
+    TEST_ASSERT_EQ(ntohs(vh->type), ETH_TYPE_ARP);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test Suite Definition
+ */
+static test_case_t txq_tests[] = {
+    { "txq_direct", test_txq_direct },
+    { "txq_strict_priority", test_txq_strict_priority },
+    { "txq_band_limit", test_txq_band_limit },
+    { "tas_launch_order", test_tas_launch_order },
+    { "tas_missed_launch", test_tas_missed_launch },
+    { "tas_protected_window", test_tas_protected_window },
+    { "vlan_tag_insert", test_vlan_tag_insert },
+    { "vlan_strip", test_vlan_strip },
+};
+
+test_suite_t txq_test_suite = {
+    .name = "VLAN and TX Queues",
+    .tests = txq_tests,
+    .test_count = sizeof(txq_tests) / sizeof(test_case_t),
+    .setup = txq_test_setup,
+    .teardown = txq_test_teardown
+};
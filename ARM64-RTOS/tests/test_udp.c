@@ -0,0 +1,218 @@
+/*
+ * Gracemont Industrial Control Framework - ARM64 RTOS
+ * Copyright (C) 2024 Zixiao System <https://github.com/Zixiao-System>
+ *
+ * This file is part of Gracemont Industrial Control Framework.
+ * Repository: https://github.com/Zixiao-System/gracemont
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ *
+ * UDP Socket Unit Tests
+ */
+
+#include "test_framework.h"
+#include "net_stack.h"
+#include "test_net.h"
+
+#define UDP_TEST_IP         0x0A000001      /* 10.0.0.1 (us) */
+#define UDP_TEST_PEER       0x0A000002      /* Two senders: PEER, PEER + 1 */
+#define UDP_TEST_PORT       4840
+#define UDP_TEST_BATCH      4
+
+static netif_t udp_test_nif;
+static int udp_test_fd;
+
+static void udp_test_setup(void)
+{
+    sockaddr_t addr = { .addr = UDP_TEST_IP, .port = UDP_TEST_PORT };
+
+    test_netif_init(&udp_test_nif, 0x10, UDP_TEST_IP, 0xFFFFFF00, test_net_send);
+
+    zbuf_queue_init(&test_net_wire);
+    arp_init();
+    route_init();
+    route_iface_update(&udp_test_nif);
+    test_arp_peer(&udp_test_nif, test_peer_mac, UDP_TEST_PEER);
+    test_arp_peer(&udp_test_nif, test_peer_mac, UDP_TEST_PEER + 1);
+
+    udp_test_fd = sock_socket(SOCK_DGRAM);
+    if (udp_test_fd >= 0) {
+        sock_bind(udp_test_fd, &addr);
+    }
+}
+
+static void udp_test_teardown(void)
+{
+    if (udp_test_fd >= 0) {
+        sock_close(udp_test_fd);
+    }
+    zbuf_queue_flush(&test_net_wire);
+    arp_init();
+    route_init();
+}
+
+/* Datagram of len bytes, each byte tag, from peer i at sport */
+static void udp_test_input(int i, uint16_t sport, uint16_t len, uint8_t tag)
+{
+    uint16_t total = sizeof(ip_hdr_t) + UDP_HDR_LEN + len;
+    zbuf_t *zb = zbuf_alloc(ETH_HDR_LEN + total);
+    if (zb == NULL) return;
+
+    eth_hdr_t *eth = (eth_hdr_t *)zbuf_put(zb, ETH_HDR_LEN);
+    for (int j = 0; j < 6; j++) {
+        eth->dst[j] = udp_test_nif.mac[j];
+        eth->src[j] = test_peer_mac[j];
+    }
+    eth->type = htons(ETH_TYPE_IP);
+
+    ip_hdr_t *ip = (ip_hdr_t *)zbuf_put(zb, total);
+    ip->ver_ihl = 0x45;
+    ip->tos = 0;
+    ip->len = htons(total);
+    ip->id = 0;
+    ip->frag = 0;
+    ip->ttl = 64;
+    ip->proto = IP_PROTO_UDP;
+    ip->src = htonl(UDP_TEST_PEER + i);
+    ip->dst = htonl(UDP_TEST_IP);
+    ip->checksum = 0;
+    ip->checksum = inet_checksum(ip, sizeof(ip_hdr_t));
+
+    udp_hdr_t *udp = (udp_hdr_t *)(ip + 1);
+    udp->sport = htons(sport);
+    udp->dport = htons(UDP_TEST_PORT);
+    udp->len = htons(UDP_HDR_LEN + len);
+    udp->checksum = 0;
+
+    uint8_t *p = (uint8_t *)(udp + 1);
+    for (uint16_t j = 0; j < len; j++) {
+        p[j] = tag;
+    }
+
+    netif_input(&udp_test_nif, zb);
+}
+
+/*
+ * Test: Each datagram keeps its own sender
+ */
+TEST_CASE(udp_recvfrom_source)
+{
+    uint8_t buf[16];
+    sockaddr_t src;
+
+    TEST_ASSERT(udp_test_fd >= 0);
+
+    /* Both in flight before either is read */
+    udp_test_input(0, 1000, 4, 0xA0);
+    udp_test_input(1, 2000, 6, 0xB0);
+
+    TEST_ASSERT_EQ(sock_recvfrom(udp_test_fd, buf, sizeof(buf), &src), 4);
+    TEST_ASSERT_EQ(src.addr, UDP_TEST_PEER);
+    TEST_ASSERT_EQ(src.port, 1000);
+    TEST_ASSERT_EQ(buf[0], 0xA0);
+
+    TEST_ASSERT_EQ(sock_recvfrom(udp_test_fd, buf, sizeof(buf), &src), 6);
+    TEST_ASSERT_EQ(src.addr, UDP_TEST_PEER + 1);
+    TEST_ASSERT_EQ(src.port, 2000);
+    TEST_ASSERT_EQ(buf[0], 0xB0);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: Batches come off the socket as buffers, with their metadata
+ */
+TEST_CASE(udp_recvmmsg_zbuf)
+{
+    zbuf_t *zbs[UDP_TEST_BATCH];
+
+    TEST_ASSERT(udp_test_fd >= 0);
+    TEST_ASSERT_EQ(sock_setopt(udp_test_fd, SO_NONBLOCK, 1), 0);
+    TEST_ASSERT_EQ(sock_recvmmsg_zbuf(udp_test_fd, zbs, UDP_TEST_BATCH), -1);
+
+    for (int i = 0; i < UDP_TEST_BATCH + 1; i++) {
+        udp_test_input(i & 1, (uint16_t)(1000 + i), (uint16_t)(10 + i), (uint8_t)i);
+    }
+
+    TEST_ASSERT_EQ(sock_recvmmsg_zbuf(udp_test_fd, zbs, UDP_TEST_BATCH), UDP_TEST_BATCH);
+    for (int i = 0; i < UDP_TEST_BATCH; i++) {
+        TEST_ASSERT_EQ(zbs[i]->len, 10 + i);
+        TEST_ASSERT_EQ(zbs[i]->data[0], i);
+        TEST_ASSERT_EQ(zbs[i]->peer_addr, UDP_TEST_PEER + (uint32_t)(i & 1));
+        TEST_ASSERT_EQ(zbs[i]->peer_port, 1000 + i);
+        TEST_ASSERT(zbs[i]->timestamp != 0);
+        zbuf_free(zbs[i]);
+    }
+
+    TEST_ASSERT_EQ(sock_recvmmsg_zbuf(udp_test_fd, zbs, UDP_TEST_BATCH), 1);
+    TEST_ASSERT_EQ(zbs[0]->peer_port, 1000 + UDP_TEST_BATCH);
+    zbuf_free(zbs[0]);
+    TEST_ASSERT_EQ(sock_recvmmsg_zbuf(udp_test_fd, zbs, UDP_TEST_BATCH), -1);
+
+    return TEST_PASS;
+}
+
+/*
+ * Test: A batch goes out to each buffer's own destination
+ */
+TEST_CASE(udp_sendmmsg_zbuf)
+{
+    zbuf_t *zbs[2];
+
+    TEST_ASSERT(udp_test_fd >= 0);
+
+    for (int i = 0; i < 2; i++) {
+        zbs[i] = zbuf_alloc_tx(8);
+        TEST_ASSERT_NOT_NULL(zbs[i]);
+        zbuf_put(zbs[i], 8);
+        zbs[i]->peer_addr = UDP_TEST_PEER + i;
+        zbs[i]->peer_port = (uint16_t)(3000 + i);
+    }
+    TEST_ASSERT_EQ(sock_sendmmsg_zbuf(udp_test_fd, zbs, 2), 2);
+    TEST_ASSERT_EQ(zbuf_queue_len(&test_net_wire), 2);
+
+    for (int i = 0; i < 2; i++) {
+        zbuf_t *zb = zbuf_queue_pop(&test_net_wire);
+        TEST_ASSERT_NOT_NULL(zb);
+        ip_hdr_t *ip = (ip_hdr_t *)(zb->data + ETH_HDR_LEN);
+        udp_hdr_t *udp = (udp_hdr_t *)(ip + 1);
+        TEST_ASSERT_EQ(ntohl(ip->dst), UDP_TEST_PEER + (uint32_t)i);
+        TEST_ASSERT_EQ(ntohs(udp->sport), UDP_TEST_PORT);
+        TEST_ASSERT_EQ(ntohs(udp->dport), 3000 + i);
+        TEST_ASSERT_EQ(ntohs(udp->len), UDP_HDR_LEN + 8);
+        zbuf_free(zb);
+    }
+
+    return TEST_PASS;
+}
+
+/*
+ * Test Suite Definition
+ */
+static test_case_t udp_tests[] = {
+    { "udp_recvfrom_source", test_udp_recvfrom_source },
+    { "udp_recvmmsg_zbuf", test_udp_recvmmsg_zbuf },
+    { "udp_sendmmsg_zbuf", test_udp_sendmmsg_zbuf },
+};
+
+test_suite_t udp_test_suite = {
+    .name = "UDP",
+    .tests = udp_tests,
+    .test_count = sizeof(udp_tests) / sizeof(test_case_t),
+    .setup = udp_test_setup,
+    .teardown = udp_test_teardown
+};
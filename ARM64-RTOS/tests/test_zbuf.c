@@ -24,6 +24,7 @@
  */
 
 #include "test_framework.h"
+#include "rtos.h"
 #include "zbuf.h"
 
 /*
@@ -229,6 +230,129 @@ TEST_CASE(zbuf_reserve_headroom)
     return TEST_PASS;
 }
 
+/*
+ * Test: Peak usage watermark
+ */
+TEST_CASE(zbuf_peak_watermark)
+{
+    zbuf_pool_reset_peak();
+    uint32_t base = zbuf_pool_peak();
+
+    zbuf_t *a = zbuf_alloc_tx(64);
+    zbuf_t *b = zbuf_alloc_tx(64);
+    TEST_ASSERT_NOT_NULL(a);
+    TEST_ASSERT_NOT_NULL(b);
+    TEST_ASSERT_EQ(zbuf_pool_peak(), base + 2);
+
+    zbuf_free(a);
+    zbuf_free(b);
+
+    /* Watermark survives the frees */
+    TEST_ASSERT_EQ(zbuf_pool_peak(), base + 2);
+    return TEST_PASS;
+}
+
+/*
+ * Test: Live buffer census
+ */
+TEST_CASE(zbuf_census_live)
+{
+    zbuf_census_t before, after;
+
+    zbuf_census(&before);
+    TEST_ASSERT_EQ(before.free + before.live, before.total);
+
+    zbuf_t *zb = zbuf_alloc_tx(64);
+    TEST_ASSERT_NOT_NULL(zb);
+    zbuf_set_owner(zb, ZBUF_OWNER_APP);
+
+    zbuf_census(&after);
+    TEST_ASSERT_EQ(after.live, before.live + 1);
+    TEST_ASSERT_EQ(after.free, before.free - 1);
+#if CONFIG_ZBUF_DEBUG
+    TEST_ASSERT_EQ(after.by_owner[ZBUF_OWNER_APP],
+                   before.by_owner[ZBUF_OWNER_APP] + 1);
+#endif
+
+    zbuf_free(zb);
+
+    zbuf_census(&after);
+    TEST_ASSERT_EQ(after.live, before.live);
+    return TEST_PASS;
+}
+
+/*
+ * Test: Leak report names the allocation site
+ */
+TEST_CASE(zbuf_leak_site)
+{
+#if CONFIG_ZBUF_DEBUG
+    /* Room for every buffer: min_age 0 also reports the RX ring's */
+    uint32_t max = zbuf_pool.total_count;
+    zbuf_leak_t *leaks = (zbuf_leak_t *)heap_alloc(max * sizeof(zbuf_leak_t));
+    TEST_ASSERT_NOT_NULL(leaks);
+
+    const uint16_t line = __LINE__ + 1;
+    zbuf_t *zb = zbuf_alloc_tx(64);
+    TEST_ASSERT_NOT_NULL(zb);
+    zbuf_set_owner(zb, ZBUF_OWNER_APP);
+
+    uint32_t n = zbuf_leak_report(0, leaks, max);
+    zbuf_leak_t *entry = NULL;
+    for (uint32_t i = 0; i < n && i < max; i++) {
+        if (leaks[i].zb == zb) {
+            entry = &leaks[i];
+        }
+    }
+    TEST_ASSERT_NOT_NULL(entry);
+    TEST_ASSERT_EQ(entry->owner, ZBUF_OWNER_APP);
+    TEST_ASSERT(entry->site == __func__);
+    TEST_ASSERT_EQ(entry->line, line);
+
+    heap_free(leaks);
+    zbuf_free(zb);
+    return TEST_PASS;
+#else
+    return TEST_SKIP;
+#endif
+}
+
+/*
+ * Test: Multi-buffer packet is measured and freed as one
+ */
+TEST_CASE(zbuf_frag_chain)
+{
+    zbuf_census_t before, after;
+
+    zbuf_census(&before);
+
+    zbuf_t *head = zbuf_alloc_tx(64);
+    zbuf_t *f1 = zbuf_alloc_tx(64);
+    zbuf_t *f2 = zbuf_alloc_tx(64);
+    TEST_ASSERT_NOT_NULL(head);
+    TEST_ASSERT_NOT_NULL(f1);
+    TEST_ASSERT_NOT_NULL(f2);
+
+    zbuf_put(head, 40);
+    zbuf_put(f1, 1000);
+    zbuf_put(f2, 17);
+    head->frag = f1;
+    f1->frag = f2;
+
+    TEST_ASSERT_EQ(zbuf_pkt_len(head), 1057);
+
+    /* A held reference keeps the whole chain */
+    zbuf_ref(head);
+    zbuf_free(head);
+    zbuf_census(&after);
+    TEST_ASSERT_EQ(after.live, before.live + 3);
+
+    zbuf_free(head);
+    zbuf_census(&after);
+    TEST_ASSERT_EQ(after.live, before.live);
+    return TEST_PASS;
+}
+
 /*
  * Test Suite Definition
  */
@@ -241,6 +365,10 @@ static test_case_t zbuf_tests[] = {
     { "zbuf_queue_basic", test_zbuf_queue_basic },
     { "zbuf_clone_basic", test_zbuf_clone_basic },
     { "zbuf_reserve_headroom", test_zbuf_reserve_headroom },
+    { "zbuf_peak_watermark", test_zbuf_peak_watermark },
+    { "zbuf_census_live", test_zbuf_census_live },
+    { "zbuf_leak_site", test_zbuf_leak_site },
+    { "zbuf_frag_chain", test_zbuf_frag_chain },
 };
 
 test_suite_t zbuf_test_suite = {
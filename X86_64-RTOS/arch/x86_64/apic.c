@@ -77,7 +77,7 @@ void apic_init(void)
 
     /* Get base address (bits 12-35, page aligned) */
     uint64_t base_phys = apic_msr & 0xFFFFFF000UL;
-    lapic_base = (volatile uint32_t*)base_phys;
+    lapic_base = (volatile uint32_t*)mmu_map_mmio(base_phys, PAGE_SIZE_4K);
 
     /* Set up Spurious Interrupt Vector Register */
     /* Enable APIC and set spurious vector to 255 */
@@ -106,7 +106,7 @@ void ioapic_init(void)
 {
     /* Use default I/O APIC base address */
     /* In a real system, this would come from ACPI MADT table */
-    ioapic_base = (volatile uint32_t*)IOAPIC_DEFAULT_BASE;
+    ioapic_base = (volatile uint32_t*)mmu_map_mmio(IOAPIC_DEFAULT_BASE, PAGE_SIZE_4K);
 
     /* Read I/O APIC version to verify it's present */
     uint32_t ver = ioapic_read(IOAPIC_VER);
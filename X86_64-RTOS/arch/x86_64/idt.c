@@ -67,6 +67,24 @@ extern void isr45(void);
 extern void isr46(void);
 extern void isr47(void);
 
+/* MSI/MSI-X vector stubs (64-79) */
+extern void isr64(void);
+extern void isr65(void);
+extern void isr66(void);
+extern void isr67(void);
+extern void isr68(void);
+extern void isr69(void);
+extern void isr70(void);
+extern void isr71(void);
+extern void isr72(void);
+extern void isr73(void);
+extern void isr74(void);
+extern void isr75(void);
+extern void isr76(void);
+extern void isr77(void);
+extern void isr78(void);
+extern void isr79(void);
+
 /* APIC vectors */
 extern void isr255(void);  /* Spurious */
 
@@ -184,6 +202,24 @@ void idt_init(void)
     idt_set_gate(46, (uint64_t)isr46, GDT_KERNEL_CODE, IDT_TYPE_INTERRUPT);
     idt_set_gate(47, (uint64_t)isr47, GDT_KERNEL_CODE, IDT_TYPE_INTERRUPT);
 
+    /* MSI/MSI-X vectors (64-79) */
+    idt_set_gate(64, (uint64_t)isr64, GDT_KERNEL_CODE, IDT_TYPE_INTERRUPT);
+    idt_set_gate(65, (uint64_t)isr65, GDT_KERNEL_CODE, IDT_TYPE_INTERRUPT);
+    idt_set_gate(66, (uint64_t)isr66, GDT_KERNEL_CODE, IDT_TYPE_INTERRUPT);
+    idt_set_gate(67, (uint64_t)isr67, GDT_KERNEL_CODE, IDT_TYPE_INTERRUPT);
+    idt_set_gate(68, (uint64_t)isr68, GDT_KERNEL_CODE, IDT_TYPE_INTERRUPT);
+    idt_set_gate(69, (uint64_t)isr69, GDT_KERNEL_CODE, IDT_TYPE_INTERRUPT);
+    idt_set_gate(70, (uint64_t)isr70, GDT_KERNEL_CODE, IDT_TYPE_INTERRUPT);
+    idt_set_gate(71, (uint64_t)isr71, GDT_KERNEL_CODE, IDT_TYPE_INTERRUPT);
+    idt_set_gate(72, (uint64_t)isr72, GDT_KERNEL_CODE, IDT_TYPE_INTERRUPT);
+    idt_set_gate(73, (uint64_t)isr73, GDT_KERNEL_CODE, IDT_TYPE_INTERRUPT);
+    idt_set_gate(74, (uint64_t)isr74, GDT_KERNEL_CODE, IDT_TYPE_INTERRUPT);
+    idt_set_gate(75, (uint64_t)isr75, GDT_KERNEL_CODE, IDT_TYPE_INTERRUPT);
+    idt_set_gate(76, (uint64_t)isr76, GDT_KERNEL_CODE, IDT_TYPE_INTERRUPT);
+    idt_set_gate(77, (uint64_t)isr77, GDT_KERNEL_CODE, IDT_TYPE_INTERRUPT);
+    idt_set_gate(78, (uint64_t)isr78, GDT_KERNEL_CODE, IDT_TYPE_INTERRUPT);
+    idt_set_gate(79, (uint64_t)isr79, GDT_KERNEL_CODE, IDT_TYPE_INTERRUPT);
+
     /* APIC Spurious vector */
     idt_set_gate(255, (uint64_t)isr255, GDT_KERNEL_CODE, IDT_TYPE_INTERRUPT);
 
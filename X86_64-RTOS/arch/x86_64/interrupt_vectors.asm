@@ -95,6 +95,23 @@ ISR_NOERRCODE 45                ; IRQ 13 - FPU
 ISR_NOERRCODE 46                ; IRQ 14 - Primary ATA
 ISR_NOERRCODE 47                ; IRQ 15 - Secondary ATA
 
+ISR_NOERRCODE 64                ; MSI/MSI-X vectors
+ISR_NOERRCODE 65
+ISR_NOERRCODE 66
+ISR_NOERRCODE 67
+ISR_NOERRCODE 68
+ISR_NOERRCODE 69
+ISR_NOERRCODE 70
+ISR_NOERRCODE 71
+ISR_NOERRCODE 72
+ISR_NOERRCODE 73
+ISR_NOERRCODE 74
+ISR_NOERRCODE 75
+ISR_NOERRCODE 76
+ISR_NOERRCODE 77
+ISR_NOERRCODE 78
+ISR_NOERRCODE 79
+
 ; Additional vectors for APIC
 ISR_NOERRCODE 255               ; APIC Spurious
 
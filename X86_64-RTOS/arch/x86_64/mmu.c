@@ -21,6 +21,11 @@ extern uint64_t pd_table[];
 /* Additional page tables for dynamic mapping */
 static uint64_t kernel_pt_table[512] __attribute__((aligned(4096)));
 
+/* Page directories for device memory above the boot identity map */
+#define MMIO_PD_TABLES  4
+static uint64_t mmio_pd_tables[MMIO_PD_TABLES][512] __attribute__((aligned(4096)));
+static uint32_t mmio_pd_used = 0;
+
 /* ============================================================================
  * MMU Initialization
  * ============================================================================ */
@@ -142,6 +147,47 @@ void mmu_unmap_page(uint64_t virt)
     mmu_flush_page((void*)virt);
 }
 
+/*
+ * Identity-map a device memory range (PCI BARs, APIC registers) as
+ * uncached 2MB pages. The boot tables only cover the first 2GB, while
+ * the APICs and firmware-assigned BARs live just below 4GB or above it.
+ * Returns the virtual address, or NULL when no page directory is left.
+ */
+void *mmu_map_mmio(uint64_t phys, uint64_t size)
+{
+    uint64_t start = phys & ~(PAGE_SIZE_2M - 1);
+    uint64_t end = phys + size;
+    uint64_t *pdpt = (uint64_t*)(pml4_table[0] & PTE_ADDR_MASK);
+
+    if (size == 0 || PML4_INDEX(end - 1) != 0) {
+        return NULL;    /* Only the first 512GB share pml4_table[0] */
+    }
+
+    for (uint64_t addr = start; addr < end; addr += PAGE_SIZE_2M) {
+        uint64_t pdpt_idx = PDPT_INDEX(addr);
+
+        if (!(pdpt[pdpt_idx] & PTE_PRESENT)) {
+            if (mmio_pd_used == MMIO_PD_TABLES) {
+                return NULL;
+            }
+            uint64_t *pd = mmio_pd_tables[mmio_pd_used++];
+            pdpt[pdpt_idx] = (uint64_t)pd | PTE_PRESENT | PTE_WRITABLE;
+        }
+
+        uint64_t *pd = (uint64_t*)(pdpt[pdpt_idx] & PTE_ADDR_MASK);
+        uint64_t pd_idx = PD_INDEX(addr);
+
+        /* RAM below 2GB is already mapped write-back; leave it alone */
+        if (!(pd[pd_idx] & PTE_PRESENT)) {
+            pd[pd_idx] = addr | PTE_PRESENT | PTE_WRITABLE | PTE_HUGE |
+                         PTE_PCD | PTE_PWT;
+            mmu_flush_page((void*)addr);
+        }
+    }
+
+    return (void*)phys;
+}
+
 uint64_t mmu_get_phys(uint64_t virt)
 {
     uint64_t pml4_idx = PML4_INDEX(virt);
@@ -0,0 +1,223 @@
+/*
+ * Gracemont X86_64 RTOS - PCI Support
+ * Copyright (C) 2024 Zixiao System
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "x86_64/pci.h"
+#include "x86_64/apic.h"
+#include "x86_64/cpu.h"
+#include "x86_64/paging.h"
+#include "rtos_types.h"
+
+/* ============================================================================
+ * Configuration Space Access
+ * ============================================================================ */
+
+static spinlock_t pci_lock = SPINLOCK_INIT;
+
+static inline uint32_t pci_address(const pci_dev_t *pdev, uint8_t off)
+{
+    return 0x80000000U |
+           ((uint32_t)pdev->bus << 16) |
+           ((uint32_t)pdev->dev << 11) |
+           ((uint32_t)pdev->fn << 8) |
+           (off & 0xFC);
+}
+
+uint32_t pci_read32(const pci_dev_t *pdev, uint8_t off)
+{
+    spin_lock_irq(&pci_lock);
+    outl(PCI_CONFIG_ADDRESS, pci_address(pdev, off));
+    uint32_t val = inl(PCI_CONFIG_DATA);
+    spin_unlock_irq(&pci_lock);
+    return val;
+}
+
+uint16_t pci_read16(const pci_dev_t *pdev, uint8_t off)
+{
+    return (uint16_t)(pci_read32(pdev, off) >> ((off & 2) * 8));
+}
+
+uint8_t pci_read8(const pci_dev_t *pdev, uint8_t off)
+{
+    return (uint8_t)(pci_read32(pdev, off) >> ((off & 3) * 8));
+}
+
+void pci_write32(const pci_dev_t *pdev, uint8_t off, uint32_t val)
+{
+    spin_lock_irq(&pci_lock);
+    outl(PCI_CONFIG_ADDRESS, pci_address(pdev, off));
+    outl(PCI_CONFIG_DATA, val);
+    spin_unlock_irq(&pci_lock);
+}
+
+void pci_write16(const pci_dev_t *pdev, uint8_t off, uint16_t val)
+{
+    spin_lock_irq(&pci_lock);
+    outl(PCI_CONFIG_ADDRESS, pci_address(pdev, off));
+    outw(PCI_CONFIG_DATA + (off & 2), val);
+    spin_unlock_irq(&pci_lock);
+}
+
+/* ============================================================================
+ * Enumeration
+ * ============================================================================ */
+
+bool pci_find_device(uint16_t vendor, uint16_t device, pci_dev_t *pdev)
+{
+    /* Brute-force scan; QEMU q35/i440fx put everything on bus 0 */
+    for (uint32_t bus = 0; bus < 256; bus++) {
+        for (uint32_t dev = 0; dev < 32; dev++) {
+            for (uint32_t fn = 0; fn < 8; fn++) {
+                pdev->bus = (uint8_t)bus;
+                pdev->dev = (uint8_t)dev;
+                pdev->fn = (uint8_t)fn;
+
+                uint32_t id = pci_read32(pdev, PCI_VENDOR_ID);
+                if ((id & 0xFFFF) == 0xFFFF) {
+                    if (fn == 0) {
+                        break;  /* No device in this slot */
+                    }
+                    continue;
+                }
+
+                if ((id & 0xFFFF) == vendor && (id >> 16) == device) {
+                    pdev->vendor = vendor;
+                    pdev->device = device;
+                    pdev->msix_cap = 0;
+                    pdev->msix_count = 0;
+                    pdev->msix_table = NULL;
+                    return true;
+                }
+
+                /* Single-function device: skip functions 1-7 */
+                if (fn == 0 && !(pci_read8(pdev, PCI_HEADER_TYPE) & 0x80)) {
+                    break;
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+uint8_t pci_find_cap(const pci_dev_t *pdev, uint8_t cap_id, uint8_t start)
+{
+    if (!(pci_read16(pdev, PCI_STATUS) & PCI_STATUS_CAP_LIST)) {
+        return 0;
+    }
+
+    /* start == 0 begins at the head, otherwise continues after start */
+    uint8_t pos = start ? pci_read8(pdev, start + 1) : pci_read8(pdev, PCI_CAP_PTR);
+
+    /* Bound the walk in case of a looping list */
+    for (uint32_t i = 0; i < 48 && pos >= 0x40; i++) {
+        pos &= 0xFC;
+        if (pci_read8(pdev, pos) == cap_id) {
+            return pos;
+        }
+        pos = pci_read8(pdev, pos + 1);
+    }
+
+    return 0;
+}
+
+uint64_t pci_bar_addr(const pci_dev_t *pdev, uint32_t bar)
+{
+    uint8_t off = (uint8_t)(PCI_BAR0 + bar * 4);
+    uint32_t lo = pci_read32(pdev, off);
+
+    if (lo & PCI_BAR_IO) {
+        return 0;
+    }
+
+    uint64_t addr = lo & PCI_BAR_MEM_MASK;
+    if ((lo & 0x6) == PCI_BAR_MEM64) {
+        addr |= (uint64_t)pci_read32(pdev, off + 4) << 32;
+    }
+
+    return addr;
+}
+
+void pci_enable_master(const pci_dev_t *pdev)
+{
+    uint16_t cmd = pci_read16(pdev, PCI_COMMAND);
+    cmd |= PCI_COMMAND_MEMORY | PCI_COMMAND_MASTER | PCI_COMMAND_INTX_OFF;
+    pci_write16(pdev, PCI_COMMAND, cmd);
+}
+
+/* ============================================================================
+ * MSI-X
+ * ============================================================================ */
+
+bool pci_msix_init(pci_dev_t *pdev)
+{
+    uint8_t cap = pci_find_cap(pdev, PCI_CAP_ID_MSIX, 0);
+    if (cap == 0) {
+        return false;
+    }
+
+    uint16_t ctrl = pci_read16(pdev, cap + PCI_MSIX_CTRL);
+    uint32_t table = pci_read32(pdev, cap + PCI_MSIX_TABLE);
+    uint64_t bar = pci_bar_addr(pdev, table & PCI_MSIX_BIR_MASK);
+    if (bar == 0) {
+        return false;
+    }
+
+    pdev->msix_cap = cap;
+    pdev->msix_count = (ctrl & PCI_MSIX_CTRL_SIZE) + 1;
+    pdev->msix_table = (volatile uint32_t*)mmu_map_mmio(
+        bar + (table & ~PCI_MSIX_BIR_MASK),
+        (uint64_t)pdev->msix_count * PCI_MSIX_ENTRY_SIZE);
+    if (pdev->msix_table == NULL) {
+        return false;
+    }
+
+    /* Start with every entry masked; drivers unmask what they program */
+    for (uint16_t i = 0; i < pdev->msix_count; i++) {
+        pci_msix_mask(pdev, i, true);
+    }
+
+    return true;
+}
+
+void pci_msix_enable(pci_dev_t *pdev, bool enable)
+{
+    uint16_t ctrl = pci_read16(pdev, pdev->msix_cap + PCI_MSIX_CTRL);
+
+    ctrl &= ~PCI_MSIX_CTRL_MASKALL;
+    if (enable) {
+        ctrl |= PCI_MSIX_CTRL_ENABLE;
+    } else {
+        ctrl &= ~PCI_MSIX_CTRL_ENABLE;
+    }
+
+    pci_write16(pdev, pdev->msix_cap + PCI_MSIX_CTRL, ctrl);
+}
+
+void pci_msix_set_entry(pci_dev_t *pdev, uint16_t entry, uint32_t vector)
+{
+    volatile uint32_t *e = pdev->msix_table + entry * (PCI_MSIX_ENTRY_SIZE / 4);
+
+    /* Fixed delivery, edge, physical destination: the boot CPU */
+    e[PCI_MSIX_ENTRY_ADDR_LO / 4] = PCI_MSI_ADDR_BASE | PCI_MSI_ADDR_DEST(lapic_get_id());
+    e[PCI_MSIX_ENTRY_ADDR_HI / 4] = 0;
+    e[PCI_MSIX_ENTRY_DATA / 4] = vector & 0xFF;
+}
+
+void pci_msix_mask(pci_dev_t *pdev, uint16_t entry, bool masked)
+{
+    volatile uint32_t *e = pdev->msix_table + entry * (PCI_MSIX_ENTRY_SIZE / 4);
+    uint32_t ctrl = e[PCI_MSIX_ENTRY_CTRL / 4];
+
+    if (masked) {
+        ctrl |= PCI_MSIX_ENTRY_MASKED;
+    } else {
+        ctrl &= ~PCI_MSIX_ENTRY_MASKED;
+    }
+
+    e[PCI_MSIX_ENTRY_CTRL / 4] = ctrl;
+    (void)e[PCI_MSIX_ENTRY_CTRL / 4];   /* Flush posted write */
+}
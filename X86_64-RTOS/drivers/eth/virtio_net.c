@@ -0,0 +1,1735 @@
+/*
+ * Gracemont Industrial Control Framework - X86_64 RTOS
+ * Copyright (C) 2024 Zixiao System <https://github.com/Zixiao-System>
+ *
+ * This file is part of Gracemont Industrial Control Framework.
+ * Repository: https://github.com/Zixiao-System/gracemont
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * Virtio Network Driver for X86_64 (virtio-net-pci, MSI-X)
+ */
+
+#define ZBUF_OWNER  ZBUF_OWNER_ETH
+
+#include "eth.h"
+#include "rtos_config.h"
+#include "rtos.h"
+#include "zbuf.h"
+#include "net_stack.h"
+#include "x86_64/cpu.h"
+#include "x86_64/paging.h"
+#include "x86_64/pci.h"
+
+/*
+ * Virtio PCI Modern Transport
+ *
+ * The device describes its register blocks with vendor capabilities,
+ * each naming a BAR and an offset into it.
+ */
+#define VIRTIO_PCI_VENDOR           0x1AF4
+#define VIRTIO_PCI_DEV_NET          0x1041      /* Modern only */
+#define VIRTIO_PCI_DEV_NET_LEGACY   0x1000      /* Transitional */
+
+#define VIRTIO_PCI_CAP_CFG_TYPE     3
+#define VIRTIO_PCI_CAP_BAR          4
+#define VIRTIO_PCI_CAP_OFFSET       8
+#define VIRTIO_PCI_CAP_LENGTH       12
+#define VIRTIO_PCI_NOTIFY_MULT      16
+
+#define VIRTIO_PCI_CAP_COMMON_CFG   1
+#define VIRTIO_PCI_CAP_NOTIFY_CFG   2
+#define VIRTIO_PCI_CAP_ISR_CFG      3
+#define VIRTIO_PCI_CAP_DEVICE_CFG   4
+
+/*
+ * Common Configuration Structure
+ */
+#define VIRTIO_PCI_DEVICE_FEATURE_SEL   0x00
+#define VIRTIO_PCI_DEVICE_FEATURE       0x04
+#define VIRTIO_PCI_DRIVER_FEATURE_SEL   0x08
+#define VIRTIO_PCI_DRIVER_FEATURE       0x0C
+#define VIRTIO_PCI_CONFIG_MSIX_VECTOR   0x10
+#define VIRTIO_PCI_NUM_QUEUES           0x12
+#define VIRTIO_PCI_DEVICE_STATUS        0x14
+#define VIRTIO_PCI_CONFIG_GENERATION    0x15
+#define VIRTIO_PCI_QUEUE_SELECT         0x16
+#define VIRTIO_PCI_QUEUE_SIZE           0x18
+#define VIRTIO_PCI_QUEUE_MSIX_VECTOR    0x1A
+#define VIRTIO_PCI_QUEUE_ENABLE         0x1C
+#define VIRTIO_PCI_QUEUE_NOTIFY_OFF     0x1E
+#define VIRTIO_PCI_QUEUE_DESC           0x20
+#define VIRTIO_PCI_QUEUE_DRIVER         0x28
+#define VIRTIO_PCI_QUEUE_DEVICE         0x30
+
+#define VIRTIO_MSI_NO_VECTOR        0xFFFF
+
+/*
+ * Virtio Status Bits
+ */
+#define VIRTIO_STATUS_ACK           1
+#define VIRTIO_STATUS_DRIVER        2
+#define VIRTIO_STATUS_DRIVER_OK     4
+#define VIRTIO_STATUS_FEATURES_OK   8
+#define VIRTIO_STATUS_FAILED        128
+
+/*
+ * Virtio Net Features
+ */
+#define VIRTIO_NET_F_CSUM           (1ULL << 0)
+#define VIRTIO_NET_F_GUEST_CSUM     (1ULL << 1)
+#define VIRTIO_NET_F_MAC            (1ULL << 5)
+#define VIRTIO_NET_F_HOST_TSO4      (1ULL << 11)
+#define VIRTIO_NET_F_STATUS         (1ULL << 16)
+#define VIRTIO_NET_F_MRG_RXBUF      (1ULL << 15)
+#define VIRTIO_NET_F_CTRL_VQ        (1ULL << 17)
+#define VIRTIO_NET_F_MQ             (1ULL << 22)
+#define VIRTIO_RING_F_EVENT_IDX     (1ULL << 29)
+#define VIRTIO_F_VERSION_1          (1ULL << 32)
+#define VIRTIO_F_RING_PACKED        (1ULL << 34)
+#define VIRTIO_F_IN_ORDER           (1ULL << 35)
+
+/*
+ * Virtio Ring Descriptor Flags
+ */
+#define VRING_DESC_F_NEXT           1
+#define VRING_DESC_F_WRITE          2
+#define VRING_DESC_F_INDIRECT       4
+
+/*
+ * Virtio Ring Avail Flags
+ */
+#define VRING_AVAIL_F_NO_INTERRUPT  1
+#define VRING_USED_F_NO_NOTIFY      1
+
+/*
+ * Packed Ring Descriptor Flags and Event Suppression
+ */
+#define VRING_PACKED_DESC_F_AVAIL   (1 << 7)
+#define VRING_PACKED_DESC_F_USED    (1 << 15)
+
+#define VRING_PACKED_EVENT_F_ENABLE     0
+#define VRING_PACKED_EVENT_F_DISABLE    1
+#define VRING_PACKED_EVENT_F_DESC       2   /* Needs EVENT_IDX */
+#define VRING_PACKED_EVENT_WRAP         15  /* off_wrap wrap counter bit */
+
+/*
+ * Virtio Net Config Space
+ */
+#define VIRTIO_NET_CFG_MAC          0x00
+#define VIRTIO_NET_CFG_MAX_VQ_PAIRS 0x08
+
+/*
+ * Queue Layout: RX/TX pairs interleaved, control queue after the last
+ * pair the device supports
+ */
+#define VIRTQ_RX(pair)              (2 * (pair))
+#define VIRTQ_TX(pair)              (2 * (pair) + 1)
+#define VIRTQ_CTRL(max_pairs)       (2 * (max_pairs))
+#define VIRTQ_SIZE                  256
+#define VIRTQ_ALIGN                 4096
+#define VIRTQ_NONE                  0xFFFF
+
+#define ETH_MAX_QUEUE_PAIRS         CONFIG_ETH_QUEUE_PAIRS
+
+/*
+ * Control Queue Commands
+ */
+#define VIRTIO_NET_CTRL_MQ              4
+#define VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET 0
+#define VIRTIO_NET_OK                   0
+
+#define ETH_CTRL_DATA_MAX           16
+#define ETH_CTRL_TIMEOUT            1000000     /* Used ring polls */
+
+/*
+ * Virtio Ring Structures
+ */
+typedef struct {
+    uint64_t    addr;
+    uint32_t    len;
+    uint16_t    flags;
+    uint16_t    next;
+} PACKED vring_desc_t;
+
+typedef struct {
+    uint16_t    flags;
+    uint16_t    idx;
+    uint16_t    ring[];
+} PACKED vring_avail_t;
+
+typedef struct {
+    uint32_t    id;
+    uint32_t    len;
+} PACKED vring_used_elem_t;
+
+typedef struct {
+    uint16_t    flags;
+    uint16_t    idx;
+    vring_used_elem_t ring[];
+} PACKED vring_used_t;
+
+/*
+ * Packed Ring Structures (virtio 1.1)
+ *
+ * Driver and device share one descriptor ring. A descriptor is made
+ * available by setting its AVAIL flag to the driver's wrap counter and
+ * USED to the inverse; the device marks it used by making both equal
+ * to its own counter. Both counters flip every time the index wraps.
+ */
+typedef struct {
+    uint64_t    addr;
+    uint32_t    len;
+    uint16_t    id;
+    uint16_t    flags;
+} PACKED vring_packed_desc_t;
+
+typedef struct {
+    uint16_t    off_wrap;
+    uint16_t    flags;
+} PACKED vring_packed_event_t;
+
+/*
+ * Virtio Net Header
+ */
+typedef struct {
+    uint8_t     flags;
+    uint8_t     gso_type;
+    uint16_t    hdr_len;
+    uint16_t    gso_size;
+    uint16_t    csum_start;
+    uint16_t    csum_offset;
+    uint16_t    num_buffers;
+} PACKED virtio_net_hdr_t;
+
+#define VIRTIO_NET_HDR_SIZE     12
+
+#define VIRTIO_NET_HDR_F_NEEDS_CSUM 1   /* csum_start/csum_offset are valid */
+#define VIRTIO_NET_HDR_F_DATA_VALID 2   /* RX checksum already verified */
+
+#define VIRTIO_NET_HDR_GSO_NONE     0
+#define VIRTIO_NET_HDR_GSO_TCPV4    1
+
+/* TSO packets are limited by the 16-bit IP total length */
+#define ETH_GSO_MAX_SIZE        65535
+
+/*
+ * RX Polling
+ *
+ * The IRQ handler only masks the device interrupt and wakes the poll
+ * task, which handles at most CONFIG_ETH_RX_BUDGET packets per pass.
+ * When a pass drains the ring the interrupt is re-armed. After
+ * CONFIG_ETH_POLL_SPIN_PASSES full passes in a row the load is taken
+ * as sustained and the task keeps the interrupt masked, polling once
+ * per tick so lower priority tasks still run.
+ */
+#define ETH_POLL_STACK_SIZE     CONFIG_TASK_STACK_SIZE
+
+/*
+ * TX Completion Handling
+ *
+ * Completed TX buffers are reclaimed in bulk: by the poll task, and by
+ * the send path once free descriptors drop below a quarter of the ring.
+ * With EVENT_IDX the TX interrupt is only requested when three quarters
+ * of the packets in flight have completed.
+ */
+#define ETH_TX_RECLAIM_THRESH(vq)   ((vq)->num / 4)
+
+/*
+ * Multi-Queue
+ *
+ * With VIRTIO_NET_F_MQ each queue pair is meant to be served by one
+ * core. A packet goes out on the pair picked by its RSS flow hash,
+ * computed as for the replies it will get, and the device's automatic
+ * steering returns a flow's traffic on the pair it last transmitted on.
+ * Both directions of a connection thus stay on one pair, and received
+ * packets carry the same hash in zb->hash.
+ */
+
+/*
+ * MSI-X
+ *
+ * Every RX and TX virtqueue gets its own MSI-X table entry and IDT
+ * vector, so no interrupt status register has to be read and queue
+ * pairs can later be steered to different cores. The control queue is
+ * only used synchronously during init and has no vector. Masking works
+ * per table entry; a notification raised while masked stays pending and
+ * is delivered on unmask.
+ */
+
+/*
+ * Virtqueue
+ *
+ * Buffers are added as descriptor chains with virtq_add_begin(),
+ * virtq_add_seg() per segment and virtq_add_end(), then exposed to the
+ * device in one go by virtq_publish(). virtq_get_used() returns them
+ * once the device is done. The ring layout is hidden behind these.
+ */
+typedef struct {
+    uint16_t        num;
+    uint16_t        qsel;
+    uint16_t        free_head;      /* Split: descriptor free list */
+    uint16_t        num_free;       /* Free descriptors */
+    uint16_t        last_used_idx;  /* Split: used index, packed: ring slot */
+    uint16_t        avail_idx;      /* Shadow, published in batches */
+    uint16_t        kicked_idx;     /* avail_idx at the last notify */
+    uint16_t        in_flight;      /* Buffers owned by the device */
+    bool            event_idx;      /* VIRTIO_RING_F_EVENT_IDX */
+    bool            packed;         /* VIRTIO_F_RING_PACKED */
+    bool            in_order;       /* VIRTIO_F_IN_ORDER */
+    uint64_t        kicks;
+    volatile uint16_t *notify;      /* Doorbell for this queue */
+    uint16_t        msix;           /* MSI-X entry or VIRTQ_NONE */
+
+    /* Split ring */
+    vring_desc_t    *desc;
+    vring_avail_t   *avail;
+    vring_used_t    *used;
+
+    /* Packed ring */
+    vring_packed_desc_t *pdesc;
+    volatile vring_packed_event_t *driver_event;
+    volatile vring_packed_event_t *device_event;
+    uint16_t        next_avail;     /* Slot of the next descriptor */
+    bool            avail_wrap;
+    bool            used_wrap;
+    uint16_t        pending_head;   /* Slot whose flags wait for publish */
+    uint16_t        pending_flags;
+    uint16_t        free_id;        /* Buffer ID free list (out of order) */
+    uint16_t        id_next[VIRTQ_SIZE];
+    uint16_t        chain_len[VIRTQ_SIZE];
+    bool            batch_active;   /* In-order: used batch being drained */
+    uint16_t        batch_last;     /* ID that ends the batch */
+    uint32_t        batch_len;
+
+    /* Chain under construction */
+    uint16_t        chain_head;
+    uint16_t        chain_prev;
+    uint16_t        chain_left;
+    uint16_t        chain_id;
+
+    /* Buffer tracking: split by head descriptor, packed by buffer ID */
+    zbuf_t          *buffers[VIRTQ_SIZE];
+
+    spinlock_t      lock;
+} virtqueue_t;
+
+/*
+ * Ethernet Device Context
+ */
+typedef struct {
+    pci_dev_t       pci;
+
+    /* Register blocks from the virtio capabilities */
+    volatile uint8_t *common;
+    volatile uint8_t *notify;
+    volatile uint8_t *devcfg;
+    uint32_t        notify_mult;
+
+    /* MSI-X entries 0..num_vectors-1 map to IDT vectors from vector_base */
+    uint32_t        vector_base;
+    uint16_t        num_vectors;
+
+    /* MAC Address */
+    uint8_t         mac[6];
+
+    /* Negotiated features */
+    uint64_t        features;
+
+    /* Virtqueues */
+    virtqueue_t     rxq[ETH_MAX_QUEUE_PAIRS];
+    virtqueue_t     txq[ETH_MAX_QUEUE_PAIRS];
+    uint16_t        num_queues;     /* Queue pairs in use */
+
+    /* Control queue (VIRTIO_NET_F_MQ only) */
+    virtqueue_t     ctrlq;
+    uint8_t         *ctrl_buf;
+
+    /* DMA Memory */
+    void            *dma_mem;
+    addr_t          dma_phys;
+    size_t          dma_size;
+
+    /* Network Interface */
+    netif_t         netif;
+
+    /* Statistics */
+    uint64_t        rx_packets;
+    uint64_t        tx_packets;
+    uint64_t        rx_bytes;
+    uint64_t        tx_bytes;
+    uint64_t        rx_errors;
+    uint64_t        tx_errors;
+    uint64_t        rx_dropped;
+
+    /* RX polling */
+    semaphore_t     poll_sem;
+    volatile bool   poll_masked;    /* Interrupt masked for polling */
+    uint64_t        cnt_freq;       /* TSC frequency */
+    eth_poll_stats_t poll_stats;
+
+    spinlock_t      lock;
+    bool            initialized;
+} eth_dev_t;
+
+/* Device instance */
+static eth_dev_t eth_device;
+
+/* Poll task */
+static tcb_t eth_poll_tcb;
+static uint8_t eth_poll_stack[ETH_POLL_STACK_SIZE] ALIGNED(16);
+
+/*
+ * Common Configuration Access
+ */
+#define VIRTIO_CFG8(dev, off)   (*(volatile uint8_t *)((dev)->common + (off)))
+#define VIRTIO_CFG16(dev, off)  (*(volatile uint16_t *)((dev)->common + (off)))
+#define VIRTIO_CFG32(dev, off)  (*(volatile uint32_t *)((dev)->common + (off)))
+
+/* EVENT_IDX fields trail the avail and used rings */
+#define VRING_USED_EVENT(vq)    (*(volatile uint16_t *)&(vq)->avail->ring[(vq)->num])
+#define VRING_AVAIL_EVENT(vq)   (*(volatile uint16_t *)((uint8_t *)(vq)->used + 4 + \
+                                                    sizeof(vring_used_elem_t) * (vq)->num))
+
+/*
+ * Feature Negotiation (64-bit, two 32-bit selector windows)
+ */
+static uint64_t virtio_get_features(eth_dev_t *dev)
+{
+    uint64_t features;
+
+    VIRTIO_CFG32(dev, VIRTIO_PCI_DEVICE_FEATURE_SEL) = 1;
+    features = (uint64_t)VIRTIO_CFG32(dev, VIRTIO_PCI_DEVICE_FEATURE) << 32;
+    VIRTIO_CFG32(dev, VIRTIO_PCI_DEVICE_FEATURE_SEL) = 0;
+    features |= VIRTIO_CFG32(dev, VIRTIO_PCI_DEVICE_FEATURE);
+
+    return features;
+}
+
+static void virtio_set_features(eth_dev_t *dev, uint64_t features)
+{
+    VIRTIO_CFG32(dev, VIRTIO_PCI_DRIVER_FEATURE_SEL) = 0;
+    VIRTIO_CFG32(dev, VIRTIO_PCI_DRIVER_FEATURE) = (uint32_t)features;
+    VIRTIO_CFG32(dev, VIRTIO_PCI_DRIVER_FEATURE_SEL) = 1;
+    VIRTIO_CFG32(dev, VIRTIO_PCI_DRIVER_FEATURE) = (uint32_t)(features >> 32);
+}
+
+static void virtio_set_status(eth_dev_t *dev, uint8_t status)
+{
+    VIRTIO_CFG8(dev, VIRTIO_PCI_DEVICE_STATUS) = status;
+}
+
+static uint8_t virtio_get_status(eth_dev_t *dev)
+{
+    return VIRTIO_CFG8(dev, VIRTIO_PCI_DEVICE_STATUS);
+}
+
+/* 64-bit ring addresses are written as two halves, low first */
+static void virtio_set_addr(eth_dev_t *dev, uint32_t off, void *ptr)
+{
+    addr_t phys = (addr_t)ptr;      /* Identity mapping */
+    VIRTIO_CFG32(dev, off) = (uint32_t)phys;
+    VIRTIO_CFG32(dev, off + 4) = (uint32_t)(phys >> 32);
+}
+
+/*
+ * Hand the ring areas to the device, route the queue to its MSI-X entry
+ * and enable it (queue selected)
+ */
+static status_t virtq_setup(eth_dev_t *dev, virtqueue_t *vq,
+                            void *desc, void *driver, void *device)
+{
+    VIRTIO_CFG16(dev, VIRTIO_PCI_QUEUE_SIZE) = vq->num;
+    virtio_set_addr(dev, VIRTIO_PCI_QUEUE_DESC, desc);
+    virtio_set_addr(dev, VIRTIO_PCI_QUEUE_DRIVER, driver);
+    virtio_set_addr(dev, VIRTIO_PCI_QUEUE_DEVICE, device);
+
+    /* The device answers NO_VECTOR if it could not take the entry */
+    VIRTIO_CFG16(dev, VIRTIO_PCI_QUEUE_MSIX_VECTOR) = vq->msix;
+    if (VIRTIO_CFG16(dev, VIRTIO_PCI_QUEUE_MSIX_VECTOR) != vq->msix) {
+        return STATUS_ERROR;
+    }
+
+    uint16_t off = VIRTIO_CFG16(dev, VIRTIO_PCI_QUEUE_NOTIFY_OFF);
+    vq->notify = (volatile uint16_t *)(dev->notify + (uint32_t)off * dev->notify_mult);
+
+    /* Enable queue */
+    VIRTIO_CFG16(dev, VIRTIO_PCI_QUEUE_ENABLE) = 1;
+
+    return STATUS_OK;
+}
+
+/*
+ * Packed ring: descriptor ring followed by the driver and device event
+ * suppression areas
+ */
+static status_t virtq_init_packed(eth_dev_t *dev, virtqueue_t *vq)
+{
+    uint16_t max = vq->num;
+    size_t ring_size = sizeof(vring_packed_desc_t) * max;
+    size_t total = ring_size + 2 * sizeof(vring_packed_event_t);
+
+    void *mem = dma_alloc(total);
+    if (!mem) return STATUS_NO_MEM;
+
+    for (size_t i = 0; i < total; i++) {
+        ((uint8_t *)mem)[i] = 0;
+    }
+
+    vq->pdesc = (vring_packed_desc_t *)mem;
+    vq->driver_event = (vring_packed_event_t *)((uint8_t *)mem + ring_size);
+    vq->device_event = vq->driver_event + 1;
+
+    vq->next_avail = 0;
+    vq->avail_wrap = true;
+    vq->used_wrap = true;
+    vq->pending_head = VIRTQ_NONE;
+    vq->batch_active = false;
+
+    /* Buffer IDs; in order they are the head slot instead */
+    for (uint16_t i = 0; i < max - 1; i++) {
+        vq->id_next[i] = i + 1;
+    }
+    vq->id_next[max - 1] = VIRTQ_NONE;
+    vq->free_id = 0;
+
+    return virtq_setup(dev, vq, (void *)vq->pdesc,
+                       (void *)vq->driver_event, (void *)vq->device_event);
+}
+
+/*
+ * Initialize Virtqueue
+ */
+static status_t virtq_init(eth_dev_t *dev, virtqueue_t *vq, uint16_t qsel, uint16_t msix)
+{
+    /* Select queue */
+    VIRTIO_CFG16(dev, VIRTIO_PCI_QUEUE_SELECT) = qsel;
+
+    /* Get max size */
+    uint32_t max = VIRTIO_CFG16(dev, VIRTIO_PCI_QUEUE_SIZE);
+    if (max == 0) return STATUS_ERROR;
+    if (max > VIRTQ_SIZE) max = VIRTQ_SIZE;
+
+    vq->num = max;
+    vq->qsel = qsel;
+    vq->free_head = 0;
+    vq->num_free = max;
+    vq->last_used_idx = 0;
+    vq->avail_idx = 0;
+    vq->kicked_idx = 0;
+    vq->in_flight = 0;
+    vq->event_idx = (dev->features & VIRTIO_RING_F_EVENT_IDX) != 0;
+    vq->packed = (dev->features & VIRTIO_F_RING_PACKED) != 0;
+    vq->in_order = (dev->features & VIRTIO_F_IN_ORDER) != 0;
+    vq->kicks = 0;
+    vq->msix = msix;
+    vq->lock = (spinlock_t)SPINLOCK_INIT;
+
+    if (vq->packed) {
+        return virtq_init_packed(dev, vq);
+    }
+
+    /* Calculate sizes */
+    size_t desc_size = sizeof(vring_desc_t) * max;
+    size_t avail_size = sizeof(uint16_t) * (3 + max);
+    size_t used_size = sizeof(uint16_t) * 3 + sizeof(vring_used_elem_t) * max;
+
+    /* Align sizes */
+    desc_size = (desc_size + VIRTQ_ALIGN - 1) & ~(VIRTQ_ALIGN - 1);
+    avail_size = (avail_size + VIRTQ_ALIGN - 1) & ~(VIRTQ_ALIGN - 1);
+    used_size = (used_size + VIRTQ_ALIGN - 1) & ~(VIRTQ_ALIGN - 1);
+
+    /* Allocate DMA memory */
+    size_t total = desc_size + avail_size + used_size;
+    void *mem = dma_alloc(total);
+    if (!mem) return STATUS_NO_MEM;
+
+    /* Clear memory */
+    for (size_t i = 0; i < total; i++) {
+        ((uint8_t *)mem)[i] = 0;
+    }
+
+    /* Setup pointers */
+    vq->desc = (vring_desc_t *)mem;
+    vq->avail = (vring_avail_t *)((uint8_t *)mem + desc_size);
+    vq->used = (vring_used_t *)((uint8_t *)mem + desc_size + avail_size);
+
+    /* Initialize free list */
+    for (uint16_t i = 0; i < max - 1; i++) {
+        vq->desc[i].next = i + 1;
+    }
+    vq->desc[max - 1].next = 0xFFFF;
+
+    /* Configure queue */
+    return virtq_setup(dev, vq, mem, (void *)vq->avail, (void *)vq->used);
+}
+
+/*
+ * Free descriptor
+ */
+static void virtq_free_desc(virtqueue_t *vq, uint16_t idx)
+{
+    vq->desc[idx].next = vq->free_head;
+    vq->free_head = idx;
+    vq->num_free++;
+}
+
+/*
+ * Start a chain of n descriptors (vq->lock held). Returns false when
+ * the ring has no room for it.
+ */
+static bool virtq_add_begin(virtqueue_t *vq, uint16_t n)
+{
+    if (n == 0 || vq->num_free < n) return false;
+
+    vq->chain_left = n;
+    vq->chain_prev = VIRTQ_NONE;
+
+    if (vq->packed) {
+        vq->chain_head = vq->next_avail;
+        if (vq->in_order) {
+            vq->chain_id = vq->next_avail;
+        } else {
+            vq->chain_id = vq->free_id;
+            vq->free_id = vq->id_next[vq->chain_id];
+        }
+        vq->chain_len[vq->chain_id] = n;
+    }
+
+    return true;
+}
+
+/*
+ * Append one segment to the chain; write marks a device-writable buffer
+ */
+static void virtq_add_seg(virtqueue_t *vq, addr_t addr, uint32_t len, bool write)
+{
+    uint16_t flags = write ? VRING_DESC_F_WRITE : 0;
+
+    if (--vq->chain_left > 0) {
+        flags |= VRING_DESC_F_NEXT;
+    }
+
+    if (vq->packed) {
+        uint16_t slot = vq->next_avail;
+        vring_packed_desc_t *d = &vq->pdesc[slot];
+
+        d->addr = addr;
+        d->len = len;
+        d->id = vq->chain_id;
+        flags |= vq->avail_wrap ? VRING_PACKED_DESC_F_AVAIL : VRING_PACKED_DESC_F_USED;
+
+        /*
+         * The first head after a publish keeps its flags back: the device
+         * stops there, so everything behind it can be written freely and
+         * virtq_publish() exposes the whole batch with one store.
+         */
+        if (slot == vq->chain_head && vq->pending_head == VIRTQ_NONE) {
+            vq->pending_head = slot;
+            vq->pending_flags = flags;
+        } else {
+            d->flags = flags;
+        }
+
+        if (++vq->next_avail == vq->num) {
+            vq->next_avail = 0;
+            vq->avail_wrap = !vq->avail_wrap;
+        }
+    } else {
+        uint16_t idx = vq->free_head;
+        vq->free_head = vq->desc[idx].next;
+
+        vq->desc[idx].addr = addr;
+        vq->desc[idx].len = len;
+        vq->desc[idx].flags = flags;
+        vq->desc[idx].next = 0;
+
+        if (vq->chain_prev == VIRTQ_NONE) {
+            vq->chain_head = idx;
+        } else {
+            vq->desc[vq->chain_prev].next = idx;
+        }
+        vq->chain_prev = idx;
+    }
+
+    vq->num_free--;
+}
+
+/*
+ * Finish the chain; token comes back from virtq_get_used()
+ */
+static void virtq_add_end(virtqueue_t *vq, zbuf_t *token)
+{
+    if (vq->packed) {
+        vq->buffers[vq->chain_id] = token;
+        vq->avail_idx += vq->chain_len[vq->chain_id];
+    } else {
+        vq->buffers[vq->chain_head] = token;
+        vq->avail->ring[vq->avail_idx % vq->num] = vq->chain_head;
+        vq->avail_idx++;
+    }
+
+    vq->in_flight++;
+}
+
+/*
+ * Publish queued entries (vq->lock held)
+ */
+static void virtq_publish(virtqueue_t *vq)
+{
+    if (vq->packed) {
+        if (vq->pending_head != VIRTQ_NONE) {
+            dmb();              /* Descriptors before the head flags */
+            *(volatile uint16_t *)&vq->pdesc[vq->pending_head].flags = vq->pending_flags;
+            vq->pending_head = VIRTQ_NONE;
+        }
+        return;
+    }
+
+    dmb();                      /* Ring entries before the index */
+    vq->avail->idx = vq->avail_idx;
+}
+
+/*
+ * Whether the device has returned a buffer (vq->lock held)
+ */
+static bool virtq_has_used(virtqueue_t *vq)
+{
+    if (vq->packed) {
+        if (vq->batch_active) return true;
+
+        uint16_t flags = *(volatile uint16_t *)&vq->pdesc[vq->last_used_idx].flags;
+        bool avail = (flags & VRING_PACKED_DESC_F_AVAIL) != 0;
+        bool used = (flags & VRING_PACKED_DESC_F_USED) != 0;
+        return avail == used && used == vq->used_wrap;
+    }
+
+    return vq->last_used_idx != *(volatile uint16_t *)&vq->used->idx;
+}
+
+/*
+ * Take the next completed buffer (vq->lock held)
+ *
+ * With VIRTIO_F_IN_ORDER the device may write a single used descriptor
+ * for a whole batch, naming the last buffer; the ones before it are
+ * returned with a length of 0.
+ */
+static bool virtq_get_used(virtqueue_t *vq, zbuf_t **token, uint32_t *len)
+{
+    if (!virtq_has_used(vq)) return false;
+
+    if (!vq->packed) {
+        dmb();
+
+        uint16_t used_idx = vq->last_used_idx % vq->num;
+        uint16_t desc_idx = vq->used->ring[used_idx].id;
+        *len = vq->used->ring[used_idx].len;
+        *token = vq->buffers[desc_idx];
+        vq->buffers[desc_idx] = NULL;
+
+        /* Free descriptor chain */
+        while (vq->desc[desc_idx].flags & VRING_DESC_F_NEXT) {
+            uint16_t next_idx = vq->desc[desc_idx].next;
+            virtq_free_desc(vq, desc_idx);
+            desc_idx = next_idx;
+        }
+        virtq_free_desc(vq, desc_idx);
+
+        vq->last_used_idx++;
+        vq->in_flight--;
+        return true;
+    }
+
+    if (!vq->batch_active) {
+        if (vq->in_flight == 0) return false;
+
+        dmb();                  /* Flags before the rest of the descriptor */
+        vring_packed_desc_t *d = &vq->pdesc[vq->last_used_idx];
+        vq->batch_last = d->id;
+        vq->batch_len = d->len;
+        vq->batch_active = true;
+    }
+
+    uint16_t id = vq->in_order ? vq->last_used_idx : vq->batch_last;
+    uint16_t n = vq->chain_len[id];
+
+    *token = vq->buffers[id];
+    vq->buffers[id] = NULL;
+    if (id == vq->batch_last || vq->in_flight == 1) {
+        *len = vq->batch_len;
+        vq->batch_active = false;
+    } else {
+        *len = 0;
+    }
+
+    if (!vq->in_order) {
+        vq->id_next[id] = vq->free_id;
+        vq->free_id = id;
+    }
+
+    vq->num_free += n;
+    vq->last_used_idx += n;
+    if (vq->last_used_idx >= vq->num) {
+        vq->last_used_idx -= vq->num;
+        vq->used_wrap = !vq->used_wrap;
+    }
+    vq->in_flight--;
+
+    return true;
+}
+
+/*
+ * Decide whether the device needs a doorbell for the entries published
+ * since the last one (vq->lock held). With EVENT_IDX the device names
+ * the avail index (split) or ring slot (packed) it wants to hear about;
+ * otherwise it can only ask for no notifications at all.
+ */
+static bool virtq_kick_prepare(virtqueue_t *vq)
+{
+    uint16_t added = vq->avail_idx - vq->kicked_idx;
+    bool need;
+
+    if (added == 0) return false;
+
+    dmb();                      /* Index store before the event read */
+    if (vq->packed) {
+        uint16_t off_wrap = vq->device_event->off_wrap;
+        uint16_t flags = vq->device_event->flags;
+
+        if (flags == VRING_PACKED_EVENT_F_DESC) {
+            uint16_t new_idx = vq->next_avail;
+            uint16_t event = off_wrap & ~(1 << VRING_PACKED_EVENT_WRAP);
+            if ((bool)(off_wrap >> VRING_PACKED_EVENT_WRAP) != vq->avail_wrap) {
+                event -= vq->num;
+            }
+            need = (uint16_t)(new_idx - event - 1) < added;
+        } else {
+            need = flags != VRING_PACKED_EVENT_F_DISABLE;
+        }
+    } else if (vq->event_idx) {
+        uint16_t event = VRING_AVAIL_EVENT(vq);
+        need = (uint16_t)(vq->avail_idx - event - 1) < added;
+    } else {
+        need = !(vq->used->flags & VRING_USED_F_NO_NOTIFY);
+    }
+
+    vq->kicked_idx = vq->avail_idx;
+    if (need) vq->kicks++;
+    return need;
+}
+
+static void virtq_notify(virtqueue_t *vq)
+{
+    *vq->notify = vq->qsel;
+}
+
+/*
+ * Used-buffer interrupt control. With EVENT_IDX the device interrupts
+ * once it passes the index (split) or ring slot (packed) given by the
+ * driver, so leaving that behind disables the interrupt; a split ring
+ * then ignores the flags.
+ */
+static void virtq_disable_cb(virtqueue_t *vq)
+{
+    if (vq->packed) {
+        vq->driver_event->flags = VRING_PACKED_EVENT_F_DISABLE;
+    } else if (!vq->event_idx) {
+        vq->avail->flags = VRING_AVAIL_F_NO_INTERRUPT;
+    }
+}
+
+static void virtq_enable_cb(virtqueue_t *vq, uint16_t delay)
+{
+    if (vq->packed) {
+        if (vq->event_idx) {
+            uint16_t slot = vq->last_used_idx + delay;
+            bool wrap = vq->used_wrap;
+            if (slot >= vq->num) {
+                slot -= vq->num;
+                wrap = !wrap;
+            }
+            vq->driver_event->off_wrap = slot | ((uint16_t)wrap << VRING_PACKED_EVENT_WRAP);
+            dmb();              /* Event offset before the mode */
+            vq->driver_event->flags = VRING_PACKED_EVENT_F_DESC;
+        } else {
+            vq->driver_event->flags = VRING_PACKED_EVENT_F_ENABLE;
+        }
+    } else if (vq->event_idx) {
+        VRING_USED_EVENT(vq) = vq->last_used_idx + delay;
+    } else {
+        vq->avail->flags = 0;
+    }
+}
+
+/*
+ * Add buffer to RX queue; the caller kicks the device
+ */
+static status_t eth_rx_add_buffer(virtqueue_t *vq)
+{
+    spin_lock_irq(&vq->lock);
+
+    if (vq->num_free < 2) {
+        spin_unlock_irq(&vq->lock);
+        return STATUS_NO_MEM;
+    }
+
+    /* Allocate zbuf */
+    zbuf_t *zb = zbuf_alloc_rx(ZBUF_DATA_MAX);
+    if (!zb) {
+        spin_unlock_irq(&vq->lock);
+        return STATUS_NO_MEM;
+    }
+
+    /* Reserve space for virtio header */
+    zbuf_reserve(zb, VIRTIO_NET_HDR_SIZE);
+
+    /* Header and data descriptors */
+    virtq_add_begin(vq, 2);
+    virtq_add_seg(vq, zb->dma_addr, VIRTIO_NET_HDR_SIZE, true);
+    virtq_add_seg(vq, zb->dma_addr + VIRTIO_NET_HDR_SIZE,
+                  CONFIG_ZBUF_SIZE - VIRTIO_NET_HDR_SIZE - CONFIG_ZBUF_HEADROOM, true);
+    virtq_add_end(vq, zb);
+    virtq_publish(vq);
+
+    spin_unlock_irq(&vq->lock);
+
+    return STATUS_OK;
+}
+
+/*
+ * Notify the device of new RX buffers, if it wants to know
+ */
+static void eth_rx_kick(virtqueue_t *vq)
+{
+    spin_lock_irq(&vq->lock);
+    bool need = virtq_kick_prepare(vq);
+    spin_unlock_irq(&vq->lock);
+
+    if (need) virtq_notify(vq);
+}
+
+/*
+ * Fill RX queue with buffers
+ */
+static void eth_rx_fill(virtqueue_t *vq)
+{
+    while (eth_rx_add_buffer(vq) == STATUS_OK);
+    eth_rx_kick(vq);
+}
+
+/*
+ * Process received packets, at most budget of them
+ */
+static uint32_t eth_rx_process(eth_dev_t *dev, virtqueue_t *vq, uint32_t budget)
+{
+    uint32_t done = 0;
+
+    zbuf_t *zb;
+    uint32_t len;
+
+    spin_lock_irq(&vq->lock);
+
+    while (done < budget && virtq_get_used(vq, &zb, &len)) {
+        spin_unlock_irq(&vq->lock);
+
+        if (zb && len > VIRTIO_NET_HDR_SIZE) {
+            virtio_net_hdr_t *vh = (virtio_net_hdr_t *)zb->head;
+
+            /* Device verified the L4 checksum (or it came from the host) */
+            if ((dev->features & VIRTIO_NET_F_GUEST_CSUM) &&
+                (vh->flags & (VIRTIO_NET_HDR_F_DATA_VALID | VIRTIO_NET_HDR_F_NEEDS_CSUM))) {
+                zb->flags |= ZBUF_F_CSUM_VALID;
+            }
+
+            /* Adjust buffer pointers */
+            zb->data = zb->head + VIRTIO_NET_HDR_SIZE;
+            zb->len = len - VIRTIO_NET_HDR_SIZE;
+            zb->tail = zb->data + zb->len;
+
+            /* Flow hash for the stack; only worth it with several pairs */
+            if (dev->num_queues > 1) {
+                rss_hash_frame(zb, false);
+            }
+
+            /* Update statistics */
+            dev->rx_packets++;
+            dev->rx_bytes += zb->len;
+
+            /* Pass to network stack */
+            netif_input(&dev->netif, zb);
+        } else {
+            if (zb) zbuf_free(zb);
+            dev->rx_errors++;
+        }
+
+        /* Refill RX buffer */
+        eth_rx_add_buffer(vq);
+        done++;
+
+        spin_lock_irq(&vq->lock);
+    }
+
+    spin_unlock_irq(&vq->lock);
+
+    /* One doorbell for all refilled buffers */
+    if (done > 0) {
+        eth_rx_kick(vq);
+    }
+
+    return done;
+}
+
+/*
+ * Fill the virtio-net header from the zbuf offload request
+ */
+static void eth_tx_offload(virtio_net_hdr_t *vh, zbuf_t *zb, uint16_t frame_off)
+{
+    if (!(zb->flags & ZBUF_F_CHECKSUM)) {
+        return;
+    }
+
+    vh->flags = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+    vh->csum_start = zb->csum_start - frame_off;
+    vh->csum_offset = zb->csum_offset;
+
+    if (zb->gso_size != 0) {
+        tcp_hdr_t *tcp = (tcp_hdr_t *)(zb->head + zb->csum_start);
+        vh->gso_type = VIRTIO_NET_HDR_GSO_TCPV4;
+        vh->gso_size = zb->gso_size;
+        vh->hdr_len = vh->csum_start + TCP_HDR_LEN(tcp);
+    }
+}
+
+/*
+ * Reclaim completed TX buffers (vq->lock held); their bytes go back to
+ * the interface TX queues
+ */
+static uint32_t eth_tx_reclaim(eth_dev_t *dev, virtqueue_t *vq)
+{
+    uint32_t done = 0;
+    uint32_t bytes = 0;
+    zbuf_t *zb;
+    uint32_t len;
+
+    while (virtq_get_used(vq, &zb, &len)) {
+        if (zb) {
+            bytes += zbuf_pkt_len(zb) - VIRTIO_NET_HDR_SIZE;
+            zbuf_free(zb);
+        }
+        done++;
+    }
+
+    if (bytes > 0) {
+        netif_tx_done(&dev->netif, bytes);
+    }
+    return done;
+}
+
+/*
+ * Queue one packet for transmission (vq->lock held)
+ *
+ * The virtio header shares the first descriptor with the frame; each
+ * buffer chained on zb->frag takes one more descriptor. The device does
+ * not see the entry before eth_tx_commit(). Frees the packet on failure.
+ */
+static status_t eth_tx_queue(eth_dev_t *dev, virtqueue_t *vq, zbuf_t *zb)
+{
+    if (!zb || zb->len == 0) {
+        if (zb) zbuf_free(zb);
+        dev->tx_errors++;
+        return STATUS_INVALID;
+    }
+
+    uint16_t ndesc = 0;
+    for (zbuf_t *f = zb; f != NULL; f = f->frag) {
+        ndesc++;
+    }
+
+    if (vq->num_free < ndesc || vq->num_free < ETH_TX_RECLAIM_THRESH(vq)) {
+        eth_tx_reclaim(dev, vq);
+    }
+    if (vq->num_free < ndesc) {
+        netif_tx_done(&dev->netif, zbuf_pkt_len(zb));
+        zbuf_free(zb);
+        dev->tx_errors++;
+        return STATUS_NO_MEM;
+    }
+
+    /* Add virtio header */
+    uint16_t frame_off = zbuf_headroom(zb);
+    uint8_t *hdr = zbuf_push(zb, VIRTIO_NET_HDR_SIZE);
+    if (!hdr) {
+        netif_tx_done(&dev->netif, zbuf_pkt_len(zb));
+        zbuf_free(zb);
+        dev->tx_errors++;
+        return STATUS_NO_MEM;
+    }
+
+    /* Clear header */
+    for (int i = 0; i < VIRTIO_NET_HDR_SIZE; i++) {
+        hdr[i] = 0;
+    }
+    eth_tx_offload((virtio_net_hdr_t *)hdr, zb, frame_off);
+
+    /* Setup descriptor chain */
+    virtq_add_begin(vq, ndesc);
+    for (zbuf_t *f = zb; f != NULL; f = f->frag) {
+        virtq_add_seg(vq, f->dma_addr + (f->data - f->head), f->len, false);
+    }
+    virtq_add_end(vq, zb);
+    zbuf_set_owner(zb, ZBUF_OWNER_ETH);
+
+    /* Update statistics */
+    dev->tx_packets++;
+    dev->tx_bytes += zbuf_pkt_len(zb) - VIRTIO_NET_HDR_SIZE;
+
+    return STATUS_OK;
+}
+
+/*
+ * Publish queued packets (vq->lock held). Returns whether the caller
+ * has to ring the doorbell after unlocking.
+ */
+static bool eth_tx_commit(eth_dev_t *dev, virtqueue_t *vq)
+{
+    virtq_publish(vq);
+
+    /* Completion interrupt once 3/4 of what is in flight is done */
+    if (!dev->poll_masked) {
+        virtq_enable_cb(vq, vq->in_flight * 3 / 4);
+    }
+
+    return virtq_kick_prepare(vq);
+}
+
+/*
+ * Pick the TX queue for a packet by its flow hash. Non-IP traffic and
+ * single-queue devices use pair 0.
+ */
+static virtqueue_t *eth_tx_select(eth_dev_t *dev, zbuf_t *zb)
+{
+    if (dev->num_queues == 1 || !zb) {
+        return &dev->txq[0];
+    }
+
+    if (!(zb->flags & ZBUF_F_HASH_VALID) && !rss_hash_frame(zb, true)) {
+        return &dev->txq[0];
+    }
+
+    return &dev->txq[zb->hash % dev->num_queues];
+}
+
+/*
+ * Transmit packet
+ */
+static status_t eth_send(netif_t *nif, zbuf_t *zb)
+{
+    eth_dev_t *dev = (eth_dev_t *)nif->priv;
+    virtqueue_t *vq = eth_tx_select(dev, zb);
+
+    spin_lock_irq(&vq->lock);
+    status_t ret = eth_tx_queue(dev, vq, zb);
+    bool kick = (ret == STATUS_OK) && eth_tx_commit(dev, vq);
+    spin_unlock_irq(&vq->lock);
+
+    if (kick) virtq_notify(vq);
+
+    return ret;
+}
+
+/*
+ * Transmit a batch of packets with one doorbell per run of packets
+ * bound for the same queue (normally the whole batch)
+ *
+ * Returns the number of packets queued; the others have been freed.
+ */
+static uint32_t eth_send_batch(netif_t *nif, zbuf_t **pkts, uint32_t count)
+{
+    eth_dev_t *dev = (eth_dev_t *)nif->priv;
+    uint32_t sent = 0;
+    uint32_t i = 0;
+
+    while (i < count) {
+        virtqueue_t *vq = eth_tx_select(dev, pkts[i]);
+        uint32_t queued = 0;
+
+        spin_lock_irq(&vq->lock);
+        do {
+            if (eth_tx_queue(dev, vq, pkts[i]) == STATUS_OK) {
+                queued++;
+            }
+            i++;
+        } while (i < count && eth_tx_select(dev, pkts[i]) == vq);
+        bool kick = (queued > 0) && eth_tx_commit(dev, vq);
+        spin_unlock_irq(&vq->lock);
+
+        if (kick) virtq_notify(vq);
+        sent += queued;
+    }
+
+    return sent;
+}
+
+/*
+ * Process transmitted packets, then refill the ring from the
+ * interface TX queues
+ */
+static void eth_tx_process(eth_dev_t *dev)
+{
+    for (uint16_t q = 0; q < dev->num_queues; q++) {
+        virtqueue_t *vq = &dev->txq[q];
+
+        spin_lock_irq(&vq->lock);
+        eth_tx_reclaim(dev, vq);
+        spin_unlock_irq(&vq->lock);
+    }
+
+    netif_tx_run(&dev->netif);
+}
+
+/*
+ * Synchronous control queue command, only used during init
+ */
+static status_t eth_ctrl_cmd(eth_dev_t *dev, uint8_t class, uint8_t cmd,
+                             const uint8_t *data, uint16_t len)
+{
+    virtqueue_t *vq = &dev->ctrlq;
+    uint8_t *buf = dev->ctrl_buf;
+
+    if (len > ETH_CTRL_DATA_MAX || vq->num_free < 3) {
+        return STATUS_INVALID;
+    }
+
+    /* class, cmd | data | ack */
+    buf[0] = class;
+    buf[1] = cmd;
+    for (uint16_t i = 0; i < len; i++) {
+        buf[2 + i] = data[i];
+    }
+    uint8_t *ack = &buf[2 + len];
+    *ack = 0xFF;
+
+    virtq_add_begin(vq, 3);
+    virtq_add_seg(vq, (addr_t)buf, 2, false);
+    virtq_add_seg(vq, (addr_t)&buf[2], len, false);
+    virtq_add_seg(vq, (addr_t)ack, 1, true);
+    virtq_add_end(vq, NULL);
+    virtq_publish(vq);
+    virtq_notify(vq);
+
+    zbuf_t *token;
+    uint32_t used_len;
+    uint32_t spins = 0;
+    while (!virtq_get_used(vq, &token, &used_len)) {
+        if (++spins >= ETH_CTRL_TIMEOUT) {
+            return STATUS_TIMEOUT;  /* Descriptors stay with the device */
+        }
+    }
+
+    return (*(volatile uint8_t *)ack == VIRTIO_NET_OK) ? STATUS_OK : STATUS_ERROR;
+}
+
+/*
+ * Interrupt Masking
+ *
+ * The MSI-X entries are masked so nothing reaches the CPU while polling;
+ * the ring event suppression additionally asks the device not to send.
+ */
+static void eth_msix_mask(eth_dev_t *dev, bool masked)
+{
+    for (uint16_t i = 0; i < dev->num_vectors; i++) {
+        pci_msix_mask(&dev->pci, i, masked);
+    }
+}
+
+static void eth_irq_mask(eth_dev_t *dev)
+{
+    eth_msix_mask(dev, true);
+    dev->poll_masked = true;
+
+    for (uint16_t q = 0; q < dev->num_queues; q++) {
+        virtq_disable_cb(&dev->rxq[q]);
+
+        spin_lock_irq(&dev->txq[q].lock);
+        virtq_disable_cb(&dev->txq[q]);
+        spin_unlock_irq(&dev->txq[q].lock);
+    }
+}
+
+/*
+ * Re-arm the interrupt unless work arrived meanwhile. Returns false,
+ * with the interrupt still masked, when the ring has to be polled again.
+ */
+static bool eth_irq_unmask(eth_dev_t *dev)
+{
+    dev->poll_masked = false;
+
+    for (uint16_t q = 0; q < dev->num_queues; q++) {
+        virtqueue_t *txq = &dev->txq[q];
+
+        virtq_enable_cb(&dev->rxq[q], 0);
+
+        spin_lock_irq(&txq->lock);
+        virtq_enable_cb(txq, txq->in_flight * 3 / 4);
+        spin_unlock_irq(&txq->lock);
+    }
+
+    /* Look again for work that arrived before the event was armed */
+    dmb();
+
+    for (uint16_t q = 0; q < dev->num_queues; q++) {
+        if (virtq_has_used(&dev->rxq[q])) {
+            eth_irq_mask(dev);
+            return false;
+        }
+    }
+
+    eth_msix_mask(dev, false);
+    return true;
+}
+
+static inline uint64_t eth_read_counter(void)
+{
+    return rdtsc();
+}
+
+/* 0, 1, 2-3, 4-7, ... with the last bucket open-ended */
+static uint32_t eth_hist_bucket(uint64_t value)
+{
+    uint32_t bucket = 0;
+
+    while (value != 0 && bucket < ETH_POLL_HIST_BUCKETS - 1) {
+        value >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+/*
+ * One poll pass: up to budget RX packets, split evenly over the RX
+ * queues, then TX reclaim
+ */
+static uint32_t eth_poll_pass(eth_dev_t *dev, uint32_t budget)
+{
+    eth_poll_stats_t *ps = &dev->poll_stats;
+    uint64_t start = eth_read_counter();
+    uint32_t quota = budget / dev->num_queues;
+    uint32_t done = 0;
+
+    if (quota == 0) quota = 1;
+    for (uint16_t q = 0; q < dev->num_queues; q++) {
+        done += eth_rx_process(dev, &dev->rxq[q], quota);
+    }
+    eth_tx_process(dev);
+
+    uint64_t us = (eth_read_counter() - start) * 1000000 / dev->cnt_freq;
+
+    ps->passes++;
+    ps->pkt_hist[eth_hist_bucket(done)]++;
+    ps->time_hist[eth_hist_bucket(us)]++;
+    if (done >= budget) {
+        ps->budget_exhausted++;
+    }
+
+    return done;
+}
+
+/*
+ * IRQ Handler, shared by all queue vectors
+ */
+static void eth_irq_handler(uint32_t irq __attribute__((unused)), void *arg)
+{
+    eth_dev_t *dev = (eth_dev_t *)arg;
+
+    /* A vector that fired before the mask took effect */
+    if (dev->poll_masked) return;
+
+    /* Used buffer notification: defer to the poll task */
+    eth_irq_mask(dev);
+    dev->poll_stats.irq_wakeups++;
+    sem_post(&dev->poll_sem);
+}
+
+/*
+ * Poll Task
+ */
+static void eth_poll_task(void *arg)
+{
+    eth_dev_t *dev = (eth_dev_t *)arg;
+
+    while (1) {
+        sem_wait(&dev->poll_sem);
+
+        uint32_t full_passes = 0;
+
+        while (1) {
+            if (eth_poll_pass(dev, CONFIG_ETH_RX_BUDGET) < CONFIG_ETH_RX_BUDGET) {
+                if (eth_irq_unmask(dev)) {
+                    break;      /* Drained, back to interrupts */
+                }
+                full_passes = 0;
+                continue;
+            }
+
+            if (++full_passes < CONFIG_ETH_POLL_SPIN_PASSES) {
+                task_yield();
+                continue;
+            }
+
+            /* Sustained load: stay masked, poll once per tick */
+            if (full_passes == CONFIG_ETH_POLL_SPIN_PASSES) {
+                dev->poll_stats.poll_mode_entries++;
+            }
+            task_sleep(1);
+        }
+    }
+}
+
+/*
+ * Map the register block a virtio capability points at
+ */
+static volatile uint8_t *eth_pci_map_cap(eth_dev_t *dev, uint8_t cap)
+{
+    uint8_t bar = pci_read8(&dev->pci, cap + VIRTIO_PCI_CAP_BAR);
+    uint32_t off = pci_read32(&dev->pci, cap + VIRTIO_PCI_CAP_OFFSET);
+    uint32_t len = pci_read32(&dev->pci, cap + VIRTIO_PCI_CAP_LENGTH);
+
+    uint64_t base = pci_bar_addr(&dev->pci, bar);
+    if (base == 0 || len == 0) return NULL;
+
+    return (volatile uint8_t *)mmu_map_mmio(base + off, len);
+}
+
+/*
+ * Find the device and its common, notify and device config blocks
+ */
+static status_t eth_pci_probe(eth_dev_t *dev)
+{
+    if (!pci_find_device(VIRTIO_PCI_VENDOR, VIRTIO_PCI_DEV_NET, &dev->pci) &&
+        !pci_find_device(VIRTIO_PCI_VENDOR, VIRTIO_PCI_DEV_NET_LEGACY, &dev->pci)) {
+        return STATUS_ERROR;
+    }
+
+    pci_enable_master(&dev->pci);
+
+    /* The first capability of each type is the preferred one */
+    dev->common = NULL;
+    dev->notify = NULL;
+    dev->devcfg = NULL;
+    for (uint8_t cap = pci_find_cap(&dev->pci, PCI_CAP_ID_VNDR, 0); cap != 0;
+         cap = pci_find_cap(&dev->pci, PCI_CAP_ID_VNDR, cap)) {
+        switch (pci_read8(&dev->pci, cap + VIRTIO_PCI_CAP_CFG_TYPE)) {
+            case VIRTIO_PCI_CAP_COMMON_CFG:
+                if (!dev->common) dev->common = eth_pci_map_cap(dev, cap);
+                break;
+
+            case VIRTIO_PCI_CAP_NOTIFY_CFG:
+                if (!dev->notify) {
+                    dev->notify = eth_pci_map_cap(dev, cap);
+                    dev->notify_mult = pci_read32(&dev->pci, cap + VIRTIO_PCI_NOTIFY_MULT);
+                }
+                break;
+
+            case VIRTIO_PCI_CAP_DEVICE_CFG:
+                if (!dev->devcfg) dev->devcfg = eth_pci_map_cap(dev, cap);
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    /* Legacy-only devices (disable-modern=on) have none of these */
+    if (!dev->common || !dev->notify || !dev->devcfg) {
+        return STATUS_ERROR;
+    }
+
+    /* No INTx fallback: every queue needs its own vector */
+    if (!pci_msix_init(&dev->pci)) {
+        return STATUS_ERROR;
+    }
+
+    return STATUS_OK;
+}
+
+/*
+ * Allocate one IDT vector per RX and TX queue and program the MSI-X
+ * table, entry 2n for RX and 2n+1 for TX of pair n. Entries stay masked
+ * until the rings are filled.
+ */
+static status_t eth_msix_setup(eth_dev_t *dev)
+{
+    uint16_t max_pairs = dev->pci.msix_count / 2;
+
+    if (max_pairs == 0) return STATUS_ERROR;
+    if (dev->num_queues > max_pairs) dev->num_queues = max_pairs;
+
+    uint16_t count = 2 * dev->num_queues;
+    if (irq_alloc_vectors(count, &dev->vector_base) != STATUS_OK) {
+        return STATUS_NO_MEM;
+    }
+
+    for (uint16_t i = 0; i < count; i++) {
+        pci_msix_set_entry(&dev->pci, i, dev->vector_base + i);
+        irq_register(dev->vector_base + i, eth_irq_handler, dev);
+    }
+    dev->num_vectors = count;
+
+    /* Config changes (link status) are not used */
+    VIRTIO_CFG16(dev, VIRTIO_PCI_CONFIG_MSIX_VECTOR) = VIRTIO_MSI_NO_VECTOR;
+    pci_msix_enable(&dev->pci, true);
+
+    return STATUS_OK;
+}
+
+/*
+ * Initialize Ethernet Driver
+ */
+status_t eth_init(void)
+{
+    eth_dev_t *dev = &eth_device;
+
+    if (dev->initialized) return STATUS_OK;
+
+    dev->lock = (spinlock_t)SPINLOCK_INIT;
+
+    if (eth_pci_probe(dev) != STATUS_OK) {
+        return STATUS_ERROR;
+    }
+
+    /* Reset device, wait for it to finish */
+    virtio_set_status(dev, 0);
+    while (virtio_get_status(dev) != 0);
+
+    /* Acknowledge */
+    virtio_set_status(dev, VIRTIO_STATUS_ACK);
+
+    /* Driver */
+    virtio_set_status(dev, VIRTIO_STATUS_ACK | VIRTIO_STATUS_DRIVER);
+
+    /* Negotiate features; the modern transport requires VERSION_1 */
+    uint64_t wanted = VIRTIO_NET_F_MAC | VIRTIO_RING_F_EVENT_IDX | VIRTIO_F_VERSION_1;
+#if CONFIG_ETH_RING_PACKED
+    wanted |= VIRTIO_F_RING_PACKED | VIRTIO_F_IN_ORDER;
+#endif
+#if CONFIG_ETH_OFFLOAD
+    wanted |= VIRTIO_NET_F_CSUM | VIRTIO_NET_F_GUEST_CSUM | VIRTIO_NET_F_HOST_TSO4;
+#endif
+
+    if (ETH_MAX_QUEUE_PAIRS > 1) {
+        wanted |= VIRTIO_NET_F_CTRL_VQ | VIRTIO_NET_F_MQ;
+    }
+
+    uint64_t features = virtio_get_features(dev) & wanted;
+    if (!(features & VIRTIO_NET_F_CSUM)) {
+        features &= ~VIRTIO_NET_F_HOST_TSO4;  /* TSO depends on CSUM */
+    }
+    if (!(features & VIRTIO_NET_F_CTRL_VQ)) {
+        features &= ~VIRTIO_NET_F_MQ;         /* MQ depends on CTRL_VQ */
+    }
+    if (!(features & VIRTIO_F_RING_PACKED)) {
+        features &= ~VIRTIO_F_IN_ORDER;       /* Split ring stays as is */
+    }
+    virtio_set_features(dev, features);
+    dev->features = features;
+
+    /* Features OK */
+    virtio_set_status(dev, VIRTIO_STATUS_ACK |
+                           VIRTIO_STATUS_DRIVER |
+                           VIRTIO_STATUS_FEATURES_OK);
+
+    /* Check features accepted */
+    if (!(virtio_get_status(dev) & VIRTIO_STATUS_FEATURES_OK)) {
+        virtio_set_status(dev, VIRTIO_STATUS_FAILED);
+        return STATUS_ERROR;
+    }
+
+    volatile uint8_t *config = dev->devcfg;
+
+    /* Read MAC address */
+    if (features & VIRTIO_NET_F_MAC) {
+        for (int i = 0; i < 6; i++) {
+            dev->mac[i] = config[VIRTIO_NET_CFG_MAC + i];
+        }
+    } else {
+        /* Default MAC */
+        dev->mac[0] = 0x52;
+        dev->mac[1] = 0x54;
+        dev->mac[2] = 0x00;
+        dev->mac[3] = 0x12;
+        dev->mac[4] = 0x34;
+        dev->mac[5] = 0x56;
+    }
+
+    /* Queue pairs: as many as both sides support */
+    uint16_t max_pairs = 1;
+    if (features & VIRTIO_NET_F_MQ) {
+        max_pairs = config[VIRTIO_NET_CFG_MAX_VQ_PAIRS] |
+                    ((uint16_t)config[VIRTIO_NET_CFG_MAX_VQ_PAIRS + 1] << 8);
+    }
+    dev->num_queues = (max_pairs < ETH_MAX_QUEUE_PAIRS) ? max_pairs : ETH_MAX_QUEUE_PAIRS;
+    if (dev->num_queues == 0) dev->num_queues = 1;
+
+    /* Vectors must be in place before the queues are routed to them */
+    if (eth_msix_setup(dev) != STATUS_OK) {
+        virtio_set_status(dev, VIRTIO_STATUS_FAILED);
+        return STATUS_ERROR;
+    }
+
+    /* Initialize virtqueues */
+    for (uint16_t q = 0; q < dev->num_queues; q++) {
+        if (virtq_init(dev, &dev->rxq[q], VIRTQ_RX(q), VIRTQ_RX(q)) != STATUS_OK ||
+            virtq_init(dev, &dev->txq[q], VIRTQ_TX(q), VIRTQ_TX(q)) != STATUS_OK) {
+            virtio_set_status(dev, VIRTIO_STATUS_FAILED);
+            return STATUS_ERROR;
+        }
+    }
+
+    if (features & VIRTIO_NET_F_MQ) {
+        dev->ctrl_buf = dma_alloc(2 + ETH_CTRL_DATA_MAX + 1);
+        if (!dev->ctrl_buf ||
+            virtq_init(dev, &dev->ctrlq, VIRTQ_CTRL(max_pairs), VIRTIO_MSI_NO_VECTOR) != STATUS_OK) {
+            virtio_set_status(dev, VIRTIO_STATUS_FAILED);
+            return STATUS_ERROR;
+        }
+    }
+
+    /* Driver OK */
+    virtio_set_status(dev, VIRTIO_STATUS_ACK |
+                           VIRTIO_STATUS_DRIVER |
+                           VIRTIO_STATUS_FEATURES_OK |
+                           VIRTIO_STATUS_DRIVER_OK);
+
+    /* The device starts on pair 0 until told otherwise */
+    if (dev->num_queues > 1) {
+        uint8_t pairs[2] = { (uint8_t)dev->num_queues, (uint8_t)(dev->num_queues >> 8) };
+        if (eth_ctrl_cmd(dev, VIRTIO_NET_CTRL_MQ, VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET,
+                         pairs, sizeof(pairs)) != STATUS_OK) {
+            dev->num_queues = 1;
+        }
+    }
+
+    /* Setup network interface */
+    dev->netif.name[0] = 'e'; dev->netif.name[1] = 't'; dev->netif.name[2] = 'h';
+    dev->netif.name[3] = '0'; dev->netif.name[4] = '\0';
+
+    for (int i = 0; i < 6; i++) {
+        dev->netif.mac[i] = dev->mac[i];
+    }
+
+    dev->netif.mtu = 1500;
+    dev->netif.up = true;
+    dev->netif.features = 0;
+    if (features & VIRTIO_NET_F_CSUM) {
+        dev->netif.features |= NETIF_F_TX_CSUM;
+    }
+    if (features & VIRTIO_NET_F_GUEST_CSUM) {
+        dev->netif.features |= NETIF_F_RX_CSUM;
+    }
+    if (features & VIRTIO_NET_F_HOST_TSO4) {
+        dev->netif.features |= NETIF_F_TSO;
+        dev->netif.gso_max_size = ETH_GSO_MAX_SIZE;
+    }
+    dev->netif.send = eth_send;
+    dev->netif.send_batch = eth_send_batch;
+    dev->netif.priv = dev;
+    dev->netif.vlan_id = 0;
+    netif_txq_init(&dev->netif, CONFIG_NET_TX_INFLIGHT);
+
+    /* RX processing runs in the poll task */
+    sem_init(&dev->poll_sem, 0);
+    dev->cnt_freq = cpu_info.tsc_freq;
+    task_create(&eth_poll_tcb, "eth-poll", eth_poll_task, dev,
+                CONFIG_ETH_POLL_PRIORITY, eth_poll_stack, sizeof(eth_poll_stack));
+    task_start(&eth_poll_tcb);
+
+    /* Handlers were registered with the vectors; let them through */
+    eth_msix_mask(dev, false);
+
+    /* Fill RX queues */
+    for (uint16_t q = 0; q < dev->num_queues; q++) {
+        eth_rx_fill(&dev->rxq[q]);
+    }
+
+    /* Register network interface */
+    netif_register(&dev->netif);
+
+    dev->initialized = true;
+
+    return STATUS_OK;
+}
+
+/*
+ * Get network interface
+ */
+netif_t *eth_get_netif(void)
+{
+    if (!eth_device.initialized) return NULL;
+    return &eth_device.netif;
+}
+
+/*
+ * Get statistics
+ */
+void eth_get_stats(eth_stats_t *stats)
+{
+    if (!stats) return;
+
+    eth_dev_t *dev = &eth_device;
+    stats->rx_packets = dev->rx_packets;
+    stats->tx_packets = dev->tx_packets;
+    stats->rx_bytes = dev->rx_bytes;
+    stats->tx_bytes = dev->tx_bytes;
+    stats->rx_errors = dev->rx_errors;
+    stats->tx_errors = dev->tx_errors;
+    stats->rx_dropped = dev->rx_dropped;
+    stats->rx_kicks = 0;
+    stats->tx_kicks = 0;
+    for (uint16_t q = 0; q < dev->num_queues; q++) {
+        stats->rx_kicks += dev->rxq[q].kicks;
+        stats->tx_kicks += dev->txq[q].kicks;
+    }
+    stats->queue_pairs = dev->num_queues;
+    stats->ring_packed = (dev->features & VIRTIO_F_RING_PACKED) != 0;
+}
+
+/*
+ * Get RX polling statistics
+ */
+void eth_get_poll_stats(eth_poll_stats_t *stats)
+{
+    if (!stats) return;
+
+    eth_poll_stats_t *ps = &eth_device.poll_stats;
+    stats->passes = ps->passes;
+    stats->irq_wakeups = ps->irq_wakeups;
+    stats->budget_exhausted = ps->budget_exhausted;
+    stats->poll_mode_entries = ps->poll_mode_entries;
+    for (int i = 0; i < ETH_POLL_HIST_BUCKETS; i++) {
+        stats->pkt_hist[i] = ps->pkt_hist[i];
+        stats->time_hist[i] = ps->time_hist[i];
+    }
+}
+
+/*
+ * Poll for packets (for non-interrupt mode)
+ */
+void eth_poll(void)
+{
+    if (!eth_device.initialized) return;
+
+    eth_poll_pass(&eth_device, CONFIG_ETH_RX_BUDGET);
+}
@@ -6,6 +6,7 @@
  */
 
 #include "x86_64/cpu.h"
+#include "x86_64/apic.h"
 #include "rtos_types.h"
 
 /* PIT I/O Ports */
@@ -14,6 +15,9 @@
 #define PIT_CH2_DATA    0x42
 #define PIT_CMD         0x43
 
+/* ISA IRQ 0 arrives on GSI 2 (MADT interrupt source override) */
+#define PIT_GSI         2
+
 /* PIT Frequency */
 #define PIT_FREQUENCY   1193182
 
@@ -82,3 +86,31 @@ void pit_delay_ms(uint32_t ms)
         __asm__ volatile("pause");
     }
 }
+
+/*
+ * One-shot interrupt ns from now (high-resolution timers)
+ *
+ * Mode 0 raises the line once at terminal count; reloading restarts
+ * the count. Longer delays are clamped to the 16-bit counter.
+ */
+void pit_oneshot(uint64_t ns)
+{
+    if (ns > 100000000ULL) ns = 100000000ULL;
+
+    uint64_t count = (ns * PIT_FREQUENCY) / 1000000000ULL;
+    if (count == 0) count = 1;
+    if (count > 65535) count = 65535;
+
+    outb(PIT_CMD, PIT_CMD_CH0 | PIT_CMD_BOTH | PIT_CMD_MODE0);
+    outb(PIT_CH0_DATA, count & 0xFF);
+    outb(PIT_CH0_DATA, (count >> 8) & 0xFF);
+}
+
+/*
+ * Deliver channel 0 on vector, starting from one harmless expiry
+ */
+void pit_route_irq(uint8_t vector)
+{
+    pit_oneshot(100000000ULL);
+    ioapic_set_irq(PIT_GSI, vector, false);
+}
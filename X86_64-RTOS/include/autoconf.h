@@ -6,7 +6,7 @@
  *
  * AUTO-GENERATED FILE - DO NOT EDIT
  * Generated by scripts/genconfig.py
- * Generated at: 2025-12-04 19:47:56
+ * Generated at: 2026-10-18 12:06:21
  *
  * To modify configuration, run: make menuconfig
  */
@@ -40,21 +40,61 @@
 #define CONFIG_UART_COM1 1
 #define CONFIG_UART_DEFAULT_BAUD 115200
 
+/* ETH Configuration */
+#define CONFIG_ETH_ENABLED 1
+#define CONFIG_ETH_OFFLOAD 1
+#define CONFIG_ETH_POLL_PRIORITY 11
+#define CONFIG_ETH_POLL_SPIN_PASSES 4
+#define CONFIG_ETH_QUEUE_PAIRS 1
+#define CONFIG_ETH_RING_PACKED 1
+#define CONFIG_ETH_RX_BUDGET 64
+#define CONFIG_ETH_RX_DESCRIPTORS 256
+#define CONFIG_ETH_TX_DESCRIPTORS 256
+
 /* NET Configuration */
-#define CONFIG_NET_ARP 1
-#define CONFIG_NET_ICMP 1
+#define CONFIG_NET_ARP_ENTRIES 256
+#define CONFIG_NET_ARP_QUEUE_LEN 4
+#define CONFIG_NET_ARP_TIMEOUT 300
+#define CONFIG_NET_CLS_RULES 16
+#define CONFIG_NET_ENABLED 1
+#define CONFIG_NET_MAX_SOCKETS 64
+#define CONFIG_NET_PROTO_HANDLERS 4
+#define CONFIG_NET_ROUTE_ENTRIES 16
 #define CONFIG_NET_RX_RING_SIZE 256
-#define CONFIG_NET_STACK 1
-#define CONFIG_NET_TCP 1
-#define CONFIG_NET_TCP_MAX_CONN 64
-#define CONFIG_NET_TCP_MSS 1460
-#define CONFIG_NET_TCP_WINDOW 65535
+#define CONFIG_NET_SOCK_HASH_SIZE 256
+#define CONFIG_NET_TAS_GUARD_NS 150000
+#define CONFIG_NET_TAS_LEAD_NS 5000
+#define CONFIG_NET_TAS_QUEUE_LEN 16
+#define CONFIG_NET_TX_BANDS 4
+#define CONFIG_NET_TX_INFLIGHT 16384
+#define CONFIG_NET_TX_QUEUE_LEN 64
 #define CONFIG_NET_TX_RING_SIZE 256
-#define CONFIG_NET_UDP 1
+
+/* TCP Configuration */
+#define CONFIG_TCP_DELACK_MS 40
+#define CONFIG_TCP_ENABLED 1
+#define CONFIG_TCP_KEEPALIVE_IDLE 7200
+#define CONFIG_TCP_KEEPALIVE_INTVL 75
+#define CONFIG_TCP_KEEPALIVE_PROBES 9
+#define CONFIG_TCP_MAX_CONNECTIONS 64
+#define CONFIG_TCP_MSS 1460
+#define CONFIG_TCP_OOO_SEGS 32
+#define CONFIG_TCP_RCVBUF_MAX 262144
+#define CONFIG_TCP_RETRIES 5
+#define CONFIG_TCP_SACK 1
+#define CONFIG_TCP_SNDBUF 32768
+#define CONFIG_TCP_TIMER_PRIORITY 11
+#define CONFIG_TCP_TIMESTAMPS 1
+#define CONFIG_TCP_WINDOW_SIZE 65535
+#define CONFIG_TCP_WSCALE 1
+
+/* UDP Configuration */
+#define CONFIG_UDP_ENABLED 1
 
 /* Modbus Configuration */
+#define CONFIG_MODBUS_ENABLED 1
 #define CONFIG_MODBUS_MAX_COILS 2048
-#define CONFIG_MODBUS_MAX_REGISTERS 256
+#define CONFIG_MODBUS_MAX_REGS 256
 #define CONFIG_MODBUS_RTU 1
 #define CONFIG_MODBUS_RTU_BAUD 115200
 #define CONFIG_MODBUS_SLAVE_ADDR 1
@@ -62,6 +102,7 @@
 #define CONFIG_MODBUS_TCP_PORT 502
 
 /* OPC UA Configuration */
+#define CONFIG_OPCUA_ENABLED 1
 #define CONFIG_OPCUA_MAX_NODES 1024
 #define CONFIG_OPCUA_MAX_SESSIONS 8
 #define CONFIG_OPCUA_MAX_SUBSCRIPTIONS 16
@@ -69,11 +110,13 @@
 #define CONFIG_OPCUA_SECURITY_NONE 1
 
 /* PROFINET Configuration */
-#define CONFIG_PROFINET_CYCLE_US 1000
+#define CONFIG_PROFINET_CYCLE_TIME 1000
+#define CONFIG_PROFINET_ENABLED 1
+#define CONFIG_PROFINET_LAUNCH_TIME 1
 #define CONFIG_PROFINET_MAX_DEVICES 32
 #define CONFIG_PROFINET_MAX_SLOTS 16
 #define CONFIG_PROFINET_MAX_SUBSLOTS 8
-#define CONFIG_PROFINET_RT_CLASS1 1
+#define CONFIG_PROFINET_RT_CLASS 1
 
 /* Debug Configuration */
 #define CONFIG_DEBUG_LEVEL 2
@@ -88,9 +131,6 @@
 #define CONFIG_DRIVER_PIT 1
 #define CONFIG_DRIVER_UART_16550 1
 #define CONFIG_DRIVER_VIRTIO_NET 1
-#define CONFIG_PROTO_MODBUS 1
-#define CONFIG_PROTO_OPCUA 1
-#define CONFIG_PROTO_PROFINET 1
 #define CONFIG_STACK_CANARY 1
 #define CONFIG_X86_64_ACPI 1
 #define CONFIG_X86_64_APIC 1
@@ -0,0 +1,661 @@
+/*
+ * Gracemont Industrial Control Framework - ARM64 RTOS
+ * Copyright (C) 2024 Zixiao System <https://github.com/Zixiao-System>
+ *
+ * This file is part of Gracemont Industrial Control Framework.
+ * Repository: https://github.com/Zixiao-System/gracemont
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * Lightweight TCP/IP Stack - Header Definitions
+ */
+
+#ifndef NET_STACK_H
+#define NET_STACK_H
+
+#include "rtos_types.h"
+#include "zbuf.h"
+
+/* Ethernet Header */
+typedef struct PACKED {
+    uint8_t     dst[6];
+    uint8_t     src[6];
+    uint16_t    type;
+} eth_hdr_t;
+
+#define ETH_HDR_LEN     14
+#define ETH_TYPE_IP     0x0800
+#define ETH_TYPE_ARP    0x0806
+#define ETH_TYPE_VLAN   0x8100
+#define ETH_TYPE_PNIO   0x8892
+
+/* 802.1Q Tag (between the MAC addresses and the inner type) */
+typedef struct PACKED {
+    uint16_t    tci;
+    uint16_t    type;
+} vlan_hdr_t;
+
+#define VLAN_HDR_LEN        4
+#define VLAN_VID_MASK       0x0FFF
+#define VLAN_PCP_SHIFT      13
+#define VLAN_TCI(pcp, vid)  ((uint16_t)(((pcp) << VLAN_PCP_SHIFT) | ((vid) & VLAN_VID_MASK)))
+
+/* ARP Header */
+typedef struct PACKED {
+    uint16_t    htype;
+    uint16_t    ptype;
+    uint8_t     hlen;
+    uint8_t     plen;
+    uint16_t    oper;
+    uint8_t     sha[6];
+    uint32_t    spa;
+    uint8_t     tha[6];
+    uint32_t    tpa;
+} arp_hdr_t;
+
+#define ARP_OP_REQUEST  1
+#define ARP_OP_REPLY    2
+
+/* IP Header */
+typedef struct PACKED {
+    uint8_t     ver_ihl;
+    uint8_t     tos;
+    uint16_t    len;
+    uint16_t    id;
+    uint16_t    frag;
+    uint8_t     ttl;
+    uint8_t     proto;
+    uint16_t    checksum;
+    uint32_t    src;
+    uint32_t    dst;
+} ip_hdr_t;
+
+#define IP_HDR_LEN(iph)     (((iph)->ver_ihl & 0x0F) << 2)
+#define IP_PROTO_ICMP       1
+#define IP_PROTO_TCP        6
+#define IP_PROTO_UDP        17
+#define IP_DEFAULT_TTL      64
+
+/* ICMP Header */
+typedef struct PACKED {
+    uint8_t     type;
+    uint8_t     code;
+    uint16_t    checksum;
+    uint16_t    id;
+    uint16_t    seq;
+} icmp_hdr_t;
+
+#define ICMP_ECHO_REQUEST   8
+#define ICMP_ECHO_REPLY     0
+
+/* UDP Header */
+typedef struct PACKED {
+    uint16_t    sport;
+    uint16_t    dport;
+    uint16_t    len;
+    uint16_t    checksum;
+} udp_hdr_t;
+
+#define UDP_HDR_LEN     8
+
+/* TCP Header */
+typedef struct PACKED {
+    uint16_t    sport;
+    uint16_t    dport;
+    uint32_t    seq;
+    uint32_t    ack;
+    uint8_t     off_rsvd;
+    uint8_t     flags;
+    uint16_t    win;
+    uint16_t    checksum;
+    uint16_t    urgent;
+} tcp_hdr_t;
+
+#define TCP_HDR_LEN(tcph)   ((((tcph)->off_rsvd >> 4) & 0x0F) << 2)
+#define TCP_FLAG_FIN        0x01
+#define TCP_FLAG_SYN        0x02
+#define TCP_FLAG_RST        0x04
+#define TCP_FLAG_PSH        0x08
+#define TCP_FLAG_ACK        0x10
+#define TCP_FLAG_URG        0x20
+
+/* TCP Options */
+#define TCP_OPT_EOL         0
+#define TCP_OPT_NOP         1
+#define TCP_OPT_MSS         2
+#define TCP_OPT_WSCALE      3
+#define TCP_OPT_SACK_PERM   4
+#define TCP_OPT_SACK        5
+#define TCP_OPT_TS          8
+#define TCP_SACK_MAX        4       /* Blocks in one SACK option */
+#define TCP_SACK_MAX_TS     3       /* ... next to a timestamp option */
+#define TCP_WSCALE_MAX      14      /* RFC 7323 2.3 */
+
+/* Software TX Queues (txq.c) */
+typedef struct {
+    zbuf_t          *head;
+    zbuf_t          *tail;
+    uint32_t        count;
+    uint32_t        drops;          /* Band full */
+} netif_band_t;
+
+/* Launch-time schedule: frames sent at zb->timestamp (ZBUF_F_TXTIME) */
+typedef struct {
+    uint32_t        sent;
+    uint32_t        missed;         /* Launch time already past when queued */
+    uint32_t        drops;          /* Schedule full */
+    uint32_t        jitter_min;     /* Release minus launch time, ns */
+    uint32_t        jitter_max;
+    uint64_t        jitter_sum;
+} netif_tas_stats_t;
+
+typedef struct {
+    zbuf_t          *head;          /* Sorted by launch time */
+    uint32_t        count;
+    uint32_t        guard_ns;       /* Protected window before each launch */
+    hrtimer_t       timer;
+    netif_tas_stats_t stats;
+} netif_tas_t;
+
+typedef struct {
+    netif_band_t    band[CONFIG_NET_TX_BANDS];  /* Highest index served first */
+    uint32_t        limit;          /* Bytes on the driver ring; 0 = no queueing */
+    uint32_t        inflight;
+    uint32_t        backlog;        /* Frames in all bands */
+    netif_tas_t     tas;
+    spinlock_t      lock;
+} netif_txq_t;
+
+/* Network Interface */
+typedef struct netif {
+    char            name[8];
+    uint8_t         mac[6];
+    uint32_t        ip;
+    uint32_t        netmask;
+    uint32_t        gateway;
+    uint16_t        mtu;
+    uint16_t        vlan_id;        /* 802.1Q VID, 0 = untagged */
+    bool            up;
+    void            *priv;
+
+    /* Offload capabilities */
+    uint32_t        features;       /* NETIF_F_* */
+    uint32_t        gso_max_size;   /* Largest TSO packet (IP header on) */
+
+    /* Statistics */
+    uint64_t        rx_packets;
+    uint64_t        rx_bytes;
+    uint64_t        tx_packets;
+    uint64_t        tx_bytes;
+    uint64_t        rx_errors;
+    uint64_t        tx_errors;
+
+    /* Driver callbacks */
+    status_t        (*send)(struct netif *nif, zbuf_t *zb);
+    uint32_t        (*send_batch)(struct netif *nif, zbuf_t **pkts, uint32_t count);  /* Optional */
+    status_t        (*ioctl)(struct netif *nif, int cmd, void *arg);
+
+    /* Strict-priority TX queues in front of the driver ring */
+    netif_txq_t     txq;
+
+    struct netif    *next;
+} netif_t;
+
+/* Netif Features */
+#define NETIF_F_TX_CSUM     (1 << 0)    /* Device completes TCP/UDP checksums */
+#define NETIF_F_RX_CSUM     (1 << 1)    /* Device validates RX checksums */
+#define NETIF_F_TSO         (1 << 2)    /* TCP segmentation offload (IPv4) */
+
+/* ARP Statistics */
+typedef struct {
+    uint32_t    entries;        /* Entries in use */
+    uint32_t    hits;
+    uint32_t    misses;
+    uint32_t    queued;         /* Packets held awaiting resolution */
+    uint32_t    dropped;        /* Held packets dropped (overflow/timeout) */
+    uint32_t    evictions;      /* LRU replacements */
+} arp_stats_t;
+
+/* Route Cache (per socket, see route.c) */
+typedef struct {
+    uint32_t    dst;
+    uint32_t    next_hop;
+    netif_t     *nif;           /* NULL when empty */
+    uint32_t    gen;            /* Table generation at lookup */
+} route_cache_t;
+
+/* Routing Statistics */
+typedef struct {
+    uint32_t    entries;
+    uint32_t    lookups;        /* Full table scans */
+    uint32_t    cache_hits;
+    uint32_t    unreachable;
+} route_stats_t;
+
+/* Early RX Classifier (classify.c): what a rule matches on */
+#define NET_CLS_M_ETHERTYPE (1 << 0)
+#define NET_CLS_M_BCAST     (1 << 1)    /* Broadcast/multicast destination MAC */
+#define NET_CLS_M_SRC_IP    (1 << 2)    /* (src & src_mask) == src_ip */
+#define NET_CLS_M_DST_IP    (1 << 3)    /* (dst & dst_mask) == dst_ip */
+#define NET_CLS_M_PROTO     (1 << 4)    /* IPv4 protocol */
+#define NET_CLS_M_SPORT     (1 << 5)    /* TCP/UDP source port range */
+#define NET_CLS_M_DPORT     (1 << 6)    /* TCP/UDP destination port range */
+#define NET_CLS_M_FRAME_ID  (1 << 7)    /* PROFINET frame ID range */
+
+typedef enum {
+    NET_CLS_PASS = 0,       /* Count, then on to the protocol switch */
+    NET_CLS_DROP,
+    NET_CLS_QUEUE,          /* Push to queue (post sem if set) */
+    NET_CLS_REDIRECT        /* Hand to handler, bypassing the stack */
+} net_cls_action_t;
+
+typedef void (*net_cls_handler_t)(netif_t *nif, zbuf_t *zb, void *arg);
+
+/* Addresses and ports in host order; handlers get data after the link header */
+typedef struct {
+    netif_t             *nif;           /* NULL = any interface */
+    uint16_t            match;          /* NET_CLS_M_* */
+    uint16_t            ethertype;
+    uint32_t            src_ip;
+    uint32_t            src_mask;
+    uint32_t            dst_ip;
+    uint32_t            dst_mask;
+    uint8_t             proto;
+    uint16_t            sport_lo;
+    uint16_t            sport_hi;
+    uint16_t            dport_lo;
+    uint16_t            dport_hi;
+    uint16_t            frame_id_lo;
+    uint16_t            frame_id_hi;
+    net_cls_action_t    action;
+    zbuf_queue_t        *queue;         /* NET_CLS_QUEUE */
+    semaphore_t         *sem;           /* NET_CLS_QUEUE, optional */
+    uint32_t            queue_limit;    /* NET_CLS_QUEUE, 0 = unbounded */
+    net_cls_handler_t   handler;        /* NET_CLS_REDIRECT */
+    void                *arg;
+} net_cls_rule_t;
+
+typedef struct {
+    uint32_t    hits;
+    uint32_t    drops;          /* NET_CLS_QUEUE: queue full */
+} net_cls_stats_t;
+
+/* Handler for an ethertype the stack does not own; data after the link header */
+typedef void (*netif_proto_handler_t)(netif_t *nif, zbuf_t *zb, void *arg);
+
+/* Socket Address */
+typedef struct {
+    uint32_t    addr;
+    uint16_t    port;
+} sockaddr_t;
+
+/* Socket Types */
+#define SOCK_STREAM     1   /* TCP */
+#define SOCK_DGRAM      2   /* UDP */
+#define SOCK_RAW        3   /* Raw IP */
+
+/* Socket Flags */
+#define SOCK_F_TX_WAIT  (1 << 0)    /* A sender waits on tx_sem for buffer space */
+#define SOCK_F_QUICKACK (1 << 1)    /* TCP: acknowledge every segment at once */
+#define SOCK_F_NODELAY  (1 << 2)    /* TCP: no Nagle, send small segments at once */
+#define SOCK_F_CORK     (1 << 3)    /* TCP: hold partial segments until uncorked */
+#define SOCK_F_RCVBUF   (1 << 4)    /* TCP: rcvbuf set by SO_RCVBUF, not autosized */
+#define SOCK_F_KEEPALIVE (1 << 5)   /* TCP: probe an idle connection */
+#define SOCK_F_NONBLOCK (1 << 6)    /* Calls fail rather than wait */
+#define SOCK_F_FIN      (1 << 7)    /* TCP: a FIN follows the last queued byte */
+#define SOCK_F_ORPHAN   (1 << 8)    /* TCP: closed, the connection finishes alone */
+
+/* Socket Options (sock_setopt/sock_getopt) */
+#define SO_SNDBUF       1   /* TCP: bytes queued for sending before send blocks */
+#define SO_RCVBUF       2   /* TCP: bytes received but unread, bounds the window */
+#define SO_PRIORITY     3   /* 802.1p PCP, as sock_set_priority() */
+#define TCP_NODELAY     4   /* Boolean: disable Nagle */
+#define TCP_CORK        5   /* Boolean: coalesce writes into full segments */
+#define TCP_QUICKACK    6   /* Boolean: as sock_set_quickack() */
+#define SO_KEEPALIVE    7   /* Boolean: TCP keepalive probes */
+#define SO_NONBLOCK     8   /* Boolean: recv, accept and send never wait */
+
+/* Readiness events (sock_poll_ctl/sock_poll_wait) */
+#define SOCK_EV_IN      (1u << 0)   /* Data, a connection to accept, or end of stream */
+#define SOCK_EV_OUT     (1u << 1)   /* Room in the send buffer */
+#define SOCK_EV_ERR     (1u << 2)   /* Reset or timed out; always reported */
+#define SOCK_EV_HUP     (1u << 3)   /* Peer closed its side; always reported */
+#define SOCK_EV_ET      (1u << 31)  /* Watch: report changes only (edge-triggered) */
+
+/* sock_poll_ctl() operations */
+#define SOCK_POLL_ADD   1
+#define SOCK_POLL_MOD   2
+#define SOCK_POLL_DEL   3
+
+#define SOCK_POLL_FOREVER   0xFFFFFFFF  /* sock_poll_wait() timeout */
+
+/* Asynchronous operations (sock_ring_submit) */
+#define SOCK_OP_SEND    1   /* Send sqe.zb on a stream socket */
+#define SOCK_OP_RECV    2   /* Receive one buffer */
+#define SOCK_OP_ACCEPT  3   /* Accept one connection */
+
+/* Socket States (TCP) */
+typedef enum {
+    TCP_CLOSED = 0,
+    TCP_LISTEN,
+    TCP_SYN_SENT,
+    TCP_SYN_RECEIVED,
+    TCP_ESTABLISHED,
+    TCP_FIN_WAIT_1,
+    TCP_FIN_WAIT_2,
+    TCP_CLOSE_WAIT,
+    TCP_CLOSING,
+    TCP_LAST_ACK,
+    TCP_TIME_WAIT
+} tcp_state_t;
+
+/* Socket Control Block */
+typedef struct socket {
+    int             fd;
+    int             type;
+    int             state;
+
+    sockaddr_t      local;
+    sockaddr_t      remote;
+    route_cache_t   route;      /* Last route to remote */
+    uint8_t         priority;   /* 802.1p PCP of sent packets */
+
+    /* TCP specific */
+    uint32_t        snd_una;    /* Unacknowledged */
+    uint32_t        snd_nxt;    /* Next to send */
+    uint32_t        snd_max;    /* Highest sequence sent */
+    uint32_t        snd_sml;    /* End of the last short segment sent (Nagle) */
+    uint32_t        snd_wnd;    /* Send window */
+    uint32_t        snd_wl1;    /* Segment seq of last window update */
+    uint32_t        snd_wl2;    /* Segment ack of last window update */
+    uint32_t        rcv_nxt;    /* Next expected */
+    uint32_t        rcv_wnd;    /* Receive window last advertised */
+    uint8_t         ack_pending; /* In-order segments not yet acknowledged */
+    tick_t          ack_start;  /* When the first of them arrived */
+    uint16_t        mss;        /* Largest segment we send */
+
+    /* TCP options negotiated on the SYN (RFC 7323) */
+    uint8_t         ws_ok;      /* Both ends offered window scaling */
+    uint8_t         snd_wscale; /* Shift of the peer's window */
+    uint8_t         rcv_wscale; /* Shift of ours */
+    uint8_t         ts_ok;      /* Both ends send timestamps */
+    uint32_t        ts_recent;  /* Peer's TSval to echo, and PAWS reference */
+    uint32_t        last_ack_sent; /* rcv_nxt of our last ACK */
+
+    /* TCP receive buffer autosizing */
+    uint32_t        rcv_space_seq;  /* rcv_nxt when the measurement began */
+    tick_t          rcv_space_time;
+    tick_t          rcv_rtt;        /* From echoed timestamps, in ticks */
+
+    /* TCP congestion control (NewReno) */
+    uint32_t        cwnd;
+    uint32_t        ssthresh;
+    uint32_t        recover;    /* snd_max when fast recovery began */
+    uint8_t         dupacks;
+    uint8_t         in_recovery;
+
+    /* TCP selective acknowledgement (RFC 2018) */
+    uint8_t         sack_ok;    /* Both ends offered SACK */
+    uint32_t        sack_high;  /* End of the highest SACKed segment */
+    uint32_t        rtx_hole;   /* Recovery: next hole is searched from here */
+
+    /* TCP retransmission timer (RFC 6298), in ticks */
+    uint8_t         rtx_armed;
+    uint8_t         retries;
+    uint8_t         rtt_active; /* Timing the segment starting at rtt_seq */
+    tick_t          rtx_start;  /* When the timer was last (re)started */
+    tick_t          rto;
+    tick_t          srtt;       /* Smoothed RTT x 8 */
+    tick_t          rttvar;     /* RTT variance x 4 */
+    uint32_t        rtt_seq;
+    tick_t          rtt_start;
+
+    /* TCP keepalive */
+    tick_t          rcv_time;   /* Last segment from the peer */
+    uint8_t         ka_probes;  /* Sent since then */
+
+    /*
+     * TCP connection timer: one kernel timer, armed for the earliest of
+     * the deadlines above. tmr_due and tmr_armed are under lock,
+     * tmr_state and next under tcp_lock; tmr_state turns dead under
+     * both.
+     */
+    timer_t         tmr;
+    tick_t          tmr_due;
+    uint8_t         tmr_armed;
+    uint8_t         tmr_state;
+
+    /* Buffers */
+    zbuf_queue_t    rx_queue;
+    zbuf_queue_t    tx_queue;   /* TCP: segments from tx_seq on, sent and unsent */
+    zbuf_t          *tx_next;   /* TCP: first unsent segment in tx_queue */
+    uint32_t        tx_seq;     /* TCP: sequence of the tx_queue head */
+    uint32_t        tx_queued;  /* TCP: bytes in tx_queue */
+    uint32_t        sndbuf;     /* TCP: limit of tx_queued */
+    uint32_t        rx_queued;  /* TCP: bytes in rx_queue */
+    uint32_t        rcvbuf;     /* TCP: limit of rx_queued, advertised as window */
+    zbuf_t          *ooo_head;  /* TCP: out-of-order segments by zb->seq */
+    uint32_t        ooo_count;
+    uint32_t        ooo_last;   /* TCP: zb->seq of the latest out-of-order arrival */
+
+    /* Synchronization */
+    semaphore_t     rx_sem;
+    semaphore_t     tx_sem;
+    mutex_t         lock;
+    uint32_t        refcnt;     /* The descriptor's or an orphan's, plus one per sock_lookup() */
+
+    /* Options */
+    uint32_t        flags;
+    tick_t          timeout;
+
+    /* TCP passive open: children not yet accepted, under tcp_lock */
+    struct socket   *parent;    /* Child: its listener, until accepted */
+    struct socket   *qnext;     /* Child: next on the listener's pending list */
+    struct socket   *pending;   /* Listener: children in handshake order */
+    uint16_t        npending;   /* Listener: SYN_RECEIVED and ready children */
+    uint16_t        backlog;    /* Listener: limit of npending */
+
+    /* Demux hash chain (sock_hash.c) */
+    struct socket   *hnext;
+    struct sock_bucket *hbucket; /* Chain it is linked on, NULL if none */
+
+    /* TCP: next socket whose timer expired */
+    struct socket   *next;
+
+    /* Poll sets watching the socket (sock_poll.c) */
+    struct sock_watch *watch;
+} socket_t;
+
+/* Poll set (sock_poll.c) */
+typedef struct sock_poll sock_poll_t;
+
+typedef struct {
+    int             fd;
+    uint32_t        events;     /* SOCK_EV_* ready */
+    void            *data;      /* As given to sock_poll_ctl() */
+} sock_event_t;
+
+/* Submission and completion ring (sock_ring.c) */
+typedef struct sock_ring sock_ring_t;
+
+typedef struct {
+    uint8_t         op;         /* SOCK_OP_* */
+    int             fd;
+    zbuf_t          *zb;        /* SEND: buffer, given to the stack */
+    void            *data;      /* Handed back in the completion */
+} sock_sqe_t;
+
+typedef struct {
+    int             res;        /* Bytes, accepted fd, 0 end of stream, -1 error */
+    zbuf_t          *zb;        /* RECV: buffer received, now the caller's */
+    sockaddr_t      addr;       /* ACCEPT: peer */
+    void            *data;      /* As submitted */
+} sock_cqe_t;
+
+/* API Functions */
+
+/* Network Interface */
+status_t netif_register(netif_t *nif);
+status_t netif_unregister(netif_t *nif);
+netif_t *netif_get_default(void);
+netif_t *netif_find_addr(uint32_t ip);
+status_t netif_set_addr(netif_t *nif, uint32_t ip, uint32_t netmask, uint32_t gateway);
+void netif_input(netif_t *nif, zbuf_t *zb);
+uint32_t netif_send_batch(netif_t *nif, zbuf_t **pkts, uint32_t count);
+status_t netif_xmit(netif_t *nif, zbuf_t *zb);
+status_t eth_header(netif_t *nif, zbuf_t *zb, const uint8_t *dst_mac, uint16_t type);
+status_t eth_output(netif_t *nif, zbuf_t *zb, const uint8_t *dst_mac, uint16_t type);
+status_t netif_add_proto(netif_t *nif, uint16_t type, netif_proto_handler_t handler, void *arg);
+status_t netif_del_proto(netif_t *nif, uint16_t type);
+
+/* TX Queues (drivers report ring occupancy) */
+void netif_txq_init(netif_t *nif, uint32_t limit);
+void netif_tx_run(netif_t *nif);
+void netif_tx_done(netif_t *nif, uint32_t bytes);
+void netif_tas_get_stats(netif_t *nif, netif_tas_stats_t *stats);
+
+/* IP Layer */
+status_t ip_output(zbuf_t *zb, uint32_t src, uint32_t dst, uint8_t proto);
+status_t ip_output_route(zbuf_t *zb, uint32_t src, uint32_t dst, uint8_t proto,
+                         route_cache_t *rc);
+void ip_input(netif_t *nif, zbuf_t *zb);
+void ip_set_ttl(ip_hdr_t *ip, uint8_t ttl);
+
+/* Routing */
+void route_init(void);
+status_t route_add(uint32_t dest, uint32_t netmask, uint32_t gateway, netif_t *nif);
+status_t route_del(uint32_t dest, uint32_t netmask);
+void route_iface_update(netif_t *nif);
+netif_t *route_lookup(uint32_t dst, uint32_t *next_hop);
+netif_t *route_lookup_cached(route_cache_t *rc, uint32_t dst, uint32_t *next_hop);
+void route_cache_init(route_cache_t *rc);
+void route_get_stats(route_stats_t *stats);
+
+/* Early RX Classifier */
+void net_cls_init(void);
+int net_cls_add(const net_cls_rule_t *rule);
+status_t net_cls_del(int id);
+status_t net_cls_get_stats(int id, net_cls_stats_t *stats);
+bool net_classify(netif_t *nif, zbuf_t *zb);
+
+/* ARP */
+void arp_init(void);
+status_t arp_resolve(netif_t *nif, uint32_t ip, uint8_t *mac);
+status_t arp_output(netif_t *nif, zbuf_t *zb, uint32_t next_hop);
+void arp_input(netif_t *nif, zbuf_t *zb);
+void arp_age(tick_t now);
+void arp_get_stats(arp_stats_t *stats);
+
+/* ICMP */
+void icmp_input(netif_t *nif, zbuf_t *zb);
+
+/* UDP */
+status_t udp_output(zbuf_t *zb, sockaddr_t *src, sockaddr_t *dst, route_cache_t *rc);
+void udp_input(netif_t *nif, zbuf_t *zb);
+
+/* TCP */
+status_t tcp_output(socket_t *sock, zbuf_t *zb);
+status_t tcp_send_zbuf(socket_t *sock, zbuf_t *zb, bool wait);
+status_t tcp_accept_conn(socket_t *sock, bool wait, socket_t **conn);
+void tcp_input(netif_t *nif, zbuf_t *zb);
+void tcp_init(void);
+void tcp_timer(void);
+uint32_t tcp_poll(socket_t *sock);
+
+/* Received buffers, for the socket API and sock_ring.c */
+status_t sock_rx_pop(socket_t *sock, bool wait, zbuf_t **zb);
+
+/* Socket Demux */
+void sock_hash_init(void);
+void sock_hash_insert(socket_t *sock);
+void sock_hash_remove(socket_t *sock);
+socket_t *sock_lookup(int type, uint32_t laddr, uint16_t lport,
+                      uint32_t raddr, uint16_t rport);
+void sock_put(socket_t *sock);
+
+/* Flow Hash (RSS) */
+uint32_t rss_toeplitz(const uint8_t *key, size_t key_len, const uint8_t *data, size_t len);
+uint32_t rss_hash_ipv4(uint32_t saddr, uint32_t daddr, uint16_t sport, uint16_t dport,
+                       bool ports);
+bool rss_hash_frame(zbuf_t *zb, bool reverse);
+
+/* Socket API */
+int sock_socket(int type);
+int sock_bind(int fd, sockaddr_t *addr);
+int sock_listen(int fd, int backlog);
+int sock_accept(int fd, sockaddr_t *addr);
+int sock_connect(int fd, sockaddr_t *addr);
+int sock_send(int fd, const void *data, size_t len);
+int sock_recv(int fd, void *data, size_t len);
+int sock_sendto(int fd, const void *data, size_t len, sockaddr_t *dst);
+int sock_recvfrom(int fd, void *data, size_t len, sockaddr_t *src);
+int sock_close(int fd);
+int sock_set_priority(int fd, uint8_t pcp);
+int sock_set_quickack(int fd, bool on);
+int sock_setopt(int fd, int opt, uint32_t val);
+int sock_getopt(int fd, int opt, uint32_t *val);
+
+/* Zero-copy socket API */
+zbuf_t *sock_recv_zbuf(int fd);
+int sock_send_zbuf(int fd, zbuf_t *zb);
+int sock_recvmmsg_zbuf(int fd, zbuf_t **zbs, uint32_t max);
+int sock_sendmmsg_zbuf(int fd, zbuf_t **zbs, uint32_t n);
+
+/* Readiness multiplexing */
+sock_poll_t *sock_poll_create(uint32_t max);
+void sock_poll_destroy(sock_poll_t *ps);
+int sock_poll_ctl(sock_poll_t *ps, int op, int fd, uint32_t events, void *data);
+int sock_poll_wait(sock_poll_t *ps, sock_event_t *ev, uint32_t max, tick_t timeout);
+void sock_poll_notify(socket_t *sock, uint32_t events);
+void sock_poll_forget(socket_t *sock);
+
+/* Asynchronous socket operations */
+sock_ring_t *sock_ring_create(uint32_t entries);
+void sock_ring_destroy(sock_ring_t *ring);
+sock_sqe_t *sock_ring_get_sqe(sock_ring_t *ring);
+int sock_ring_submit(sock_ring_t *ring);
+int sock_ring_wait(sock_ring_t *ring, sock_cqe_t *cqe, uint32_t max, tick_t timeout);
+int sock_ring_cancel(sock_ring_t *ring, int fd);
+
+/* Utilities */
+uint16_t inet_checksum(const void *data, size_t len);
+uint16_t inet_pseudo_checksum(uint32_t src, uint32_t dst, uint8_t proto, uint16_t len);
+uint32_t inet_csum_partial(const void *data, size_t len, uint32_t sum);
+uint32_t inet_csum_copy(void *dst, const void *src, size_t len, uint32_t sum);
+uint16_t inet_csum_fold(uint32_t sum);
+uint16_t inet_csum_update16(uint16_t check, uint16_t old_val, uint16_t new_val);
+uint16_t inet_csum_update32(uint16_t check, uint32_t old_val, uint32_t new_val);
+uint32_t htonl(uint32_t h);
+uint16_t htons(uint16_t h);
+uint32_t ntohl(uint32_t n);
+uint16_t ntohs(uint16_t n);
+
+#define HTONL(x)    htonl(x)
+#define HTONS(x)    htons(x)
+#define NTOHL(x)    ntohl(x)
+#define NTOHS(x)    ntohs(x)
+
+/* IP Address Macros */
+#define IP4_ADDR(a,b,c,d)   (((uint32_t)(a) << 24) | ((uint32_t)(b) << 16) | \
+                             ((uint32_t)(c) << 8) | (uint32_t)(d))
+#define IP4_ADDR_ANY        0x00000000
+#define IP4_ADDR_BROADCAST  0xFFFFFFFF
+
+/* Stack Initialization */
+void net_stack_init(void);
+void net_stack_poll(void);
+
+#endif /* NET_STACK_H */
@@ -0,0 +1,128 @@
+/*
+ * Gracemont Industrial Control Framework - X86_64 RTOS
+ * Copyright (C) 2024 Zixiao System <https://github.com/Zixiao-System>
+ *
+ * This file is part of Gracemont Industrial Control Framework.
+ * Repository: https://github.com/Zixiao-System/gracemont
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * X86_64 RTOS - Master Header
+ */
+
+#ifndef RTOS_H
+#define RTOS_H
+
+#include "rtos_config.h"
+#include "rtos_types.h"
+
+/*
+ * Kernel API
+ *
+ * Spinlocks, atomics and arch_irq_save/restore are inline in
+ * rtos_types.h on x86_64.
+ */
+
+/* Task Management */
+extern status_t task_create(tcb_t *tcb, const char *name, void (*entry)(void *),
+                            void *arg, uint8_t priority, void *stack, size_t stack_size);
+extern status_t task_start(tcb_t *tcb);
+extern void task_terminate(void);
+extern void task_yield(void);
+extern void task_sleep(tick_t ticks);
+extern tcb_t *task_current(void);
+
+/* Scheduler */
+extern void scheduler_start(void);
+extern void scheduler_tick(void);
+extern tick_t get_system_ticks(void);
+
+/* Semaphore */
+extern void sem_init(semaphore_t *sem, int32_t initial);
+extern status_t sem_wait(semaphore_t *sem);
+extern status_t sem_trywait(semaphore_t *sem);
+extern void sem_post(semaphore_t *sem);
+
+/* Mutex */
+extern void mutex_init(mutex_t *mutex);
+extern status_t mutex_lock(mutex_t *mutex);
+extern status_t mutex_trylock(mutex_t *mutex);
+extern void mutex_unlock(mutex_t *mutex);
+
+/* Event Flags */
+extern void event_init(event_t *event);
+extern status_t event_wait(event_t *event, uint32_t mask, uint32_t *flags_out,
+                           bool wait_all, bool clear);
+extern void event_set(event_t *event, uint32_t mask);
+extern void event_clear(event_t *event, uint32_t mask);
+
+/* Timer */
+extern void timer_init(timer_t *timer, timer_callback_t callback, void *arg);
+extern status_t timer_start(timer_t *timer, tick_t delay, bool periodic);
+extern void timer_stop(timer_t *timer);
+extern uint64_t timer_get_ns(void);
+
+/* High-Resolution Timer (callbacks run in IRQ context) */
+extern void hrtimer_driver_init(void);
+extern void hrtimer_init(hrtimer_t *timer, timer_callback_t callback, void *arg);
+extern status_t hrtimer_start(hrtimer_t *timer, uint64_t expires);
+extern void hrtimer_cancel(hrtimer_t *timer);
+
+/* Memory */
+extern void heap_init(void);
+extern void *heap_alloc(size_t size);
+extern void heap_free(void *ptr);
+extern void *heap_alloc_aligned(size_t size, size_t alignment);
+extern void heap_free_aligned(void *ptr);
+extern status_t mempool_init(mempool_t *pool, void *base, size_t block_size, size_t block_count);
+extern void *mempool_alloc(mempool_t *pool);
+extern void mempool_free(mempool_t *pool, void *block);
+extern void dma_pool_init(void);
+extern void *dma_alloc(size_t size);
+extern void dma_free(void *ptr, size_t size);
+
+/* IRQ (numbers are IDT vectors) */
+extern void interrupt_init(void);
+extern void irq_enable(uint32_t irq);
+extern void irq_disable(uint32_t irq);
+extern status_t irq_register(uint32_t irq, irq_handler_t handler, void *arg);
+extern status_t irq_unregister(uint32_t irq);
+extern status_t irq_alloc_vectors(uint32_t count, uint32_t *first);
+extern bool in_irq_context(void);
+
+/* Cache (coherent on x86_64, kept for shared drivers) */
+extern void dcache_invalidate(void *addr, size_t size);
+extern void dcache_clean(void *addr, size_t size);
+extern void dcache_clean_invalidate(void *addr, size_t size);
+
+/*
+ * Critical Section Macros
+ */
+#define CRITICAL_ENTER()    uint64_t _irq_flags = arch_irq_save()
+#define CRITICAL_EXIT()     arch_irq_restore(_irq_flags)
+
+/*
+ * Utility Macros (ARRAY_SIZE, MIN, MAX are in rtos_types.h)
+ */
+#define MS_TO_TICKS(ms)     ((ms) * CONFIG_TICK_RATE_HZ / 1000)
+#define TICKS_TO_MS(t)      ((t) * 1000 / CONFIG_TICK_RATE_HZ)
+
+#define CLAMP(x, lo, hi)    MIN(MAX(x, lo), hi)
+
+#define BIT(n)              (1UL << (n))
+#define BITS(h, l)          ((BIT((h) - (l) + 1) - 1) << (l))
+
+#endif /* RTOS_H */
@@ -153,6 +153,15 @@ typedef struct timer {
     struct timer    *prev;
 } timer_t;
 
+/* High-resolution one-shot timer, nanoseconds on the timer_get_ns() clock */
+typedef struct hrtimer {
+    uint64_t        expires;
+    timer_callback_t callback;
+    void            *arg;
+    bool            active;
+    struct hrtimer  *next;
+} hrtimer_t;
+
 /* ============================================================================
  * IRQ Handler
  * ============================================================================ */
@@ -203,14 +212,15 @@ static inline void atomic_store(volatile uint32_t *addr, uint32_t val)
     __atomic_store_n(addr, val, __ATOMIC_SEQ_CST);
 }
 
+/* atomic_add/atomic_sub return the new value, as on ARM64 */
 static inline uint32_t atomic_add(volatile uint32_t *addr, uint32_t val)
 {
-    return __atomic_fetch_add(addr, val, __ATOMIC_SEQ_CST);
+    return __atomic_add_fetch(addr, val, __ATOMIC_SEQ_CST);
 }
 
 static inline uint32_t atomic_sub(volatile uint32_t *addr, uint32_t val)
 {
-    return __atomic_fetch_sub(addr, val, __ATOMIC_SEQ_CST);
+    return __atomic_sub_fetch(addr, val, __ATOMIC_SEQ_CST);
 }
 
 static inline bool atomic_cas(volatile uint32_t *addr, uint32_t expected, uint32_t desired)
@@ -296,5 +306,20 @@ static inline void spin_unlock_irq(spinlock_t *lock)
 #define ALIGNED(n)          __attribute__((aligned(n)))
 #define NORETURN            __attribute__((noreturn))
 #define WEAK                __attribute__((weak))
+#define SECTION(s)          __attribute__((section(s)))
+#define USED                __attribute__((used))
+
+/* Branch hints */
+#define likely(x)           __builtin_expect(!!(x), 1)
+#define unlikely(x)         __builtin_expect(!!(x), 0)
+
+/* ============================================================================
+ * Kernel Functions, for code that only includes this header
+ * ============================================================================ */
+
+extern void task_yield(void);
+extern void task_sleep(tick_t ticks);
+extern tcb_t *task_current(void);
+extern tick_t get_system_ticks(void);
 
 #endif /* RTOS_TYPES_H */
@@ -88,6 +88,10 @@ typedef struct {
 #define IRQ_APIC_ERROR      19  /* APIC Error */
 #define IRQ_APIC_SPURIOUS   255 /* Spurious */
 
+/* MSI/MSI-X vectors, handed out by irq_alloc_vectors() */
+#define IRQ_MSI_BASE        64
+#define IRQ_MSI_COUNT       16
+
 /* ============================================================================
  * Interrupt Frame
  * ============================================================================ */
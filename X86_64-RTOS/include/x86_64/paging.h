@@ -87,6 +87,7 @@ void mmu_unmap_page(uint64_t virt);
 uint64_t mmu_get_phys(uint64_t virt);
 void mmu_flush_tlb(void);
 void mmu_flush_page(void *addr);
+void *mmu_map_mmio(uint64_t phys, uint64_t size);
 
 /* Cache operations */
 void dcache_invalidate(void *addr, size_t size);
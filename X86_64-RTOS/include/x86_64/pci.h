@@ -0,0 +1,111 @@
+/*
+ * Gracemont X86_64 RTOS - PCI Definitions
+ * Copyright (C) 2024 Zixiao System
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef X86_64_PCI_H
+#define X86_64_PCI_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* ============================================================================
+ * Configuration Mechanism #1
+ * ============================================================================ */
+
+#define PCI_CONFIG_ADDRESS      0xCF8
+#define PCI_CONFIG_DATA         0xCFC
+
+/* ============================================================================
+ * Configuration Space Header
+ * ============================================================================ */
+
+#define PCI_VENDOR_ID           0x00
+#define PCI_DEVICE_ID           0x02
+#define PCI_COMMAND             0x04
+#define PCI_STATUS              0x06
+#define PCI_HEADER_TYPE         0x0E
+#define PCI_BAR0                0x10
+#define PCI_CAP_PTR             0x34
+
+#define PCI_COMMAND_MEMORY      (1 << 1)
+#define PCI_COMMAND_MASTER      (1 << 2)
+#define PCI_COMMAND_INTX_OFF    (1 << 10)
+
+#define PCI_STATUS_CAP_LIST     (1 << 4)
+
+#define PCI_BAR_IO              (1 << 0)
+#define PCI_BAR_MEM64           (2 << 1)
+#define PCI_BAR_MEM_MASK        0xFFFFFFF0U
+
+/* ============================================================================
+ * Capabilities
+ * ============================================================================ */
+
+#define PCI_CAP_ID_VNDR         0x09    /* Vendor specific (virtio) */
+#define PCI_CAP_ID_MSIX         0x11
+
+/* MSI-X capability layout */
+#define PCI_MSIX_CTRL           0x02
+#define PCI_MSIX_TABLE          0x04
+#define PCI_MSIX_PBA            0x08
+
+#define PCI_MSIX_CTRL_SIZE      0x07FF  /* Table size - 1 */
+#define PCI_MSIX_CTRL_MASKALL   (1 << 14)
+#define PCI_MSIX_CTRL_ENABLE    (1 << 15)
+#define PCI_MSIX_BIR_MASK       0x7
+
+/* MSI-X table entry (16 bytes) */
+#define PCI_MSIX_ENTRY_SIZE     16
+#define PCI_MSIX_ENTRY_ADDR_LO  0x0
+#define PCI_MSIX_ENTRY_ADDR_HI  0x4
+#define PCI_MSIX_ENTRY_DATA     0x8
+#define PCI_MSIX_ENTRY_CTRL     0xC
+#define PCI_MSIX_ENTRY_MASKED   (1 << 0)
+
+/* Message address targeting a local APIC (fixed, physical destination) */
+#define PCI_MSI_ADDR_BASE       0xFEE00000U
+#define PCI_MSI_ADDR_DEST(id)   ((uint32_t)(id) << 12)
+
+/* ============================================================================
+ * Device Handle
+ * ============================================================================ */
+
+typedef struct {
+    uint8_t             bus;
+    uint8_t             dev;
+    uint8_t             fn;
+    uint16_t            vendor;
+    uint16_t            device;
+    /* MSI-X, valid after pci_msix_init() */
+    uint8_t             msix_cap;
+    uint16_t            msix_count;
+    volatile uint32_t   *msix_table;
+} pci_dev_t;
+
+/* ============================================================================
+ * Functions
+ * ============================================================================ */
+
+/* Configuration space access */
+uint32_t pci_read32(const pci_dev_t *pdev, uint8_t off);
+uint16_t pci_read16(const pci_dev_t *pdev, uint8_t off);
+uint8_t pci_read8(const pci_dev_t *pdev, uint8_t off);
+void pci_write32(const pci_dev_t *pdev, uint8_t off, uint32_t val);
+void pci_write16(const pci_dev_t *pdev, uint8_t off, uint16_t val);
+
+/* Enumeration */
+bool pci_find_device(uint16_t vendor, uint16_t device, pci_dev_t *pdev);
+uint8_t pci_find_cap(const pci_dev_t *pdev, uint8_t cap_id, uint8_t start);
+uint64_t pci_bar_addr(const pci_dev_t *pdev, uint32_t bar);
+void pci_enable_master(const pci_dev_t *pdev);
+
+/* MSI-X */
+bool pci_msix_init(pci_dev_t *pdev);
+void pci_msix_enable(pci_dev_t *pdev, bool enable);
+void pci_msix_set_entry(pci_dev_t *pdev, uint16_t entry, uint32_t vector);
+void pci_msix_mask(pci_dev_t *pdev, uint16_t entry, bool masked);
+
+#endif /* X86_64_PCI_H */
@@ -8,6 +8,7 @@
 #include "rtos_types.h"
 #include "x86_64/idt.h"
 #include "x86_64/apic.h"
+#include "x86_64/cpu.h"
 
 /* ============================================================================
  * External Functions
@@ -79,17 +80,60 @@ void irq_handler(interrupt_frame_t *frame)
 
     irq_nest_count++;
 
+    /*
+     * EOI first: a handler may switch tasks (scheduler tick, semaphore
+     * wakeup), and the in-service bit would otherwise block this and all
+     * lower vectors until the interrupted task runs again. Interrupts
+     * stay disabled until iretq.
+     */
+    apic_send_eoi();
+
     /* Call registered handler if present */
     if (int_no < MAX_IRQS && irq_table[int_no].handler != NULL) {
         irq_table[int_no].handler(irq, irq_table[int_no].arg);
     }
 
-    /* Send EOI to APIC */
-    apic_send_eoi();
-
     irq_nest_count--;
 }
 
+/* ============================================================================
+ * Check if in IRQ Context
+ * ============================================================================ */
+
+bool in_irq_context(void)
+{
+    return irq_nest_count > 0;
+}
+
+/* ============================================================================
+ * MSI/MSI-X Vector Allocation
+ * ============================================================================ */
+
+static uint32_t msi_next_vector = IRQ_MSI_BASE;
+
+/*
+ * Reserve count consecutive vectors from the MSI range. Vectors are
+ * never returned; drivers allocate them once at init.
+ */
+status_t irq_alloc_vectors(uint32_t count, uint32_t *first)
+{
+    status_t ret = STATUS_NO_MEM;
+
+    if (count == 0 || first == NULL) {
+        return STATUS_INVALID;
+    }
+
+    spin_lock_irq(&irq_lock);
+    if (msi_next_vector + count <= IRQ_MSI_BASE + IRQ_MSI_COUNT) {
+        *first = msi_next_vector;
+        msi_next_vector += count;
+        ret = STATUS_OK;
+    }
+    spin_unlock_irq(&irq_lock);
+
+    return ret;
+}
+
 /* ============================================================================
  * IRQ Enable/Disable
  * ============================================================================ */
@@ -108,23 +152,270 @@ void irq_disable(uint32_t irq)
  * System Tick Counter
  * ============================================================================ */
 
-static volatile tick_t system_ticks = 0;
+volatile tick_t system_ticks = 0;     /* Also read by the scheduler */
 
 tick_t get_system_ticks(void)
 {
     return system_ticks;
 }
 
+/* ============================================================================
+ * Software Timer Management
+ * ============================================================================ */
+
+static timer_t *timer_list = NULL;
+static spinlock_t timer_lock = SPINLOCK_INIT;
+
+void timer_init(timer_t *timer, timer_callback_t callback, void *arg)
+{
+    timer->callback = callback;
+    timer->arg = arg;
+    timer->active = false;
+    timer->periodic = false;
+    timer->next = NULL;
+    timer->prev = NULL;
+}
+
+status_t timer_start(timer_t *timer, tick_t delay, bool periodic)
+{
+    if (timer == NULL || timer->callback == NULL) {
+        return STATUS_INVALID;
+    }
+
+    spin_lock_irq(&timer_lock);
+
+    /* Remove if already in list */
+    timer_t **pp = &timer_list;
+    while (*pp != NULL) {
+        if (*pp == timer) {
+            *pp = timer->next;
+            break;
+        }
+        pp = &(*pp)->next;
+    }
+
+    /* Setup timer */
+    timer->expire_tick = system_ticks + delay;
+    timer->period = periodic ? delay : 0;
+    timer->periodic = periodic;
+    timer->active = true;
+
+    /* Insert sorted by expiration */
+    pp = &timer_list;
+    while (*pp != NULL && (*pp)->expire_tick <= timer->expire_tick) {
+        pp = &(*pp)->next;
+    }
+    timer->next = *pp;
+    *pp = timer;
+
+    spin_unlock_irq(&timer_lock);
+    return STATUS_OK;
+}
+
+void timer_stop(timer_t *timer)
+{
+    if (timer == NULL) return;
+
+    spin_lock_irq(&timer_lock);
+
+    timer->active = false;
+
+    timer_t **pp = &timer_list;
+    while (*pp != NULL) {
+        if (*pp == timer) {
+            *pp = timer->next;
+            break;
+        }
+        pp = &(*pp)->next;
+    }
+
+    spin_unlock_irq(&timer_lock);
+}
+
+/* Run expired timers (IRQ context, interrupts disabled) */
+static void timer_expire(tick_t now)
+{
+    spin_lock(&timer_lock);
+
+    while (timer_list != NULL && timer_list->expire_tick <= now) {
+        timer_t *timer = timer_list;
+        timer_list = timer->next;
+
+        if (timer->active) {
+            /* Call callback outside lock */
+            spin_unlock(&timer_lock);
+            timer->callback(timer->arg);
+            spin_lock(&timer_lock);
+
+            /* Reschedule if periodic */
+            if (timer->periodic && timer->active) {
+                timer->expire_tick = now + timer->period;
+
+                /* Reinsert sorted */
+                timer_t **pp = &timer_list;
+                while (*pp != NULL && (*pp)->expire_tick <= timer->expire_tick) {
+                    pp = &(*pp)->next;
+                }
+                timer->next = *pp;
+                *pp = timer;
+            }
+        }
+    }
+
+    spin_unlock(&timer_lock);
+}
+
 /* Timer tick handler - called from APIC timer IRQ */
 static void timer_tick_handler(uint32_t irq, void *arg)
 {
     (void)irq;
     (void)arg;
 
+    extern void scheduler_tick(void);
+
     system_ticks++;
 
-    /* TODO: Call scheduler tick */
-    /* scheduler_tick(); */
+    timer_expire(system_ticks);
+    scheduler_tick();
+}
+
+/* ============================================================================
+ * High-Resolution Timers
+ *
+ * One-shot timers on the TSC nanosecond clock. The APIC timer carries
+ * the tick, so these run from PIT channel 0 in one-shot mode (about
+ * 838 ns resolution, 55 ms reach). The list is sorted by expiry and
+ * the PIT is armed for its head; an interrupt that finds nothing due
+ * re-arms for the new head, which also covers deadlines past 55 ms.
+ * ============================================================================ */
+
+extern void pit_oneshot(uint64_t ns);
+extern void pit_route_irq(uint8_t vector);
+
+static hrtimer_t *hrtimer_list = NULL;
+static spinlock_t hrtimer_lock = SPINLOCK_INIT;
+
+uint64_t timer_get_ns(void)
+{
+    uint64_t freq = cpu_info.tsc_freq;
+    uint64_t tsc = rdtsc();
+
+    /* Split so tsc * 1e9 cannot overflow */
+    return (tsc / freq) * 1000000000ULL + (tsc % freq) * 1000000000ULL / freq;
+}
+
+/* Arm the PIT for expires (hrtimer_lock held) */
+static void hrtimer_program(uint64_t expires)
+{
+    uint64_t now = timer_get_ns();
+
+    pit_oneshot(expires > now ? expires - now : 0);
+}
+
+/* Take timer off the list if it is on it (hrtimer_lock held) */
+static void hrtimer_unlink(hrtimer_t *timer)
+{
+    hrtimer_t **pp = &hrtimer_list;
+
+    while (*pp != NULL) {
+        if (*pp == timer) {
+            *pp = timer->next;
+            break;
+        }
+        pp = &(*pp)->next;
+    }
+    timer->next = NULL;
+    timer->active = false;
+}
+
+static void hrtimer_irq_handler(uint32_t irq, void *arg)
+{
+    (void)irq;
+    (void)arg;
+
+    spin_lock(&hrtimer_lock);
+
+    while (hrtimer_list != NULL) {
+        hrtimer_t *timer = hrtimer_list;
+
+        if (timer->expires > timer_get_ns()) {
+            hrtimer_program(timer->expires);
+            break;
+        }
+
+        hrtimer_list = timer->next;
+        timer->next = NULL;
+        timer->active = false;
+
+        /* Call callback outside lock; it may re-arm */
+        spin_unlock(&hrtimer_lock);
+        timer->callback(timer->arg);
+        spin_lock(&hrtimer_lock);
+    }
+
+    spin_unlock(&hrtimer_lock);
+}
+
+void hrtimer_driver_init(void)
+{
+    uint32_t vector;
+
+    if (irq_alloc_vectors(1, &vector) != STATUS_OK) {
+        uart_puts("[WARN] No vector for high-resolution timers\n");
+        return;
+    }
+
+    irq_register(vector, hrtimer_irq_handler, NULL);
+    pit_route_irq((uint8_t)vector);
+}
+
+void hrtimer_init(hrtimer_t *timer, timer_callback_t callback, void *arg)
+{
+    timer->expires = 0;
+    timer->callback = callback;
+    timer->arg = arg;
+    timer->active = false;
+    timer->next = NULL;
+}
+
+/*
+ * Arm timer for the absolute time expires (timer_get_ns() clock),
+ * moving it if already armed. A time in the past fires at once.
+ */
+status_t hrtimer_start(hrtimer_t *timer, uint64_t expires)
+{
+    if (timer == NULL || timer->callback == NULL) {
+        return STATUS_INVALID;
+    }
+
+    spin_lock_irq(&hrtimer_lock);
+
+    hrtimer_unlink(timer);
+    timer->expires = expires;
+    timer->active = true;
+
+    hrtimer_t **pp = &hrtimer_list;
+    while (*pp != NULL && (*pp)->expires <= expires) {
+        pp = &(*pp)->next;
+    }
+    timer->next = *pp;
+    *pp = timer;
+
+    if (hrtimer_list == timer) {
+        hrtimer_program(expires);
+    }
+
+    spin_unlock_irq(&hrtimer_lock);
+    return STATUS_OK;
+}
+
+void hrtimer_cancel(hrtimer_t *timer)
+{
+    if (timer == NULL) return;
+
+    spin_lock_irq(&hrtimer_lock);
+    hrtimer_unlink(timer);
+    spin_unlock_irq(&hrtimer_lock);
 }
 
 /* ============================================================================
@@ -5,7 +5,14 @@
  * SPDX-License-Identifier: GPL-3.0-or-later
  */
 
-#include "rtos_types.h"
+#include "rtos.h"
+#include "rtos_config.h"
+#include "zbuf.h"
+#include "net_stack.h"
+#include "eth.h"
+#include "modbus.h"
+#include "opcua.h"
+#include "profinet.h"
 #include "x86_64/cpu.h"
 #include "x86_64/gdt.h"
 #include "x86_64/idt.h"
@@ -129,6 +136,177 @@ static void parse_multiboot2_info(uint64_t magic, uint64_t info_addr)
     }
 }
 
+/* ============================================================================
+ * Application Tasks
+ * ============================================================================ */
+
+/* Network interface, NULL when no virtio-net device was found */
+static netif_t *eth0;
+
+/* Protocol contexts */
+static modbus_server_t modbus_server;
+static modbus_data_t modbus_data;
+static uint8_t modbus_coils[256];
+static uint16_t modbus_holding_regs[256];
+static uint16_t modbus_input_regs[256];
+
+static opcua_server_t opcua_server;
+static pnio_device_t profinet_device;
+
+/* Task stacks */
+static uint8_t main_task_stack[CONFIG_TASK_STACK_SIZE] ALIGNED(16);
+static uint8_t modbus_task_stack[CONFIG_TASK_STACK_SIZE] ALIGNED(16);
+static uint8_t opcua_task_stack[CONFIG_TASK_STACK_SIZE] ALIGNED(16);
+static uint8_t profinet_task_stack[CONFIG_TASK_STACK_SIZE] ALIGNED(16);
+
+static tcb_t main_tcb;
+static tcb_t modbus_tcb;
+static tcb_t opcua_tcb;
+static tcb_t profinet_tcb;
+
+static void modbus_task(void *arg)
+{
+    (void)arg;
+    uart_puts("[MODBUS] Starting server on port 502\n");
+
+    /* Initialize data model */
+    modbus_data.coils = modbus_coils;
+    modbus_data.coils_count = CONFIG_MODBUS_MAX_COILS;
+    modbus_data.discrete_inputs = modbus_coils;
+    modbus_data.discrete_inputs_count = CONFIG_MODBUS_MAX_COILS;
+    modbus_data.holding_registers = modbus_holding_regs;
+    modbus_data.holding_registers_count = CONFIG_MODBUS_MAX_REGS;
+    modbus_data.input_registers = modbus_input_regs;
+    modbus_data.input_registers_count = CONFIG_MODBUS_MAX_REGS;
+    modbus_data.lock = (spinlock_t)SPINLOCK_INIT;
+
+    modbus_server_init(&modbus_server, CONFIG_MODBUS_SLAVE_ADDR, &modbus_data);
+    modbus_tcp_server_start(&modbus_server, CONFIG_MODBUS_TCP_PORT);
+
+    while (1) {
+        modbus_server_poll(&modbus_server);
+        task_sleep(1);
+    }
+}
+
+static void opcua_task(void *arg)
+{
+    (void)arg;
+    uart_puts("[OPCUA] Starting server on port 4840\n");
+
+    opcua_server_init(&opcua_server);
+
+    /* Create address space */
+    opcua_nodeid_t root_id = { .ns = 0, .type = OPCUA_NODEID_NUMERIC, .id.numeric = 84 };
+    opcua_node_t *root = opcua_add_node(&opcua_server, NULL, &root_id,
+                                         OPCUA_NC_OBJECT, "Root", "Root Folder");
+
+    opcua_nodeid_t objects_id = { .ns = 0, .type = OPCUA_NODEID_NUMERIC, .id.numeric = 85 };
+    opcua_node_t *objects = opcua_add_node(&opcua_server, root, &objects_id,
+                                            OPCUA_NC_OBJECT, "Objects", "Objects");
+
+    /* Process variables, INT32 fixed point (x10): no FPU state in the kernel */
+    opcua_nodeid_t temp_id = { .ns = 1, .type = OPCUA_NODEID_NUMERIC, .id.numeric = 1001 };
+    opcua_node_t *temp_node = opcua_add_node(&opcua_server, objects, &temp_id,
+                                              OPCUA_NC_VARIABLE, "Temperature", "Temperature");
+    if (temp_node) {
+        opcua_variant_t val = { .type = OPCUA_TYPE_INT32, .value.i32 = 255 };
+        opcua_set_value(temp_node, &val);
+    }
+
+    opcua_nodeid_t pressure_id = { .ns = 1, .type = OPCUA_NODEID_NUMERIC, .id.numeric = 1002 };
+    opcua_node_t *pressure_node = opcua_add_node(&opcua_server, objects, &pressure_id,
+                                                  OPCUA_NC_VARIABLE, "Pressure", "Pressure");
+    if (pressure_node) {
+        opcua_variant_t val = { .type = OPCUA_TYPE_INT32, .value.i32 = 1013 };
+        opcua_set_value(pressure_node, &val);
+    }
+
+    opcua_server_start(&opcua_server, CONFIG_OPCUA_PORT);
+
+    while (1) {
+        opcua_server_poll(&opcua_server);
+        task_sleep(10);
+    }
+}
+
+static void profinet_task(void *arg)
+{
+    (void)arg;
+    uart_puts("[PNIO] Starting device\n");
+
+    pnio_device_init(&profinet_device, eth0, "rtos-device", 0x1234, 0x5678);
+
+    /* Add slots and subslots */
+    pnio_add_slot(&profinet_device, 0, 0x00000001);  /* DAP */
+    pnio_add_subslot(&profinet_device, 0, 1, 0x00000001, 0, 0);
+
+    pnio_add_slot(&profinet_device, 1, 0x00000010);  /* IO Module */
+    pnio_add_subslot(&profinet_device, 1, 1, 0x00000001, 8, 8);  /* 8 bytes I/O */
+
+    pnio_plug_submodule(&profinet_device, 0, 1);
+    pnio_plug_submodule(&profinet_device, 1, 1);
+
+    pnio_device_start(&profinet_device);
+
+    uint8_t counter = 0;
+    while (1) {
+        pnio_device_poll(&profinet_device);
+
+        /* Update I/O data */
+        uint8_t *input = pnio_get_input_data(&profinet_device, 1, 1);
+        if (input) {
+            input[0] = counter++;
+            input[1] = (uint8_t)(get_system_ticks() & 0xFF);
+        }
+
+        task_sleep(1);  /* 1ms cycle */
+    }
+}
+
+static void main_task(void *arg)
+{
+    (void)arg;
+    uart_puts("[MAIN] System running\n");
+
+    /* System monitoring */
+    uint64_t uptime = 0;
+    while (1) {
+        task_sleep(MS_TO_TICKS(1000));
+        uptime++;
+
+        if ((uptime % 60) == 0) {
+            uint32_t total, free, failures;
+            zbuf_pool_stats(&total, &free, &failures);
+
+            uart_puts("[MAIN] Uptime: ");
+            uart_putdec(uptime);
+            uart_puts("s, zbuf free: ");
+            uart_putdec(free);
+            uart_puts("/");
+            uart_putdec(total);
+            uart_puts(", peak: ");
+            uart_putdec(zbuf_pool_peak());
+            uart_puts("\n");
+
+#if CONFIG_ZBUF_DEBUG
+            /* Buffers held for more than a minute are leak suspects */
+            zbuf_leak_t leaks[4];
+            uint32_t n = zbuf_leak_report(60 * CONFIG_TICK_RATE_HZ, leaks, 4);
+            for (uint32_t i = 0; i < n && i < 4; i++) {
+                uart_puts("[MAIN] zbuf leak? owner=");
+                uart_puts(zbuf_owner_name(leaks[i].owner));
+                uart_puts(" site=");
+                uart_puts(leaks[i].site ? leaks[i].site : "?");
+                uart_puts(":");
+                uart_putdec(leaks[i].line);
+                uart_puts("\n");
+            }
+#endif
+        }
+    }
+}
+
 /* ============================================================================
  * Kernel Main Entry Point
  * ============================================================================ */
@@ -172,14 +350,59 @@ void kernel_main(uint64_t magic, uint64_t info)
     apic_init();
     ioapic_init();
 
+    /* IRQ dispatch table and tick handler, before any irq_register() */
+    interrupt_init();
+
+    /* Initialize memory */
+    uart_puts("[INIT] Initializing memory...\n");
+    heap_init();
+    dma_pool_init();
+
+    uart_puts("[INIT] Initializing zero-copy buffers...\n");
+    zbuf_pool_init();
+
+    /* Initialize network stack and virtio-net */
+    uart_puts("[INIT] Initializing network stack...\n");
+    net_stack_init();
+    if (eth_init() == STATUS_OK) {
+        eth0 = eth_get_netif();
+        netif_set_addr(eth0, IP4_ADDR(192, 168, 1, 100), IP4_ADDR(255, 255, 255, 0),
+                       IP4_ADDR(192, 168, 1, 1));
+        uart_puts("[INIT] eth0: 192.168.1.100/24\n");
+    } else {
+        uart_puts("[INIT] No virtio-net device, protocols disabled\n");
+    }
+
+    /* One-shot timers for launch-time transmit */
+    hrtimer_driver_init();
+
     /* Initialize APIC timer (1000 Hz = 1ms tick) */
     uart_puts("[INIT] Starting APIC timer (1000 Hz)...\n");
-    apic_timer_init(1000);
+    apic_timer_init(CONFIG_TICK_RATE_HZ);
 
     /* Enable interrupts */
     uart_puts("[INIT] Enabling interrupts...\n");
     enable_interrupts();
 
+    /* Create tasks */
+    uart_puts("[INIT] Creating tasks...\n");
+    task_create(&main_tcb, "main", main_task, NULL, 8,
+                main_task_stack, sizeof(main_task_stack));
+    task_start(&main_tcb);
+
+    if (eth0 != NULL) {
+        task_create(&modbus_tcb, "modbus", modbus_task, NULL, 10,
+                    modbus_task_stack, sizeof(modbus_task_stack));
+        task_create(&opcua_tcb, "opcua", opcua_task, NULL, 10,
+                    opcua_task_stack, sizeof(opcua_task_stack));
+        task_create(&profinet_tcb, "profinet", profinet_task, NULL, 12,
+                    profinet_task_stack, sizeof(profinet_task_stack));
+
+        task_start(&modbus_tcb);
+        task_start(&opcua_tcb);
+        task_start(&profinet_tcb);
+    }
+
     /* Initialization complete */
     uart_puts("\n");
     uart_puts("[INIT] ========================================\n");
@@ -187,25 +410,6 @@ void kernel_main(uint64_t magic, uint64_t info)
     uart_puts("[INIT] ========================================\n");
     uart_puts("\n");
 
-    /* TODO: Initialize memory allocator */
-    /* TODO: Initialize scheduler */
-    /* TODO: Create system tasks */
-    /* TODO: Initialize network stack */
-    /* TODO: Initialize industrial protocols */
-
-    /* For now, just loop and show we're alive */
-    uart_puts("[MAIN] Entering main loop...\n");
-
-    volatile uint64_t counter = 0;
-    while (1) {
-        /* Simple heartbeat every ~10 million iterations */
-        if (++counter % 100000000 == 0) {
-            uart_puts("[MAIN] Heartbeat: ");
-            uart_putdec(counter / 100000000);
-            uart_puts("\n");
-        }
-
-        /* Halt until next interrupt */
-        __asm__ volatile("hlt");
-    }
+    /* Start scheduler - never returns */
+    scheduler_start();
 }
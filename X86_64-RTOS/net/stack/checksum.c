@@ -0,0 +1,318 @@
+/*
+ * Gracemont Industrial Control Framework - ARM64 RTOS
+ * Copyright (C) 2024 Zixiao System <https://github.com/Zixiao-System>
+ *
+ * This file is part of Gracemont Industrial Control Framework.
+ * Repository: https://github.com/Zixiao-System/gracemont
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * Internet Checksum (RFC 1071, RFC 1624)
+ */
+
+#include "net_stack.h"
+#include "rtos_config.h"
+#include "rtos_types.h"
+
+extern uint64_t arch_irq_save(void);
+extern void arch_irq_restore(uint64_t flags);
+
+/*
+ * Sums are kept in memory order: 16-bit words are loaded in host byte
+ * order straight from the packet (RFC 1071 section 2(B)), so a folded,
+ * complemented result can be stored into a header field as is. Partial
+ * sums are returned folded to 16 bits, so two of them can be added
+ * before the final fold. They may be chained, provided every chunk but
+ * the last has even length.
+ */
+
+/* Packet data may be any type and alignment */
+typedef uint64_t __attribute__((may_alias)) csum_a64_t;
+typedef uint16_t __attribute__((may_alias, aligned(1))) csum_u16_t;
+typedef uint32_t __attribute__((may_alias, aligned(1))) csum_u32_t;
+typedef uint64_t __attribute__((may_alias, aligned(1))) csum_u64_t;
+
+#if CONFIG_ARM64_NEON_CSUM
+/* arch/arm64/csum.S */
+extern uint64_t csum_neon_block(const void *buf, size_t len);
+
+/*
+ * SIMD registers are not part of the task context, so NEON runs with
+ * IRQs masked, one chunk at a time to bound the latency.
+ */
+#define CSUM_NEON_MIN       256
+#define CSUM_NEON_CHUNK     1024
+#endif
+
+static inline uint32_t csum_fold64(uint64_t sum)
+{
+    sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+    sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+    return (uint32_t)sum;
+}
+
+static inline uint16_t csum_fold16(uint32_t sum)
+{
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    return (uint16_t)sum;
+}
+
+static inline uint16_t csum_swab16(uint16_t x)
+{
+    return (uint16_t)((x << 8) | (x >> 8));
+}
+
+/*
+ * Sum 8-byte aligned words, len a multiple of 8
+ *
+ * Each 64-bit word is added as two 32-bit halves, so the accumulators
+ * cannot overflow for any realistic length and no carry chain is needed.
+ */
+static uint64_t csum_words(const uint8_t *p, size_t len)
+{
+    const csum_a64_t *w = (const csum_a64_t *)p;
+    uint64_t a0 = 0, a1 = 0;
+
+    while (len >= 32) {
+        uint64_t x0 = w[0], x1 = w[1], x2 = w[2], x3 = w[3];
+        a0 += (x0 & 0xFFFFFFFF) + (x0 >> 32);
+        a1 += (x1 & 0xFFFFFFFF) + (x1 >> 32);
+        a0 += (x2 & 0xFFFFFFFF) + (x2 >> 32);
+        a1 += (x3 & 0xFFFFFFFF) + (x3 >> 32);
+        w += 4;
+        len -= 32;
+    }
+
+    while (len >= 8) {
+        a0 += (w[0] & 0xFFFFFFFF) + (w[0] >> 32);
+        w++;
+        len -= 8;
+    }
+
+    return a0 + a1;
+}
+
+/*
+ * Partial Checksum
+ */
+uint32_t inet_csum_partial(const void *data, size_t len, uint32_t sum)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    uint64_t acc = 0;
+    bool odd;
+
+    if (len == 0) {
+        return sum;
+    }
+
+    /* Odd start: sum byte-shifted words and swap the result back */
+    odd = ((uintptr_t)p & 1) != 0;
+    if (odd) {
+        acc += (uint64_t)*p << 8;
+        p++;
+        len--;
+    }
+
+    /* Align to 8 bytes */
+    while (len >= 2 && ((uintptr_t)p & 7) != 0) {
+        acc += *(const csum_u16_t *)p;
+        p += 2;
+        len -= 2;
+    }
+
+#if CONFIG_ARM64_NEON_CSUM
+    if (len >= CSUM_NEON_MIN) {
+        while (len >= 64) {
+            size_t n = len & ~(size_t)63;
+            if (n > CSUM_NEON_CHUNK) n = CSUM_NEON_CHUNK;
+            uint64_t flags = arch_irq_save();
+            acc += csum_neon_block(p, n);
+            arch_irq_restore(flags);
+            p += n;
+            len -= n;
+        }
+    }
+#endif
+
+    size_t n = len & ~(size_t)7;
+    acc += csum_words(p, n);
+    p += n;
+    len -= n;
+
+    /* Tail */
+    if (len >= 4) {
+        acc += *(const csum_u32_t *)p;
+        p += 4;
+        len -= 4;
+    }
+    if (len >= 2) {
+        acc += *(const csum_u16_t *)p;
+        p += 2;
+        len -= 2;
+    }
+    if (len == 1) {
+        acc += *p;  /* Little-endian: trailing byte is the low half */
+    }
+
+    uint16_t result = csum_fold16(csum_fold64(acc));
+    if (odd) {
+        result = csum_swab16(result);
+    }
+
+    return csum_fold16(csum_fold64((uint64_t)result + sum));
+}
+
+/*
+ * Copy and Checksum
+ *
+ * Sums the data while it is copied, so a payload copied into a TX
+ * buffer never has to be read a second time.
+ */
+uint32_t inet_csum_copy(void *dst, const void *src, size_t len, uint32_t sum)
+{
+    const uint8_t *s = (const uint8_t *)src;
+    uint8_t *d = (uint8_t *)dst;
+    uint64_t acc = 0;
+    bool odd;
+
+    if (len == 0) {
+        return sum;
+    }
+
+    odd = ((uintptr_t)s & 1) != 0;
+    if (odd) {
+        *d = *s;
+        acc += (uint64_t)*s << 8;
+        s++;
+        d++;
+        len--;
+    }
+
+    /* Align source to 8 bytes; stores may stay unaligned */
+    while (len >= 2 && ((uintptr_t)s & 7) != 0) {
+        uint16_t v = *(const csum_u16_t *)s;
+        *(csum_u16_t *)d = v;
+        acc += v;
+        s += 2;
+        d += 2;
+        len -= 2;
+    }
+
+    while (len >= 16) {
+        uint64_t x0 = ((const csum_a64_t *)s)[0];
+        uint64_t x1 = ((const csum_a64_t *)s)[1];
+        ((csum_u64_t *)d)[0] = x0;
+        ((csum_u64_t *)d)[1] = x1;
+        acc += (x0 & 0xFFFFFFFF) + (x0 >> 32);
+        acc += (x1 & 0xFFFFFFFF) + (x1 >> 32);
+        s += 16;
+        d += 16;
+        len -= 16;
+    }
+
+    if (len >= 8) {
+        uint64_t x = *(const csum_a64_t *)s;
+        *(csum_u64_t *)d = x;
+        acc += (x & 0xFFFFFFFF) + (x >> 32);
+        s += 8;
+        d += 8;
+        len -= 8;
+    }
+    if (len >= 4) {
+        uint32_t v = *(const csum_u32_t *)s;
+        *(csum_u32_t *)d = v;
+        acc += v;
+        s += 4;
+        d += 4;
+        len -= 4;
+    }
+    if (len >= 2) {
+        uint16_t v = *(const csum_u16_t *)s;
+        *(csum_u16_t *)d = v;
+        acc += v;
+        s += 2;
+        d += 2;
+        len -= 2;
+    }
+    if (len == 1) {
+        *d = *s;
+        acc += *s;
+    }
+
+    uint16_t result = csum_fold16(csum_fold64(acc));
+    if (odd) {
+        result = csum_swab16(result);
+    }
+
+    return csum_fold16(csum_fold64((uint64_t)result + sum));
+}
+
+/*
+ * Fold a partial sum into a checksum field value
+ */
+uint16_t inet_csum_fold(uint32_t sum)
+{
+    return (uint16_t)~csum_fold16(sum);
+}
+
+uint16_t inet_checksum(const void *data, size_t len)
+{
+    return inet_csum_fold(inet_csum_partial(data, len, 0));
+}
+
+/*
+ * Pseudo-Header Sum
+ *
+ * Addresses and length are in host order; the result is a partial sum
+ * in memory order, ready to seed inet_csum_partial().
+ */
+uint16_t inet_pseudo_checksum(uint32_t src, uint32_t dst, uint8_t proto, uint16_t len)
+{
+    uint32_t sum = 0;
+    sum += (src >> 16) & 0xFFFF;
+    sum += src & 0xFFFF;
+    sum += (dst >> 16) & 0xFFFF;
+    sum += dst & 0xFFFF;
+    sum += proto;
+    sum += len;
+
+    return htons(csum_fold16(sum));
+}
+
+/*
+ * Incremental Update (RFC 1624, eqn. 3)
+ *
+ * HC' = ~(~HC + ~m + m'), with the checksum and field values taken as
+ * they appear in the header.
+ */
+uint16_t inet_csum_update16(uint16_t check, uint16_t old_val, uint16_t new_val)
+{
+    uint32_t sum = (uint16_t)~check;
+    sum += (uint16_t)~old_val;
+    sum += new_val;
+
+    return (uint16_t)~csum_fold16(sum);
+}
+
+uint16_t inet_csum_update32(uint16_t check, uint32_t old_val, uint32_t new_val)
+{
+    uint32_t sum = (uint16_t)~check;
+    sum += (~old_val & 0xFFFF) + (~old_val >> 16);
+    sum += (new_val & 0xFFFF) + (new_val >> 16);
+
+    return (uint16_t)~csum_fold16(sum);
+}
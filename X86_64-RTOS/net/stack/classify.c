@@ -0,0 +1,332 @@
+/*
+ * Gracemont Industrial Control Framework - ARM64 RTOS
+ * Copyright (C) 2024 Zixiao System <https://github.com/Zixiao-System>
+ *
+ * This file is part of Gracemont Industrial Control Framework.
+ * Repository: https://github.com/Zixiao-System/gracemont
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ *
+ *
+ * Early RX Classifier
+ *
+ * A short rule table consulted by netif_input() before the protocol
+ * switch. Rules match on interface, ethertype, broadcast destination,
+ * IPv4 addresses, protocol and port ranges, or PROFINET frame ID
+ * range; the first match decides. Unwanted traffic (broadcast storms,
+ * port scans) is shed before ip_input() verifies a checksum, and known
+ * flows can be queued or handed to a handler directly. Only headers
+ * are looked at: IP packets are matched before their checksum is
+ * verified.
+ *
+ * The RX path reads the table without the lock. A rule is published
+ * by setting its bit in cls_mask after it is written and withdrawn by
+ * clearing the bit. Each walk is counted in the current epoch; delete
+ * moves to the next epoch and waits for the walks of the last one, so
+ * once net_cls_del() returns no packet can still use the rule and its
+ * queue, handler and semaphore may be freed. The slot is not reused
+ * until then. A handler therefore must not delete rules itself. With
+ * no rules the cost is one load.
+ */
+
+#include "net_stack.h"
+#include "rtos_config.h"
+#include "rtos.h"
+
+typedef struct {
+    net_cls_rule_t      rule;
+    volatile uint32_t   hits;
+    volatile uint32_t   drops;
+} cls_entry_t;
+
+static cls_entry_t cls_table[CONFIG_NET_CLS_RULES];
+static volatile uint32_t cls_mask;     /* Bit n: slot n published */
+static uint32_t cls_used;              /* Bit n: slot n taken, or being deleted */
+static spinlock_t cls_lock = SPINLOCK_INIT;
+
+/* Walks in progress per epoch; a delete drains the old one */
+static volatile uint32_t cls_epoch;
+static volatile uint32_t cls_walkers[2];
+static bool cls_draining;               /* One delete at a time, under cls_lock */
+
+/* Header fields of one packet, parsed once for all rules */
+typedef struct {
+    uint16_t    ethertype;
+    bool        bcast;
+    bool        has_ip;
+    bool        has_ports;
+    bool        has_frame_id;
+    uint8_t     proto;
+    uint32_t    src;
+    uint32_t    dst;
+    uint16_t    sport;
+    uint16_t    dport;
+    uint16_t    frame_id;
+} cls_key_t;
+
+void net_cls_init(void)
+{
+    spin_lock_irq(&cls_lock);
+    cls_mask = 0;
+    cls_used = 0;
+    for (int i = 0; i < CONFIG_NET_CLS_RULES; i++) {
+        cls_table[i].hits = 0;
+        cls_table[i].drops = 0;
+    }
+    spin_unlock_irq(&cls_lock);
+}
+
+/*
+ * Add a rule in the lowest free slot; rules are tried in slot order.
+ * Returns the rule ID, or STATUS_INVALID / STATUS_NO_MEM.
+ */
+int net_cls_add(const net_cls_rule_t *rule)
+{
+    if (rule == NULL ||
+        (rule->action == NET_CLS_QUEUE && rule->queue == NULL) ||
+        (rule->action == NET_CLS_REDIRECT && rule->handler == NULL) ||
+        rule->action > NET_CLS_REDIRECT) {
+        return STATUS_INVALID;
+    }
+
+    int id = STATUS_NO_MEM;
+
+    spin_lock_irq(&cls_lock);
+
+    for (int i = 0; i < CONFIG_NET_CLS_RULES; i++) {
+        if (!(cls_used & (1U << i))) {
+            cls_table[i].rule = *rule;
+            cls_table[i].hits = 0;
+            cls_table[i].drops = 0;
+            dmb();
+            cls_used |= 1U << i;
+            cls_mask |= 1U << i;
+            id = i;
+            break;
+        }
+    }
+
+    spin_unlock_irq(&cls_lock);
+
+    return id;
+}
+
+/*
+ * Delete a rule; returns once no packet can still be using it
+ */
+status_t net_cls_del(int id)
+{
+    if (id < 0 || id >= CONFIG_NET_CLS_RULES) {
+        return STATUS_INVALID;
+    }
+
+    spin_lock_irq(&cls_lock);
+    while (cls_draining) {
+        spin_unlock_irq(&cls_lock);
+        task_sleep(1);
+        spin_lock_irq(&cls_lock);
+    }
+    if (!(cls_mask & (1U << id))) {
+        spin_unlock_irq(&cls_lock);
+        return STATUS_INVALID;
+    }
+
+    /* Withdrawn first: walks of the new epoch cannot see it */
+    cls_draining = true;
+    cls_mask &= ~(1U << id);
+    dmb();
+    uint32_t old = cls_epoch;
+    cls_epoch = old ^ 1;
+    dmb();
+    spin_unlock_irq(&cls_lock);
+
+    while (atomic_load(&cls_walkers[old]) != 0) {
+        task_sleep(1);
+    }
+
+    spin_lock_irq(&cls_lock);
+    cls_used &= ~(1U << id);
+    cls_draining = false;
+    spin_unlock_irq(&cls_lock);
+
+    return STATUS_OK;
+}
+
+status_t net_cls_get_stats(int id, net_cls_stats_t *stats)
+{
+    if (id < 0 || id >= CONFIG_NET_CLS_RULES || stats == NULL) {
+        return STATUS_INVALID;
+    }
+
+    stats->hits = cls_table[id].hits;
+    stats->drops = cls_table[id].drops;
+
+    return STATUS_OK;
+}
+
+/* Fill key from a frame whose data starts after the link header */
+static void cls_parse(const zbuf_t *zb, cls_key_t *key)
+{
+    const eth_hdr_t *eth = (const eth_hdr_t *)(zb->data - zb->l3_offset);
+
+    key->ethertype = zb->protocol;
+    key->bcast = (eth->dst[0] & 0x01) != 0;     /* Group bit: broadcast or multicast */
+    key->has_ip = false;
+    key->has_ports = false;
+    key->has_frame_id = false;
+    key->proto = 0;
+    key->src = 0;
+    key->dst = 0;
+    key->sport = 0;
+    key->dport = 0;
+    key->frame_id = 0;
+
+    if (key->ethertype == ETH_TYPE_IP && zb->len >= sizeof(ip_hdr_t)) {
+        const ip_hdr_t *ip = (const ip_hdr_t *)zb->data;
+        uint8_t ihl = IP_HDR_LEN(ip);
+
+        if ((ip->ver_ihl >> 4) != 4 || ihl < sizeof(ip_hdr_t) || ihl > zb->len) {
+            return;
+        }
+
+        key->has_ip = true;
+        key->proto = ip->proto;
+        key->src = ntohl(ip->src);
+        key->dst = ntohl(ip->dst);
+
+        /* Ports only in the first fragment */
+        if ((key->proto == IP_PROTO_TCP || key->proto == IP_PROTO_UDP) &&
+            (ntohs(ip->frag) & 0x1FFF) == 0 && zb->len >= ihl + 4) {
+            const uint16_t *ports = (const uint16_t *)(zb->data + ihl);
+            key->sport = ntohs(ports[0]);
+            key->dport = ntohs(ports[1]);
+            key->has_ports = true;
+        }
+    } else if (key->ethertype == ETH_TYPE_PNIO && zb->len >= 2) {
+        key->frame_id = (uint16_t)((zb->data[0] << 8) | zb->data[1]);
+        key->has_frame_id = true;
+    }
+}
+
+static bool cls_match(const net_cls_rule_t *r, const netif_t *nif, const cls_key_t *key)
+{
+    uint16_t m = r->match;
+
+    if (r->nif != NULL && r->nif != nif) return false;
+    if ((m & NET_CLS_M_ETHERTYPE) && key->ethertype != r->ethertype) return false;
+    if ((m & NET_CLS_M_BCAST) && !key->bcast) return false;
+
+    if (m & (NET_CLS_M_SRC_IP | NET_CLS_M_DST_IP | NET_CLS_M_PROTO)) {
+        if (!key->has_ip) return false;
+        if ((m & NET_CLS_M_SRC_IP) && (key->src & r->src_mask) != r->src_ip) return false;
+        if ((m & NET_CLS_M_DST_IP) && (key->dst & r->dst_mask) != r->dst_ip) return false;
+        if ((m & NET_CLS_M_PROTO) && key->proto != r->proto) return false;
+    }
+
+    if (m & (NET_CLS_M_SPORT | NET_CLS_M_DPORT)) {
+        if (!key->has_ports) return false;
+        if ((m & NET_CLS_M_SPORT) &&
+            (key->sport < r->sport_lo || key->sport > r->sport_hi)) return false;
+        if ((m & NET_CLS_M_DPORT) &&
+            (key->dport < r->dport_lo || key->dport > r->dport_hi)) return false;
+    }
+
+    if (m & NET_CLS_M_FRAME_ID) {
+        if (!key->has_frame_id) return false;
+        if (key->frame_id < r->frame_id_lo || key->frame_id > r->frame_id_hi) return false;
+    }
+
+    return true;
+}
+
+/* First matching rule decides, within a counted walk */
+static bool cls_walk(netif_t *nif, zbuf_t *zb, uint32_t mask)
+{
+    cls_key_t key;
+    cls_parse(zb, &key);
+
+    for (int i = 0; i < CONFIG_NET_CLS_RULES && mask != 0; i++, mask >>= 1) {
+        if (!(mask & 1)) continue;
+
+        cls_entry_t *e = &cls_table[i];
+        const net_cls_rule_t *r = &e->rule;
+
+        if (!cls_match(r, nif, &key)) continue;
+
+        atomic_add(&e->hits, 1);
+
+        switch (r->action) {
+        case NET_CLS_PASS:
+            return false;
+
+        case NET_CLS_QUEUE: {
+            zbuf_queue_t *q = r->queue;
+            if (q == NULL || (r->queue_limit != 0 && zbuf_queue_len(q) >= r->queue_limit)) {
+                atomic_add(&e->drops, 1);
+                zbuf_free(zb);
+                return true;
+            }
+            zbuf_queue_push(q, zb);
+            if (r->sem != NULL) {
+                sem_post(r->sem);
+            }
+            return true;
+        }
+
+        case NET_CLS_REDIRECT: {
+            net_cls_handler_t handler = r->handler;
+            if (handler == NULL) {
+                zbuf_free(zb);
+                return true;
+            }
+            handler(nif, zb, r->arg);
+            return true;
+        }
+
+        case NET_CLS_DROP:
+        default:
+            zbuf_free(zb);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Classify a received frame (data after the link header)
+ *
+ * Returns true if a rule consumed it; false sends it on to the
+ * protocol switch, either because nothing matched or because the
+ * first match was NET_CLS_PASS.
+ */
+bool net_classify(netif_t *nif, zbuf_t *zb)
+{
+    if (cls_mask == 0) {
+        return false;
+    }
+
+    /* Counted before the mask is read, so a delete waits for this walk */
+    uint32_t epoch = cls_epoch;
+    atomic_add(&cls_walkers[epoch], 1);
+    dmb();
+
+    bool taken = cls_walk(nif, zb, cls_mask);
+
+    atomic_sub(&cls_walkers[epoch], 1);
+    return taken;
+}
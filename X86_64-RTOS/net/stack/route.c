@@ -0,0 +1,289 @@
+/*
+ * Gracemont Industrial Control Framework - ARM64 RTOS
+ * Copyright (C) 2024 Zixiao System <https://github.com/Zixiao-System>
+ *
+ * This file is part of Gracemont Industrial Control Framework.
+ * Repository: https://github.com/Zixiao-System/gracemont
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ *
+ * IPv4 Routing Table
+ *
+ * A small longest-prefix-match table. Entries are kept ordered by
+ * prefix length, longest first, so the first match of a linear scan is
+ * the best one; with a few dozen routes at most this beats a trie on
+ * both size and speed.
+ *
+ * Every change bumps route_gen. Sockets keep the result of their last
+ * lookup in a route_cache_t and reuse it until the generation moves,
+ * so a connection resolves its route once rather than per segment.
+ */
+
+#include "net_stack.h"
+#include "rtos_config.h"
+#include "rtos.h"
+
+typedef struct {
+    uint32_t    dest;           /* Network, host byte order */
+    uint32_t    netmask;
+    uint32_t    gateway;        /* 0 for on-link */
+    netif_t     *nif;
+    bool        iface;          /* Installed from the interface address */
+} route_entry_t;
+
+static route_entry_t route_table[CONFIG_NET_ROUTE_ENTRIES];
+static uint32_t route_count;
+static volatile uint32_t route_gen = 1;    /* 0 never matches a cache */
+static spinlock_t route_lock = SPINLOCK_INIT;
+static route_stats_t route_stats;
+
+static inline bool route_mask_valid(uint32_t netmask)
+{
+    uint32_t host = ~netmask;
+    return (host & (host + 1)) == 0;
+}
+
+/*
+ * Table Internals (route_lock held)
+ */
+static netif_t *route_find(uint32_t dst, uint32_t *next_hop)
+{
+    /* Contiguous masks compare like prefix lengths */
+    for (uint32_t i = 0; i < route_count; i++) {
+        route_entry_t *r = &route_table[i];
+        if ((dst & r->netmask) == r->dest) {
+            *next_hop = r->gateway ? r->gateway : dst;
+            return r->nif;
+        }
+    }
+    return NULL;
+}
+
+static void route_remove_at(uint32_t i)
+{
+    for (; i + 1 < route_count; i++) {
+        route_table[i] = route_table[i + 1];
+    }
+    route_count--;
+    route_gen++;
+}
+
+static status_t route_insert(uint32_t dest, uint32_t netmask, uint32_t gateway,
+                             netif_t *nif, bool iface)
+{
+    dest &= netmask;
+
+    /* Same prefix replaces the old entry */
+    for (uint32_t i = 0; i < route_count; i++) {
+        if (route_table[i].dest == dest && route_table[i].netmask == netmask) {
+            route_remove_at(i);
+            break;
+        }
+    }
+
+    if (route_count >= CONFIG_NET_ROUTE_ENTRIES) {
+        return STATUS_NO_MEM;
+    }
+
+    /* After the last entry with an equal or longer prefix */
+    uint32_t pos = route_count;
+    while (pos > 0 && route_table[pos - 1].netmask < netmask) {
+        route_table[pos] = route_table[pos - 1];
+        pos--;
+    }
+
+    route_table[pos].dest = dest;
+    route_table[pos].netmask = netmask;
+    route_table[pos].gateway = gateway;
+    route_table[pos].nif = nif;
+    route_table[pos].iface = iface;
+    route_count++;
+    route_gen++;
+
+    return STATUS_OK;
+}
+
+/*
+ * Initialize Routing Table
+ *
+ * May be called again to flush the table.
+ */
+void route_init(void)
+{
+    spin_lock_irq(&route_lock);
+
+    route_count = 0;
+    route_gen++;
+
+    route_stats.entries = 0;
+    route_stats.lookups = 0;
+    route_stats.cache_hits = 0;
+    route_stats.unreachable = 0;
+
+    spin_unlock_irq(&route_lock);
+}
+
+/*
+ * Add a Route
+ *
+ * A zero gateway makes the prefix on-link. The mask must be contiguous;
+ * 0/0 is the default route.
+ */
+status_t route_add(uint32_t dest, uint32_t netmask, uint32_t gateway, netif_t *nif)
+{
+    if (nif == NULL || !route_mask_valid(netmask)) {
+        return STATUS_INVALID;
+    }
+
+    spin_lock_irq(&route_lock);
+    status_t ret = route_insert(dest, netmask, gateway, nif, false);
+    route_stats.entries = route_count;
+    spin_unlock_irq(&route_lock);
+
+    return ret;
+}
+
+status_t route_del(uint32_t dest, uint32_t netmask)
+{
+    status_t ret = STATUS_INVALID;
+
+    spin_lock_irq(&route_lock);
+
+    for (uint32_t i = 0; i < route_count; i++) {
+        if (route_table[i].dest == (dest & netmask) &&
+            route_table[i].netmask == netmask) {
+            route_remove_at(i);
+            ret = STATUS_OK;
+            break;
+        }
+    }
+    route_stats.entries = route_count;
+
+    spin_unlock_irq(&route_lock);
+    return ret;
+}
+
+/*
+ * Reinstall Interface Routes
+ *
+ * Called when an interface address changes: replaces the connected
+ * route and the default route via its gateway. Static routes added
+ * with route_add() are left alone.
+ */
+void route_iface_update(netif_t *nif)
+{
+    spin_lock_irq(&route_lock);
+
+    for (uint32_t i = route_count; i > 0; i--) {
+        if (route_table[i - 1].iface && route_table[i - 1].nif == nif) {
+            route_remove_at(i - 1);
+        }
+    }
+
+    if (nif->ip != 0 && route_mask_valid(nif->netmask)) {
+        route_insert(nif->ip, nif->netmask, 0, nif, true);
+
+        /* The first interface with a gateway owns the default route */
+        bool have_default = false;
+        for (uint32_t i = 0; i < route_count; i++) {
+            if (route_table[i].netmask == 0) {
+                have_default = true;
+            }
+        }
+        if (nif->gateway != 0 && !have_default) {
+            route_insert(0, 0, nif->gateway, nif, true);
+        }
+    }
+    route_stats.entries = route_count;
+
+    spin_unlock_irq(&route_lock);
+}
+
+/*
+ * Route Lookup
+ *
+ * Returns the outgoing interface and sets *next_hop to the gateway or,
+ * for on-link destinations, to dst itself. NULL if unreachable.
+ */
+netif_t *route_lookup(uint32_t dst, uint32_t *next_hop)
+{
+    spin_lock_irq(&route_lock);
+
+    netif_t *nif = route_find(dst, next_hop);
+    route_stats.lookups++;
+    if (nif == NULL) {
+        route_stats.unreachable++;
+    }
+
+    spin_unlock_irq(&route_lock);
+    return nif;
+}
+
+/*
+ * Cached Route Lookup
+ *
+ * The caller serializes use of the cache (socket lock). A hit costs a
+ * compare of the destination and generation; failures are not cached.
+ */
+netif_t *route_lookup_cached(route_cache_t *rc, uint32_t dst, uint32_t *next_hop)
+{
+    if (rc->nif != NULL && rc->dst == dst && rc->gen == route_gen) {
+        *next_hop = rc->next_hop;
+        route_stats.cache_hits++;
+        return rc->nif;
+    }
+
+    spin_lock_irq(&route_lock);
+
+    netif_t *nif = route_find(dst, next_hop);
+    route_stats.lookups++;
+    if (nif != NULL) {
+        rc->dst = dst;
+        rc->next_hop = *next_hop;
+        rc->nif = nif;
+        rc->gen = route_gen;
+    } else {
+        rc->nif = NULL;
+        route_stats.unreachable++;
+    }
+
+    spin_unlock_irq(&route_lock);
+    return nif;
+}
+
+void route_cache_init(route_cache_t *rc)
+{
+    rc->dst = 0;
+    rc->next_hop = 0;
+    rc->nif = NULL;
+    rc->gen = 0;
+}
+
+/*
+ * Get Statistics
+ */
+void route_get_stats(route_stats_t *stats)
+{
+    if (stats == NULL) return;
+
+    spin_lock_irq(&route_lock);
+    stats->entries = route_stats.entries;
+    stats->lookups = route_stats.lookups;
+    stats->cache_hits = route_stats.cache_hits;
+    stats->unreachable = route_stats.unreachable;
+    spin_unlock_irq(&route_lock);
+}
@@ -0,0 +1,383 @@
+/*
+ * Gracemont Industrial Control Framework - ARM64 RTOS
+ * Copyright (C) 2024 Zixiao System <https://github.com/Zixiao-System>
+ *
+ * This file is part of Gracemont Industrial Control Framework.
+ * Repository: https://github.com/Zixiao-System/gracemont
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * Socket Readiness Multiplexing
+ *
+ * A poll set lets one task wait on many sockets. Each socket in a set
+ * has a watch, linked on the socket so the stack finds it in O(1) when
+ * an event arrives: the watch goes on the set's ready list and the
+ * waiting task is woken. Sockets nobody watches pay one pointer test.
+ *
+ * Readiness is always re-evaluated when the list is collected, so a
+ * stale entry reports nothing. A level-triggered watch goes back on the
+ * list after it is reported and stays there while its socket is ready;
+ * an edge-triggered one comes back only with the next event.
+ *
+ * All watches and ready lists are under sock_poll_lock, taken with
+ * interrupts masked and before tcp_lock where both are held.
+ */
+
+#include "net_stack.h"
+#include "rtos_config.h"
+#include "rtos.h"
+
+extern socket_t *socket_table[CONFIG_NET_MAX_SOCKETS];
+
+typedef struct sock_watch {
+    struct sock_poll    *ps;
+    socket_t            *sock;      /* NULL: free slot */
+    uint32_t            events;     /* SOCK_EV_* wanted, SOCK_EV_ET */
+    void                *data;
+    struct sock_watch   *snext;     /* Next watch on the same socket */
+    struct sock_watch   *rnext;     /* Next on the ready list */
+    uint8_t             queued;     /* On the ready list */
+} sock_watch_t;
+
+struct sock_poll {
+    sock_watch_t        *ready;
+    sock_watch_t        *ready_tail;
+    semaphore_t         sem;
+    timer_t             timer;      /* sock_poll_wait() timeout */
+    uint32_t            max;
+    sock_watch_t        watch[];
+};
+
+/* Reported whether asked for or not */
+#define SOCK_EV_ALWAYS      (SOCK_EV_ERR | SOCK_EV_HUP)
+
+static spinlock_t sock_poll_lock = SPINLOCK_INIT;
+
+/* What a socket is ready for now */
+static uint32_t sock_poll_events(socket_t *sock)
+{
+    if (sock->type == SOCK_STREAM) {
+        return tcp_poll(sock);
+    }
+
+    /* Datagrams: sending never waits */
+    uint32_t ev = SOCK_EV_OUT;
+    if (zbuf_queue_len(&sock->rx_queue) > 0) {
+        ev |= SOCK_EV_IN;
+    }
+    return ev;
+}
+
+/* sock_poll_lock held; returns true if the list was empty */
+static bool sock_poll_queue(sock_watch_t *w)
+{
+    sock_poll_t *ps = w->ps;
+    bool was_empty = (ps->ready == NULL);
+
+    w->queued = 1;
+    w->rnext = NULL;
+    if (was_empty) {
+        ps->ready = w;
+    } else {
+        ps->ready_tail->rnext = w;
+    }
+    ps->ready_tail = w;
+
+    return was_empty;
+}
+
+/* sock_poll_lock held */
+static void sock_poll_dequeue(sock_watch_t *w)
+{
+    sock_poll_t *ps = w->ps;
+    sock_watch_t *prev = NULL;
+    sock_watch_t **pp = &ps->ready;
+
+    if (!w->queued) return;
+
+    while (*pp != w) {
+        prev = *pp;
+        pp = &(*pp)->rnext;
+    }
+    *pp = w->rnext;
+    if (ps->ready_tail == w) {
+        ps->ready_tail = prev;
+    }
+    w->queued = 0;
+}
+
+/* sock_poll_lock held: take w off its socket and free the slot */
+static void sock_poll_unwatch(sock_watch_t *w)
+{
+    sock_watch_t **pp = &w->sock->watch;
+
+    while (*pp != w) {
+        pp = &(*pp)->snext;
+    }
+    *pp = w->snext;
+
+    sock_poll_dequeue(w);
+    w->sock = NULL;
+}
+
+static void sock_poll_timeout(void *arg)
+{
+    sock_poll_t *ps = (sock_poll_t *)arg;
+    sem_post(&ps->sem);
+}
+
+/*
+ * Create a poll set for up to max sockets
+ */
+sock_poll_t *sock_poll_create(uint32_t max)
+{
+    if (max == 0) return NULL;
+
+    sock_poll_t *ps = heap_alloc(sizeof(sock_poll_t) + max * sizeof(sock_watch_t));
+    if (ps == NULL) return NULL;
+
+    ps->ready = NULL;
+    ps->ready_tail = NULL;
+    ps->max = max;
+    sem_init(&ps->sem, 0);
+    timer_init(&ps->timer, sock_poll_timeout, ps);
+
+    for (uint32_t i = 0; i < max; i++) {
+        ps->watch[i].ps = ps;
+        ps->watch[i].sock = NULL;
+        ps->watch[i].queued = 0;
+    }
+
+    return ps;
+}
+
+/*
+ * Destroy a poll set; its sockets stay open
+ */
+void sock_poll_destroy(sock_poll_t *ps)
+{
+    if (ps == NULL) return;
+
+    timer_stop(&ps->timer);
+
+    spin_lock_irq(&sock_poll_lock);
+    for (uint32_t i = 0; i < ps->max; i++) {
+        if (ps->watch[i].sock != NULL) {
+            sock_poll_unwatch(&ps->watch[i]);
+        }
+    }
+    spin_unlock_irq(&sock_poll_lock);
+
+    heap_free(ps);
+}
+
+/*
+ * Add, change or remove the watch of a socket
+ *
+ * events is a mask of SOCK_EV_IN and SOCK_EV_OUT, plus SOCK_EV_ET for
+ * edge-triggered reports; errors and hangups are always reported. data
+ * is handed back with each report. A socket already ready when added
+ * or changed is reported on the next wait, in either mode.
+ */
+int sock_poll_ctl(sock_poll_t *ps, int op, int fd, uint32_t events, void *data)
+{
+    socket_t *sock = socket_table[fd % CONFIG_NET_MAX_SOCKETS];
+    if (ps == NULL || sock == NULL || sock->fd != fd) return -1;
+
+    int ret = 0;
+    bool wake = false;
+
+    spin_lock_irq(&sock_poll_lock);
+
+    sock_watch_t *w = sock->watch;
+    while (w != NULL && w->ps != ps) {
+        w = w->snext;
+    }
+
+    switch (op) {
+    case SOCK_POLL_ADD:
+        if (w != NULL) {
+            ret = -1;
+            break;
+        }
+        for (uint32_t i = 0; i < ps->max; i++) {
+            if (ps->watch[i].sock == NULL) {
+                w = &ps->watch[i];
+                break;
+            }
+        }
+        if (w == NULL) {
+            ret = -1;   /* Set full */
+            break;
+        }
+        w->sock = sock;
+        w->snext = sock->watch;
+        sock->watch = w;
+        /* Fall through */
+
+    case SOCK_POLL_MOD:
+        if (w == NULL) {
+            ret = -1;
+            break;
+        }
+        w->events = events;
+        w->data = data;
+        if (!w->queued && (sock_poll_events(sock) & (events | SOCK_EV_ALWAYS))) {
+            wake = sock_poll_queue(w);
+        }
+        break;
+
+    case SOCK_POLL_DEL:
+        if (w == NULL) {
+            ret = -1;
+            break;
+        }
+        sock_poll_unwatch(w);
+        break;
+
+    default:
+        ret = -1;
+        break;
+    }
+
+    spin_unlock_irq(&sock_poll_lock);
+
+    if (wake) {
+        sem_post(&ps->sem);
+    }
+    return ret;
+}
+
+/*
+ * Take up to max reports off the ready list
+ *
+ * Level-triggered watches that were reported go back at the tail, so
+ * the sockets behind them get their turn on the next wait.
+ */
+static uint32_t sock_poll_collect(sock_poll_t *ps, sock_event_t *ev, uint32_t max)
+{
+    sock_watch_t *again = NULL;
+    sock_watch_t *again_last = NULL;
+    uint32_t n = 0;
+
+    spin_lock_irq(&sock_poll_lock);
+
+    while (n < max && ps->ready != NULL) {
+        sock_watch_t *w = ps->ready;
+        ps->ready = w->rnext;
+        w->queued = 0;
+
+        uint32_t got = sock_poll_events(w->sock) & (w->events | SOCK_EV_ALWAYS);
+        if (got == 0) {
+            continue;
+        }
+
+        ev[n].fd = w->sock->fd;
+        ev[n].events = got;
+        ev[n].data = w->data;
+        n++;
+
+        if (!(w->events & SOCK_EV_ET)) {
+            w->queued = 1;
+            w->rnext = NULL;
+            if (again_last != NULL) {
+                again_last->rnext = w;
+            } else {
+                again = w;
+            }
+            again_last = w;
+        }
+    }
+
+    if (ps->ready == NULL) {
+        ps->ready_tail = NULL;
+    }
+    if (again != NULL) {
+        if (ps->ready == NULL) {
+            ps->ready = again;
+        } else {
+            ps->ready_tail->rnext = again;
+        }
+        ps->ready_tail = again_last;
+    }
+
+    spin_unlock_irq(&sock_poll_lock);
+    return n;
+}
+
+/*
+ * Wait for ready sockets
+ *
+ * Fills up to max reports and returns how many. timeout is in ticks:
+ * 0 only collects what is ready, SOCK_POLL_FOREVER waits for at least
+ * one report. Returns 0 when the timeout passes first.
+ */
+int sock_poll_wait(sock_poll_t *ps, sock_event_t *ev, uint32_t max, tick_t timeout)
+{
+    if (ps == NULL || ev == NULL || max == 0) return -1;
+
+    tick_t start = get_system_ticks();
+    bool timed = (timeout != 0 && timeout != SOCK_POLL_FOREVER);
+    uint32_t n;
+
+    if (timed) {
+        timer_start(&ps->timer, timeout, false);
+    }
+
+    for (;;) {
+        n = sock_poll_collect(ps, ev, max);
+        if (n > 0 || timeout == 0) break;
+        if (timed && get_system_ticks() - start >= timeout) break;
+        sem_wait(&ps->sem);
+    }
+
+    if (timed) {
+        timer_stop(&ps->timer);
+    }
+    return (int)n;
+}
+
+/*
+ * An event on a socket, from the stack
+ *
+ * Queues the watches that asked for any of events and wakes their sets.
+ */
+void sock_poll_notify(socket_t *sock, uint32_t events)
+{
+    if (sock->watch == NULL) return;
+
+    spin_lock_irq(&sock_poll_lock);
+    for (sock_watch_t *w = sock->watch; w != NULL; w = w->snext) {
+        if (!w->queued && (events & (w->events | SOCK_EV_ALWAYS)) && sock_poll_queue(w)) {
+            sem_post(&w->ps->sem);
+        }
+    }
+    spin_unlock_irq(&sock_poll_lock);
+}
+
+/*
+ * A socket is closing: drop it from every set
+ */
+void sock_poll_forget(socket_t *sock)
+{
+    if (sock->watch == NULL) return;
+
+    spin_lock_irq(&sock_poll_lock);
+    while (sock->watch != NULL) {
+        sock_poll_unwatch(sock->watch);
+    }
+    spin_unlock_irq(&sock_poll_lock);
+}
@@ -0,0 +1,424 @@
+/*
+ * Gracemont Industrial Control Framework - ARM64 RTOS
+ * Copyright (C) 2024 Zixiao System <https://github.com/Zixiao-System>
+ *
+ * This file is part of Gracemont Industrial Control Framework.
+ * Repository: https://github.com/Zixiao-System/gracemont
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ *
+ * Software TX Queues
+ *
+ * The driver ring is a FIFO: a frame queued behind a burst of bulk
+ * traffic waits for all of it. To bound that wait, a driver that
+ * reports completions caps the bytes it holds (txq.limit) and the
+ * excess waits here, in one queue per priority band. Bands are served
+ * strictly from the highest, so an RT frame is never behind more than
+ * one ring limit of other traffic.
+ *
+ * Every frame handed to the driver is counted in txq.inflight; the
+ * driver gives the bytes back with netif_tx_done() when it reclaims
+ * the frame, or when it drops it. With limit 0 frames go straight to
+ * the driver and nothing is counted.
+ *
+ * A frame flagged ZBUF_F_TXTIME waits instead in a launch-time
+ * schedule until zb->timestamp (timer_get_ns() clock). A
+ * high-resolution timer fires CONFIG_NET_TAS_LEAD_NS early and the
+ * release spins out the rest, so cyclic frames leave on their cycle
+ * rather than whenever the sending task ran. For tas.guard_ns before
+ * each launch only the top band is served: best-effort frames are held
+ * so the ring is drained when the scheduled frame goes out. The guard
+ * should cover txq.limit bytes at line rate.
+ */
+
+#include "net_stack.h"
+#include "rtos_config.h"
+#include "rtos_types.h"
+#include "rtos.h"
+
+/* Frames moved from the bands to the driver per call */
+#define NETIF_TX_BATCH      16
+
+/* 802.1p PCP 0-7 onto the configured bands, PCP 7 in the top one */
+static inline uint32_t netif_tx_band(const zbuf_t *zb)
+{
+    return ((uint32_t)(zb->priority & 7) * CONFIG_NET_TX_BANDS) >> 3;
+}
+
+static void netif_tas_expire(void *arg);
+
+/*
+ * Set up the queues of an interface; called by the driver before
+ * netif_register(). limit is in bytes.
+ */
+void netif_txq_init(netif_t *nif, uint32_t limit)
+{
+    netif_txq_t *q = &nif->txq;
+    netif_tas_t *tas = &q->tas;
+
+    for (int b = 0; b < CONFIG_NET_TX_BANDS; b++) {
+        q->band[b].head = NULL;
+        q->band[b].tail = NULL;
+        q->band[b].count = 0;
+        q->band[b].drops = 0;
+    }
+    q->limit = limit;
+    q->inflight = 0;
+    q->backlog = 0;
+
+    tas->head = NULL;
+    tas->count = 0;
+    tas->guard_ns = CONFIG_NET_TAS_GUARD_NS;
+    hrtimer_init(&tas->timer, netif_tas_expire, nif);
+    tas->stats.sent = 0;
+    tas->stats.missed = 0;
+    tas->stats.drops = 0;
+    tas->stats.jitter_min = UINT32_MAX;
+    tas->stats.jitter_max = 0;
+    tas->stats.jitter_sum = 0;
+
+    q->lock = (spinlock_t)SPINLOCK_INIT;
+}
+
+/*
+ * Lowest band that may be served now: only the top one inside the
+ * protected window before the next launch (q->lock held)
+ */
+static uint32_t netif_tx_floor(netif_txq_t *q)
+{
+    zbuf_t *next = q->tas.head;
+
+    if (next != NULL && timer_get_ns() + q->tas.guard_ns >= next->timestamp) {
+        return CONFIG_NET_TX_BANDS - 1;
+    }
+    return 0;
+}
+
+/* Append to the packet's band; frees it when the band is full (q->lock held) */
+static status_t netif_txq_enqueue(netif_txq_t *q, zbuf_t *zb)
+{
+    netif_band_t *band = &q->band[netif_tx_band(zb)];
+
+    if (band->count >= CONFIG_NET_TX_QUEUE_LEN) {
+        band->drops++;
+        zbuf_free(zb);
+        return STATUS_NO_MEM;
+    }
+
+    zb->next = NULL;
+    if (band->tail != NULL) {
+        band->tail->next = zb;
+    } else {
+        band->head = zb;
+    }
+    band->tail = zb;
+    band->count++;
+    q->backlog++;
+
+    return STATUS_OK;
+}
+
+/* Head of the highest non-empty band from floor up (q->lock held) */
+static zbuf_t *netif_txq_dequeue(netif_txq_t *q, uint32_t floor)
+{
+    for (int b = CONFIG_NET_TX_BANDS - 1; b >= (int)floor; b--) {
+        netif_band_t *band = &q->band[b];
+        zbuf_t *zb = band->head;
+
+        if (zb != NULL) {
+            band->head = zb->next;
+            if (band->head == NULL) {
+                band->tail = NULL;
+            }
+            band->count--;
+            q->backlog--;
+            zb->next = NULL;
+            return zb;
+        }
+    }
+    return NULL;
+}
+
+/* Hand frames to the driver, one doorbell if it supports batches */
+static uint32_t netif_tx_driver(netif_t *nif, zbuf_t **pkts, uint32_t count)
+{
+    if (nif->send_batch != NULL) {
+        return nif->send_batch(nif, pkts, count);
+    }
+
+    uint32_t sent = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (nif->send(nif, pkts[i]) == STATUS_OK) {
+            sent++;
+        }
+    }
+    return sent;
+}
+
+/*
+ * Insert into the launch-time schedule and arm the timer if it is the
+ * new head. Frees the frame if its time has passed or the schedule is
+ * full.
+ */
+static status_t netif_tas_enqueue(netif_t *nif, zbuf_t *zb)
+{
+    netif_txq_t *q = &nif->txq;
+    netif_tas_t *tas = &q->tas;
+    uint64_t launch = zb->timestamp;
+    status_t ret = STATUS_OK;
+
+    spin_lock_irq(&q->lock);
+
+    if (launch < timer_get_ns()) {
+        tas->stats.missed++;
+        ret = STATUS_TIMEOUT;
+    } else if (tas->count >= CONFIG_NET_TAS_QUEUE_LEN) {
+        tas->stats.drops++;
+        ret = STATUS_NO_MEM;
+    } else {
+        /* FIFO among equal launch times */
+        zbuf_t **pp = &tas->head;
+        while (*pp != NULL && (*pp)->timestamp <= launch) {
+            pp = &(*pp)->next;
+        }
+        zb->next = *pp;
+        *pp = zb;
+        tas->count++;
+
+        if (tas->head == zb) {
+            hrtimer_start(&tas->timer, launch > CONFIG_NET_TAS_LEAD_NS ?
+                          launch - CONFIG_NET_TAS_LEAD_NS : 0);
+        }
+    }
+
+    spin_unlock_irq(&q->lock);
+
+    if (ret != STATUS_OK) {
+        nif->tx_errors++;
+        zbuf_free(zb);
+    }
+    return ret;
+}
+
+/*
+ * Release scheduled frames that are due (timer callback, IRQ context)
+ *
+ * Spins from the early wakeup to the exact launch time, so the release
+ * jitter is that of the clock read, not of the interrupt. Only this
+ * callback writes sent and the jitter figures.
+ */
+static void netif_tas_expire(void *arg)
+{
+    netif_t *nif = (netif_t *)arg;
+    netif_txq_t *q = &nif->txq;
+    netif_tas_t *tas = &q->tas;
+
+    for (;;) {
+        spin_lock_irq(&q->lock);
+
+        zbuf_t *zb = tas->head;
+        if (zb == NULL) {
+            spin_unlock_irq(&q->lock);
+            break;
+        }
+
+        uint64_t launch = zb->timestamp;
+        if (launch > timer_get_ns() + CONFIG_NET_TAS_LEAD_NS) {
+            hrtimer_start(&tas->timer, launch - CONFIG_NET_TAS_LEAD_NS);
+            spin_unlock_irq(&q->lock);
+            break;
+        }
+
+        tas->head = zb->next;
+        tas->count--;
+        zb->next = NULL;
+        if (q->limit != 0) {
+            q->inflight += zbuf_pkt_len(zb);
+        }
+
+        spin_unlock_irq(&q->lock);
+
+        uint64_t now;
+        while ((now = timer_get_ns()) < launch) {
+            /* Spin out the lead */
+        }
+
+        /* The frame leaves carrying its release time */
+        uint64_t late = now - launch;
+        uint32_t jitter = late > UINT32_MAX ? UINT32_MAX : (uint32_t)late;
+        zb->timestamp = now;
+        zb->flags &= ~ZBUF_F_TXTIME;
+
+        nif->send(nif, zb);
+
+        tas->stats.sent++;
+        tas->stats.jitter_sum += jitter;
+        if (jitter < tas->stats.jitter_min) tas->stats.jitter_min = jitter;
+        if (jitter > tas->stats.jitter_max) tas->stats.jitter_max = jitter;
+    }
+
+    /* Window over: let held best-effort frames go */
+    netif_tx_run(nif);
+}
+
+/*
+ * Transmit a frame that carries its link header
+ *
+ * Goes straight to the driver while nothing is queued and the ring has
+ * room, otherwise into its band. ZBUF_F_TXTIME frames are scheduled.
+ */
+status_t netif_xmit(netif_t *nif, zbuf_t *zb)
+{
+    netif_txq_t *q = &nif->txq;
+    uint32_t len = zbuf_pkt_len(zb);
+
+    nif->tx_packets++;
+    nif->tx_bytes += len;
+
+    if (zb->flags & ZBUF_F_TXTIME) {
+        return netif_tas_enqueue(nif, zb);
+    }
+
+    if (q->limit == 0) {
+        return nif->send(nif, zb);
+    }
+
+    spin_lock_irq(&q->lock);
+
+    if (q->backlog == 0 && q->inflight < q->limit &&
+        netif_tx_band(zb) >= netif_tx_floor(q)) {
+        q->inflight += len;
+        spin_unlock_irq(&q->lock);
+        return nif->send(nif, zb);
+    }
+
+    status_t ret = netif_txq_enqueue(q, zb);
+    spin_unlock_irq(&q->lock);
+
+    if (ret != STATUS_OK) {
+        nif->tx_errors++;
+        return ret;
+    }
+
+    netif_tx_run(nif);
+    return STATUS_OK;
+}
+
+/*
+ * Batch Transmit
+ *
+ * Hands frames that already carry their link header to the driver in
+ * one call, so it can notify the device once. Drivers without
+ * send_batch get them one at a time. Returns the number accepted.
+ * Launch times are not honoured here; use netif_xmit() for those.
+ */
+uint32_t netif_send_batch(netif_t *nif, zbuf_t **pkts, uint32_t count)
+{
+    netif_txq_t *q = &nif->txq;
+
+    for (uint32_t i = 0; i < count; i++) {
+        nif->tx_packets++;
+        nif->tx_bytes += zbuf_pkt_len(pkts[i]);
+    }
+
+    if (q->limit == 0) {
+        return netif_tx_driver(nif, pkts, count);
+    }
+
+    /* Through the bands, then drained together */
+    uint32_t accepted = 0;
+
+    spin_lock_irq(&q->lock);
+    for (uint32_t i = 0; i < count; i++) {
+        if (netif_txq_enqueue(q, pkts[i]) == STATUS_OK) {
+            accepted++;
+        } else {
+            nif->tx_errors++;
+        }
+    }
+    spin_unlock_irq(&q->lock);
+
+    netif_tx_run(nif);
+    return accepted;
+}
+
+/*
+ * Move queued frames to the driver while the ring is under its limit
+ *
+ * Called after enqueueing, by the driver once completions have freed
+ * room, and when a protected window ends. The lock is not held across
+ * the driver call.
+ */
+void netif_tx_run(netif_t *nif)
+{
+    netif_txq_t *q = &nif->txq;
+    zbuf_t *batch[NETIF_TX_BATCH];
+
+    for (;;) {
+        uint32_t n = 0;
+
+        spin_lock_irq(&q->lock);
+        uint32_t floor = netif_tx_floor(q);
+        while (n < NETIF_TX_BATCH && q->inflight < q->limit) {
+            zbuf_t *zb = netif_txq_dequeue(q, floor);
+            if (zb == NULL) break;
+            q->inflight += zbuf_pkt_len(zb);
+            batch[n++] = zb;
+        }
+        spin_unlock_irq(&q->lock);
+
+        if (n == 0) {
+            return;
+        }
+        netif_tx_driver(nif, batch, n);
+    }
+}
+
+/*
+ * Return ring bytes of frames the driver has finished with
+ */
+void netif_tx_done(netif_t *nif, uint32_t bytes)
+{
+    netif_txq_t *q = &nif->txq;
+
+    if (q->limit == 0) {
+        return;
+    }
+
+    spin_lock_irq(&q->lock);
+    q->inflight = (bytes < q->inflight) ? q->inflight - bytes : 0;
+    spin_unlock_irq(&q->lock);
+}
+
+/*
+ * Get Launch-Time Statistics
+ */
+void netif_tas_get_stats(netif_t *nif, netif_tas_stats_t *stats)
+{
+    netif_txq_t *q = &nif->txq;
+
+    if (stats == NULL) return;
+
+    spin_lock_irq(&q->lock);
+    stats->sent = q->tas.stats.sent;
+    stats->missed = q->tas.stats.missed;
+    stats->drops = q->tas.stats.drops;
+    stats->jitter_min = q->tas.stats.jitter_min;
+    stats->jitter_max = q->tas.stats.jitter_max;
+    stats->jitter_sum = q->tas.stats.jitter_sum;
+    spin_unlock_irq(&q->lock);
+}